@@ -0,0 +1,342 @@
+/*
+   Detection benchmark over synthetic renderings of Calibu targets.
+
+   Renders a target preset through several camera models, resolutions, blur
+   and noise levels, then times each stage of the detection pipeline and
+   scores the result against ground truth. One line is written to stdout
+   per scene, as CSV (default) or JSON; progress goes to stderr.
+
+   Usage: calibu_bench [-n iterations] [-p preset] [--json]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Eigen/Eigen>
+#include <sophus/se3.hpp>
+
+#include <calibu/cam/camera_crtp.h>
+#include <calibu/cam/camera_models_poly.h>
+#include <calibu/conics/ConicFinder.h>
+#include <calibu/image/ImageProcessing.h>
+#include <calibu/pose/Pnp.h>
+#include <calibu/target/GridDefinitions.h>
+#include <calibu/target/TargetGridDot.h>
+
+using namespace calibu;
+
+typedef std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > Points2d;
+
+struct Scene
+{
+    int width;
+    int height;
+    std::string model;
+    double blur;    // Gaussian sigma, pixels
+    double noise;   // Gaussian sigma, grey levels
+};
+
+struct Board
+{
+    Eigen::MatrixXi grid;
+    double spacing;
+    double large_radius;
+    double small_radius;
+};
+
+std::shared_ptr<CameraInterface<double>> MakeCamera(const std::string& model, int w, int h)
+{
+    Eigen::Vector2i size(w,h);
+    const double f = 0.8 * w;
+    const double u0 = (w-1) / 2.0;
+    const double v0 = (h-1) / 2.0;
+
+    if(model == "fov") {
+        Eigen::VectorXd params(5);
+        params << f, f, u0, v0, 0.9;
+        return std::make_shared<FovCamera<double>>(params, size);
+    }else if(model == "poly3") {
+        Eigen::VectorXd params(7);
+        params << f, f, u0, v0, -0.25, 0.08, -0.01;
+        return std::make_shared<Poly3Camera<double>>(params, size);
+    }
+
+    Eigen::VectorXd params(4);
+    params << f, f, u0, v0;
+    return std::make_shared<LinearCamera<double>>(params, size);
+}
+
+// Board filling about 60% of the image width, slightly tilted
+Sophus::SE3d MakePose(const Board& board, const CameraInterface<double>& cam, int w)
+{
+    const Eigen::Vector3d centre(board.spacing * (board.grid.cols()-1) / 2.0,
+                                 board.spacing * (board.grid.rows()-1) / 2.0, 0);
+    const double board_width = board.spacing * (board.grid.cols()+1);
+    const double dist = cam.K()(0,0) * board_width / (0.6 * w);
+
+    const Sophus::SO3d R_cw = Sophus::SO3d::exp(Eigen::Vector3d(0.25, -0.3, 0.05));
+    return Sophus::SE3d(R_cw, Eigen::Vector3d(0,0,dist) - (R_cw * centre));
+}
+
+// Ray cast every pixel onto the target plane with 4x4 supersampling.
+// Dots are black on white, within a white board on a grey background.
+void Render(const Board& board, const CameraInterface<double>& cam,
+            const Sophus::SE3d& T_cw, int w, int h, std::vector<float>& img)
+{
+    const int S = 4;
+    const Sophus::SE3d T_wc = T_cw.inverse();
+    const Eigen::Vector3d o = T_wc.translation();
+    const Eigen::Matrix3d R_wc = T_wc.rotationMatrix();
+
+    img.assign(w*h, 0.0f);
+    for(int y=0; y < h; ++y) {
+        for(int x=0; x < w; ++x) {
+            float sum = 0;
+            for(int sy=0; sy < S; ++sy) {
+                for(int sx=0; sx < S; ++sx) {
+                    const Eigen::Vector2d p(x + (sx + 0.5) / S - 0.5, y + (sy + 0.5) / S - 0.5);
+                    const Eigen::Vector3d d = R_wc * cam.Unproject(p);
+                    float value = 100;
+                    if(d[2] * o[2] < 0) {
+                        const Eigen::Vector3d P = o - (o[2] / d[2]) * d;
+                        const double gc = P[0] / board.spacing;
+                        const double gr = P[1] / board.spacing;
+                        if(-1 < gc && gc < board.grid.cols() && -1 < gr && gr < board.grid.rows()) {
+                            value = 230;
+                            const int c = std::max(0, std::min<int>(board.grid.cols()-1, std::lround(gc)));
+                            const int r = std::max(0, std::min<int>(board.grid.rows()-1, std::lround(gr)));
+                            const double rad = board.grid(r,c) ? board.large_radius : board.small_radius;
+                            if((P.head<2>() - board.spacing * Eigen::Vector2d(c,r)).norm() < rad) {
+                                value = 20;
+                            }
+                        }
+                    }
+                    sum += value;
+                }
+            }
+            img[y*w + x] = sum / (S*S);
+        }
+    }
+}
+
+void GaussianBlur(std::vector<float>& img, int w, int h, double sigma)
+{
+    if(sigma <= 0) return;
+    const int rad = (int)std::ceil(3*sigma);
+    std::vector<float> kernel(2*rad+1);
+    float ksum = 0;
+    for(int i=-rad; i <= rad; ++i) {
+        kernel[i+rad] = std::exp(-0.5 * i*i / (sigma*sigma));
+        ksum += kernel[i+rad];
+    }
+    for(float& k : kernel) k /= ksum;
+
+    std::vector<float> tmp(img.size());
+    for(int y=0; y < h; ++y) {
+        for(int x=0; x < w; ++x) {
+            float s = 0;
+            for(int i=-rad; i <= rad; ++i) {
+                s += kernel[i+rad] * img[y*w + std::max(0, std::min(w-1, x+i))];
+            }
+            tmp[y*w + x] = s;
+        }
+    }
+    for(int y=0; y < h; ++y) {
+        for(int x=0; x < w; ++x) {
+            float s = 0;
+            for(int i=-rad; i <= rad; ++i) {
+                s += kernel[i+rad] * tmp[std::max(0, std::min(h-1, y+i))*w + x];
+            }
+            img[y*w + x] = s;
+        }
+    }
+}
+
+void Quantise(const std::vector<float>& img, double noise, std::vector<unsigned char>& out)
+{
+    std::mt19937 rng(1234);
+    std::normal_distribution<float> dist(0.0f, noise > 0 ? noise : 1.0f);
+    out.resize(img.size());
+    for(size_t i=0; i < img.size(); ++i) {
+        const float v = img[i] + (noise > 0 ? dist(rng) : 0.0f);
+        out[i] = (unsigned char)std::max(0.0f, std::min(255.0f, std::round(v)));
+    }
+}
+
+template<typename F>
+double MedianMs(int iterations, F f)
+{
+    std::vector<double> ms(iterations);
+    for(int i=0; i < iterations; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        ms[i] = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    std::nth_element(ms.begin(), ms.begin() + iterations/2, ms.end());
+    return ms[iterations/2];
+}
+
+int main( int argc, char* argv[] )
+{
+    int iterations = 10;
+    std::string preset = "medium";
+    bool json = false;
+    for(int i=1; i < argc; ++i) {
+        if(!strcmp(argv[i], "-n") && i+1 < argc) {
+            iterations = std::max(1, atoi(argv[++i]));
+        }else if(!strcmp(argv[i], "-p") && i+1 < argc) {
+            preset = argv[++i];
+        }else if(!strcmp(argv[i], "--json")) {
+            json = true;
+        }else{
+            std::cerr << "Usage: " << argv[0] << " [-n iterations] [-p preset] [--json]" << std::endl;
+            return -1;
+        }
+    }
+
+    Board board;
+    LoadGridFromPreset(preset, board.grid, board.spacing, board.large_radius, board.small_radius);
+    if(board.grid.size() == 0) {
+        std::cerr << "Unknown preset " << preset << std::endl;
+        return -1;
+    }
+    TargetGridDot target(board.spacing, board.grid);
+
+    std::vector<Scene> scenes;
+    const int sizes[3][2] = { {640,480}, {1280,960}, {1920,1440} };
+    for(const auto& size : sizes) {
+        for(const char* model : {"linear", "fov", "poly3"}) {
+            for(double blur : {0.0, 1.5}) {
+                for(double noise : {0.0, 8.0}) {
+                    scenes.push_back(Scene{size[0], size[1], model, blur, noise});
+                }
+            }
+        }
+    }
+
+    if(!json) {
+        std::cout << "width,height,model,blur,noise,iterations,"
+                     "process_ms,conics_ms,target_ms,pnp_ms,process_mpix_s,"
+                     "detected,num_conics,num_matched,num_correct,num_visible,"
+                     "centre_rms_px,trans_err,rot_err_deg" << std::endl;
+    }
+
+    std::vector<float> render;
+    std::vector<unsigned char> img;
+    for(const Scene& s : scenes) {
+        std::cerr << "Scene " << s.width << "x" << s.height << " " << s.model
+                  << " blur " << s.blur << " noise " << s.noise << std::endl;
+
+        std::shared_ptr<CameraInterface<double>> cam = MakeCamera(s.model, s.width, s.height);
+        const Sophus::SE3d T_cw = MakePose(board, *cam, s.width);
+        Render(board, *cam, T_cw, s.width, s.height, render);
+        GaussianBlur(render, s.width, s.height, s.blur);
+        Quantise(render, s.noise, img);
+
+        // Ground truth image positions of grid points
+        const auto& pts3d = target.Circles3D();
+        Points2d truth(pts3d.size());
+        int num_visible = 0;
+        for(size_t g=0; g < pts3d.size(); ++g) {
+            truth[g] = cam->Project(T_cw * pts3d[g]);
+            if(0 <= truth[g][0] && truth[g][0] < s.width &&
+               0 <= truth[g][1] && truth[g][1] < s.height) ++num_visible;
+        }
+
+        ImageProcessing images(s.width, s.height);
+        images.Params().black_on_white = true;
+        images.Params().at_threshold = 0.9;
+        images.Params().at_window_ratio = 30;
+
+        ConicFinder conic_finder;
+        conic_finder.Params().conic_min_area = 4.0;
+        conic_finder.Params().conic_min_density = 0.6;
+        conic_finder.Params().conic_min_aspect = 0.2;
+
+        std::vector<int> ellipse_target_map;
+        bool detected = false;
+
+        const double process_ms = MedianMs(iterations, [&]() {
+            images.Process(&img[0], s.width, s.height, s.width);
+        });
+        const double conics_ms = MedianMs(iterations, [&]() {
+            conic_finder.Find(images);
+        });
+        const auto& conics = conic_finder.Conics();
+        const double target_ms = MedianMs(iterations, [&]() {
+            detected = target.FindTarget(images, conics, ellipse_target_map);
+        });
+
+        Points2d centres;
+        for(const Conic& c : conics) centres.push_back(c.center);
+
+        // A match is correct if it is nearest the grid point it was given
+        int num_matched = 0, num_correct = 0;
+        double sum_sq = 0;
+        if(detected) {
+            for(size_t i=0; i < ellipse_target_map.size(); ++i) {
+                const int g = ellipse_target_map[i];
+                if(g < 0) continue;
+                ++num_matched;
+                const double err = (centres[i] - truth[g]).norm();
+                size_t nearest = 0;
+                for(size_t t=1; t < truth.size(); ++t) {
+                    if((centres[i] - truth[t]).squaredNorm() <
+                       (centres[i] - truth[nearest]).squaredNorm()) nearest = t;
+                }
+                if((int)nearest == g) {
+                    ++num_correct;
+                    sum_sq += err*err;
+                }
+            }
+        }
+
+        double pnp_ms = 0;
+        double trans_err = NAN;
+        double rot_err = NAN;
+        if(detected) {
+            Sophus::SE3d T_est;
+            pnp_ms = MedianMs(iterations, [&]() {
+                PosePnPRansac(cam, centres, pts3d, ellipse_target_map, 100, 2.0, &T_est);
+            });
+            trans_err = (T_est.translation() - T_cw.translation()).norm();
+            rot_err = (T_est.so3().inverse() * T_cw.so3()).log().norm() * 180.0 / M_PI;
+        }
+
+        const double centre_rms = num_correct ? std::sqrt(sum_sq / num_correct) : NAN;
+        const double mpix_s = s.width * s.height / (process_ms * 1e3);
+
+        if(json) {
+            printf("{\"width\":%d,\"height\":%d,\"model\":\"%s\",\"blur\":%g,\"noise\":%g,"
+                   "\"iterations\":%d,\"process_ms\":%.4f,\"conics_ms\":%.4f,\"target_ms\":%.4f,"
+                   "\"pnp_ms\":%.4f,\"process_mpix_s\":%.2f,\"detected\":%s,\"num_conics\":%zu,"
+                   "\"num_matched\":%d,\"num_correct\":%d,\"num_visible\":%d,",
+                   s.width, s.height, s.model.c_str(), s.blur, s.noise, iterations,
+                   process_ms, conics_ms, target_ms, pnp_ms, mpix_s,
+                   detected ? "true" : "false", conics.size(),
+                   num_matched, num_correct, num_visible);
+            // NaN isn't valid JSON
+            auto value = [](double v) { return std::isfinite(v) ? std::to_string(v) : std::string("null"); };
+            printf("\"centre_rms_px\":%s,\"trans_err\":%s,\"rot_err_deg\":%s}\n",
+                   value(centre_rms).c_str(), value(trans_err).c_str(), value(rot_err).c_str());
+        }else{
+            printf("%d,%d,%s,%g,%g,%d,%.4f,%.4f,%.4f,%.4f,%.2f,%d,%zu,%d,%d,%d,%.4f,%.6f,%.4f\n",
+                   s.width, s.height, s.model.c_str(), s.blur, s.noise, iterations,
+                   process_ms, conics_ms, target_ms, pnp_ms, mpix_s,
+                   detected ? 1 : 0, conics.size(), num_matched, num_correct, num_visible,
+                   centre_rms, trans_err, rot_err);
+        }
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,252 @@
+/*
+   Per camera target detection on worker threads for calibgrid.
+
+   Each camera has its own ImageProcessing, ConicFinder and TargetGridDot,
+   run on a thread of its own, so a frame of the rig is detected in the
+   time of its slowest camera. Detected frames then go through a bounded
+   queue to a thread adding them to the Calibrator, so that keyframe
+   selection and solver locks don't hold up the cameras.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pangolin/pangolin.h>
+
+#include <sophus/se3.hpp>
+
+#include <calibu/cam/camera_crtp.h>
+#include <calibu/calib/KeyframePolicy.h>
+#include <calibu/conics/ConicFinder.h>
+#include <calibu/image/ImageProcessing.h>
+#include <calibu/pose/Pnp.h>
+#include <calibu/target/TargetGridDot.h>
+#include <calibu/utils/Trace.h>
+
+namespace calibu {
+
+// Detection state of one camera, valid between DetectionPipeline::Detect
+// calls, e.g. for drawing.
+struct CameraDetector
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  CameraDetector(int w, int h, double grid_spacing,
+                 const Eigen::Vector2i& grid_size, uint32_t grid_seed)
+    : image_processing(w, h), target(grid_spacing, grid_size, grid_seed),
+      grid_spacing(grid_spacing), grid_size(grid_size), tracking_good(false) {}
+
+  void Detect(const pangolin::Image<unsigned char>& image,
+              const std::shared_ptr<CameraInterface<double>>& camera)
+  {
+    image_processing.Process(image.ptr, image.w, image.h, image.pitch);
+    conic_finder.Find(image_processing);
+
+    const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics =
+        conic_finder.Conics();
+    tracking_good = target.FindTarget(image_processing, conics,
+                                      ellipse_target_map);
+
+    P_w.clear();
+    p_c.clear();
+    if(!tracking_good) {
+      return;
+    }
+
+    const ConicSet::CenterVector& ellipses = conic_finder.Columns().center;
+
+    // find camera pose given intrinsics
+    PosePnPRansac(camera, ellipses, target.Circles3D(), ellipse_target_map,
+                  0, 0, &T_hw);
+
+    for(size_t p=0; p < ellipses.size(); ++p) {
+      const Eigen::Vector2i pg = target.Map()[p].pg;
+      if( 0<= pg(0) && pg(0) < grid_size(0) &&  0<= pg(1) && pg(1) < grid_size(1) ) {
+        P_w.push_back( grid_spacing * Eigen::Vector3d(pg(0), pg(1), 0) );
+        p_c.push_back( ellipses[p] );
+      }
+    }
+  }
+
+  ImageProcessing image_processing;
+  ConicFinder conic_finder;
+  TargetGridDot target;
+  double grid_spacing;
+  Eigen::Vector2i grid_size;
+
+  bool tracking_good;
+  Sophus::SE3d T_hw;
+  std::vector<int> ellipse_target_map;
+
+  // Observations of the target grid points
+  std::vector<Eigen::Vector3d> P_w;
+  KeyframePixels p_c;
+};
+
+// One worker thread per camera, each running its CameraDetector.
+class DetectionPipeline
+{
+ public:
+  DetectionPipeline(size_t num_cameras, int w, int h, double grid_spacing,
+                    const Eigen::Vector2i& grid_size, uint32_t grid_seed)
+    : generation_(0), pending_(0), frame_(-1), stop_(false)
+  {
+    for(size_t c=0; c < num_cameras; ++c) {
+      detectors_.emplace_back(new CameraDetector(w, h, grid_spacing, grid_size, grid_seed));
+    }
+    images_.resize(num_cameras);
+    cameras_.resize(num_cameras);
+    for(size_t c=0; c < num_cameras; ++c) {
+      workers_.push_back(std::thread(&DetectionPipeline::Work, this, c));
+    }
+  }
+
+  ~DetectionPipeline()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    work_cond_.notify_all();
+    for(std::thread& w : workers_) {
+      w.join();
+    }
+  }
+
+  // Detect images[c] with camera c on every worker, returning once all are
+  // done. params are copied to the detectors first.
+  void Detect(const std::vector<pangolin::Image<unsigned char> >& images,
+              const std::vector<std::shared_ptr<CameraInterface<double>>>& cameras,
+              const ParamsImageProcessing& image_params,
+              const ParamsConicFinder& conic_params)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(size_t c=0; c < detectors_.size(); ++c) {
+      detectors_[c]->image_processing.Params() = image_params;
+      detectors_[c]->conic_finder.Params() = conic_params;
+      images_[c] = images[c];
+      cameras_[c] = cameras[c];
+    }
+    frame_ = CurrentTraceContext().frame;
+    pending_ = detectors_.size();
+    ++generation_;
+    work_cond_.notify_all();
+    done_cond_.wait(lock, [this]() { return pending_ == 0; });
+  }
+
+  size_t NumCameras() const {
+    return detectors_.size();
+  }
+
+  CameraDetector& Camera(size_t c) {
+    return *detectors_[c];
+  }
+
+ protected:
+  void Work(size_t c)
+  {
+    CALIBU_TRACE_THREAD("Detection " + std::to_string(c));
+    size_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(true) {
+      work_cond_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+      if(stop_) {
+        return;
+      }
+      seen = generation_;
+
+      lock.unlock();
+      {
+        CALIBU_TRACE_CONTEXT(frame_, (int)c);
+        CALIBU_TRACE("CameraDetector::Detect");
+        detectors_[c]->Detect(images_[c], cameras_[c]);
+      }
+      lock.lock();
+
+      if(--pending_ == 0) {
+        done_cond_.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<CameraDetector> > detectors_;
+  std::vector<pangolin::Image<unsigned char> > images_;
+  std::vector<std::shared_ptr<CameraInterface<double>>> cameras_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable work_cond_;
+  std::condition_variable done_cond_;
+  size_t generation_;
+  size_t pending_;
+  int frame_;     // trace frame id of the caller of Detect
+  bool stop_;
+};
+
+// Observations of one rig frame, as queued for the Calibrator
+struct FrameObservations
+{
+  Sophus::SE3d T_kw;
+  std::vector<std::vector<Eigen::Vector3d> > P_w;
+  std::vector<KeyframePixels> p_c;
+};
+
+// Queue of at most capacity items between one producer and one consumer.
+// Push blocks while full, Pop while empty until Close().
+template<typename T>
+class BoundedQueue
+{
+ public:
+  explicit BoundedQueue(size_t capacity) : capacity_(capacity), closed_(false) {}
+
+  void Push(T item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this]() { return closed_ || items_.size() < capacity_; });
+    if(closed_) {
+      return;
+    }
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+  }
+
+  // False once closed and drained
+  bool Pop(T& item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this]() { return closed_ || !items_.empty(); });
+    if(items_.empty()) {
+      return false;
+    }
+    item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void Close()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+ protected:
+  size_t capacity_;
+  bool closed_;
+  std::deque<T> items_;
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+};
+
+}  // namespace calibu
@@ -0,0 +1,293 @@
+/*
+   Headless batch calibration.
+
+   Detects the target in every frame of a recorded dataset on all cores,
+   then solves for the camera rig once. Unlike calibgrid, frames are not
+   limited by playback speed nor processed one camera at a time.
+
+   Detections can be saved to a binary cache with -save-detections, and a
+   later run with -load-detections solves from the cache without reading
+   the video again, e.g. to try other solver or keyframe options.
+
+   Usage: calibgrid_batch <options> video_uri
+ */
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <pangolin/pangolin.h>
+
+#include <sophus/se3.hpp>
+
+#include <calibu/calib/Calibrator.h>
+#include <calibu/calib/KeyframePolicy.h>
+#include <calibu/calib/ModelSelection.h>
+#include <calibu/target/BatchDetection.h>
+
+#include "GetPot"
+
+using namespace calibu;
+
+const char* usage_message =
+    "Usage:"
+    "\tcalibgrid_batch <options> video_uri\n"
+    "\tcalibgrid_batch <options> -load-detections <file>\n"
+    "Options:\n"
+    "\t-output,-o <file>      Output XML file to write camera models to (=cameras.xml).\n"
+    "\t-cameras,-c <file>     Input XML file to read starting intrinsics from.\n"
+    "\t-grid-spacing <value>  Distance between circles in grid\n"
+    "\t-grid-seed <value>     Random seed used when creating grid (=71)\n"
+    "\t-grid-rows <value>     Number of rows in the grid pattern.\n"
+    "\t-grid-cols <value>     Number of columns in the grid pattern.\n"
+    "\t-fix-intrinsics,-f     Fix camera intrinsics during optimisation.\n"
+    "\t-threads <value>       Detection threads (=number of cores).\n"
+    "\t-max-iterations <value> Solver iterations (=100).\n"
+    "\t-no-outlier-culling    Keep observations of large reprojection error.\n"
+    "\t-select-model          Calibrate FOV, Poly3, KB4 and Rational6 models concurrently,\n"
+    "\t                       writing the one of lowest BIC.\n"
+    "\t-all-frames            Add every frame, not only novel keyframes.\n"
+    "\t-max-frames <value>    Keep at most this many keyframes (=0, unbounded).\n"
+    "\t-max-residuals <value> Keep at most this many residuals (=0, unbounded).\n"
+    "\t-save-detections <file> Write every frame's detections to a binary cache.\n"
+    "\t-load-detections <file> Read detections from a cache instead of a video.\n"
+    "e.g.:\n"
+    "\tcalibgrid_batch -c leftcam.xml -c rightcam.xml files:///data/seq/*.pgm\n"
+    "\tcalibgrid_batch -save-detections seq.obs files:///data/seq/*.pgm\n"
+    "\tcalibgrid_batch -max-frames 50 -load-detections seq.obs\n";
+
+int main( int argc, char** argv)
+{
+  GetPot cl(argc,argv);
+  if(cl.search(3, "-help", "-h", "?") || argc < 2) {
+    std::cout << usage_message << std::endl;
+    return -1;
+  }
+
+  const std::string load_filename = cl.follow("", "-load-detections");
+  const std::string save_filename = cl.follow("", "-save-detections");
+
+  // Image sizes come from the video, or from the cache when loading
+  pangolin::VideoInput video;
+  ObservationStore loaded;
+  std::vector<Eigen::Vector2i> image_sizes;
+  if(!load_filename.empty()) {
+    if(!LoadObservations(load_filename, loaded)) {
+      return -1;
+    }
+    image_sizes = loaded.image_sizes;
+  }else{
+    video.Open(argv[argc-1]);
+    for(size_t i=0; i<video.Streams().size(); ++i) {
+      if( video.Streams()[i].PixFormat().channels != 1) {
+        throw pangolin::VideoException("Video channels must be GRAY8 format. Use Convert:[fmt=GRAY8]// video scheme.");
+      }
+      image_sizes.push_back(Eigen::Vector2i(video.Streams()[i].Width(),
+                                            video.Streams()[i].Height()));
+    }
+  }
+  const size_t N = image_sizes.size();
+
+  const int grid_rows = cl.follow(19, "-grid-rows");
+  const int grid_cols = cl.follow(10, "-grid-cols");
+  const double grid_spacing = cl.follow(0.254 / (grid_rows - 1), "-grid-spacing");
+  const int grid_seed = cl.follow(71, "-grid-seed");
+  const bool fix_intrinsics = cl.search(2, "-fix-intrinsics", "-f");
+  const std::string output_filename = cl.follow("cameras.xml", 2, "-output", "-o");
+  const int max_iterations = cl.follow(100, "-max-iterations");
+  const bool all_frames = cl.search(1, "-all-frames");
+  const bool outlier_culling = !cl.search(1, "-no-outlier-culling");
+  const bool select_model = cl.search(1, "-select-model");
+
+  ParamsBatchDetection params;
+  params.num_threads = cl.follow(params.num_threads, "-threads");
+
+  KeyframeOptions keyframe_options;
+  keyframe_options.max_frames = cl.follow(0, "-max-frames");
+  keyframe_options.max_residuals = cl.follow(0, "-max-residuals");
+
+  ////////////////////////////////////////////////////////////////////
+  // Starting cameras, from XML files or generic FOV models
+
+  std::vector<CameraAndPose> input_cameras;
+  cl.disable_loop();
+  cl.reset_cursor();
+  for(std::string filename = cl.follow("",2,"-cameras","-c");
+      !filename.empty(); filename = cl.follow("",2,"-cameras","-c") ) {
+    const std::shared_ptr<Rig<double>> rig = ReadXmlRig(filename);
+    for(const std::shared_ptr<CameraInterface<double>>& cop : rig->cameras_ ) {
+      input_cameras.push_back( CameraAndPose(cop, cop->Pose().inverse()) );
+    }
+  }
+
+  Calibrator calibrator;
+  calibrator.FixCameraIntrinsics(fix_intrinsics);
+  OutlierCullOptions cull_options;
+  cull_options.enabled = outlier_culling;
+  calibrator.SetOutlierCulling(cull_options);
+
+  std::vector<int> calib_cams(N);
+  std::vector<std::shared_ptr<CameraInterface<double>>> cameras;
+  for(size_t i=0; i<N; ++i) {
+    if(i < input_cameras.size()) {
+      calib_cams[i] = calibrator.AddCamera(input_cameras[i].camera, input_cameras[i].T_ck);
+    }else{
+      const int w_i = image_sizes[i][0];
+      const int h_i = image_sizes[i][1];
+      Eigen::Vector2i size_(w_i, h_i);
+      Eigen::VectorXd params_(FovCamera<double>::NumParams);
+      params_ << 300, 300, w_i/2.0, h_i/2.0, 0.2;
+      calib_cams[i] = calibrator.AddCamera(
+          std::make_shared<FovCamera<double>>(params_, size_), Sophus::SE3d() );
+    }
+    cameras.push_back(calibrator.GetCamera(calib_cams[i]).camera);
+  }
+
+  KeyframePolicy keyframes(keyframe_options);
+  for(size_t i=0; i<N; ++i) {
+    keyframes.AddCamera(cameras[i]);
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Detect all frames, adding keyframes as they come in frame order
+
+  ObservationWriter writer;
+  if(!save_filename.empty() && !writer.Open(save_filename, image_sizes)) {
+    return -1;
+  }
+  ObservationStore chunk;
+
+  BatchDetector detector(cameras, [&]() {
+      return std::unique_ptr<TargetGridDot>(
+          new TargetGridDot(grid_spacing, Eigen::Vector2i(grid_rows, grid_cols), grid_seed));
+    }, params);
+
+  std::vector<std::vector<unsigned char> > buffers;
+  std::vector<pangolin::Image<unsigned char> > images;
+  const BatchFrameSource source = [&](size_t slot, std::vector<BatchImage>& out) {
+    if(buffers.size() <= slot) {
+      buffers.resize(slot + 1, std::vector<unsigned char>(video.SizeBytes()));
+    }
+    if(!video.Grab(buffers[slot].data(), images, true, false)) {
+      return false;
+    }
+    out.clear();
+    for(const pangolin::Image<unsigned char>& im : images) {
+      out.push_back(BatchImage{im.ptr, im.w, im.h, im.pitch});
+    }
+    return true;
+  };
+
+  // Observations of each keyframe, for model selection
+  std::map<int, ObservationStore> keyframe_observations;
+
+  size_t num_keyframes = 0;
+  std::vector<std::vector<Eigen::Vector3d> > frame_P(N);
+  std::vector<KeyframePixels> frame_p(N);
+  const BatchFrameSink sink = [&](size_t frame, const FrameDetections& detections) {
+    if(writer.IsOpen()) {
+      chunk.Clear();
+      AddDetections(frame, detections, chunk);
+      writer.Write(chunk);
+    }
+
+    Sophus::SE3d T_kw(Sophus::SO3d(), Eigen::Vector3d(0, 0, 1000));
+    bool found = false;
+    for(size_t c=0; c<N; ++c) {
+      frame_P[c] = detections[c].P_w;
+      frame_p[c] = detections[c].p_c;
+      if(detections[c].found && !found) {
+        // Initialize pose of frame for least squares optimisation
+        T_kw = detections[c].T_cw;
+        found = true;
+      }
+    }
+    if(!found) {
+      return;
+    }
+
+    KeyframeDecision decision;
+    if(!all_frames) {
+      decision = keyframes.Evaluate(T_kw, frame_p);
+      if(!decision.accept) {
+        return;
+      }
+      for(int k : decision.evict) {
+        calibrator.RemoveFrame(keyframes.FrameId(k));
+        keyframe_observations.erase(keyframes.FrameId(k));
+        --num_keyframes;
+      }
+    }
+    const int calib_frame = calibrator.AddFrame(T_kw);
+    for(size_t c=0; c<N; ++c) {
+      calibrator.AddObservations(calib_frame, calib_cams[c], frame_P[c], frame_p[c]);
+    }
+    if(!all_frames) {
+      keyframes.Accept(decision, T_kw, frame_p, calib_frame);
+    }
+    if(select_model) {
+      AddDetections(frame, detections, keyframe_observations[calib_frame]);
+    }
+    ++num_keyframes;
+  };
+
+  const size_t num_frames = load_filename.empty() ?
+        detector.Run(source, sink) : ReplayDetections(loaded, sink);
+  if(writer.IsOpen() && !writer.Close()) {
+    return -1;
+  }
+  std::cout << "Detected " << num_frames << " frames, keeping "
+            << num_keyframes << std::endl;
+
+  ////////////////////////////////////////////////////////////////////
+  // Or solve each model hypothesis, from the starting cameras
+
+  if(select_model) {
+    ObservationStore store;
+    for(const std::pair<const int, ObservationStore>& kf : keyframe_observations) {
+      store.Append(kf.second);
+    }
+    std::vector<CameraAndPose> starting_cameras;
+    for(size_t i=0; i<N; ++i) {
+      starting_cameras.push_back(calibrator.GetCamera(calib_cams[i]));
+    }
+
+    ModelSelectionOptions selection_options;
+    selection_options.max_iterations = max_iterations;
+    selection_options.fix_intrinsics = fix_intrinsics;
+    const ModelSelectionResult selection = CalibrateModels(
+        store, starting_cameras,
+        {CameraModelId::kFov, CameraModelId::kPoly3,
+         CameraModelId::kKB4, CameraModelId::kRational6},
+        selection_options);
+    PrintModelSelection(selection);
+    if(selection.best < 0) {
+      std::cerr << "No model converged." << std::endl;
+      return 1;
+    }
+
+    std::shared_ptr<Rig<double>> rig(new Rig<double>);
+    for(const CameraAndPose& cp : selection.hypotheses[selection.best].cameras) {
+      cp.camera->SetPose(cp.T_ck.inverse());
+      rig->AddCamera(cp.camera);
+    }
+    WriteXmlRig(output_filename, rig);
+    return 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Solve once
+
+  const bool converged = calibrator.Solve(max_iterations);
+  calibrator.PrintResults();
+  if(calibrator.NumCulled()) {
+    std::cout << "Culled " << calibrator.NumCulled() << " outlying observations." << std::endl;
+  }
+  if(!converged) {
+    std::cerr << "Solver did not converge, writing " << output_filename << " anyway." << std::endl;
+  }
+  calibrator.WriteCameraModels(output_filename);
+  return converged ? 0 : 1;
+}
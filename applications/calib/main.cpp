@@ -7,12 +7,17 @@
 #include <sophus/se3.hpp>
 
 #include <calibu/calib/Calibrator.h>
+#include <calibu/calib/KeyframePolicy.h>
+#include <calibu/cam/camera_rig.h>
 #include <calibu/image/ImageProcessing.h>
 #include <calibu/target/TargetGridDot.h>
 #include <calibu/target/RandomGrid.h>
 #include <calibu/gl/Drawing.h>
 #include <calibu/pose/Pnp.h>
 #include <calibu/conics/ConicFinder.h>
+#include <calibu/utils/Trace.h>
+
+#include "DetectionPipeline.h"
 
 #include <cvars/CVar.h>
 
@@ -35,6 +40,14 @@ const char* usage_message =
     "\t-grid-cols <value>     Number of columns in the grid pattern.\n"
     "\t-no-gui                Run without gui.\n"
     "\t-max-opt-time <value>  Max time in seconds allowed to the optimiser.\n"
+    "\t-all-frames            Add every frame, not only novel keyframes. Within a\n"
+    "\t                       budget, the oldest frames make way for new ones.\n"
+    "\t-max-frames <value>    Keep at most this many frames (=0, unbounded).\n"
+    "\t-max-residuals <value> Keep at most this many residuals (=0, unbounded).\n"
+    "\t-max-memory <MB>       Bound the residuals kept to about this much memory\n"
+    "\t                       (=0, unbounded), for long unattended captures.\n"
+    "\t-trace <file>          Write a Chrome trace JSON of the run to file, for\n"
+    "\t                       chrome://tracing or Perfetto (needs BUILD_TRACE).\n"
     "e.g.:\n"
     "\tcalibgrid -c leftcam.xml -c rightcaml.xml video_uri\n\n"
     "Video URI's take the following form:\n"
@@ -73,6 +86,57 @@ const char* usage_message =
     "split - split a single stream video into a multi stream video based on memory offset\n"
     " e.g. \"split:[mem1=20480:640x480:640:GRAY8,mem2=573440:1280x720:1280:GRAY8]//files:///home/user/sequence/foo%03d.pgm\"\n\n";
 
+// Approximate memory held per residual: the cost and its parameter list,
+// and the solver's residual block and Jacobian storage.
+const size_t kBytesPerResidual = 512;
+
+// Add the observations of a frame, P[c] of the target seen at p[c] by
+// camera c, if keyframes accepts it, or else when given a ring in place of
+// the oldest frames over its budget. Returns the calibrator frame, or -1.
+int AddKeyframe(Calibrator& calibrator, KeyframePolicy* keyframes,
+                FrameRing* ring,
+                const Sophus::SE3d& T_kw, const int* calib_cams,
+                const std::vector<std::vector<Eigen::Vector3d> >& P,
+                const std::vector<KeyframePixels>& p)
+{
+  size_t num_residuals = 0;
+  for(size_t c = 0; c < p.size(); ++c) {
+    num_residuals += 2 * p[c].size();
+  }
+  if(ring && !keyframes) {
+    while(ring->Full(num_residuals)) {
+      calibrator.RemoveFrame(ring->PopOldest());
+    }
+  }
+
+  KeyframeDecision decision;
+  if(keyframes) {
+    // Score against the last parameters published by the solver
+    const std::shared_ptr<const CalibrationSnapshot> snapshot = calibrator.Snapshot();
+    if(snapshot) {
+      keyframes->SetParams(snapshot->params);
+    }
+    decision = keyframes->Evaluate(T_kw, p);
+    if(!decision.accept) {
+      return -1;
+    }
+    for(int k : decision.evict) {
+      calibrator.RemoveFrame(keyframes->FrameId(k));
+    }
+  }
+
+  const int calib_frame = calibrator.AddFrame(T_kw);
+  for(size_t c = 0; c < P.size(); ++c) {
+    calibrator.AddObservations(calib_frame, calib_cams[c], P[c], p[c]);
+  }
+  if(keyframes) {
+    keyframes->Accept(decision, T_kw, p, calib_frame);
+  }else if(ring) {
+    ring->Push(calib_frame, num_residuals);
+  }
+  return calib_frame;
+}
+
 int main( int argc, char** argv)
 {
   ////////////////////////////////////////////////////////////////////
@@ -116,6 +180,10 @@ int main( int argc, char** argv)
   // By default allow at most 120 sec to the optimizer (in cl mode).
   int max_opt_time = 120;
 
+  // Only add frames which bring new views, within an optional budget.
+  bool all_frames = false;
+  KeyframeOptions keyframe_options;
+
   ////////////////////////////////////////////////////////////////////
   // Setup Video Source
 
@@ -158,6 +226,20 @@ int main( int argc, char** argv)
   output_filename = cl.follow(output_filename.c_str(), 2, "-output", "-o");
   gui = !cl.search(1, "-no-gui");
   max_opt_time = cl.follow((int) max_opt_time, "-max-opt_time");
+  all_frames = cl.search(1, "-all-frames");
+  keyframe_options.max_frames = cl.follow(0, "-max-frames");
+  keyframe_options.max_residuals = cl.follow(0, "-max-residuals");
+  const size_t max_memory_mb = cl.follow(0, "-max-memory");
+  if(max_memory_mb) {
+    const size_t memory_residuals = (max_memory_mb << 20) / kBytesPerResidual;
+    keyframe_options.max_residuals = keyframe_options.max_residuals ?
+        std::min(keyframe_options.max_residuals, memory_residuals) : memory_residuals;
+  }
+  const std::string trace_filename = cl.follow("", "-trace");
+  if(!trace_filename.empty()) {
+    SetTraceThreadName("Main");
+    StartTrace();
+  }
 
   // Load camera hints from command line
   cl.disable_loop();
@@ -217,22 +299,23 @@ int main( int argc, char** argv)
   ////////////////////////////////////////////////////////////////////
   // Setup image processing pipeline
 
-  ImageProcessing image_processing(maxw, maxh);
-  image_processing.Params().black_on_white = true;
-  image_processing.Params().at_threshold = 0.9;
-  image_processing.Params().at_window_ratio = 30.0;
+  // Parameters shared by the detectors of every camera
+  ParamsImageProcessing image_params;
+  image_params.black_on_white = true;
+  image_params.at_threshold = 0.9;
+  image_params.at_window_ratio = 30.0;
 
-  CVarUtils::AttachCVar("proc.adaptive.threshold", &image_processing.Params().at_threshold);
-  CVarUtils::AttachCVar("proc.adaptive.window_ratio", &image_processing.Params().at_window_ratio);
-  CVarUtils::AttachCVar("proc.black_on_white", &image_processing.Params().black_on_white);
+  CVarUtils::AttachCVar("proc.adaptive.threshold", &image_params.at_threshold);
+  CVarUtils::AttachCVar("proc.adaptive.window_ratio", &image_params.at_window_ratio);
+  CVarUtils::AttachCVar("proc.black_on_white", &image_params.black_on_white);
 
   ////////////////////////////////////////////////////////////////////
   // Setup Grid pattern
 
-  ConicFinder conic_finder;
-  conic_finder.Params().conic_min_area = 4.0;
-  conic_finder.Params().conic_min_density = 0.6;
-  conic_finder.Params().conic_min_aspect = 0.2;
+  ParamsConicFinder conic_params;
+  conic_params.conic_min_area = 4.0;
+  conic_params.conic_min_density = 0.6;
+  conic_params.conic_min_aspect = 0.2;
 
   TargetGridDot target( grid_spacing, grid_size, grid_seed );
 
@@ -252,6 +335,7 @@ int main( int argc, char** argv)
   bool tracking_good[N];
   std::vector<Sophus::SE3d> T_hw;
   T_hw.resize(N);
+  TargetCode code;
 
   for(size_t i=0; i<N; ++i) {
     const int w_i = video.Streams()[i].Width();
@@ -273,6 +357,60 @@ int main( int argc, char** argv)
     }
   }
 
+  KeyframePolicy keyframe_policy(keyframe_options);
+  for(size_t i=0; i<N; ++i) {
+    keyframe_policy.AddCamera(calibrator.GetCamera(calib_cams[i]).camera);
+  }
+  KeyframePolicy* keyframes = all_frames ? nullptr : &keyframe_policy;
+  FrameRing frame_ring(keyframe_options.max_frames, keyframe_options.max_residuals);
+
+  // Copies of the cameras for detection and drawing, which the solver
+  // thread doesn't write to, brought up to date from its snapshots
+  std::vector<std::shared_ptr<CameraInterface<double>>> cameras;
+  for(size_t i=0; i<N; ++i) {
+    cameras.push_back(CastCamera<double>(calibrator.GetCamera(calib_cams[i]).camera));
+  }
+  const auto update_cameras = [&]() {
+    const std::shared_ptr<const CalibrationSnapshot> snapshot = calibrator.Snapshot();
+    for(size_t i=0; snapshot && i<N && size_t(calib_cams[i]) < snapshot->params.size(); ++i) {
+      cameras[i]->SetParams(snapshot->params[calib_cams[i]]);
+    }
+  };
+
+  ////////////////////////////////////////////////////////////////////
+  // Detect each camera on its own thread, queueing frames for calibration
+
+  DetectionPipeline detection(N, maxw, maxh, grid_spacing, grid_size, grid_seed);
+
+  BoundedQueue<FrameObservations> frame_queue(4);
+  std::thread frame_feeder([&]() {
+      CALIBU_TRACE_THREAD("Frame feeder");
+      FrameObservations obs;
+      while(frame_queue.Pop(obs)) {
+        AddKeyframe(calibrator, keyframes, &frame_ring, obs.T_kw, calib_cams, obs.P_w, obs.p_c);
+      }
+    });
+
+  // Observations of the cameras which saw the target, once they are done
+  const auto queue_frame = [&]() {
+    FrameObservations obs;
+    obs.T_kw = Sophus::SE3d(Sophus::SO3d(), Eigen::Vector3d(0,0,1000));
+    obs.P_w.resize(N);
+    obs.p_c.resize(N);
+    for(size_t iI = 0; iI < N; ++iI) {
+      const CameraDetector& det = detection.Camera(iI);
+      if(det.tracking_good) {
+        if(iI==0 || !detection.Camera(0).tracking_good) {
+          // Initialize pose of frame for least squares optimisation
+          obs.T_kw = det.T_hw;
+        }
+        obs.P_w[iI] = det.P_w;
+        obs.p_c[iI] = det.p_c;
+      }
+    }
+    frame_queue.Push(std::move(obs));
+  };
+
   if (gui) {
     ////////////////////////////////////////////////////////////////////
     // Setup GUI
@@ -366,12 +504,12 @@ int main( int argc, char** argv)
     for(int frame=0; !pangolin::ShouldQuit();){
       const bool go = (frame==0) || run || pangolin::Pushed(step);
 
-      int calib_frame = -1;
+      bool add_frame = false;
 
       if( go ) {
         if( video.Grab(image_buffer, images, true, true) ) {
           if(add) {
-            calib_frame = calibrator.AddFrame(Sophus::SE3d(Sophus::SO3d(), Eigen::Vector3d(0,0,1000)) );
+            add_frame = true;
           }
           ++frame;
         }else{
@@ -381,54 +519,25 @@ int main( int argc, char** argv)
 
       glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 
-      for(size_t iI = 0; iI < N; ++iI)
-      {
-        image_processing.Process( images[iI].ptr, images[iI].w, images[iI].h, images[iI].pitch );
-        conic_finder.Find( image_processing );
-
-        const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics =
-            conic_finder.Conics();
-        std::vector<int> ellipse_target_map;
-
-        tracking_good[iI] = target.FindTarget(
-            image_processing, conic_finder.Conics(),
-            ellipse_target_map
-                                              );
-
+      CALIBU_TRACE_CONTEXT(frame, -1);
+      update_cameras();
+      detection.Detect(images, cameras, image_params, conic_params);
+      for(size_t iI = 0; iI < N; ++iI) {
+        tracking_good[iI] = detection.Camera(iI).tracking_good;
         if(tracking_good[iI]) {
-          // Generate map and point structures
-          std::vector<Eigen::Vector2d,
-                      Eigen::aligned_allocator<Eigen::Vector2d> > ellipses;
-          for( size_t i=0; i < conics.size(); ++i ) {
-            ellipses.push_back(conics[i].center);
-          }
-
-          // find camera pose given intrinsics
-          PosePnPRansac(
-              calibrator.GetCamera(iI).camera, ellipses, target.Circles3D(),
-              ellipse_target_map,
-              0, 0, &T_hw[iI]
-                        );
-
-          if(calib_frame >= 0) {
-            if(iI==0 || !tracking_good[0]) {
-              // Initialize pose of frame for least squares optimisation
-              calibrator.GetFrame(calib_frame) = T_hw[iI];
-            }
-
-            for(size_t p=0; p < ellipses.size(); ++p) {
-              const Eigen::Vector2d pc = ellipses[p];
-              const Eigen::Vector2i pg = target.Map()[p].pg;
-
-              if( 0<= pg(0) && pg(0) < grid_size(0) &&  0<= pg(1) && pg(1) < grid_size(1) ) {
-                const Eigen::Vector3d pg3d = grid_spacing * Eigen::Vector3d(pg(0), pg(1), 0);
-                // TODO: Add these correspondences in bulk to avoid
-                //       hitting mutex each time.
-                calibrator.AddObservation( calib_frame, calib_cams[iI], pg3d, pc );
-              }
-            }
-          }
+          T_hw[iI] = detection.Camera(iI).T_hw;
         }
+      }
+      if(add_frame) {
+        queue_frame();
+      }
+
+      for(size_t iI = 0; iI < N; ++iI)
+      {
+        const CameraDetector& det = detection.Camera(iI);
+        const ImageProcessing& image_processing = det.image_processing;
+        const TargetGridDot& target = det.target;
+        const ConicSet& conics = det.conic_finder.Columns();
 
         if(container[iI].IsShown()) {
           container[iI].ActivateScissorAndClear();
@@ -450,12 +559,12 @@ int main( int argc, char** argv)
           glMatrixMode(GL_MODELVIEW);
 
           if(disp_lines) {
-            for(std::list<LineGroup>::const_iterator i = target.LineGroups().begin(); i != target.LineGroups().end(); ++i) {
+            for(LineGroupList::const_iterator i = target.LineGroups().begin(); i != target.LineGroups().end(); ++i) {
               glColor3f(0.5,0.5,0.5);
               glBegin(GL_LINE_STRIP);
-              for(std::list<size_t>::const_iterator el = i->ops.begin(); el != i->ops.end(); ++el)
+              for(auto el = i->ops.begin(); el != i->ops.end(); ++el)
               {
-                const Eigen::Vector2d p = conics[*el].center;
+                const Eigen::Vector2d& p = conics.center[*el];
                 glVertex2d(p(0), p(1));
               }
               glEnd();
@@ -463,50 +572,36 @@ int main( int argc, char** argv)
           }
 
           if( tracking_good[iI] && disp_barcode ) {
-            const std::vector<Eigen::Vector3d,
-                              Eigen::aligned_allocator<Eigen::Vector3d> >&
-                codepts = target.Code3D();
-            const calibu::CameraAndPose cap= calibrator.GetCamera(iI);
-            const unsigned char* im = image_processing.ImgThresh();
-            unsigned char id = 0;
-            bool found = true;
-            for( size_t c = 0; c < codepts.size(); c++ ){
-              const Eigen::Vector3d& xwp = codepts[c];
-              Eigen::Vector2d pt;
-              pt = cap.camera->Project( T_hw[iI]*xwp );
-              if( pt[0] < 10 || pt[0] >= images[iI].w-10 ||
-                  pt[1] < 10 || pt[1] >= images[iI].h-10 ) {
-                found = false;
-                continue;
-              }
-              int idx = image_processing.Width() * round(pt(1)) + round(pt(0));
-              if( im[ idx ] == 0 ){
+            target.SampleCode(cameras[iI], T_hw[iI],
+                              image_processing, code);
+            for( int c = 0; c < code.pixels.cols(); c++ ){
+              if( !(code.visible & (1u<<c)) ) continue;
+              const Eigen::Vector2d pt = code.pixels.col(c);
+              if( code.bits & (1u<<c) ){
                 glColor3f( 0.0, 1.0, 0.0 );
-                id |= 1<<c;
               } else {
                 glColor3f( 1.0, 0.0, 0.0 );
               }
               pangolin::glDrawRect( pt(0)-5, pt(1)-5, pt(0)+5, pt(1)+5 );
             }
-            if( found ){
-              printf( "ID: %d\n", id );
+            if( code.Complete() ){
+              printf( "ID: %d\n", (int)code.bits );
             }
           }
 
           if(disp_cross) {
-            for( size_t i=0; i < conics.size(); ++i ) {
-              const Eigen::Vector2d pc = conics[i].center;
+            for( size_t i=0; i < conics.Size(); ++i ) {
               pangolin::glColorBin( target.Map()[i].value, 2);
-              pangolin::glDrawCross(pc, conics[i].bbox.Width()*0.75 );
+              pangolin::glDrawCross(conics.center[i], conics.bbox[i].Width()*0.75 );
             }
           }
 
           if(disp_bbox) {
-            for( size_t i=0; i < conics.size(); ++i ) {
+            for( size_t i=0; i < conics.Size(); ++i ) {
               const Eigen::Vector2i pg = tracking_good[iI] ? target.Map()[i].pg : Eigen::Vector2i(0,0);
               if( 0<= pg(0) && pg(0) < grid_size(0) &&  0<= pg(1) && pg(1) < grid_size(1) ) {
                 pangolin::glColorBin(pg(1)*grid_size(0)+pg(0), grid_size(0)*grid_size(1));
-                glDrawRectPerimeter(conics[i].bbox);
+                glDrawRectPerimeter(conics.bbox[i]);
               }
             }
           }
@@ -527,19 +622,22 @@ int main( int argc, char** argv)
           }
         }
 
+        // Solver state, read without waiting for the solver
+        const std::shared_ptr<const CalibrationSnapshot> snapshot = calibrator.Snapshot();
+
         for(size_t c=0; c< calibrator.NumCameras(); ++c) {
           const int w_i = video.Streams()[c].Width();
           const int h_i = video.Streams()[c].Height();
 
-          const Eigen::Matrix3d Kinv = calibrator.GetCamera(c).camera->K().inverse();
-
-          const CameraAndPose cap = calibrator.GetCamera(c);
-          const Sophus::SE3d T_ck = cap.T_ck;
+          const Eigen::Matrix3d Kinv = cameras[c]->K().inverse();
 
           // Draw keyframes
-          pangolin::glColorBin(c, 2, 0.2);
-          for(size_t k=0; k< calibrator.NumFrames(); ++k) {
-            pangolin::glDrawAxis((T_ck * calibrator.GetFrame(k)).inverse().matrix(), 0.01);
+          if(snapshot && c < snapshot->T_ck.size()) {
+            const Sophus::SE3d T_ck = snapshot->T_ck[c];
+            pangolin::glColorBin(c, 2, 0.2);
+            for(size_t k=0; k< snapshot->T_kw.size(); ++k) {
+              pangolin::glDrawAxis((T_ck * snapshot->T_kw[k]).inverse().matrix(), 0.01);
+            }
           }
 
           // Draw current camera
@@ -564,62 +662,17 @@ int main( int argc, char** argv)
 
     bool valid_frame = video.Grab(image_buffer, images, true, true);
 
-    while (valid_frame) {
-
-      int calib_frame = calibrator.AddFrame(Sophus::SE3d(Sophus::SO3d(),
-                                                         Eigen::Vector3d(0, 0, 1000)));
-
-      for (size_t iI = 0; iI < N; ++iI) {
-        image_processing.Process(images[iI].ptr, images[iI].w,
-                                 images[iI].h, images[iI].pitch);
-        conic_finder.Find(image_processing);
-
-        const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics =
-            conic_finder.Conics();
-        std::vector<int> ellipse_target_map;
-
-        tracking_good[iI] = target.FindTarget(image_processing,
-                                              conic_finder.Conics(), ellipse_target_map);
-
-        if (tracking_good[iI]) {
-          // Generate map and point structures
-          std::vector<Eigen::Vector2d,
-                      Eigen::aligned_allocator<Eigen::Vector2d> > ellipses;
-          for (size_t i = 0; i < conics.size(); ++i) {
-            ellipses.push_back(conics[i].center);
-          }
-
-          // find camera pose given intrinsics
-          PosePnPRansac(calibrator.GetCamera(iI).camera, ellipses,
-                        target.Circles3D(), ellipse_target_map, 0, 0,
-                        &T_hw[iI]);
-
-          if (calib_frame >= 0) {
-            if (iI == 0 || !tracking_good[0]) {
-              // Initialize pose of frame for least squares optimisation
-              calibrator.GetFrame(calib_frame) = T_hw[iI];
-            }
-
-            for (size_t p = 0; p < ellipses.size(); ++p) {
-              const Eigen::Vector2d pc = ellipses[p];
-              const Eigen::Vector2i pg = target.Map()[p].pg;
-
-              if (0 <= pg(0) && pg(0) < grid_size(0) && 0 <= pg(1)
-                  && pg(1) < grid_size(1)) {
-                const Eigen::Vector3d pg3d = grid_spacing
-                    * Eigen::Vector3d(pg(0), pg(1), 0);
-                // TODO: Add these correspondences in bulk to avoid
-                //       hitting mutex each time.
-                calibrator.AddObservation(calib_frame,
-                                          calib_cams[iI], pg3d, pc);
-              }
-            }
-          }
-        }
-      }
+    for (int frame = 0; valid_frame; ++frame) {
+      CALIBU_TRACE_CONTEXT(frame, -1);
+      update_cameras();
+      detection.Detect(images, cameras, image_params, conic_params);
+      queue_frame();
       valid_frame = video.Grab(image_buffer, images, true, true);
     }
 
+    frame_queue.Close();
+    frame_feeder.join();
+
     std::cout<<"Optimization started"<<std::endl;
     calibrator.Start();
 
@@ -630,9 +683,19 @@ int main( int argc, char** argv)
     }
   }
 
+  if(frame_feeder.joinable()) {
+    frame_queue.Close();
+    frame_feeder.join();
+  }
+
   calibrator.Stop();
   calibrator.PrintResults();
 
+  if(!trace_filename.empty()) {
+    StopTrace();
+    WriteChromeTrace(trace_filename);
+  }
+
   if(gui || calibrator.ReachedTolerance()) {
     calibrator.WriteCameraModels(output_filename);
   }
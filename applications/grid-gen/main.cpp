@@ -3,15 +3,18 @@
 #include <random>
 #include <iostream>
 #include <array>
+#include <atomic>
 #include <signal.h>
 #include <fstream>
 #include <deque>
+#include <limits>
+#include <thread>
 
 #include <calibu/target/RandomGrid.h>
 
 using namespace calibu;
 
-bool should_run = true;
+std::atomic<bool> should_run(true);
 
 void UserQuit(int)
 {
@@ -26,7 +29,17 @@ int main( int, char** )
     const int PR = 10;
     const int PC = 19;
 
-    uint32_t seed = FindBestSeed(PR, PC, should_run); // 14
+    const int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    int last_score = std::numeric_limits<int>::max();
+    uint32_t seed = FindBestSeed(PR, PC, 0, std::numeric_limits<uint32_t>::max(),
+                                 num_threads, should_run,
+                                 [&last_score](uint64_t num_scored, uint32_t best_seed, int best_score) {
+        if(best_score < last_score) {
+            std::cout << "*Seed " << best_seed << ": score:" << best_score
+                      << " (" << num_scored << " seeds tried)" << std::endl;
+            last_score = best_score;
+        }
+    }); // 14
     const std::array<Eigen::MatrixXi,4> PG = MakePatternGroup(PR, PC, seed);
 
     std::cout << PG[0] << std::endl;
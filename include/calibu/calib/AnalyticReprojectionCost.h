@@ -0,0 +1,196 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <Eigen/Eigen>
+#include <sophus/se3.hpp>
+#include <ceres/ceres.h>
+
+#include <calibu/cam/camera_crtp.h>
+
+namespace calibu
+{
+
+// Maps Jacobians w.r.t. the tangent perturbation T * exp(delta) of a
+// Sophus::SE3d block, as LocalParameterizationSe3 applies it, onto the 7
+// coefficients of the block, such that multiplying by its ComputeJacobian
+// gives the tangent Jacobians back exactly. The quaternion columns of
+// ComputeJacobian are orthogonal with norm 1/2, and its translation columns
+// the rotation R of T, so rotation derivatives map through 4 Q^T and
+// translation derivatives are those w.r.t. the translation coefficients.
+struct Se3TangentJacobian
+{
+    explicit Se3TangentJacobian(const double* T)
+    {
+        const Eigen::Map<const Eigen::Quaterniond> q(T);
+        R = q.toRotationMatrix();
+        const double x = 2 * q.x(), y = 2 * q.y(), z = 2 * q.z(), w = 2 * q.w();
+        q_from_omega <<  w,  z, -y, -x,
+                        -z,  w,  x, -y,
+                         y, -x,  w, -z;
+    }
+
+    // Fill the two row major rows j, of 7 doubles each, from the
+    // derivatives w.r.t. the rotation perturbation and the translation.
+    void Set(const Eigen::Matrix<double,2,3>& dr_domega,
+             const Eigen::Matrix<double,2,3>& dr_dt, double* j) const
+    {
+        Eigen::Map<Eigen::Matrix<double,2,Sophus::SE3d::num_parameters,Eigen::RowMajor> > J(j);
+        J.leftCols<4>() = dr_domega * q_from_omega;
+        J.rightCols<3>() = dr_dt;
+    }
+
+    Eigen::Matrix3d R;
+    Eigen::Matrix<double,3,4> q_from_omega;
+};
+
+inline Eigen::Matrix3d Skew(const Eigen::Vector3d& v)
+{
+    Eigen::Matrix3d m;
+    m <<     0, -v[2],  v[1],
+          v[2],     0, -v[0],
+         -v[1],  v[0],     0;
+    return m;
+}
+
+// Residuals p_c[i] - Project(T_ck * T_kw * P_w[i]) of n points, and their
+// row major Jacobians for the blocks of jacobians which are not null (rows
+// 2i and 2i+1 for point i), with parameters as for AnalyticReprojectionCost.
+// The pose rotations are formed once for all points, and pose Jacobians are
+// taken in the tangent space through Se3TangentJacobian.
+template<typename CameraInt>
+bool EvaluateAnalyticReprojection(
+        double const* const* parameters, const Eigen::Vector3d* P_w,
+        const Eigen::Vector2d* p_c, size_t n, double* residuals,
+        double** jacobians)
+{
+    const int kSe3 = Sophus::SE3d::num_parameters;
+    const Se3TangentJacobian J_kw(parameters[0]);
+    const Se3TangentJacobian J_ck(parameters[1]);
+    const Eigen::Map<const Eigen::Vector3d> t_kw(parameters[0] + 4);
+    const Eigen::Map<const Eigen::Vector3d> t_ck(parameters[1] + 4);
+    const double* camparam = parameters[2];
+
+    double* const j_kw = jacobians ? jacobians[0] : nullptr;
+    double* const j_ck = jacobians ? jacobians[1] : nullptr;
+    double* const j_params = jacobians ? jacobians[2] : nullptr;
+
+    for(size_t i = 0; i < n; ++i) {
+        const Eigen::Vector3d Pk = J_kw.R * P_w[i] + t_kw;
+        const Eigen::Vector3d Pc = J_ck.R * Pk + t_ck;
+
+        Eigen::Vector2d pc;
+        CameraInt::Project(Pc.data(), camparam, pc.data());
+        Eigen::Map<Eigen::Vector2d>(residuals + 2 * i) = pc - p_c[i];
+
+        if(j_kw || j_ck) {
+            Eigen::Matrix<double,2,3> dpc_dPc;
+            CameraInt::dProject_dray(Pc.data(), camparam, dpc_dPc.data());
+
+            if(j_kw) {
+                // dPk / domega = -R_kw [P_w]x
+                const Eigen::Matrix<double,2,3> dpc_dPk = dpc_dPc * J_ck.R;
+                J_kw.Set(-(dpc_dPk * J_kw.R) * Skew(P_w[i]), dpc_dPk,
+                         j_kw + 2 * i * kSe3);
+            }
+            if(j_ck) {
+                J_ck.Set(-(dpc_dPc * J_ck.R) * Skew(Pk), dpc_dPc,
+                         j_ck + 2 * i * kSe3);
+            }
+        }
+
+        if(j_params) {
+            // The models fill column major matrices
+            Eigen::Matrix<double,2,CameraInt::NumParams> dpc_dparams;
+            CameraInt::dProject_dparams(Pc.data(), camparam, dpc_dparams.data());
+            Eigen::Map<Eigen::Matrix<double,2,CameraInt::NumParams,Eigen::RowMajor> >(
+                        j_params + 2 * i * CameraInt::NumParams) = dpc_dparams;
+        }
+    }
+    return true;
+}
+
+// Same residual as ReprojectionCostFunctor, with Jacobians from the camera
+// model's dProject_dray and dProject_dparams instead of automatic
+// differentiation.
+//
+// Parameter block 0: T_kw // keyframe
+// Parameter block 1: T_ck // keyframe to cam
+// Parameter block 2: camera params
+//
+// The SE3 blocks hold the quaternion (x, y, z, w) then the translation, as
+// Sophus::SE3d does. Their Jacobians are only valid through
+// LocalParameterizationSe3, see Se3TangentJacobian.
+template<typename CameraInt>
+class AnalyticReprojectionCost
+    : public ceres::SizedCostFunction<2, Sophus::SE3d::num_parameters,
+                                      Sophus::SE3d::num_parameters,
+                                      CameraInt::NumParams>
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    AnalyticReprojectionCost(const Eigen::Vector3d& Pw,
+                             const Eigen::Vector2d& pc)
+        : m_Pw(Pw), m_pc(pc)
+    {
+    }
+
+    virtual bool Evaluate(double const* const* parameters, double* residuals,
+                          double** jacobians) const
+    {
+        return EvaluateAnalyticReprojection<CameraInt>(
+                    parameters, &m_Pw, &m_pc, 1, residuals, jacobians);
+    }
+
+    Eigen::Vector3d m_Pw;
+    Eigen::Vector2d m_pc;
+};
+
+// AnalyticReprojectionCost of n observations in one residual block of 2n
+// residuals, with the same three parameter blocks, for all the points seen
+// by one camera in one frame.
+template<typename CameraInt>
+class AnalyticReprojectionCosts : public ceres::CostFunction
+{
+public:
+    AnalyticReprojectionCosts(const Eigen::Vector3d* Pw,
+                              const Eigen::Vector2d* pc, size_t n)
+        : m_Pw(Pw, Pw + n), m_pc(pc, pc + n)
+    {
+        set_num_residuals(2 * n);
+        mutable_parameter_block_sizes()->push_back(int(Sophus::SE3d::num_parameters));
+        mutable_parameter_block_sizes()->push_back(int(Sophus::SE3d::num_parameters));
+        mutable_parameter_block_sizes()->push_back(int(CameraInt::NumParams));
+    }
+
+    virtual bool Evaluate(double const* const* parameters, double* residuals,
+                          double** jacobians) const
+    {
+        return EvaluateAnalyticReprojection<CameraInt>(
+                    parameters, m_Pw.data(), m_pc.data(), m_Pw.size(),
+                    residuals, jacobians);
+    }
+
+    std::vector<Eigen::Vector3d> m_Pw;
+    std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > m_pc;
+};
+
+}
@@ -21,9 +21,12 @@
 
 #pragma once
 
-// Compile against new ceres covarience interface.
-//#define CALIBU_CERES_COVAR
-
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <set>
 #include <thread>
 #include <mutex>
 #include <memory>
@@ -33,18 +36,18 @@
 
 #include <calibu/Platform.h>
 #include <calibu/cam/camera_crtp.h>
+#include <calibu/cam/camera_model_registry.h>
 #include <calibu/cam/camera_xml.h>
 #include <calibu/calib/CostFunctionAndParams.h>
+#include <calibu/utils/Trace.h>
 
 #include <ceres/ceres.h>
-
-#ifdef CALIBU_CERES_COVAR
 #include <ceres/covariance.h>
-#endif // CALIBU_CERES_COVAR
 
 #include <calibu/calib/LocalParamSe3.h>
 
 #include <calibu/calib/ReprojectionCostFunctor.h>
+#include <calibu/calib/AnalyticReprojectionCost.h>
 #include <calibu/calib/CostFunctionAndParams.h>
 
 
@@ -68,6 +71,86 @@ struct CameraAndPose
     Sophus::SE3d T_ck;
 };
 
+/// Marginal covariance of the rig parameters at one solution, published by
+/// the solver thread of Calibrator.
+struct CalibrationCovariance
+{
+    size_t num_frames;
+    int num_residuals;
+    double mse;
+
+    /// Intrinsics of each camera and their covariance, zero if fixed or if
+    /// the camera has no observations
+    std::vector<Eigen::VectorXd> params;
+    std::vector<Eigen::MatrixXd> params_cov;
+
+    /// Extrinsics of each camera and the covariance of their 7 parameters,
+    /// zero for camera 0, which is held constant
+    std::vector<Sophus::SE3d, Eigen::aligned_allocator<Sophus::SE3d> > T_ck;
+    std::vector<Eigen::MatrixXd> T_ck_cov;
+};
+
+/// Rig parameters after one iteration of the solver thread of Calibrator.
+struct CalibrationSnapshot
+{
+    /// Solve of the solver thread, and iteration within it
+    size_t solve;
+    int iteration;
+
+    /// Intrinsics and extrinsics of each camera, and pose of each frame of
+    /// the problem being solved
+    std::vector<Eigen::VectorXd> params;
+    std::vector<Sophus::SE3d, Eigen::aligned_allocator<Sophus::SE3d> > T_ck;
+    std::vector<Sophus::SE3d, Eigen::aligned_allocator<Sophus::SE3d> > T_kw;
+};
+
+/// Progress of the solver thread of Calibrator, after each iteration and
+/// once more at the end of each solve, with final set.
+struct CalibrationProgress
+{
+    size_t solve;
+    int iteration;
+    double cost;
+    double mse;
+    double iteration_time;
+    double solve_time;
+
+    size_t num_cameras;
+    size_t num_frames;
+    int num_residuals;
+
+    bool final;
+    /// Only meaningful if final
+    ceres::TerminationType termination_type;
+    /// Observations culled after the solve, above cull_threshold pixels
+    size_t num_culled;
+    double cull_threshold;
+};
+
+/// Culling of outlying observations after each converged solve. An
+/// observation is dropped when its reprojection error is above both
+/// min_error pixels and num_sigmas times the pixel noise, estimated from
+/// the median error as for Rayleigh distributed errors. Culling waits for
+/// min_observations, and only applies to costs of a single observation.
+struct OutlierCullOptions
+{
+    OutlierCullOptions() :
+        enabled(true),
+        num_sigmas(4.0),
+        min_error(1.0),
+        min_observations(100)
+    {
+    }
+
+    bool enabled;
+    double num_sigmas;
+    double min_error;
+    size_t min_observations;
+};
+
+/// Called on the solver thread, so it should return quickly.
+typedef std::function<void(const CalibrationProgress&)> CalibrationProgressCallback;
+
 CALIBU_EXPORT
 class Calibrator
 {
@@ -75,17 +158,37 @@ public:
     
     /// Construct empty calibration object.
     Calibrator() :
+        m_should_run(false),
         m_running(false),
+        m_solver_started(false),
         m_fix_intrinsics(false),
+        m_analytic_jacobians(true),
+        m_problem_cameras(0),
+        m_problem_frames(0),
+        m_problem_costs(0),
+        m_problem_fix_intrinsics(false),
+        m_problem_dirty(false),
+        m_covariance_requested(false),
+        m_covariance_continuous(false),
+        m_covariance_min_change(1e-3),
+        m_solve(0),
+        m_solve_num_residuals(0),
+        m_solve_culled(0),
+        m_num_culled(0),
+        m_iteration_publisher(*this),
         m_LossFunction( new ceres::SoftLOneLoss(0.5), ceres::TAKE_OWNERSHIP )
     {
         m_prob_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
         m_prob_options.local_parameterization_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
         m_prob_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+        // Evicted frames and culled observations leave the persistent
+        // problem block by block
+        m_prob_options.enable_fast_removal = true;
         
         m_solver_options.num_threads = 4;
         m_solver_options.update_state_every_iteration = true;
         m_solver_options.max_num_iterations = 10;
+        m_solver_options.callbacks.push_back(&m_iteration_publisher);
         
         Clear();
     }
@@ -112,41 +215,80 @@ public:
     void Clear()
     {
         Stop();
+        ResetProblem();
         m_T_kw.clear();
         m_camera.clear();
         m_costs.clear();
+        m_retired_costs.clear();
+        m_removed_frames.clear();
+        m_free_frames.clear();
+        std::atomic_store(&m_covariance, std::shared_ptr<const CalibrationCovariance>());
+        m_covariance_x.resize(0);
+        std::atomic_store(&m_snapshot, std::shared_ptr<const CalibrationSnapshot>());
+        m_num_culled = 0;
         m_mse = 0;
     }
     
     /// Start optimisation thread to modify intrinsic / extrinsic parameters
     void Start()
     {
-        if(!m_running) {
+        if(!m_thread.joinable()) {
             m_should_run = true;
+            m_solver_started = true;
             m_thread = std::thread(std::bind( &Calibrator::SolveThread, this )) ;
         }else{
             std::cerr << "Already Running." << std::endl;
         }        
     }
     
+    /// Optimise on the calling thread until convergence or max_iterations
+    /// (0 for the default of the solver thread), for offline calibration
+    /// once all observations are added. Not to be used while started.
+    /// Returns true if the solver converged. Solves again without the
+    /// observations culled after a converged solve.
+    bool Solve(int max_iterations = 0)
+    {
+        static const int kMaxCullRounds = 3;
+
+        if(m_thread.joinable()) {
+            std::cerr << "Solver thread running." << std::endl;
+            return false;
+        }
+        ceres::Solver::Options options = m_solver_options;
+        if(max_iterations > 0) {
+            options.max_num_iterations = max_iterations;
+        }
+        bool converged = SolveProblem(options) && ReachedTolerance();
+        for(int round = 0; converged && m_solve_culled && round < kMaxCullRounds; ++round) {
+            converged = SolveProblem(options) && ReachedTolerance();
+        }
+        return converged;
+    }
+
     /// Stop optimisation thread
     void Stop()
     {
-        if(m_running) {
+        if(m_thread.joinable()) {
             m_should_run = false;
             try {
                 m_thread.join();
-            }catch(std::system_error) {
+            }catch(const std::system_error&) {
                 // thread already died.
             }
+            m_solver_started = false;
         }
     }
  
     /// Add camera to sensor rig. The returned ID should be used when adding
-    /// measurements for this camera
+    /// measurements for this camera. Cameras can't be added while the
+    /// solver thread is started, as they change the problem it solves.
     int AddCamera(const std::shared_ptr<CameraInterface<double>> cam,
                   const Sophus::SE3d& T_ck = Sophus::SE3d() )
     {
+        CALIBU_TRACE_LOCK(lock, m_update_mutex);
+        if(m_solver_started) {
+            throw std::runtime_error("AddCamera: solver thread started.");
+        }
         int id = m_camera.size();
         m_camera.push_back( make_unique<CameraAndPose>(cam,T_ck) );
         m_camera.back()->camera->SetIndex(id);
@@ -159,6 +301,27 @@ public:
     {
         m_fix_intrinsics = v;
     }
+
+    /// Set how outlying observations are culled between solves.
+    void SetOutlierCulling(const OutlierCullOptions& options)
+    {
+        CALIBU_TRACE_LOCK(lock, m_update_mutex);
+        m_cull_options = options;
+    }
+
+    /// Total number of observations culled as outliers.
+    size_t NumCulled() const
+    {
+        return m_num_culled;
+    }
+
+    /// Set whether observations added from now on use the camera models'
+    /// analytic Jacobians (the default) rather than automatic
+    /// differentiation.
+    void UseAnalyticJacobians(bool v = true)
+    {
+        m_analytic_jacobians = v;
+    }
  
     /// Add frame to optimiser. The returned ID should be used when adding
     /// target measurements for a given moment in time. Measurements given
@@ -166,12 +329,8 @@ public:
     /// camera extrinsics equal between all cameras for each frame.
     int AddFrame(Sophus::SE3d T_kw = Sophus::SE3d())
     {
-        m_update_mutex.lock();
-        int id = m_T_kw.size();
-        m_T_kw.push_back( make_unique<Sophus::SE3d>(T_kw) );
-        m_update_mutex.unlock();
-        
-        return id;
+        CALIBU_TRACE_LOCK(lock, m_update_mutex);
+        return AddFrameLocked(T_kw);
     }
  
     /// Add observation p_c of 3D feature P_w from 'camera' for 'frame'
@@ -182,62 +341,102 @@ public:
             const Eigen::Vector3d& P_w,
             const Eigen::Vector2d& p_c
             ) {
-        m_update_mutex.lock();
- 
-        // Ensure index is valid
-        while( NumFrames() < frame) { AddFrame(); }
-        if( NumCameras() < camera ) { throw std::runtime_error("Bad camera index. Add all cameras first."); }
-        
-        // new camera pose to bundle adjust
-        
-        CameraAndPose& cp = *m_camera[camera];
-        Sophus::SE3d& T_kw = *m_T_kw[frame];
-        
-        // Create cost function
-        CostFunctionAndParams* cost = new CostFunctionAndParams();
-
-        std::shared_ptr<CameraInterface<double>> interface = cp.camera;
-
-        if( dynamic_cast<FovCamera<double>* >(interface.get()) ) {
-            cost->Cost() =  new ceres::AutoDiffCostFunction<ReprojectionCostFunctor<FovCamera<double>>,
-                    2, Sophus::SE3d::num_parameters, Sophus::SE3d::num_parameters,
-                    calibu::FovCamera<double>::NumParams>( new ReprojectionCostFunctor<FovCamera<double>>(P_w, p_c) );
-        } else if( dynamic_cast<Poly2Camera<double>* >(interface.get()) ) {
-            cost->Cost() =  new ceres::AutoDiffCostFunction<ReprojectionCostFunctor<Poly2Camera<double>>,
-                    2, Sophus::SE3d::num_parameters, Sophus::SE3d::num_parameters,
-                    calibu::Poly2Camera<double>::NumParams>( new ReprojectionCostFunctor<Poly2Camera<double>>(P_w, p_c) );
-        } else if( dynamic_cast<LinearCamera<double>* >(interface.get()) ) {
-            cost->Cost() =  new ceres::AutoDiffCostFunction<ReprojectionCostFunctor<LinearCamera<double>>,
-                    2, Sophus::SE3d::num_parameters, Sophus::SE3d::num_parameters,
-                    calibu::LinearCamera<double>::NumParams>( new ReprojectionCostFunctor<LinearCamera<double>>(P_w, p_c) );
-        } else if( dynamic_cast<Poly3Camera<double>* >(interface.get()) ) {
-            cost->Cost() =  new ceres::AutoDiffCostFunction<ReprojectionCostFunctor<Poly3Camera<double>>,
-                    2, Sophus::SE3d::num_parameters, Sophus::SE3d::num_parameters,
-                    calibu::Poly3Camera<double>::NumParams>( new ReprojectionCostFunctor<Poly3Camera<double>>(P_w, p_c) );
-        } else if( dynamic_cast<KannalaBrandtCamera<double>* >(interface.get()) ) {
-            cost->Cost() =  new ceres::AutoDiffCostFunction<ReprojectionCostFunctor<KannalaBrandtCamera<double>>,
-                    2, Sophus::SE3d::num_parameters, Sophus::SE3d::num_parameters,
-                    calibu::KannalaBrandtCamera<double>::NumParams>( new ReprojectionCostFunctor<KannalaBrandtCamera<double>>(P_w, p_c) );
-        } else {
-            throw std::runtime_error("Don't know how to optimize Camera.");
+        CALIBU_TRACE_LOCK(lock, m_update_mutex);
+        CameraAndPose& cp = ObservingCamera(frame, camera);
+
+        m_costs.push_back( NewObservationCost(
+                frame, cp,
+                VisitCameraModel<ceres::CostFunction*>(
+                    cp.camera->ModelId(), ReprojectionCostFactory{*this, P_w, p_c} ),
+                &m_LossFunction ) );
+    }
+
+    /// Add the n observations p_c[i] of 3D features P_w[i] from 'camera' for
+    /// 'frame', as n calls to AddObservation but taking the lock once. With
+    /// single_cost they instead form one residual block of 2n residuals,
+    /// with analytic Jacobians and no loss function, as the loss would act on
+    /// the total error of the block rather than on each point.
+    void AddObservations(
+            size_t frame, size_t camera,
+            const Eigen::Vector3d* P_w,
+            const Eigen::Vector2d* p_c,
+            size_t n,
+            bool single_cost = false
+            ) {
+        if(n == 0) return;
+
+        CALIBU_TRACE_IDS("Calibrator::AddObservations", frame, camera);
+        CALIBU_TRACE_LOCK(lock, m_update_mutex);
+        CameraAndPose& cp = ObservingCamera(frame, camera);
+        const CameraModelId id = cp.camera->ModelId();
+
+        if(single_cost) {
+            m_costs.push_back( NewObservationCost(
+                    frame, cp,
+                    VisitCameraModel<ceres::CostFunction*>(
+                        id, MultiReprojectionCostFactory{P_w, p_c, n} ),
+                    nullptr ) );
+            return;
         }
 
-        cost->Params() = std::vector<double*>{
-                T_kw.data(), cp.T_ck.data(), cp.camera->GetParams().data()
-        };
-        cost->Loss() = &m_LossFunction;
-        m_costs.push_back(std::unique_ptr<CostFunctionAndParams>(cost));
-        
-        m_update_mutex.unlock();
+        m_costs.reserve(m_costs.size() + n);
+        for(size_t i = 0; i < n; ++i) {
+            m_costs.push_back( NewObservationCost(
+                    frame, cp,
+                    VisitCameraModel<ceres::CostFunction*>(
+                        id, ReprojectionCostFactory{*this, P_w[i], p_c[i]} ),
+                    &m_LossFunction ) );
+        }
+    }
+
+    void AddObservations(
+            size_t frame, size_t camera,
+            const std::vector<Eigen::Vector3d>& P_w,
+            const std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> >& p_c,
+            bool single_cost = false
+            ) {
+        if(P_w.size() != p_c.size()) {
+            throw std::invalid_argument("AddObservations: P_w and p_c differ in size.");
+        }
+        AddObservations(frame, camera, P_w.data(), p_c.data(), P_w.size(), single_cost);
     }
     
+    /// Remove all observations of 'frame', e.g. when a KeyframePolicy evicts
+    /// it. The frame keeps its pose, which is no longer optimised. The
+    /// solver removes the costs and the frame from its problem before its
+    /// next solve, as it may be running with them; from then on AddFrame
+    /// may reuse the frame's id, so that a stream of evictions and
+    /// additions doesn't grow the rig.
+    void RemoveFrame(size_t frame)
+    {
+        CALIBU_TRACE_LOCK(lock, m_update_mutex);
+        if(frame >= m_T_kw.size()) {
+            throw std::invalid_argument("RemoveFrame: no such frame.");
+        }
+
+        const double* T_kw = m_T_kw[frame]->data();
+        RetireCosts([T_kw](size_t, CostFunctionAndParams& cost) {
+            return cost.Params()[0] == T_kw;
+        });
+        if(std::find(m_removed_frames.begin(), m_removed_frames.end(), frame) == m_removed_frames.end() &&
+           std::find(m_free_frames.begin(), m_free_frames.end(), frame) == m_free_frames.end()) {
+            m_removed_frames.push_back(frame);
+            m_problem_dirty = true;
+        }
+        if(!m_solver_started) {
+            // No solver can be using the problem: release the frame now
+            RemoveRetired();
+        }
+    }
+
     /// Return number of synchronised camera rig frames
     size_t NumFrames() const
     {
         return m_T_kw.size();
     }
     
-    /// Return pose of camera rig frame i
+    /// Return pose of camera rig frame i. It is written to by the solver
+    /// thread while running, from which Snapshot() is safe to read.
     Sophus::SE3d& GetFrame(size_t i)
     {
         return *m_T_kw[i];
@@ -249,7 +448,22 @@ public:
         return m_camera.size();
     }
     
-    /// Return camera i of camera rig
+    /// Parameters published by the solver thread after its last iteration,
+    /// or null before the first one. Never waits for the solver.
+    std::shared_ptr<const CalibrationSnapshot> Snapshot() const
+    {
+        return std::atomic_load(&m_snapshot);
+    }
+
+    /// Report the solver progress to callback rather than to std::cout.
+    void SetProgressCallback(const CalibrationProgressCallback& callback)
+    {
+        std::lock_guard<std::mutex> lock(m_callback_mutex);
+        m_progress_callback = callback;
+    }
+
+    /// Return camera i of camera rig. Its parameters are written to by the
+    /// solver thread while running, see Snapshot().
     CameraAndPose GetCamera(size_t i)
     {
         return *m_camera[i];
@@ -269,148 +483,617 @@ public:
     }
 
 
-#ifdef CALIBU_CERES_COVAR    
-    /// Print summary of calibration
-    void PrintResults()
+    /// Ask the solver thread to compute the covariance after its current
+    /// solve, without waiting for it. The result is then available from
+    /// LatestCovariance().
+    void RequestCovariance()
     {
-        if(m_costs.size() < 10)
-            return;
-        
-        ceres::Problem problem(m_prob_options);
-        SetupProblem(problem);
-        
-        ceres::Covariance::Options cov_options;
-        ceres::Covariance covariance(cov_options);
-        
-        std::vector<std::pair<const double*, const double*> > cov_blocks;
+        m_covariance_requested = true;
+    }
 
-        const int cam_block_size = CameraModelT<ProjModel>::NUM_PARAMS;
-        const int pose_block_size = Sophus::SE3d::num_parameters;
-        
-        // Setup which blocks of covarience to request.
-        for(size_t c=0; c < m_camera.size(); ++c) {
-            const double* cam_block = m_camera[c]->camera.data();
-            cov_blocks.push_back(std::make_pair(cam_block,cam_block) );
-            
-            if(c > 0) {
-                const double* pose_block = m_camera[c]->T_ck.data();
-                cov_blocks.push_back( std::make_pair(pose_block, pose_block) );
-            }
-            
-        }
-        
-        // Compute sparse covarience
-        if(covariance.Compute(cov_blocks, &problem)) {
-            std::cout << "------------------------------------------" << std::endl;        
-            
-            // Retrieve covariences for parameters
-            for(size_t c=0; c < m_camera.size(); ++c) {                
-                std::cout << "Camera: " << c << std::endl;
-
-                const double* cam_block = m_camera[c]->camera.data();
-                Eigen::Matrix<double,cam_block_size,cam_block_size> cam_cov;
-                covariance.GetCovarianceBlock(cam_block,cam_block, cam_cov.data());
-                std::cout << m_camera[c]->camera.Params().transpose() << std::endl;
-                std::cout << "Variance: " << cam_cov.diagonal() << std::endl;            
-                
-                if(c > 0) {
-                    const double* poseblock = m_camera[c]->T_ck.data();
-                    Eigen::Matrix<double,pose_block_size,pose_block_size> pose_cov;
-                    covariance.GetCovarianceBlock(poseblock,poseblock, pose_cov.data());
-                    std::cout << m_camera[c]->T_ck.matrix3x4() << std::endl << std::endl;
-                    std::cout << "Variance: " << pose_cov.diagonal() << std::endl;
-                }
-                
-            }        
-        }
+    /// Recompute the covariance after every solve which changed the rig
+    /// parameters by more than min_relative_change, relative to those of
+    /// the last covariance.
+    void SetContinuousCovariance(bool v = true, double min_relative_change = 1e-3)
+    {
+        m_covariance_min_change = min_relative_change;
+        m_covariance_continuous = v;
+    }
+
+    /// Most recent covariance, or null if none was computed yet. The
+    /// snapshot is immutable and stays valid while it is held.
+    std::shared_ptr<const CalibrationCovariance> LatestCovariance() const
+    {
+        return std::atomic_load(&m_covariance);
     }
-    
-#else  // CALIBU_CERES_COVAR
 
-    /// Print summary of calibration
+    /// Print summary of calibration, with the variances of the latest
+    /// covariance. When the solver is running the covariance is requested
+    /// for the next print, otherwise it is computed now.
     void PrintResults()
     {
+        if(m_thread.joinable()) {
+            RequestCovariance();
+        }else if(!m_costs.empty()) {
+            UpdateProblem();
+            RequestCovariance();
+            UpdateCovariance(m_problem->NumResiduals(), m_mse);
+        }
+
+        const std::shared_ptr<const CalibrationCovariance> cov = LatestCovariance();
         std::cout << "------------------------------------------" << std::endl;        
         
         for(size_t c=0; c < m_camera.size(); ++c) {
             std::cout << "Camera: " << c << std::endl;
             std::cout << m_camera[c]->camera->GetParams().transpose() << std::endl;
+            if(cov && c < cov->params_cov.size()) {
+                std::cout << "Variance: " << cov->params_cov[c].diagonal().transpose() << std::endl;
+            }
             
             if(c > 0) {
                 std::cout << m_camera[c]->T_ck.matrix3x4() << std::endl;
+                if(cov && c < cov->T_ck_cov.size()) {
+                    std::cout << "Variance: " << cov->T_ck_cov[c].diagonal().transpose() << std::endl;
+                }
             }
             std::cout << std::endl;
         }        
     }
-#endif // CALIBU_CERES_COVAR
     
 protected:
+
+    /// Reprojection cost of one observation for camera model CameraInt
+    template<typename CameraInt>
+    ceres::CostFunction* NewReprojectionCost(const Eigen::Vector3d& P_w,
+                                             const Eigen::Vector2d& p_c) const
+    {
+        if(m_analytic_jacobians) {
+            return new AnalyticReprojectionCost<CameraInt>(P_w, p_c);
+        }
+        return new ceres::AutoDiffCostFunction<ReprojectionCostFunctor<CameraInt>,
+                2, Sophus::SE3d::num_parameters, Sophus::SE3d::num_parameters,
+                CameraInt::NumParams>( new ReprojectionCostFunctor<CameraInt>(P_w, p_c) );
+    }
+
+    /// AddFrame with m_update_mutex held, reusing a removed frame if any.
+    int AddFrameLocked(const Sophus::SE3d& T_kw = Sophus::SE3d())
+    {
+        if(!m_free_frames.empty()) {
+            const int id = m_free_frames.back();
+            m_free_frames.pop_back();
+            *m_T_kw[id] = T_kw;
+            m_reused_frames.push_back(id);
+            return id;
+        }
+        int id = m_T_kw.size();
+        m_T_kw.push_back( make_unique<Sophus::SE3d>(T_kw) );
+        return id;
+    }
+
+    /// Camera 'camera' after checking it can be optimised, adding frames up
+    /// to 'frame' as needed. Requires m_update_mutex.
+    CameraAndPose& ObservingCamera(size_t frame, size_t camera)
+    {
+        if( NumCameras() <= camera ) { throw std::runtime_error("Bad camera index. Add all cameras first."); }
+        if( m_camera[camera]->camera->ModelId() == CameraModelId::kUnknown ) {
+            throw std::runtime_error("Don't know how to optimize Camera.");
+        }
+        while( NumFrames() <= frame ) { m_T_kw.push_back( make_unique<Sophus::SE3d>() ); }
+        return *m_camera[camera];
+    }
+
+    /// cost on the parameters of 'frame' and cp
+    std::unique_ptr<CostFunctionAndParams> NewObservationCost(
+            size_t frame, CameraAndPose& cp,
+            ceres::CostFunction* cost_function, ceres::LossFunction* loss)
+    {
+        std::unique_ptr<CostFunctionAndParams> cost(new CostFunctionAndParams());
+        cost->Cost() = cost_function;
+        cost->Params() = std::vector<double*>{
+                m_T_kw[frame]->data(), cp.T_ck.data(), cp.camera->GetParams().data()
+        };
+        cost->Loss() = loss;
+        return cost;
+    }
+
+    /// NewReprojectionCost for the model visited by VisitCameraModel
+    struct ReprojectionCostFactory
+    {
+        template<typename Tag>
+        ceres::CostFunction* operator()(Tag) const
+        {
+            return calibrator.NewReprojectionCost<
+                    typename Tag::template Camera<double> >(P_w, p_c);
+        }
+
+        const Calibrator& calibrator;
+        const Eigen::Vector3d& P_w;
+        const Eigen::Vector2d& p_c;
+    };
+
+    /// AnalyticReprojectionCosts for the model visited by VisitCameraModel
+    struct MultiReprojectionCostFactory
+    {
+        template<typename Tag>
+        ceres::CostFunction* operator()(Tag) const
+        {
+            return new AnalyticReprojectionCosts<
+                    typename Tag::template Camera<double> >(P_w, p_c, n);
+        }
+
+        const Eigen::Vector3d* P_w;
+        const Eigen::Vector2d* p_c;
+        size_t n;
+    };
     
-    void SetupProblem(ceres::Problem& problem)
+    /// Forget the persistent problem, so that UpdateProblem rebuilds it.
+    void ResetProblem()
     {
-        m_update_mutex.lock();
+        m_problem.reset();
+        m_problem_cameras = 0;
+        m_problem_frames = 0;
+        m_problem_costs = 0;
+        m_problem_dirty = false;
+        m_problem_T_kw.clear();
+        m_reused_frames.clear();
+    }
 
-        
-        // Add parameters
-        for(size_t c=0; c<m_camera.size(); ++c) {
-            problem.AddParameterBlock(m_camera[c]->T_ck.data(), 7, &m_LocalParamSe3 );
+    /// Reset the problem, and with it the last references to retired costs
+    /// and the poses of removed frames. Requires m_update_mutex.
+    void DropProblem()
+    {
+        ResetProblem();
+        m_retired_costs.clear();
+        m_free_frames.insert(m_free_frames.end(), m_removed_frames.begin(), m_removed_frames.end());
+        m_removed_frames.clear();
+    }
+
+    /// Move the costs of m_costs for which retire(index, cost) holds to
+    /// m_retired_costs, keeping the order of the rest. Those the problem
+    /// holds wait there for RemoveRetired. Requires m_update_mutex.
+    template<typename Predicate>
+    void RetireCosts(Predicate retire)
+    {
+        size_t kept = 0;
+        size_t kept_in_problem = 0;
+        for(size_t c=0; c<m_costs.size(); ++c) {
+            if(!retire(c, *m_costs[c])) {
+                if(c < m_problem_costs) ++kept_in_problem;
+                m_costs[kept++] = std::move(m_costs[c]);
+            }else if(c < m_problem_costs) {
+                m_retired_costs.push_back(std::move(m_costs[c]));
+                m_problem_dirty = true;
+            }
+        }
+        m_costs.resize(kept);
+        m_problem_costs = kept_in_problem;
+    }
+
+    /// Remove retired costs and removed frames from the problem, freeing the
+    /// frames for AddFrame. Must not run during a solve of the problem.
+    /// Requires m_update_mutex.
+    void RemoveRetired()
+    {
+        if(m_problem) {
+            for(const std::unique_ptr<CostFunctionAndParams>& cost : m_retired_costs) {
+                m_problem->RemoveResidualBlock(cost->ResidualId());
+            }
+            for(size_t f : m_removed_frames) {
+                if(m_problem->HasParameterBlock(m_T_kw[f]->data())) {
+                    m_problem->RemoveParameterBlock(m_T_kw[f]->data());
+                }
+            }
+        }
+        m_retired_costs.clear();
+        m_free_frames.insert(m_free_frames.end(), m_removed_frames.begin(), m_removed_frames.end());
+        m_removed_frames.clear();
+        m_problem_dirty = false;
+    }
+
+    /// Bring the persistent problem up to date, removing the blocks retired
+    /// and adding those added since the last call. The parameters are
+    /// optimised in place, so each solve warm starts from the last one. It
+    /// is only rebuilt when its cameras change.
+    void UpdateProblem()
+    {
+        CALIBU_TRACE("Calibrator::UpdateProblem");
+        CALIBU_TRACE_LOCK(lock, m_update_mutex);
+
+        // Camera blocks are set up once for all, before any residual
+        if(!m_problem || m_problem_cameras != m_camera.size() ||
+           m_problem_fix_intrinsics != m_fix_intrinsics) {
+            DropProblem();
+            m_problem.reset(new ceres::Problem(m_prob_options));
+            m_problem_fix_intrinsics = m_fix_intrinsics;
+        }else{
+            RemoveRetired();
+        }
+
+        for(size_t c=m_problem_cameras; c<m_camera.size(); ++c) {
+            m_problem->AddParameterBlock(m_camera[c]->T_ck.data(), 7, &m_LocalParamSe3 );
             if(c==0) {
-                problem.SetParameterBlockConstant(m_camera[c]->T_ck.data());
+                m_problem->SetParameterBlockConstant(m_camera[c]->T_ck.data());
             }
             if(m_fix_intrinsics) {
-                problem.AddParameterBlock(m_camera[c]->camera->GetParams().data(), m_camera[c]->camera->NumParams() );
-                problem.SetParameterBlockConstant(m_camera[c]->camera->GetParams().data());
+                m_problem->AddParameterBlock(m_camera[c]->camera->GetParams().data(), m_camera[c]->camera->NumParams() );
+                m_problem->SetParameterBlockConstant(m_camera[c]->camera->GetParams().data());
             }
         }
-        
-        for(size_t p=0; p<m_T_kw.size(); ++p) {
-            problem.AddParameterBlock(m_T_kw[p]->data(), 7, &m_LocalParamSe3 );
+        m_problem_cameras = m_camera.size();
+
+        // Frames removed from the problem come back when AddFrame reuses them
+        for(size_t p : m_reused_frames) {
+            if(p < m_problem_frames && !m_problem->HasParameterBlock(m_T_kw[p]->data())) {
+                m_problem->AddParameterBlock(m_T_kw[p]->data(), 7, &m_LocalParamSe3 );
+            }
         }
+        m_reused_frames.clear();
+        for(size_t p=m_problem_frames; p<m_T_kw.size(); ++p) {
+            m_problem->AddParameterBlock(m_T_kw[p]->data(), 7, &m_LocalParamSe3 );
+            m_problem_T_kw.push_back(m_T_kw[p].get());
+        }
+        m_problem_frames = m_T_kw.size();
 
-        // Add costs
-        for(size_t c=0; c<m_costs.size(); ++c) {
+        for(size_t c=m_problem_costs; c<m_costs.size(); ++c) {
             CostFunctionAndParams& cost = *m_costs[c];
-            problem.AddResidualBlock(cost.Cost(), cost.Loss(), cost.Params());
+            cost.ResidualId() = m_problem->AddResidualBlock(cost.Cost(), cost.Loss(), cost.Params());
         }
-        
-        m_update_mutex.unlock();        
+        m_problem_costs = m_costs.size();
     }
-    
+
+    /// Concatenated intrinsics and extrinsics, to measure solution change
+    Eigen::VectorXd RigParameters() const
+    {
+        size_t n = 0;
+        for(size_t c=0; c<m_camera.size(); ++c) {
+            n += m_camera[c]->camera->NumParams() + Sophus::SE3d::num_parameters;
+        }
+        Eigen::VectorXd x(n);
+        size_t i = 0;
+        for(size_t c=0; c<m_camera.size(); ++c) {
+            const CameraAndPose& cp = *m_camera[c];
+            x.segment(i, cp.camera->NumParams()) = cp.camera->GetParams();
+            i += cp.camera->NumParams();
+            x.segment(i, int(Sophus::SE3d::num_parameters)) =
+                    Eigen::Map<const Eigen::VectorXd>(cp.T_ck.data(), Sophus::SE3d::num_parameters);
+            i += Sophus::SE3d::num_parameters;
+        }
+        return x;
+    }
+
+    /// Compute and publish the covariance of the camera blocks of the
+    /// persistent problem, if requested or if the solution moved enough.
+    /// Must run on the thread which solves the problem, between solves.
+    void UpdateCovariance(int num_residuals, double mse)
+    {
+        const bool requested = m_covariance_requested.exchange(false);
+        if(!requested && !m_covariance_continuous) {
+            return;
+        }
+
+        const Eigen::VectorXd x = RigParameters();
+        if(!requested && m_covariance_x.size() == x.size() &&
+           (x - m_covariance_x).norm() <= m_covariance_min_change * m_covariance_x.norm()) {
+            return;
+        }
+
+        CALIBU_TRACE("Calibrator::UpdateCovariance");
+
+        // Blocks of the problem, and frames left without observations by
+        // RemoveFrame, which are held constant so that the Jacobian keeps
+        // full rank.
+        std::set<const double*> blocks;
+        std::vector<double*> unobserved;
+        {
+            CALIBU_TRACE_LOCK(lock, m_update_mutex);
+            if(m_problem_dirty || !m_problem) {
+                // Problem out of date with m_costs, retry after the next solve
+                m_covariance_requested = m_covariance_requested || requested;
+                return;
+            }
+            for(size_t c=0; c<m_problem_costs; ++c) {
+                const std::vector<double*>& params = m_costs[c]->Params();
+                blocks.insert(params.begin(), params.end());
+            }
+            for(size_t f=0; f<m_problem_frames; ++f) {
+                if(!blocks.count(m_T_kw[f]->data()) &&
+                   m_problem->HasParameterBlock(m_T_kw[f]->data())) {
+                    unobserved.push_back(m_T_kw[f]->data());
+                }
+            }
+        }
+
+        std::vector<std::pair<const double*, const double*> > cov_blocks;
+        for(size_t c=0; c < m_problem_cameras; ++c) {
+            const double* cam_block = m_camera[c]->camera->GetParams().data();
+            if(blocks.count(cam_block)) {
+                cov_blocks.push_back(std::make_pair(cam_block, cam_block));
+            }
+            const double* pose_block = m_camera[c]->T_ck.data();
+            if(c > 0 && blocks.count(pose_block)) {
+                cov_blocks.push_back(std::make_pair(pose_block, pose_block));
+            }
+        }
+        if(cov_blocks.empty()) {
+            return;
+        }
+
+        for(double* f : unobserved) {
+            m_problem->SetParameterBlockConstant(f);
+        }
+        ceres::Covariance::Options cov_options;
+        cov_options.num_threads = m_solver_options.num_threads;
+        ceres::Covariance covariance(cov_options);
+        const bool computed = covariance.Compute(cov_blocks, m_problem.get());
+        for(double* f : unobserved) {
+            m_problem->SetParameterBlockVariable(f);
+        }
+        if(!computed) {
+            std::cerr << "Covariance computation failed." << std::endl;
+            return;
+        }
+
+        std::shared_ptr<CalibrationCovariance> cov(new CalibrationCovariance);
+        cov->num_frames = m_problem_frames;
+        cov->num_residuals = num_residuals;
+        cov->mse = mse;
+        for(size_t c=0; c < m_problem_cameras; ++c) {
+            const CameraAndPose& cp = *m_camera[c];
+            const int n = cp.camera->NumParams();
+            const double* cam_block = cp.camera->GetParams().data();
+            cov->params.push_back(cp.camera->GetParams());
+            cov->params_cov.push_back(Eigen::MatrixXd::Zero(n, n));
+            if(blocks.count(cam_block) && !m_fix_intrinsics) {
+                // Ceres fills the row major block, symmetric
+                covariance.GetCovarianceBlock(cam_block, cam_block, cov->params_cov.back().data());
+            }
+
+            const int np = Sophus::SE3d::num_parameters;
+            const double* pose_block = cp.T_ck.data();
+            cov->T_ck.push_back(cp.T_ck);
+            cov->T_ck_cov.push_back(Eigen::MatrixXd::Zero(np, np));
+            if(c > 0 && blocks.count(pose_block)) {
+                covariance.GetCovarianceBlock(pose_block, pose_block, cov->T_ck_cov.back().data());
+            }
+        }
+        m_covariance_x = x;
+        std::atomic_store(&m_covariance, std::shared_ptr<const CalibrationCovariance>(cov));
+    }
+
+    /// Publishes a snapshot and progress after each solver iteration. Ceres
+    /// writes the parameters back every iteration, as
+    /// update_state_every_iteration is set.
+    class IterationPublisher : public ceres::IterationCallback
+    {
+    public:
+        IterationPublisher(Calibrator& calibrator) : m_calibrator(calibrator)
+        {
+        }
+
+        ceres::CallbackReturnType operator()(const ceres::IterationSummary& summary)
+        {
+            m_calibrator.PublishSnapshot(summary.iteration);
+
+            CalibrationProgress progress = m_calibrator.NewProgress(summary.iteration, summary.cost);
+            progress.iteration_time = summary.iteration_time_in_seconds;
+            progress.solve_time = summary.cumulative_time_in_seconds;
+            m_calibrator.ReportProgress(progress);
+            return ceres::SOLVER_CONTINUE;
+        }
+
+    protected:
+        Calibrator& m_calibrator;
+    };
+
+    /// Copy the parameters of the problem being solved into a new snapshot.
+    void PublishSnapshot(int iteration)
+    {
+        std::shared_ptr<CalibrationSnapshot> snapshot(new CalibrationSnapshot);
+        snapshot->solve = m_solve;
+        snapshot->iteration = iteration;
+        for(size_t c=0; c<m_problem_cameras; ++c) {
+            snapshot->params.push_back(m_camera[c]->camera->GetParams());
+            snapshot->T_ck.push_back(m_camera[c]->T_ck);
+        }
+        for(const Sophus::SE3d* T_kw : m_problem_T_kw) {
+            snapshot->T_kw.push_back(*T_kw);
+        }
+        std::atomic_store(&m_snapshot, std::shared_ptr<const CalibrationSnapshot>(snapshot));
+    }
+
+    CalibrationProgress NewProgress(int iteration, double cost) const
+    {
+        CalibrationProgress progress;
+        progress.solve = m_solve;
+        progress.iteration = iteration;
+        progress.cost = cost;
+        progress.mse = m_solve_num_residuals ? cost / m_solve_num_residuals : 0;
+        progress.iteration_time = 0;
+        progress.solve_time = 0;
+        progress.num_cameras = m_problem_cameras;
+        progress.num_frames = m_problem_T_kw.size();
+        progress.num_residuals = m_solve_num_residuals;
+        progress.final = false;
+        progress.termination_type = ceres::NO_CONVERGENCE;
+        progress.num_culled = 0;
+        progress.cull_threshold = 0;
+        return progress;
+    }
+
+    /// Pass progress to the callback. Without one, only the end of each
+    /// solve is printed.
+    void ReportProgress(const CalibrationProgress& progress)
+    {
+        std::lock_guard<std::mutex> lock(m_callback_mutex);
+        if(m_progress_callback) {
+            m_progress_callback(progress);
+        }else if(progress.final) {
+            std::cout << "Frames: " << progress.num_frames << "; Observations: " << progress.num_residuals << "; mse: " << progress.mse;
+            if(progress.num_culled) {
+                std::cout << "; culled: " << progress.num_culled << " above " << progress.cull_threshold << "px";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    /// One solve of the persistent problem with options, if it has any
+    /// residual. Returns false if there was nothing to solve.
+    bool SolveProblem(const ceres::Solver::Options& options)
+    {
+        CALIBU_TRACE("Calibrator::SolveProblem");
+        UpdateProblem();
+        ceres::Problem& problem = *m_problem;
+        if(problem.NumResiduals() == 0) {
+            return false;
+        }
+
+        try {
+            ++m_solve;
+            m_solve_num_residuals = problem.NumResiduals();
+            ceres::Solver::Summary summary;
+            {
+                CALIBU_TRACE("ceres::Solve");
+                ceres::Solve(options, &problem, &summary);
+            }
+            m_termination_type = summary.termination_type;
+            m_mse = summary.final_cost / summary.num_residuals;
+
+            // Before convergence, large errors may be those of new frames
+            double cull_threshold = 0;
+            m_solve_culled = summary.termination_type == ceres::CONVERGENCE ?
+                        CullOutliers(cull_threshold) : 0;
+            m_num_culled += m_solve_culled;
+
+            CalibrationProgress progress = NewProgress(summary.num_successful_steps + summary.num_unsuccessful_steps, summary.final_cost);
+            progress.solve_time = summary.total_time_in_seconds;
+            progress.final = true;
+            progress.termination_type = summary.termination_type;
+            progress.num_culled = m_solve_culled;
+            progress.cull_threshold = cull_threshold;
+            ReportProgress(progress);
+
+            UpdateCovariance(summary.num_residuals, m_mse);
+        }catch(const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+        return true;
+    }
+
+    /// Remove the single observation costs of the solved problem whose
+    /// reprojection error is above the threshold of m_cull_options, which
+    /// is returned in threshold. Must run on the thread which solves the
+    /// problem, between solves. Returns the number of costs removed.
+    size_t CullOutliers(double& threshold)
+    {
+        // Median of the norm of 2D errors of unit variance per axis
+        static const double kRayleighMedian = 1.1774100225154747;
+
+        CALIBU_TRACE("Calibrator::CullOutliers");
+        CALIBU_TRACE_LOCK(lock, m_update_mutex);
+        threshold = 0;
+        if(!m_cull_options.enabled || m_problem_dirty) {
+            return 0;
+        }
+
+        // Error of each cost of the problem, or NaN if not culled
+        std::vector<double> errors(m_problem_costs, std::numeric_limits<double>::quiet_NaN());
+        std::vector<double> valid;
+        valid.reserve(m_problem_costs);
+        for(size_t c=0; c<m_problem_costs; ++c) {
+            CostFunctionAndParams& cost = *m_costs[c];
+            double r[2];
+            if(cost.Cost()->num_residuals() != 2 ||
+               !cost.Cost()->Evaluate(cost.Params().data(), r, nullptr)) {
+                continue;
+            }
+            const double e = std::sqrt(r[0]*r[0] + r[1]*r[1]);
+            if(std::isfinite(e)) {
+                errors[c] = e;
+                valid.push_back(e);
+            }
+        }
+        if(valid.empty() || valid.size() < m_cull_options.min_observations) {
+            return 0;
+        }
+
+        std::nth_element(valid.begin(), valid.begin() + valid.size() / 2, valid.end());
+        const double sigma = valid[valid.size() / 2] / kRayleighMedian;
+        threshold = std::max(m_cull_options.min_error, m_cull_options.num_sigmas * sigma);
+
+        const size_t before = m_costs.size();
+        RetireCosts([&errors, threshold](size_t c, CostFunctionAndParams&) {
+            return c < errors.size() && errors[c] > threshold;
+        });
+        RemoveRetired();
+        return before - m_costs.size();
+    }
+
     void SolveThread()
     {
+        CALIBU_TRACE_THREAD("Calibrator solver");
         m_running = true;
         while( m_should_run ){
-            ceres::Problem problem(m_prob_options);
-            SetupProblem(problem);            
-            
-            // Crank optimisation
-            if(problem.NumResiduals() > 0) {
-                try {
-                    ceres::Solver::Summary summary;
-                    ceres::Solve(m_solver_options, &problem, &summary);
-                    std::cout << summary.BriefReport() << std::endl;
-                    m_termination_type = summary.termination_type;
-                    m_mse = summary.final_cost / summary.num_residuals;
-                    std::cout << "Frames: " << m_T_kw.size() << "; Observations: " << summary.num_residuals << "; mse: " << m_mse << std::endl;
-                }catch(std::exception e) {
-                    std::cerr << e.what() << std::endl;
-                }
-            }
+            // Crank optimisation, while new observations queue up in m_costs
+            SolveProblem(m_solver_options);
         }
         m_running = false;
     }
  
     std::mutex m_update_mutex;
     std::thread m_thread;
-    bool m_should_run;
-    bool m_running;
+    std::atomic<bool> m_should_run;
+    std::atomic<bool> m_running;
+    // From Start until Stop has joined the solver thread, for RemoveFrame
+    std::atomic<bool> m_solver_started;
     bool m_fix_intrinsics;
+    bool m_analytic_jacobians;
     ceres::TerminationType m_termination_type;
     
     std::vector< std::unique_ptr<Sophus::SE3d> > m_T_kw;
     std::vector< std::unique_ptr<CameraAndPose> > m_camera;
     std::vector< std::unique_ptr<CostFunctionAndParams > > m_costs;
  
+    // Persistent problem of SolveThread, holding the first m_problem_*
+    // cameras, frames and costs.
+    std::unique_ptr<ceres::Problem> m_problem;
+    size_t m_problem_cameras;
+    size_t m_problem_frames;
+    size_t m_problem_costs;
+    bool m_problem_fix_intrinsics;
+
+    // Set while the problem still holds the retired costs or removed frames
+    // of RemoveFrame, which stay alive until RemoveRetired
+    bool m_problem_dirty;
+    std::vector< std::unique_ptr<CostFunctionAndParams > > m_retired_costs;
+
+    // Frames emptied by RemoveFrame, which become free for AddFrame to
+    // reuse once RemoveRetired has taken them out of the problem, and those
+    // reused since, to add back to it
+    std::vector<size_t> m_removed_frames;
+    std::vector<size_t> m_free_frames;
+    std::vector<size_t> m_reused_frames;
+
+    // Covariance service of the solver thread, m_covariance_x holding the
+    // rig parameters of the published snapshot
+    std::atomic<bool> m_covariance_requested;
+    std::atomic<bool> m_covariance_continuous;
+    std::atomic<double> m_covariance_min_change;
+    std::shared_ptr<const CalibrationCovariance> m_covariance;
+    Eigen::VectorXd m_covariance_x;
+
+    // Published by the solver thread, m_problem_T_kw being the frames of
+    // the persistent problem, safe to read from the solver thread
+    std::vector<const Sophus::SE3d*> m_problem_T_kw;
+    size_t m_solve;
+    int m_solve_num_residuals;
+    size_t m_solve_culled;
+    std::atomic<size_t> m_num_culled;
+    OutlierCullOptions m_cull_options;
+    std::shared_ptr<const CalibrationSnapshot> m_snapshot;
+    std::mutex m_callback_mutex;
+    CalibrationProgressCallback m_progress_callback;
+    IterationPublisher m_iteration_publisher;
+
     ceres::Problem::Options m_prob_options;
     ceres::Solver::Options  m_solver_options;
     ceres::LossFunctionWrapper m_LossFunction;
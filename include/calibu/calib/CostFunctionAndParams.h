@@ -29,6 +29,11 @@ namespace calibu
 class CostFunctionAndParams
 {
 public:     
+    CostFunctionAndParams()
+        : m_cost(nullptr), m_loss_func(nullptr), m_residual_id(nullptr)
+    {
+    }
+
     virtual ~CostFunctionAndParams()
     {
     }    
@@ -47,11 +52,18 @@ public:
     {
         return m_loss_func;
     }    
+
+    /// Block of the cost in the problem it was added to, or null
+    ceres::ResidualBlockId& ResidualId()
+    {
+        return m_residual_id;
+    }
     
 protected:
     ceres::CostFunction* m_cost;
     std::vector<double*> m_params;
     ceres::LossFunction* m_loss_func;
+    ceres::ResidualBlockId m_residual_id;
 };
 
 }
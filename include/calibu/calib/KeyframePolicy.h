@@ -0,0 +1,426 @@
+/* 
+   This file is part of the Calibu Project.
+   https://github.com/arpg/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove,
+                      Gabe Sibley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <sophus/se3.hpp>
+
+#include <calibu/Platform.h>
+#include <calibu/cam/camera_crtp.h>
+#include <calibu/cam/camera_rig.h>
+
+namespace calibu {
+
+/// Thresholds and budget of KeyframePolicy. A frame becomes a keyframe if
+/// any of its novelty measures passes its threshold, while the budget is not
+/// exhausted. 0 leaves a budget unbounded.
+struct KeyframeOptions
+{
+    KeyframeOptions() :
+        min_translation(0.05),
+        min_rotation(5.0 * M_PI / 180.0),
+        coverage_bins_x(8),
+        coverage_bins_y(6),
+        min_new_coverage(0.05),
+        min_information_gain(0.05),
+        max_frames(0),
+        max_residuals(0)
+    {
+    }
+
+    /// Distance to the nearest keyframe pose, in target units and radians
+    double min_translation;
+    double min_rotation;
+
+    /// Image grid of each camera, and the fraction of its bins that a frame
+    /// must see for the first time
+    int coverage_bins_x;
+    int coverage_bins_y;
+    double min_new_coverage;
+
+    /// Increase of the log determinant of the intrinsics information
+    double min_information_gain;
+
+    size_t max_frames;
+    size_t max_residuals;
+};
+
+/// Observed pixels of one camera in a frame.
+typedef std::vector<Eigen::Vector2d,
+                    Eigen::aligned_allocator<Eigen::Vector2d> > KeyframePixels;
+
+struct KeyframeDecision
+{
+    bool accept;
+    /// Keyframes to remove before adding the frame, when over budget, in
+    /// decreasing order so that each index stays valid as those before it
+    /// are removed
+    std::vector<int> evict;
+
+    bool novel_pose;
+    double new_coverage;
+    double information_gain;
+};
+
+/// Chooses which frames of a capture to add to a Calibrator, so that near
+/// duplicate views stop growing the problem. Novelty is measured by the
+/// distance to the nearest keyframe pose, the image bins seen for the first
+/// time, and the information gained on the intrinsics, from the cameras'
+/// dProject_dparams at the rays of the observed pixels, evaluated on copies
+/// of the cameras which SetParams updates. Once the frame or
+/// residual budget is reached, a frame is only added in place of the
+/// keyframes whose removal would lose the least information, evicted one by
+/// one until the frame fits, if it gains more than they lose together.
+class KeyframePolicy
+{
+public:
+    KeyframePolicy(const KeyframeOptions& options = KeyframeOptions()) :
+        m_options(options), m_num_residuals(0)
+    {
+    }
+
+    /// Add camera c of the rig, in Calibrator order. The information gain is
+    /// computed on a copy of the camera at its current parameters, so that
+    /// a solver may keep writing to cam.
+    void AddCamera(const std::shared_ptr<CameraInterface<double>> cam)
+    {
+        CameraState state;
+        state.camera = CastCamera<double>(cam);
+        if(!state.camera) {
+            throw std::invalid_argument("KeyframePolicy: unknown camera model.");
+        }
+        state.information = Eigen::MatrixXd::Zero(cam->NumParams(), cam->NumParams());
+        state.coverage.assign(m_options.coverage_bins_x * m_options.coverage_bins_y, 0);
+        m_cameras.push_back(state);
+    }
+
+    /// Set the intrinsics of the copied cameras, params[c] for camera c, e.g.
+    /// to the params of Calibrator::Snapshot() as the solver refines them.
+    void SetParams(const std::vector<Eigen::VectorXd>& params)
+    {
+        for(size_t c = 0; c < m_cameras.size() && c < params.size(); ++c) {
+            if(params[c].size() == m_cameras[c].camera->NumParams()) {
+                m_cameras[c].camera->SetParams(params[c]);
+            }
+        }
+    }
+
+    /// Decide on a frame of rig pose T_kw, with pixels[c] observed by
+    /// camera c.
+    KeyframeDecision Evaluate(const Sophus::SE3d& T_kw,
+                              const std::vector<KeyframePixels>& pixels) const
+    {
+        KeyframeDecision decision;
+        decision.accept = false;
+
+        // Pose novelty
+        decision.novel_pose = true;
+        for(const Keyframe& k : m_keyframes) {
+            const Sophus::SE3d T = k.T_kw * T_kw.inverse();
+            if(T.translation().norm() < m_options.min_translation &&
+               T.so3().log().norm() < m_options.min_rotation) {
+                decision.novel_pose = false;
+                break;
+            }
+        }
+
+        // New image coverage and information gain
+        size_t num_residuals = 0;
+        size_t new_bins = 0;
+        size_t num_bins = 0;
+        decision.information_gain = 0;
+        for(size_t c = 0; c < m_cameras.size() && c < pixels.size(); ++c) {
+            const CameraState& cam = m_cameras[c];
+            num_residuals += 2 * pixels[c].size();
+            num_bins += cam.coverage.size();
+
+            std::vector<bool> seen(cam.coverage.size(), false);
+            for(const Eigen::Vector2d& p : pixels[c]) {
+                const int bin = Bin(*cam.camera, p);
+                if(!cam.coverage[bin] && !seen[bin]) ++new_bins;
+                seen[bin] = true;
+            }
+            decision.information_gain += LogDetGain(
+                        cam.information, Information(*cam.camera, pixels[c]));
+        }
+        decision.new_coverage = num_bins ? double(new_bins) / num_bins : 0;
+
+        const bool novel = m_keyframes.empty() || decision.novel_pose ||
+                decision.new_coverage >= m_options.min_new_coverage ||
+                decision.information_gain >= m_options.min_information_gain;
+        if(!novel || num_residuals == 0) {
+            return decision;
+        }
+
+        size_t frames = m_keyframes.size() + 1;
+        size_t residuals = m_num_residuals + num_residuals;
+        if(!OverBudget(frames, residuals)) {
+            decision.accept = true;
+            return decision;
+        }
+
+        // Evict the keyframe which contributes the least to what remains,
+        // until the frame fits the budget
+        std::vector<Eigen::MatrixXd> remaining;
+        for(const CameraState& cam : m_cameras) {
+            remaining.push_back(cam.information);
+        }
+        std::vector<bool> evicted(m_keyframes.size(), false);
+        double total_loss = 0;
+        while(OverBudget(frames, residuals)) {
+            int weakest = -1;
+            double weakest_loss = 0;
+            for(size_t k = 0; k < m_keyframes.size(); ++k) {
+                if(evicted[k]) continue;
+                double loss = 0;
+                for(size_t c = 0; c < m_keyframes[k].information.size(); ++c) {
+                    loss += LogDetGain(remaining[c] - m_keyframes[k].information[c],
+                                       m_keyframes[k].information[c]);
+                }
+                if(weakest < 0 || loss < weakest_loss) {
+                    weakest = k;
+                    weakest_loss = loss;
+                }
+            }
+            if(weakest < 0) {
+                // Over budget on its own
+                decision.evict.clear();
+                return decision;
+            }
+
+            const Keyframe& w = m_keyframes[weakest];
+            for(size_t c = 0; c < w.information.size(); ++c) {
+                remaining[c] -= w.information[c];
+            }
+            evicted[weakest] = true;
+            total_loss += weakest_loss;
+            --frames;
+            residuals -= w.num_residuals;
+            decision.evict.push_back(weakest);
+        }
+
+        if(decision.information_gain > total_loss) {
+            decision.accept = true;
+            std::sort(decision.evict.begin(), decision.evict.end(), std::greater<int>());
+        }else{
+            decision.evict.clear();
+        }
+        return decision;
+    }
+
+    /// Record a frame accepted by Evaluate, added to the Calibrator as
+    /// frame_id, first removing decision.evict.
+    void Accept(const KeyframeDecision& decision, const Sophus::SE3d& T_kw,
+                const std::vector<KeyframePixels>& pixels, int frame_id)
+    {
+        for(int k : decision.evict) {
+            Remove(k);
+        }
+
+        Keyframe k;
+        k.T_kw = T_kw;
+        k.frame_id = frame_id;
+        k.num_residuals = 0;
+        for(size_t c = 0; c < m_cameras.size() && c < pixels.size(); ++c) {
+            CameraState& cam = m_cameras[c];
+            k.information.push_back(Information(*cam.camera, pixels[c]));
+            cam.information += k.information.back();
+            k.bins.push_back(std::vector<int>());
+            for(const Eigen::Vector2d& p : pixels[c]) {
+                const int bin = Bin(*cam.camera, p);
+                ++cam.coverage[bin];
+                k.bins.back().push_back(bin);
+            }
+            k.num_residuals += 2 * pixels[c].size();
+        }
+        m_num_residuals += k.num_residuals;
+        m_keyframes.push_back(k);
+    }
+
+    size_t NumKeyframes() const
+    {
+        return m_keyframes.size();
+    }
+
+    /// Calibrator frame of keyframe k, e.g. to remove it on eviction
+    int FrameId(size_t k) const
+    {
+        return m_keyframes[k].frame_id;
+    }
+
+    size_t NumResiduals() const
+    {
+        return m_num_residuals;
+    }
+
+protected:
+    struct CameraState
+    {
+        std::shared_ptr<CameraInterface<double>> camera;
+        Eigen::MatrixXd information;
+        std::vector<int> coverage;
+    };
+
+    struct Keyframe
+    {
+        Sophus::SE3d T_kw;
+        int frame_id;
+        size_t num_residuals;
+        std::vector<Eigen::MatrixXd> information;
+        std::vector<std::vector<int> > bins;
+    };
+
+    bool OverBudget(size_t frames, size_t residuals) const
+    {
+        return (m_options.max_frames && frames > m_options.max_frames) ||
+               (m_options.max_residuals && residuals > m_options.max_residuals);
+    }
+
+    void Remove(size_t k)
+    {
+        const Keyframe& r = m_keyframes[k];
+        for(size_t c = 0; c < r.information.size(); ++c) {
+            m_cameras[c].information -= r.information[c];
+            for(int bin : r.bins[c]) --m_cameras[c].coverage[bin];
+        }
+        m_num_residuals -= r.num_residuals;
+        m_keyframes.erase(m_keyframes.begin() + k);
+    }
+
+    int Bin(const CameraInterface<double>& cam, const Eigen::Vector2d& p) const
+    {
+        const int bx = std::min(std::max(0, int(p[0] * m_options.coverage_bins_x / cam.Width())),
+                                m_options.coverage_bins_x - 1);
+        const int by = std::min(std::max(0, int(p[1] * m_options.coverage_bins_y / cam.Height())),
+                                m_options.coverage_bins_y - 1);
+        return by * m_options.coverage_bins_x + bx;
+    }
+
+    // Gauss-Newton information on the intrinsics of the pixels' rays
+    static Eigen::MatrixXd Information(const CameraInterface<double>& cam,
+                                       const KeyframePixels& pixels)
+    {
+        Eigen::MatrixXd H = Eigen::MatrixXd::Zero(cam.NumParams(), cam.NumParams());
+        for(const Eigen::Vector2d& p : pixels) {
+            const Eigen::Matrix<double,2,Eigen::Dynamic> J =
+                    cam.dProject_dparams(cam.Unproject(p));
+            H.noalias() += J.transpose() * J;
+        }
+        return H;
+    }
+
+    // log det(H + dH) - log det(H), regularised so that a first frame gains
+    // a finite amount
+    static double LogDetGain(const Eigen::MatrixXd& H, const Eigen::MatrixXd& dH)
+    {
+        const double lambda = 1e-6 * (1.0 + (H + dH).trace() / H.rows());
+        const Eigen::MatrixXd I = Eigen::MatrixXd::Identity(H.rows(), H.cols());
+        return LogDet(H + dH + lambda * I) - LogDet(H + lambda * I);
+    }
+
+    static double LogDet(const Eigen::MatrixXd& A)
+    {
+        const Eigen::LLT<Eigen::MatrixXd> llt(A);
+        if(llt.info() != Eigen::Success) {
+            return -std::numeric_limits<double>::infinity();
+        }
+        return 2.0 * llt.matrixL().toDenseMatrix().diagonal().array().log().sum();
+    }
+
+    KeyframeOptions m_options;
+    std::vector<CameraState> m_cameras;
+    std::vector<Keyframe> m_keyframes;
+    size_t m_num_residuals;
+};
+
+/// The most recent frames of a capture within a frame and residual budget,
+/// for streaming every frame to a Calibrator with bounded memory: before
+/// adding a frame, pop and remove the oldest frames while Full(). 0 leaves
+/// a budget unbounded.
+class FrameRing
+{
+public:
+    FrameRing(size_t max_frames = 0, size_t max_residuals = 0) :
+        m_max_frames(max_frames), m_max_residuals(max_residuals),
+        m_num_residuals(0)
+    {
+    }
+
+    /// Whether a frame of num_residuals doesn't fit alongside the frames
+    /// held. Never true when empty, so that any frame can be added.
+    bool Full(size_t num_residuals) const
+    {
+        return !m_frames.empty() &&
+                ((m_max_frames && m_frames.size() + 1 > m_max_frames) ||
+                 (m_max_residuals && m_num_residuals + num_residuals > m_max_residuals));
+    }
+
+    /// Calibrator frame of the oldest frame, which leaves the ring
+    int PopOldest()
+    {
+        const Entry oldest = m_frames.front();
+        m_frames.pop_front();
+        m_num_residuals -= oldest.num_residuals;
+        return oldest.frame_id;
+    }
+
+    void Push(int frame_id, size_t num_residuals)
+    {
+        Entry e;
+        e.frame_id = frame_id;
+        e.num_residuals = num_residuals;
+        m_frames.push_back(e);
+        m_num_residuals += num_residuals;
+    }
+
+    size_t Size() const
+    {
+        return m_frames.size();
+    }
+
+    size_t NumResiduals() const
+    {
+        return m_num_residuals;
+    }
+
+protected:
+    struct Entry
+    {
+        int frame_id;
+        size_t num_residuals;
+    };
+
+    size_t m_max_frames;
+    size_t m_max_residuals;
+    std::deque<Entry> m_frames;
+    size_t m_num_residuals;
+};
+
+}
@@ -0,0 +1,265 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/arpg/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove,
+                      Gabe Sibley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <calibu/Platform.h>
+#include <calibu/cam/camera_model_registry.h>
+#include <calibu/calib/Calibrator.h>
+#include <calibu/target/ObservationStore.h>
+#include <calibu/utils/ParallelFor.h>
+
+namespace calibu {
+
+/// Options of CalibrateModels.
+struct ModelSelectionOptions
+{
+    ModelSelectionOptions() :
+        max_iterations(100),
+        fix_intrinsics(false),
+        outlier_culling(false)
+    {
+    }
+
+    int max_iterations;
+    bool fix_intrinsics;
+    /// Off by default: culling would let poor models discard the
+    /// observations they fit worst, and compare on different data
+    bool outlier_culling;
+};
+
+/// Calibration of the rig under one camera model.
+struct ModelHypothesis
+{
+    CameraModelId model;
+    std::vector<CameraAndPose> cameras;
+
+    bool converged;
+    double mse;
+    size_t num_residuals;
+    /// Parameters estimated: intrinsics, extrinsics and frame poses
+    size_t num_params;
+
+    /// Information criteria of the fit, lower being better
+    double aic;
+    double bic;
+};
+
+struct ModelSelectionResult
+{
+    std::vector<ModelHypothesis> hypotheses;
+    /// Hypothesis of lowest BIC among those which converged, or -1
+    int best;
+};
+
+/// Starting camera for the model visited by VisitCameraModel, see
+/// NewStartingCamera.
+struct StartingCameraFactory
+{
+    template<typename Tag>
+    std::shared_ptr<CameraInterface<double>> operator()(Tag) const
+    {
+        typedef typename Tag::template Camera<double> Model;
+        Eigen::VectorXd params = Eigen::VectorXd::Zero(Model::NumParams);
+        params.head<4>() << K(0,0), K(1,1), K(0,2), K(1,2);
+        if(Model::kModelId == CameraModelId::kFov) {
+            params[4] = 0.2;
+        }
+        Eigen::Vector2i image_size = size;
+        return std::make_shared<Model>(params, image_size);
+    }
+
+    const Eigen::Matrix3d& K;
+    const Eigen::Vector2i& size;
+};
+
+/// Camera of model id with the pinhole intrinsics of K, the remaining
+/// parameters zero, except for the FOV distortion which starts at 0.2 as
+/// in the calibration applications.
+inline std::shared_ptr<CameraInterface<double>> NewStartingCamera(
+        CameraModelId id, const Eigen::Matrix3d& K, const Eigen::Vector2i& size)
+{
+    return VisitCameraModel<std::shared_ptr<CameraInterface<double>>>(
+            id, StartingCameraFactory{K, size});
+}
+
+/// Add the observations of store to calibrator, one frame per frame id of
+/// the store starting at its stored pose if any, for cameras below
+/// num_cameras. Returns the number of observations added.
+inline size_t AddObservations(Calibrator& calibrator, const ObservationStore& store,
+                              size_t num_cameras)
+{
+    std::map<uint32_t, Sophus::SE3d, std::less<uint32_t>,
+             Eigen::aligned_allocator<std::pair<const uint32_t, Sophus::SE3d> > > poses;
+    for(size_t j=0; j<store.NumPoses(); ++j) {
+        poses[store.pose_frame[j]] = store.T_kw[j];
+    }
+
+    std::vector<Eigen::Vector3d> P_w;
+    std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > p_c;
+    std::map<uint32_t, int> frames;
+    size_t num_added = 0;
+    for(size_t begin=0; begin < store.Size(); ) {
+        // Run of observations of one camera in one frame
+        size_t end = begin;
+        P_w.clear();
+        p_c.clear();
+        for(; end < store.Size() && store.frame[end] == store.frame[begin] &&
+              store.camera[end] == store.camera[begin]; ++end) {
+            P_w.push_back(store.Point(end));
+            p_c.push_back(store.Pixel(end));
+        }
+
+        const uint32_t frame_id = store.frame[begin];
+        const size_t camera = store.camera[begin];
+        begin = end;
+        if(camera >= num_cameras) {
+            continue;
+        }
+
+        std::map<uint32_t, int>::const_iterator frame = frames.find(frame_id);
+        if(frame == frames.end()) {
+            const auto pose = poses.find(frame_id);
+            const int calib_frame = calibrator.AddFrame(pose != poses.end() ? pose->second :
+                    Sophus::SE3d(Sophus::SO3d(), Eigen::Vector3d(0,0,1000)));
+            frame = frames.insert(std::make_pair(frame_id, calib_frame)).first;
+        }
+        calibrator.AddObservations(frame->second, camera, P_w, p_c);
+        num_added += P_w.size();
+    }
+    return num_added;
+}
+
+/// Calibrate the rig of starting cameras over the observations of store
+/// once per model of models, every camera being given that model with the
+/// pinhole intrinsics and extrinsics of its starting camera. Hypotheses are
+/// solved concurrently through exec, by default one thread each, so that
+/// the whole takes as long as the slowest model. Each is scored with
+/// AIC = n log(mse) + 2k and BIC = n log(mse) + k log(n), for n residuals
+/// and k parameters, mse being the robust cost of the solver.
+inline ModelSelectionResult CalibrateModels(
+        const ObservationStore& store,
+        const std::vector<CameraAndPose>& starting_cameras,
+        const std::vector<CameraModelId>& models,
+        const ModelSelectionOptions& options = ModelSelectionOptions(),
+        const Executor& exec = Executor())
+{
+    ModelSelectionResult result;
+    result.hypotheses.resize(models.size());
+    result.best = -1;
+
+    const size_t num_cameras = starting_cameras.size();
+    const std::function<void(size_t)> solve = [&](size_t h) {
+        ModelHypothesis& hypothesis = result.hypotheses[h];
+        hypothesis.model = models[h];
+        hypothesis.converged = false;
+        hypothesis.mse = 0;
+        hypothesis.num_residuals = 0;
+        hypothesis.num_params = 0;
+        hypothesis.aic = std::numeric_limits<double>::infinity();
+        hypothesis.bic = std::numeric_limits<double>::infinity();
+
+        Calibrator calibrator;
+        calibrator.FixCameraIntrinsics(options.fix_intrinsics);
+        OutlierCullOptions cull_options;
+        cull_options.enabled = options.outlier_culling;
+        calibrator.SetOutlierCulling(cull_options);
+        // Hypotheses solve together: keep their progress off std::cout
+        calibrator.SetProgressCallback([](const CalibrationProgress&) {});
+
+        for(size_t c=0; c<num_cameras; ++c) {
+            const CameraInterface<double>& start = *starting_cameras[c].camera;
+            const Eigen::Vector2i size(start.Width(), start.Height());
+            calibrator.AddCamera(NewStartingCamera(models[h], start.K(), size),
+                                 starting_cameras[c].T_ck);
+        }
+        if(AddObservations(calibrator, store, num_cameras) == 0) {
+            return;
+        }
+
+        hypothesis.converged = calibrator.Solve(options.max_iterations);
+        hypothesis.mse = calibrator.MeanSquareError();
+        for(size_t c=0; c<num_cameras; ++c) {
+            hypothesis.cameras.push_back(calibrator.GetCamera(c));
+        }
+
+        // Observations left after culling, of 2 residuals each
+        for(size_t i=0; i<store.Size(); ++i) {
+            hypothesis.num_residuals += store.camera[i] < num_cameras ? 2 : 0;
+        }
+        hypothesis.num_residuals -= 2 * calibrator.NumCulled();
+
+        hypothesis.num_params = 6 * (num_cameras - 1) + 6 * calibrator.NumFrames();
+        if(!options.fix_intrinsics) {
+            for(size_t c=0; c<num_cameras; ++c) {
+                hypothesis.num_params += hypothesis.cameras[c].camera->NumParams();
+            }
+        }
+
+        const double n = hypothesis.num_residuals;
+        const double k = hypothesis.num_params;
+        if(n > 0 && hypothesis.mse > 0) {
+            hypothesis.aic = n * std::log(hypothesis.mse) + 2 * k;
+            hypothesis.bic = n * std::log(hypothesis.mse) + k * std::log(n);
+        }
+    };
+
+    if(exec) {
+        exec(models.size(), solve);
+    }else{
+        ParallelFor(models.size(), models.size(), solve);
+    }
+
+    for(size_t h=0; h<result.hypotheses.size(); ++h) {
+        const ModelHypothesis& hypothesis = result.hypotheses[h];
+        if(hypothesis.converged && (result.best < 0 ||
+           hypothesis.bic < result.hypotheses[result.best].bic)) {
+            result.best = h;
+        }
+    }
+    return result;
+}
+
+/// Print a table of the hypotheses of result, marking the best.
+inline void PrintModelSelection(const ModelSelectionResult& result)
+{
+    std::cout << "------------------------------------------" << std::endl;
+    for(size_t h=0; h<result.hypotheses.size(); ++h) {
+        const ModelHypothesis& hypothesis = result.hypotheses[h];
+        std::cout << ((int)h == result.best ? "* " : "  ")
+                  << std::setw(32) << std::left << CameraModelTypeName(hypothesis.model)
+                  << " mse: " << hypothesis.mse
+                  << "; params: " << hypothesis.num_params
+                  << "; AIC: " << hypothesis.aic
+                  << "; BIC: " << hypothesis.bic
+                  << (hypothesis.converged ? "" : " (not converged)") << std::endl;
+    }
+}
+
+}
@@ -0,0 +1,102 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove,
+                      Gabe Sibley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include <calibu/Platform.h>
+#include <calibu/cam/camera_crtp.h>
+
+// Binary rig files: the same content as a rig XML file (model id, params,
+// image size, RDF, T_rc, name, type, index, serial number and version of
+// each camera), stored as native doubles so that it reads back bit for bit
+// without parsing. Files are versioned and record the byte order of the
+// host that wrote them. Errors are reported to std::cerr.
+
+namespace calibu {
+
+/// Camera record of a binary rig, pointing into the buffer it was read from.
+struct BinaryRigCamera
+{
+    CameraModelId model;
+    int width, height;
+    int index, version;
+    uint64_t serialno;
+    const double* params;      ///< num_params values
+    uint32_t num_params;
+    const double* rdf;         ///< 3x3, column major
+    const double* T_rc;        ///< 3x4 [R|t], column major
+    const char* name;          ///< name_length chars, not terminated
+    uint32_t name_length;
+    const char* type;          ///< type_length chars, not terminated
+    uint32_t type_length;
+};
+
+/// Zero-copy view of a binary rig in memory, e.g. a memory mapped file.
+/// The buffer must be 8 byte aligned and outlive the view.
+CALIBU_EXPORT
+class BinaryRigView
+{
+public:
+    BinaryRigView() : data(NULL), size(0), num_cameras(0) {}
+
+    /// Check the header and every record of the size bytes at data. False,
+    /// with a message on std::cerr, if the buffer isn't a valid binary rig.
+    bool Open(const void* data, size_t size);
+
+    size_t NumCameras() const {
+        return num_cameras;
+    }
+
+    /// Record of camera c, in O(c) as records vary in length.
+    BinaryRigCamera Camera(size_t c) const;
+
+protected:
+    const unsigned char* data;
+    size_t size;
+    size_t num_cameras;
+};
+
+CALIBU_EXPORT
+void WriteBinaryRig(std::ostream& out, const std::shared_ptr<Rig<double>> rig);
+
+/// False if filename can't be written
+CALIBU_EXPORT
+bool WriteBinaryRig(const std::string& filename, const std::shared_ptr<Rig<double>> rig);
+
+/// Rig of the cameras of view, or NULL for an unknown camera model or a
+/// number of parameters other than the model's.
+CALIBU_EXPORT
+std::shared_ptr<Rig<double>> ReadBinaryRig(const BinaryRigView& view);
+
+/// Rig of the size bytes at data, or NULL if they aren't a valid binary rig.
+CALIBU_EXPORT
+std::shared_ptr<Rig<double>> ReadBinaryRig(const void* data, size_t size);
+
+/// Rig of filename, or NULL if it is missing or not a valid binary rig.
+CALIBU_EXPORT
+std::shared_ptr<Rig<double>> ReadBinaryRig(const std::string& filename);
+
+}
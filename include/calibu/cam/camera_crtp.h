@@ -29,6 +29,20 @@
 
 namespace calibu {
 
+/**
+ * Stable identifiers of the camera models, see camera_model_registry.h.
+ * Values are positions in CameraModels and must not be reordered.
+ */
+enum class CameraModelId {
+  kUnknown,
+  kLinear,
+  kFov,
+  kPoly2,
+  kPoly3,
+  kKB4,
+  kRational6
+};
+
 /*
   CameraInterface is the top-level mostly pure-virtual interface
   class all cameras must honor.
@@ -40,6 +54,8 @@ protected:
   typedef Eigen::Matrix<Scalar, 2, 1> Vec2t;
   typedef Eigen::Matrix<Scalar, 3, 1> Vec3t;
   typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> VecXt;
+  typedef Eigen::Matrix<Scalar, 2, Eigen::Dynamic> Mat2Xt;
+  typedef Eigen::Matrix<Scalar, 3, Eigen::Dynamic> Mat3Xt;
   typedef Sophus::SE3Group<Scalar> SE3t;
 
 public:
@@ -63,6 +79,27 @@ public:
   /** Project a world point into an image location. */
   virtual Vec2t Project(const Vec3t& ray) const = 0;
 
+  /**
+   * Unproject each column of pix into the same column of rays, which must
+   * have as many columns. Camera models implement this as a loop over their
+   * kernels, so there is one virtual call per batch rather than per point.
+   * Raw arrays can be passed through an Eigen::Map.
+   */
+  virtual void Unproject(const Eigen::Ref<const Mat2Xt>& pix,
+                         Eigen::Ref<Mat3Xt> rays) const {
+    for (int i = 0; i < pix.cols(); ++i) {
+      rays.col(i) = Unproject(Vec2t(pix.col(i)));
+    }
+  }
+
+  /** Project each column of rays into the same column of pix. */
+  virtual void Project(const Eigen::Ref<const Mat3Xt>& rays,
+                       Eigen::Ref<Mat2Xt> pix) const {
+    for (int i = 0; i < rays.cols(); ++i) {
+      pix.col(i) = Project(Vec3t(rays.col(i)));
+    }
+  }
+
   /** Derivative of the Project along a ray */
   virtual Eigen::Matrix<Scalar, 2, 3>
   dProject_dray(const Vec3t& ray) const = 0;
@@ -73,6 +110,11 @@ public:
   virtual Eigen::Matrix<Scalar, 3, Eigen::Dynamic>
   dUnproject_dparams(const Vec2t& pix) const = 0;
 
+  /** Model of the camera, kUnknown for models outside the registry. */
+  virtual CameraModelId ModelId() const {
+    return CameraModelId::kUnknown;
+  }
+
   /**
    * Project a point into a camera located at t_ba.
    *
@@ -108,6 +150,36 @@ public:
     return dtransfer3d_dray;
   }
 
+  /**
+   * Transfer3d of each column of rays, with inverse depth the same entry of
+   * rho, into the same column of pix. The rotation of t_ba is converted to a
+   * matrix once and the points are projected in a single batch call.
+   *
+   * @param dpix_dray If not null, resized to 2 x 4N and filled with
+   * dTransfer3d_dray of ray i in columns 4i to 4i + 3.
+   */
+  void Transfer3d(const SE3t& t_ba,
+                  const Eigen::Ref<const Mat3Xt>& rays,
+                  const Eigen::Ref<const VecXt>& rho,
+                  Eigen::Ref<Mat2Xt> pix,
+                  Mat2Xt* dpix_dray = nullptr) const {
+    const Eigen::Matrix<Scalar, 3, 3> rot_matrix = t_ba.rotationMatrix();
+    const Vec3t translation = t_ba.translation();
+    Mat3Xt rays_b = rot_matrix * rays;
+    rays_b.noalias() += translation * rho.transpose();
+    Project(rays_b, pix);
+
+    if (dpix_dray) {
+      dpix_dray->resize(2, 4 * rays.cols());
+      for (int i = 0; i < rays.cols(); ++i) {
+        const Eigen::Matrix<Scalar, 2, 3> dproject_dray =
+                        dProject_dray(Vec3t(rays_b.col(i)));
+        dpix_dray->template middleCols<3>(4 * i) = dproject_dray * rot_matrix;
+        dpix_dray->col(4 * i + 3) = dproject_dray * translation;
+      }
+    }
+  }
+
   Eigen::Matrix<Scalar, 2, Eigen::Dynamic> dTransfer_dparams(
                   const SE3t& t_ba,
                   const Vec2t& pix,
@@ -136,12 +208,12 @@ public:
 
   /// Metadata member functions from CameraModelInterface.h (non-CRTP).
   /// Returns the camera intrinsics & parameters.
-  const Eigen::VectorXd& GetParams() const {
+  const VecXt& GetParams() const {
     return params_;
   }
 
   // Why are there const & non-const versions?
-  Eigen::VectorXd& GetParams() {
+  VecXt& GetParams() {
     return params_;
   }
 
@@ -236,7 +308,7 @@ public:
 
   /// Set generic camera intrinsics and parameters.
   void SetParams( const Eigen::VectorXd params ) {
-    params_ = params;
+    params_ = params.template cast<Scalar>();
   }
 
   /// Set the pose of the camera (typically in the "rig" frame).
@@ -259,13 +331,14 @@ protected:
   /// Direct input of parameters and image size to create a camera inteface.
   CameraInterface(const Eigen::VectorXd& params_in,
                   const Eigen::Vector2i& image_size)
-          : image_size_(image_size), params_(params_in) {
+          : image_size_(image_size), params_(params_in.template cast<Scalar>()) {
   }
 
   Eigen::Vector2i image_size_;
 
-  /// All the camera parameters (fu, fv, u0, v0, ...distortion).
-  Eigen::VectorXd params_;
+  /// All the camera parameters (fu, fv, u0, v0, ...distortion), stored at
+  /// the precision of the camera.
+  VecXt params_;
 
 
   /// Protected data structures for CameraInterface.
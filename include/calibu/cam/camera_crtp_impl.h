@@ -22,7 +22,9 @@
   limitations under the License.
 */
 #pragma once
+#include <type_traits>
 #include <calibu/cam/camera_crtp.h>
+#include <calibu/cam/camera_packet.h>
 
 /**
  * Avoids copying inherited function implementations for all camera models.
@@ -35,16 +37,24 @@
  * - static void dProject_dray(const T* ray, const T* params, T* j) {
  * - static void dProject_dparams(const T* ray, const T* params, T* j)
  * - static void dUnproject_dparams(const T* pix, const T* params, T* j)
+ * - static constexpr CameraModelId kModelId and static const char* TypeName()
+ *
+ * Models whose Project and Unproject kernels are free of branches on T may
+ * set kPacketKernels, so that the batch calls run them on Packets of
+ * CameraPacketSize<Scalar> points at a time.
  */
 namespace calibu {
 template <typename Scalar, int ParamSize, typename Derived>
 class CameraImpl : public CameraInterface<Scalar> {
   typedef typename CameraInterface<Scalar>::Vec2t Vec2t;
   typedef typename CameraInterface<Scalar>::Vec3t Vec3t;
+  typedef typename CameraInterface<Scalar>::Mat2Xt Mat2Xt;
+  typedef typename CameraInterface<Scalar>::Mat3Xt Mat3Xt;
   typedef typename CameraInterface<Scalar>::SE3t SE3t;
 
  public:
   static constexpr int kParamSize = ParamSize;
+  static constexpr bool kPacketKernels = false;
 
   CameraImpl() {}
   virtual ~CameraImpl() {}
@@ -95,6 +105,30 @@ class CameraImpl : public CameraInterface<Scalar> {
     return pix;
   }
 
+  void
+  Unproject(const Eigen::Ref<const Mat2Xt>& pix,
+            Eigen::Ref<Mat3Xt> rays) const override {
+    int i = 0;
+    UnprojectPackets(pix, rays, i,
+                     std::integral_constant<bool, Derived::kPacketKernels>());
+    const Scalar* params = this->params_.data();
+    for (; i < pix.cols(); ++i) {
+      Derived::Unproject(pix.col(i).data(), params, rays.col(i).data());
+    }
+  }
+
+  void
+  Project(const Eigen::Ref<const Mat3Xt>& rays,
+          Eigen::Ref<Mat2Xt> pix) const override {
+    int i = 0;
+    ProjectPackets(rays, pix, i,
+                   std::integral_constant<bool, Derived::kPacketKernels>());
+    const Scalar* params = this->params_.data();
+    for (; i < rays.cols(); ++i) {
+      Derived::Project(rays.col(i).data(), params, pix.col(i).data());
+    }
+  }
+
   Eigen::Matrix<Scalar, 2, Eigen::Dynamic>
   dProject_dparams(const Vec3t& ray) const override {
     Eigen::Matrix<Scalar, 2, kParamSize> j;
@@ -109,11 +143,74 @@ class CameraImpl : public CameraInterface<Scalar> {
     return j;
   }
 
+  CameraModelId
+  ModelId() const override {
+    return Derived::kModelId;
+  }
+
   Eigen::Matrix<Scalar, 2, 3>
   dProject_dray(const Vec3t& ray) const override {
     Eigen::Matrix<Scalar, 2, 3> j;
     Derived::dProject_dray(ray.data(), this->params_.data(), j.data());
     return j;
   }
+
+ protected:
+  static constexpr int kPacketSize = CameraPacketSize<Scalar>::value;
+  typedef packet::Packet<Scalar, kPacketSize> PacketT;
+
+  // Whole packets of points, advancing i past them. The remainder is left
+  // to the scalar kernels.
+  void
+  UnprojectPackets(const Eigen::Ref<const Mat2Xt>&, Eigen::Ref<Mat3Xt>,
+                   int&, std::false_type) const {
+  }
+
+  void
+  UnprojectPackets(const Eigen::Ref<const Mat2Xt>& pix, Eigen::Ref<Mat3Xt> rays,
+                   int& i, std::true_type) const {
+    PacketT params[ParamSize];
+    for (int k = 0; k < ParamSize; ++k) params[k] = PacketT(this->params_[k]);
+
+    for (; i + kPacketSize <= pix.cols(); i += kPacketSize) {
+      PacketT p[2], r[3];
+      for (int l = 0; l < kPacketSize; ++l) {
+        p[0][l] = pix(0, i + l);
+        p[1][l] = pix(1, i + l);
+      }
+      Derived::Unproject(p, params, r);
+      for (int l = 0; l < kPacketSize; ++l) {
+        rays(0, i + l) = r[0][l];
+        rays(1, i + l) = r[1][l];
+        rays(2, i + l) = r[2][l];
+      }
+    }
+  }
+
+  void
+  ProjectPackets(const Eigen::Ref<const Mat3Xt>&, Eigen::Ref<Mat2Xt>,
+                 int&, std::false_type) const {
+  }
+
+  void
+  ProjectPackets(const Eigen::Ref<const Mat3Xt>& rays, Eigen::Ref<Mat2Xt> pix,
+                 int& i, std::true_type) const {
+    PacketT params[ParamSize];
+    for (int k = 0; k < ParamSize; ++k) params[k] = PacketT(this->params_[k]);
+
+    for (; i + kPacketSize <= rays.cols(); i += kPacketSize) {
+      PacketT r[3], p[2];
+      for (int l = 0; l < kPacketSize; ++l) {
+        r[0][l] = rays(0, i + l);
+        r[1][l] = rays(1, i + l);
+        r[2][l] = rays(2, i + l);
+      }
+      Derived::Project(r, params, p);
+      for (int l = 0; l < kPacketSize; ++l) {
+        pix(0, i + l) = p[0][l];
+        pix(1, i + l) = p[1][l];
+      }
+    }
+  }
 }; // public CameraInterface<Scalar>
 }  // namespace calibu
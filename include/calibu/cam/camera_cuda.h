@@ -0,0 +1,99 @@
+/*
+  This file is part of the Calibu Project.
+  https://github.com/arpg/Calibu
+
+  Copyright (C) 2013 George Washington University,
+  Copyright (C) 2015 University of Colorado,
+  Steven Lovegrove,
+  Nima Keivan,
+  Christoffer Heckman,
+  Gabe Sibley
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#pragma once
+
+#include <calibu/Platform.h>
+
+#ifndef CALIBU_WITH_CUDA
+#  error "Calibu was built without CUDA, configure with -DBUILD_CUDA=ON"
+#endif
+
+#include <vector>
+#include <cuda_runtime_api.h>
+#include <calibu/cam/camera_crtp.h>
+
+namespace calibu {
+namespace cuda {
+
+/** Model and intrinsics of one camera, passed to the kernels by value. */
+template<typename Scalar>
+struct DeviceCamera {
+  static constexpr int kMaxParams = 16;
+
+  CameraModelId model;
+  int width;
+  int height;
+  Scalar params[kMaxParams];
+};
+
+/**
+ * The cameras of a Rig for the CUDA backend, which runs the models'
+ * Project and Unproject kernels as device functions over buffers in device
+ * memory. Points are stored interleaved: x, y for pixels and x, y, z for
+ * rays. Only the intrinsics are copied, so Update() must be called after
+ * they change. Cameras outside CameraModels are rejected by the calls
+ * below with cudaErrorInvalidValue.
+ *
+ * Calls are asynchronous on stream; the returned error is that of the
+ * kernel launch.
+ */
+template<typename Scalar>
+class CALIBU_EXPORT DeviceRig {
+ public:
+  DeviceRig() {}
+  explicit DeviceRig(const Rig<Scalar>& rig);
+
+  /** Re-read the models and intrinsics of rig. */
+  void Update(const Rig<Scalar>& rig);
+
+  size_t NumCams() const {
+    return cameras_.size();
+  }
+
+  const DeviceCamera<Scalar>& Camera(size_t cam) const {
+    return cameras_[cam];
+  }
+
+  /** Unproject n pixels, d_pix holding 2n Scalars, into 3n Scalars of d_rays. */
+  cudaError_t Unproject(size_t cam, const Scalar* d_pix, Scalar* d_rays,
+                        int n, cudaStream_t stream = 0) const;
+
+  /** Project n rays, d_rays holding 3n Scalars, into 2n Scalars of d_pix. */
+  cudaError_t Project(size_t cam, const Scalar* d_rays, Scalar* d_pix,
+                      int n, cudaStream_t stream = 0) const;
+
+  /**
+   * Back-project a row major depth image the size of the camera: point i of
+   * d_points is depth i times the ray of pixel i, scaled so that z = depth.
+   * Pixels of depth 0 or NaN give NaN points.
+   */
+  cudaError_t UnprojectDepth(size_t cam, const float* d_depth,
+                             Scalar* d_points, cudaStream_t stream = 0) const;
+
+ protected:
+  std::vector<DeviceCamera<Scalar>> cameras_;
+};
+
+}  // namespace cuda
+}  // namespace calibu
@@ -0,0 +1,221 @@
+/*
+  This file is part of the Calibu Project.
+  https://github.com/arpg/Calibu
+
+  Copyright (C) 2013 George Washington University,
+  Copyright (C) 2015 University of Colorado,
+  Steven Lovegrove,
+  Nima Keivan,
+  Christoffer Heckman,
+  Gabe Sibley
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <calibu/cam/camera_crtp.h>
+#include <calibu/cam/camera_models_poly.h>
+#include <calibu/cam/camera_models_kb4.h>
+
+namespace calibu {
+
+/**
+ * Camera model whose Unproject inverts the radial distortion with Newton's
+ * method on rd(u) - rd, stopping as soon as the residual is within
+ * Tolerance(), instead of the model's fixed iteration count. Iteration starts
+ * from an odd polynomial in rd fitted to the inverse over the image, so that
+ * most pixels need one step or none.
+ *
+ * Models provide DistortRadius and RayFromRadius (Poly2, Poly3, KB4). With
+ * the default tolerance of 1e-12 in normalised coordinates, rays reproject
+ * to within 1e-9 * focal length pixels of the input. Pixels for which Newton
+ * has not converged after kMaxIterations use the model's own Unproject.
+ *
+ * The fit is redone by SetParams(), Scale() and UpdateInverse(). If the
+ * parameters or image size are changed any other way, e.g. through a
+ * CameraInterface pointer, the model's own Unproject is used until
+ * UpdateInverse() is called.
+ *
+ * Usage: FittedInverseCamera<Poly3Camera> cam(params, size);
+ */
+template<template<typename> class Model, typename Scalar = double>
+class FittedInverseCamera : public Model<Scalar> {
+  typedef Model<Scalar> Base;
+  // The models' static kernels hide the CameraImpl members of the same name
+  typedef CameraImpl<Scalar, Base::kParamSize, Base> Impl;
+  typedef Eigen::Matrix<Scalar, 2, 1> Vec2t;
+  typedef Eigen::Matrix<Scalar, 3, 1> Vec3t;
+  typedef Eigen::Matrix<Scalar, 2, Eigen::Dynamic> Mat2Xt;
+  typedef Eigen::Matrix<Scalar, 3, Eigen::Dynamic> Mat3Xt;
+
+ public:
+  static constexpr int kInverseDegree = 4;
+  static constexpr int kFitSamples = 64;
+  static constexpr int kMaxIterations = 10;
+
+  FittedInverseCamera(const Eigen::VectorXd& params, Eigen::Vector2i& image_size)
+      : Base(params, image_size), tolerance_(1e-12) {
+    UpdateInverse();
+  }
+
+  /** Copy of cam, including its pose and metadata. */
+  explicit FittedInverseCamera(const Base& cam)
+      : Base(cam), tolerance_(1e-12) {
+    // The CameraInterface copy constructor only copies the intrinsics
+    this->SetPose(cam.Pose());
+    this->SetRDF(cam.RDF());
+    this->SetName(cam.Name());
+    this->SetSerialNumber(cam.SerialNumber());
+    this->SetIndex(cam.Index());
+    this->SetVersion(cam.Version());
+    this->SetType(cam.Type());
+    UpdateInverse();
+  }
+
+  /** Fit the initial guess to the current parameters and image size. */
+  void UpdateInverse() {
+    fit_params_ = this->params_;
+    fit_size_ = this->image_size_;
+    const Scalar* p = this->params_.data();
+
+    // Largest distorted radius in the image, at one of the corners
+    Scalar rd_max = 0;
+    for (int c = 0; c < 4; ++c) {
+      const Scalar corner[2] = { Scalar((c & 1) ? this->Width() : 0),
+                                 Scalar((c & 2) ? this->Height() : 0) };
+      Scalar corner_kinv[2];
+      CameraUtils::MultInvK(p, corner, corner_kinv);
+      rd_max = std::max(rd_max, CameraUtils::PixNorm(corner_kinv));
+    }
+
+    // Sample the forward model from the centre out to the corners, or to
+    // where the distortion stops being monotonic.
+    std::vector<Scalar> rd, u;
+    const Scalar step = rd_max / kFitSamples;
+    Scalar d_du = 1;
+    for (int i = 1; i <= 4 * kFitSamples; ++i) {
+      const Scalar ui = i * step;
+      const Scalar rdi = Base::DistortRadius(ui, p, &d_du);
+      if (d_du <= 0 || (!rd.empty() && rdi <= rd.back())) break;
+      rd.push_back(rdi);
+      u.push_back(ui);
+      if (rdi >= rd_max) break;
+    }
+
+    // u / rd - 1 as a polynomial in rd^2
+    inverse_.setZero();
+    if ((int)rd.size() > kInverseDegree) {
+      Eigen::Matrix<Scalar, Eigen::Dynamic, kInverseDegree> a(rd.size(), kInverseDegree);
+      Eigen::Matrix<Scalar, Eigen::Dynamic, 1> b(rd.size());
+      for (size_t i = 0; i < rd.size(); ++i) {
+        const Scalar rd2 = rd[i] * rd[i];
+        Scalar pow = rd2;
+        for (int k = 0; k < kInverseDegree; ++k, pow *= rd2) a(i, k) = pow;
+        b[i] = u[i] / rd[i] - 1;
+      }
+      inverse_ = a.householderQr().solve(b);
+    }
+  }
+
+  void SetParams(const Eigen::VectorXd params) {
+    Impl::SetParams(params);
+    UpdateInverse();
+  }
+
+  void Scale(const Scalar& s) override {
+    Impl::Scale(s);
+    UpdateInverse();
+  }
+
+  /** Largest residual of rd(u) - rd, in normalised coordinates. */
+  Scalar Tolerance() const {
+    return tolerance_;
+  }
+
+  void SetTolerance(const Scalar tolerance) {
+    tolerance_ = tolerance;
+  }
+
+  Vec3t Unproject(const Vec2t& pix) const override {
+    Vec3t ray;
+    if (!IsFitValid() || !UnprojectFitted(pix.data(), ray.data())) {
+      return Impl::Unproject(pix);
+    }
+    return ray;
+  }
+
+  void Unproject(const Eigen::Ref<const Mat2Xt>& pix,
+                 Eigen::Ref<Mat3Xt> rays) const override {
+    if (!IsFitValid()) {
+      Impl::Unproject(pix, rays);
+      return;
+    }
+    for (int i = 0; i < pix.cols(); ++i) {
+      const Vec2t p = pix.col(i);
+      Vec3t ray;
+      if (UnprojectFitted(p.data(), ray.data())) {
+        rays.col(i) = ray;
+      } else {
+        rays.col(i) = Impl::Unproject(p);
+      }
+    }
+  }
+
+  // Keep the batch Project visible next to the per point one
+  using Impl::Project;
+
+ protected:
+  bool IsFitValid() const {
+    return fit_size_ == this->image_size_ &&
+        fit_params_.size() == this->params_.size() &&
+        fit_params_ == this->params_;
+  }
+
+  // False if Newton did not converge.
+  bool UnprojectFitted(const Scalar* pix, Scalar* ray) const {
+    const Scalar* p = this->params_.data();
+    Scalar pix_kinv[2];
+    CameraUtils::MultInvK(p, pix, pix_kinv);
+    const Scalar rd = CameraUtils::PixNorm(pix_kinv);
+
+    const Scalar rd2 = rd * rd;
+    Scalar seed = 0;
+    for (int k = kInverseDegree - 1; k >= 0; --k) seed = (seed + inverse_[k]) * rd2;
+    Scalar u = rd * (1 + seed);
+
+    for (int i = 0; i <= kMaxIterations; ++i) {
+      Scalar d_du;
+      const Scalar err = Base::DistortRadius(u, p, &d_du) - rd;
+      if (std::abs(err) <= tolerance_) {
+        Base::RayFromRadius(pix_kinv, rd, u, ray);
+        return true;
+      }
+      if (i == kMaxIterations || !(d_du > 0)) break;
+      u -= err / d_du;
+    }
+    return false;
+  }
+
+  Scalar tolerance_;
+
+  // Coefficients of rd^2, rd^4, ... in u / rd - 1
+  Eigen::Matrix<Scalar, kInverseDegree, 1> inverse_;
+
+  // Parameters and image size the fit was made for
+  Eigen::Matrix<Scalar, Eigen::Dynamic, 1> fit_params_;
+  Eigen::Vector2i fit_size_;
+};
+
+}  // namespace calibu
@@ -0,0 +1,224 @@
+/*
+  This file is part of the Calibu Project.
+  https://github.com/arpg/Calibu
+
+  Copyright (C) 2013 George Washington University,
+  Copyright (C) 2015 University of Colorado,
+  Steven Lovegrove,
+  Nima Keivan,
+  Christoffer Heckman,
+  Gabe Sibley
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#pragma once
+#include <memory>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <calibu/cam/camera_crtp.h>
+#include <calibu/cam/camera_model_registry.h>
+
+namespace calibu {
+
+/**
+ * Non virtual view of a camera of the concrete CRTP type Model, calling its
+ * static kernels directly so that they inline into the caller. Valid while
+ * the camera is alive and its parameters are not resized.
+ */
+template<typename Model>
+class CameraModelView {
+ public:
+  typedef typename std::remove_reference<
+      decltype(std::declval<Model>().GetParams()[0])>::type Scalar;
+  typedef Eigen::Matrix<Scalar, 2, 1> Vec2t;
+  typedef Eigen::Matrix<Scalar, 3, 1> Vec3t;
+  typedef Sophus::SE3Group<Scalar> SE3t;
+
+  explicit CameraModelView(const Model& cam)
+      : cam_(cam), params_(cam.GetParams().data()) {}
+
+  const Model& Camera() const {
+    return cam_;
+  }
+
+  int Width() const {
+    return cam_.Width();
+  }
+
+  int Height() const {
+    return cam_.Height();
+  }
+
+  Vec3t Unproject(const Vec2t& pix) const {
+    Vec3t ray;
+    Model::Unproject(pix.data(), params_, ray.data());
+    return ray;
+  }
+
+  Vec2t Project(const Vec3t& ray) const {
+    Vec2t pix;
+    Model::Project(ray.data(), params_, pix.data());
+    return pix;
+  }
+
+  Eigen::Matrix<Scalar, 2, 3> dProject_dray(const Vec3t& ray) const {
+    Eigen::Matrix<Scalar, 2, 3> j;
+    Model::dProject_dray(ray.data(), params_, j.data());
+    return j;
+  }
+
+  /** As CameraInterface::Transfer3d. */
+  Vec2t Transfer3d(const SE3t& t_ba, const Vec3t& ray, const Scalar rho) const {
+    return Project(Vec3t(t_ba.rotationMatrix() * ray + rho * t_ba.translation()));
+  }
+
+ protected:
+  const Model& cam_;
+  const Scalar* params_;
+};
+
+/**
+ * The same interface as CameraModelView through the virtual calls of
+ * CameraInterface, for cameras of no known model.
+ */
+template<typename Scalar>
+class CameraInterfaceView {
+ public:
+  typedef Eigen::Matrix<Scalar, 2, 1> Vec2t;
+  typedef Eigen::Matrix<Scalar, 3, 1> Vec3t;
+  typedef Sophus::SE3Group<Scalar> SE3t;
+
+  explicit CameraInterfaceView(const CameraInterface<Scalar>& cam)
+      : cam_(cam) {}
+
+  const CameraInterface<Scalar>& Camera() const {
+    return cam_;
+  }
+
+  int Width() const {
+    return cam_.Width();
+  }
+
+  int Height() const {
+    return cam_.Height();
+  }
+
+  Vec3t Unproject(const Vec2t& pix) const {
+    return cam_.Unproject(pix);
+  }
+
+  Vec2t Project(const Vec3t& ray) const {
+    return cam_.Project(ray);
+  }
+
+  Eigen::Matrix<Scalar, 2, 3> dProject_dray(const Vec3t& ray) const {
+    return cam_.dProject_dray(ray);
+  }
+
+  Vec2t Transfer3d(const SE3t& t_ba, const Vec3t& ray, const Scalar rho) const {
+    return cam_.Transfer3d(t_ba, ray, rho);
+  }
+
+ protected:
+  const CameraInterface<Scalar>& cam_;
+};
+
+/**
+ * Value type handle on a camera which resolves its model once, on
+ * construction, so that loops over points can run without virtual calls.
+ * Visit(f) calls f with a CameraModelView of the concrete model, or a
+ * CameraInterfaceView if the camera is not exactly one of CameraModels. f is
+ * usually a functor with a templated operator(), instantiated and inlined
+ * per model:
+ *
+ *   struct SumProjected {
+ *     template<typename View> Eigen::Vector2d operator()(const View& cam) const {
+ *       Eigen::Vector2d sum = Eigen::Vector2d::Zero();
+ *       for (const auto& P : points) sum += cam.Project(P);
+ *       return sum;
+ *     }
+ *     const std::vector<Eigen::Vector3d, ...>& points;
+ *   };
+ *   CameraHandle<double>(cam).Visit(SumProjected{points});
+ *
+ * Every instantiation of operator() must return the same type.
+ */
+template<typename Scalar = double>
+class CameraHandle {
+ public:
+  CameraHandle() : id_(CameraModelId::kUnknown) {}
+
+  CameraHandle(const std::shared_ptr<CameraInterface<Scalar>>& cam)
+      : cam_(cam), id_(Identify(cam.get())) {}
+
+  CameraModelId Model() const {
+    return id_;
+  }
+
+  const std::shared_ptr<CameraInterface<Scalar>>& Camera() const {
+    return cam_;
+  }
+
+  explicit operator bool() const {
+    return (bool)cam_;
+  }
+
+  /** Calls f with a view of the camera, which must not be null. */
+  template<typename F>
+  typename std::result_of<F(const CameraInterfaceView<Scalar>&)>::type
+  Visit(F&& f) const {
+    typedef typename std::result_of<F(const CameraInterfaceView<Scalar>&)>::type R;
+    if (id_ == CameraModelId::kUnknown) {
+      return f(CameraInterfaceView<Scalar>(*cam_));
+    }
+    return VisitCameraModel<R>(id_, ViewVisitor<F>{*cam_, f});
+  }
+
+  static CameraModelId Identify(const CameraInterface<Scalar>* cam) {
+    if (!cam || cam->ModelId() == CameraModelId::kUnknown) {
+      return CameraModelId::kUnknown;
+    }
+    // Exact types only: derived classes may override the kernels' behaviour
+    return VisitCameraModel<bool>(cam->ModelId(), IsExactly{typeid(*cam)}) ?
+        cam->ModelId() : CameraModelId::kUnknown;
+  }
+
+ protected:
+  template<typename F>
+  struct ViewVisitor {
+    template<typename Tag>
+    typename std::result_of<F(const CameraInterfaceView<Scalar>&)>::type
+    operator()(Tag) const {
+      typedef typename Tag::template Camera<Scalar> M;
+      return f(CameraModelView<M>(static_cast<const M&>(cam)));
+    }
+
+    const CameraInterface<Scalar>& cam;
+    F& f;
+  };
+
+  struct IsExactly {
+    template<typename Tag>
+    bool operator()(Tag) const {
+      return type == typeid(typename Tag::template Camera<Scalar>);
+    }
+
+    const std::type_info& type;
+  };
+
+  std::shared_ptr<CameraInterface<Scalar>> cam_;
+  CameraModelId id_;
+};
+
+}  // namespace calibu
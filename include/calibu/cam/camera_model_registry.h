@@ -0,0 +1,138 @@
+/*
+  This file is part of the Calibu Project.
+  https://github.com/arpg/Calibu
+
+  Copyright (C) 2013 George Washington University,
+  Copyright (C) 2015 University of Colorado,
+  Steven Lovegrove,
+  Nima Keivan,
+  Christoffer Heckman,
+  Gabe Sibley
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#pragma once
+#include <stdexcept>
+#include <string>
+#include <calibu/cam/camera_crtp.h>
+#include <calibu/cam/camera_models_crtp.h>
+
+/**
+ * Compile time list of the camera models. Dispatch on a CameraModelId, for
+ * cost functions, XML I/O or kernels, goes through tables generated from
+ * CameraModels, so adding a model means giving it a kModelId and TypeName()
+ * and appending it here.
+ */
+namespace calibu {
+
+template<template<typename> class... Models>
+struct CameraModelList {
+  static constexpr int kSize = sizeof...(Models);
+};
+
+typedef CameraModelList<LinearCamera,
+                        FovCamera,
+                        Poly2Camera,
+                        Poly3Camera,
+                        KannalaBrandtCamera,
+                        Rational6Camera> CameraModels;
+
+/** Passed to model visitors, which template operator() on Model. */
+template<template<typename> class Model>
+struct CameraModelTag {
+  template<typename Scalar>
+  using Camera = Model<Scalar>;
+};
+
+namespace internal {
+
+// Checks that list position i + 1 holds the model with id i + 1
+template<int I, template<typename> class... Models>
+struct ModelIdsMatchPositions {
+  static constexpr bool value = true;
+};
+
+template<int I, template<typename> class M, template<typename> class... Rest>
+struct ModelIdsMatchPositions<I, M, Rest...> {
+  static constexpr bool value = (int)M<double>::kModelId == I &&
+      ModelIdsMatchPositions<I + 1, Rest...>::value;
+};
+
+template<typename R, typename F, template<typename> class Model>
+R InvokeWithModel(F& f) {
+  return f(CameraModelTag<Model>());
+}
+
+template<typename R, typename F, typename List>
+struct ModelDispatchTable;
+
+template<typename R, typename F, template<typename> class... Models>
+struct ModelDispatchTable<R, F, CameraModelList<Models...>> {
+  static_assert(ModelIdsMatchPositions<1, Models...>::value,
+                "CameraModels must be ordered by CameraModelId");
+
+  static R Call(CameraModelId id, F& f) {
+    typedef R (*Fn)(F&);
+    static const Fn table[] = { &InvokeWithModel<R, F, Models>... };
+    const int i = (int)id - 1;
+    if (i < 0 || i >= (int)sizeof...(Models)) {
+      throw std::invalid_argument("Unknown camera model.");
+    }
+    return table[i](f);
+  }
+};
+
+template<typename List>
+struct ModelTypeNames;
+
+template<template<typename> class... Models>
+struct ModelTypeNames<CameraModelList<Models...>> {
+  static const char* const* Names() {
+    static const char* const names[] = { Models<double>::TypeName()... };
+    return names;
+  }
+};
+
+}  // namespace internal
+
+/**
+ * f(CameraModelTag<Model>()) for the model with the given id, through a
+ * table indexed by id. Throws std::invalid_argument for kUnknown.
+ */
+template<typename R, typename F>
+inline R VisitCameraModel(CameraModelId id, F&& f) {
+  typedef typename std::remove_reference<F>::type FunctorT;
+  return internal::ModelDispatchTable<R, FunctorT, CameraModels>::Call(id, f);
+}
+
+/** Type string used for the model in camera XML files. */
+inline std::string CameraModelTypeName(CameraModelId id) {
+  const int i = (int)id - 1;
+  if (i < 0 || i >= CameraModels::kSize) {
+    return "";
+  }
+  return internal::ModelTypeNames<CameraModels>::Names()[i];
+}
+
+/** Model with the given XML type string, kUnknown if there is none. */
+inline CameraModelId CameraModelIdFromTypeName(const std::string& type) {
+  const char* const* names = internal::ModelTypeNames<CameraModels>::Names();
+  for (int i = 0; i < CameraModels::kSize; ++i) {
+    if (type == names[i]) {
+      return (CameraModelId)(i + 1);
+    }
+  }
+  return CameraModelId::kUnknown;
+}
+
+}  // namespace calibu
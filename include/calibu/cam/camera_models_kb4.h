@@ -43,9 +43,12 @@ class KannalaBrandtCamera : public CameraImpl<Scalar, 8, KannalaBrandtCamera<Sca
   using Base::Base;
 
   static constexpr int NumParams = 8;
+  static constexpr CameraModelId kModelId = CameraModelId::kKB4;
+  static const char* TypeName() { return "calibu_fu_fv_u0_v0_kb4"; }
+  static constexpr bool kPacketKernels = true;
 
   template<typename T>
-  static void Scale( const double s, T* params ) {
+  CALIBU_HOST_DEVICE static void Scale( const double s, T* params ) {
     CameraUtils::Scale( s, params );
   }
 
@@ -53,12 +56,35 @@ class KannalaBrandtCamera : public CameraImpl<Scalar, 8, KannalaBrandtCamera<Sca
   // and sy. If your camera model doesn't respect this ordering, then evaluating
   // K for it will result in an incorrect matrix.
   template<typename T>
-  static void K( const T* params , T* Kmat) {
+  CALIBU_HOST_DEVICE static void K( const T* params , T* Kmat) {
     CameraUtils::K( params , Kmat);
   }
 
+  // Distorted radius of the ray at angle th from the optical axis, in
+  // normalised image coordinates, and its derivative.
   template<typename T>
-  static void Unproject(const T* pix, const T* params, T* ray) {
+  CALIBU_HOST_DEVICE static T DistortRadius(const T th, const T* params, T* d_dth) {
+    const T th2 = th*th;
+    const T th4 = th2*th2;
+    const T th6 = th4*th2;
+    *d_dth = 1 + 3*params[4]*th2 + 5*params[5]*th4 + 7*params[6]*th6 +
+        9*params[7]*th6*th2;
+    return th*(1 + params[4]*th2 + params[5]*th4 + params[6]*th6 +
+               params[7]*th6*th2);
+  }
+
+  // Ray through the normalised point pix_kinv, of radius rd, at angle th
+  // from the optical axis.
+  template<typename T>
+  CALIBU_HOST_DEVICE static void RayFromRadius(const T* pix_kinv, const T rd, const T th, T* ray) {
+    const T s = rd > T(0) ? sin(th) / rd : T(0);
+    ray[0] = pix_kinv[0] * s;
+    ray[1] = pix_kinv[1] * s;
+    ray[2] = cos(th);
+  }
+
+  template<typename T>
+  CALIBU_HOST_DEVICE static void Unproject(const T* pix, const T* params, T* ray) {
 
     const T fu = params[0];
     const T fv = params[1];
@@ -99,7 +125,7 @@ class KannalaBrandtCamera : public CameraImpl<Scalar, 8, KannalaBrandtCamera<Sca
   }
 
   template<typename T>
-  static void Project(const T* ray, const T* params, T* pix) {
+  CALIBU_HOST_DEVICE static void Project(const T* ray, const T* params, T* pix) {
     const T fu = params[0];
     const T fv = params[1];
     const T u0 = params[2];
@@ -126,19 +152,75 @@ class KannalaBrandtCamera : public CameraImpl<Scalar, 8, KannalaBrandtCamera<Sca
   }
 
   template<typename T>
-  static void dProject_dparams(const T* ray, const T* params, T* j) {
-    T pix[2];
-    CameraUtils::Dehomogenize(ray, pix);
-    CameraUtils::dMultK_dparams(params, pix, j);
+  CALIBU_HOST_DEVICE static void dProject_dparams(const T* ray, const T* params, T* j) {
+    const T Xsq_plus_Ysq = ray[0]*ray[0]+ray[1]*ray[1];
+    const T theta = atan2( sqrt(Xsq_plus_Ysq), ray[2] );
+    const T psi = atan2( ray[1], ray[0] );
+    const T cos_psi = cos(psi);
+    const T sin_psi = sin(psi);
+
+    T dr_dth;
+    const T r = DistortRadius(theta, params, &dr_dth);
+
+    j[0] = r*cos_psi;  j[2] = 0;          j[4] = 1;  j[6] = 0;
+    j[1] = 0;          j[3] = r*sin_psi;  j[5] = 0;  j[7] = 1;
+
+    // Coefficient k of the distortion multiplies theta^(2k+3).
+    const T theta2 = theta*theta;
+    T theta_pow = theta2*theta;
+    for (int k = 0; k < 4; ++k, theta_pow *= theta2) {
+      j[8 + 2*k] = params[0]*theta_pow*cos_psi;
+      j[9 + 2*k] = params[1]*theta_pow*sin_psi;
+    }
   }
 
   template<typename T>
-  static void dUnproject_dparams(const T* pix, const T* params, T* j) {
+  CALIBU_HOST_DEVICE static void dUnproject_dparams(const T* pix, const T* params, T* j) {
+    T pix_kinv[2];
+    CameraUtils::MultInvK(params, pix, pix_kinv);
     CameraUtils::dMultInvK_dparams(params, pix, j);
+
+    // The ray is (pix_kinv * s, cos(theta)), with s = sin(theta) / rd and
+    // theta the root of DistortRadius(theta) = rd. The derivatives of theta
+    // follow from implicitly differentiating that equation.
+    T ray[3];
+    Unproject(pix, params, ray);
+    const T rd = CameraUtils::PixNorm(pix_kinv);
+    const T theta = atan2( sqrt(ray[0]*ray[0]+ray[1]*ray[1]), ray[2] );
+    const T sin_th = sin(theta);
+    const T cos_th = cos(theta);
+    const T s = rd > T(0) ? sin_th / rd : T(1);
+    T dr_dth;
+    DistortRadius(theta, params, &dr_dth);
+
+    // Derivatives w.r.t. the K parameters, through both pix_kinv and theta.
+    // Each only moves one coordinate of pix_kinv.
+    for (int i = 0; i < 4; ++i) {
+      const int c = i % 2;
+      const T dp = j[3*i + c];
+      const T drd = rd > T(0) ? pix_kinv[c]*dp / rd : T(0);
+      const T dth = drd / dr_dth;
+      const T ds = rd > T(0) ? (cos_th*dth - s*drd) / rd : T(0);
+      j[3*i] = pix_kinv[0]*ds;
+      j[3*i + 1] = pix_kinv[1]*ds;
+      j[3*i + c] += s*dp;
+      j[3*i + 2] = -sin_th*dth;
+    }
+
+    // Derivatives w.r.t. the distortion, which only moves theta.
+    const T theta2 = theta*theta;
+    T theta_pow = theta2*theta;
+    for (int k = 0; k < 4; ++k, theta_pow *= theta2) {
+      const T dth = -theta_pow / dr_dth;
+      const T ds = rd > T(0) ? cos_th*dth / rd : T(0);
+      j[12 + 3*k] = pix_kinv[0]*ds;
+      j[13 + 3*k] = pix_kinv[1]*ds;
+      j[14 + 3*k] = -sin_th*dth;
+    }
   }
 
   template<typename T>
-  static void dProject_dray(const T* ray, const T* params, T* j) {
+  CALIBU_HOST_DEVICE static void dProject_dray(const T* ray, const T* params, T* j) {
       const T fu = params[0];
       const T fv = params[1];
       const T k0 = params[4];
@@ -168,11 +250,12 @@ class KannalaBrandtCamera : public CameraImpl<Scalar, 8, KannalaBrandtCamera<Sca
       const T x19 = x17/x3;
       const T x20 = ray[2]*x12/(x2*x5);
 
+      // Column major storage order.
       j[0] = fu*(x0*x16*x17 + x0*x20 + x19);
-      j[1] = ray[1]*x13*x14;
-      j[2] = x14*x18;
-      j[3] = ray[0]*x13*x15;
-      j[4] = fv*(x1*x16*x17 + x1*x20 + x19);
+      j[1] = ray[0]*x13*x15;
+      j[2] = ray[1]*x13*x14;
+      j[3] = fv*(x1*x16*x17 + x1*x20 + x19);
+      j[4] = x14*x18;
       j[5] = x15*x18;
       }
 };
@@ -40,9 +40,11 @@ class FovCamera : public CameraImpl<Scalar, 5, FovCamera<Scalar> > {
   using Base::Base;
 
   static constexpr int NumParams = 5;
+  static constexpr CameraModelId kModelId = CameraModelId::kFov;
+  static const char* TypeName() { return "calibu_fu_fv_u0_v0_w"; }
 
   template<typename T>
-  static void Scale( const double s, T* params ) {
+  CALIBU_HOST_DEVICE static void Scale( const double s, T* params ) {
     CameraUtils::Scale( s, params );
   }
 
@@ -54,13 +56,13 @@ class FovCamera : public CameraImpl<Scalar, 5, FovCamera<Scalar> > {
   // and sy. If your camera model doesn't respect this ordering, then evaluating
   // K for it will result in an incorrect (even approximate) matrix.
   template<typename T>
-  static void K( const T* params , T* Kmat) {
+  CALIBU_HOST_DEVICE static void K( const T* params , T* Kmat) {
     CameraUtils::K( params, Kmat);
   }
 
   // For these derivatives, refer to the camera_derivatives.m matlab file.
   template<typename T>
-  static T Factor(const T rad, const T* params) {
+  CALIBU_HOST_DEVICE static T Factor(const T rad, const T* params) {
     const T param = params[4];
     if (param * param > (T)kFovCamDistEps) {
       const T mul2_tanw_by2 = (T)2.0 * tan(param / (T)2.0);
@@ -75,7 +77,7 @@ class FovCamera : public CameraImpl<Scalar, 5, FovCamera<Scalar> > {
   }
 
   template<typename T>
-  static T dFactor_dparam(const T rad, const T* params, T* fac) {
+  CALIBU_HOST_DEVICE static T dFactor_dparam(const T rad, const T* params, T* fac) {
     const T param = params[4];
     if (param * param > kFovCamDistEps) {
       const T tanw_by2 = tan(param / (T)2.0);
@@ -100,7 +102,7 @@ class FovCamera : public CameraImpl<Scalar, 5, FovCamera<Scalar> > {
   }
 
   template<typename T>
-  static T dFactor_drad(const T rad, const T* params, T* fac) {
+  CALIBU_HOST_DEVICE static T dFactor_drad(const T rad, const T* params, T* fac) {
     const T param = params[4];
     if(param * param < kFovCamDistEps) {
       *fac = (T)1;
@@ -126,7 +128,7 @@ class FovCamera : public CameraImpl<Scalar, 5, FovCamera<Scalar> > {
 
 
   template<typename T>
-  static T Factor_inv(const T rad, const T* params) {
+  CALIBU_HOST_DEVICE static T Factor_inv(const T rad, const T* params) {
     const T param = params[4];
     if(param * param > kFovCamDistEps) {
       const T w_by2 = param / (T)2.0;
@@ -143,7 +145,7 @@ class FovCamera : public CameraImpl<Scalar, 5, FovCamera<Scalar> > {
   }
 
   template<typename T>
-  static T dFactor_inv_dparam(const T rad, const T* params) {
+  CALIBU_HOST_DEVICE static T dFactor_inv_dparam(const T rad, const T* params) {
     const T param = params[4];
     if(param * param > kFovCamDistEps) {
       const T tan_wby2 = tan(param / (T)2.0);
@@ -163,7 +165,7 @@ class FovCamera : public CameraImpl<Scalar, 5, FovCamera<Scalar> > {
   }
 
   template<typename T>
-  static T dFactor_inv_drad(const T rad, const T* params, T* fac) {
+  CALIBU_HOST_DEVICE static T dFactor_inv_drad(const T rad, const T* params, T* fac) {
     const T param = params[4];
     if(param * param > kFovCamDistEps) {
       const T w_by2 = param / (T)2.0;
@@ -186,7 +188,7 @@ class FovCamera : public CameraImpl<Scalar, 5, FovCamera<Scalar> > {
   }
 
   template<typename T>
-  static void Unproject(const T* pix, const T* params, T* ray) {
+  CALIBU_HOST_DEVICE static void Unproject(const T* pix, const T* params, T* ray) {
     // First multiply by inverse K and calculate distortion parameter.
     T pix_kinv[2];
     CameraUtils::MultInvK(params, pix, pix_kinv);
@@ -199,7 +201,7 @@ class FovCamera : public CameraImpl<Scalar, 5, FovCamera<Scalar> > {
   }
 
   template<typename T>
-  static void dUnproject_dparams(const T* pix, const T* params, T* j) {
+  CALIBU_HOST_DEVICE static void dUnproject_dparams(const T* pix, const T* params, T* j) {
     T pix_kinv[2];
     CameraUtils::MultInvK(params, pix, pix_kinv);
     CameraUtils::dMultInvK_dparams(params, pix, j);
@@ -253,7 +255,7 @@ class FovCamera : public CameraImpl<Scalar, 5, FovCamera<Scalar> > {
   }
 
   template<typename T>
-  static void Project(const T* ray, const T* params, T* pix) {
+  CALIBU_HOST_DEVICE static void Project(const T* ray, const T* params, T* pix) {
     // De-homogenize and multiply by K.
     CameraUtils::Dehomogenize(ray, pix);
     // Calculate distortion parameter.
@@ -265,7 +267,7 @@ class FovCamera : public CameraImpl<Scalar, 5, FovCamera<Scalar> > {
   }
 
   template<typename T>
-  static void dProject_dparams(const T* ray, const T* params, T* j) {
+  CALIBU_HOST_DEVICE static void dProject_dparams(const T* ray, const T* params, T* j) {
     T pix[2];
     CameraUtils::Dehomogenize(ray, pix);
     // This derivative is simplified compared to the unproject derivative,
@@ -282,7 +284,7 @@ class FovCamera : public CameraImpl<Scalar, 5, FovCamera<Scalar> > {
   }
 
   template<typename T>
-  static void dProject_dray(const T* ray, const T* params, T* j) {
+  CALIBU_HOST_DEVICE static void dProject_dray(const T* ray, const T* params, T* j) {
     // De-homogenize and multiply by K.
     T pix[2];
     CameraUtils::Dehomogenize(ray, pix);
@@ -323,9 +325,12 @@ class Poly2Camera : public CameraImpl<Scalar, 6, Poly2Camera<Scalar> > {
   using Base::Base;
 
   static constexpr int NumParams = 6;
+  static constexpr CameraModelId kModelId = CameraModelId::kPoly2;
+  static const char* TypeName() { return "calibu_fu_fv_u0_v0_k1_k2"; }
+  static constexpr bool kPacketKernels = true;
 
   template<typename T>
-  static void Scale( const double s, T* params ) {
+  CALIBU_HOST_DEVICE static void Scale( const double s, T* params ) {
     CameraUtils::Scale( s, params );
   }
 
@@ -337,25 +342,25 @@ class Poly2Camera : public CameraImpl<Scalar, 6, Poly2Camera<Scalar> > {
   // and sy. If your camera model doesn't respect this ordering, then evaluating
   // K for it will result in an incorrect (even approximate) matrix.
   template<typename T>
-  static void K( const T* params , T* Kmat) {
+  CALIBU_HOST_DEVICE static void K( const T* params , T* Kmat) {
     CameraUtils::K( params , Kmat);
   }
 
   template<typename T>
-  static T Factor(const T rad, const T* params) {
+  CALIBU_HOST_DEVICE static T Factor(const T rad, const T* params) {
     T r2 = rad * rad;
     T r4 = r2 * r2;
     return (static_cast<T>(1.0) + params[4]*r2 + params[5]*r4);
   }
 
   template<typename T>
-  static T dFactor_drad(const T r, const T* params, T* fac) {
+  CALIBU_HOST_DEVICE static T dFactor_drad(const T r, const T* params, T* fac) {
     *fac = Factor(r, params);
     return 2.0*params[4]*r + 4.0*params[5]*r*r*r;
   }
 
   template<typename T>
-  static T Factor_inv(const T r, const T* params) {
+  CALIBU_HOST_DEVICE static T Factor_inv(const T r, const T* params) {
     T k1 = params[4];
     T k2 = params[5];
 
@@ -385,8 +390,27 @@ class Poly2Camera : public CameraImpl<Scalar, 6, Poly2Camera<Scalar> > {
     return ru / r;
   }
 
+  // Distorted radius ru * Factor(ru) and its derivative, so that callers
+  // can invert the distortion with their own solver.
   template<typename T>
-  static void Unproject(const T* pix, const T* params, T* ray) {
+  CALIBU_HOST_DEVICE static T DistortRadius(const T ru, const T* params, T* d_dru) {
+    T fac;
+    const T dfac = dFactor_drad(ru, params, &fac);
+    *d_dru = fac + ru * dfac;
+    return ru * fac;
+  }
+
+  // Ray through the normalised point pix_kinv, of radius rd, once its
+  // undistorted radius ru is known.
+  template<typename T>
+  CALIBU_HOST_DEVICE static void RayFromRadius(const T* pix_kinv, const T rd, const T ru, T* ray) {
+    const T fac_inv = rd > T(0) ? ru / rd : T(1);
+    const T pix_u[2] = { pix_kinv[0] * fac_inv, pix_kinv[1] * fac_inv };
+    CameraUtils::Homogenize<T>(pix_u, ray);
+  }
+
+  template<typename T>
+  CALIBU_HOST_DEVICE static void Unproject(const T* pix, const T* params, T* ray) {
     // First multiply by inverse K and calculate distortion parameter.
     T pix_kinv[2];
     CameraUtils::MultInvK(params, pix, pix_kinv);
@@ -400,7 +424,7 @@ class Poly2Camera : public CameraImpl<Scalar, 6, Poly2Camera<Scalar> > {
   }
 
   template<typename T>
-  static void Project(const T* ray, const T* params, T* pix) {
+  CALIBU_HOST_DEVICE static void Project(const T* ray, const T* params, T* pix) {
     // De-homogenize and multiply by K.
     CameraUtils::Dehomogenize(ray, pix);
 
@@ -412,7 +436,7 @@ class Poly2Camera : public CameraImpl<Scalar, 6, Poly2Camera<Scalar> > {
   }
 
   template<typename T>
-  static void dProject_dray(const T* ray, const T* params, T* j) {
+  CALIBU_HOST_DEVICE static void dProject_dray(const T* ray, const T* params, T* j) {
     // De-homogenize and multiply by K.
     T pix[2];
     CameraUtils::Dehomogenize(ray, pix);
@@ -445,17 +469,61 @@ class Poly2Camera : public CameraImpl<Scalar, 6, Poly2Camera<Scalar> > {
   }
 
   template<typename T>
-  static void dProject_dparams(const T*, const T*, T* ) {
-    std::cerr << "dProjedt_dparams not defined for the poly2 model. "
-        " Throwing exception." << std::endl;
-    throw 0;
+  CALIBU_HOST_DEVICE static void dProject_dparams(const T* ray, const T* params, T* j) {
+    T pix[2];
+    CameraUtils::Dehomogenize(ray, pix);
+    const T r2 = pix[0] * pix[0] + pix[1] * pix[1];
+    const T fac = Factor(CameraUtils::PixNorm(pix), params);
+    CameraUtils::dMultK_dparams(params, pix, j);
+    j[0] *= fac;
+    j[3] *= fac;
+
+    // Coefficient k of the distortion multiplies r^(2k).
+    const T params0_pix0 = params[0] * pix[0];
+    const T params1_pix1 = params[1] * pix[1];
+    T r2k = r2;
+    for (int k = 4; k < NumParams; ++k, r2k *= r2) {
+      j[2 * k] = params0_pix0 * r2k;
+      j[2 * k + 1] = params1_pix1 * r2k;
+    }
   }
 
   template<typename T>
-  static void dUnproject_dparams(const T*, const T*, T* ) {
-    std::cerr << "dUnproject_dparams not defined for the poly2 model. "
-        " Throwing exception." << std::endl;
-    throw 0;
+  CALIBU_HOST_DEVICE static void dUnproject_dparams(const T* pix, const T* params, T* j) {
+    T pix_kinv[2];
+    CameraUtils::MultInvK(params, pix, pix_kinv);
+    CameraUtils::dMultInvK_dparams(params, pix, j);
+
+    // The ray is pix_kinv * s, with s = ru / rd and ru the root of
+    // ru * Factor(ru) = rd. The derivatives of ru follow from implicitly
+    // differentiating that equation.
+    const T rd = CameraUtils::PixNorm(pix_kinv);
+    const T s = Factor_inv(rd, params);
+    const T ru = s * rd;
+    T dd_dru;
+    DistortRadius(ru, params, &dd_dru);
+    const T ru2 = ru * ru;
+
+    // Derivatives w.r.t. the K parameters, through both pix_kinv and s.
+    // Each only moves one coordinate of pix_kinv.
+    for (int i = 0; i < 4; ++i) {
+      const int c = i % 2;
+      const T dp = j[3 * i + c];
+      const T ds = rd > T(0) ?
+          (pix_kinv[c] * dp / rd) * (1 / dd_dru - s) / rd : T(0);
+      j[3 * i] = pix_kinv[0] * ds;
+      j[3 * i + 1] = pix_kinv[1] * ds;
+      j[3 * i + c] += s * dp;
+    }
+
+    // Derivatives w.r.t. the distortion, which only moves ru.
+    T ru2k = ru2;
+    for (int k = 4; k < NumParams; ++k, ru2k *= ru2) {
+      const T ds = -s * ru2k / dd_dru;
+      j[3 * k] = pix_kinv[0] * ds;
+      j[3 * k + 1] = pix_kinv[1] * ds;
+      j[3 * k + 2] = 0;
+    }
   }
 };
 
@@ -467,9 +535,12 @@ class Poly3Camera : public CameraImpl<Scalar, 7, Poly3Camera<Scalar> > {
   using Base::Base;
 
   static constexpr int NumParams = 7;
+  static constexpr CameraModelId kModelId = CameraModelId::kPoly3;
+  static const char* TypeName() { return "calibu_fu_fv_u0_v0_k1_k2_k3"; }
+  static constexpr bool kPacketKernels = true;
 
   template<typename T>
-  static void Scale( const double s, T* params ) {
+  CALIBU_HOST_DEVICE static void Scale( const double s, T* params ) {
     CameraUtils::Scale( s, params );
   }
 
@@ -481,12 +552,12 @@ class Poly3Camera : public CameraImpl<Scalar, 7, Poly3Camera<Scalar> > {
   // and sy. If your camera model doesn't respect this ordering, then evaluating
   // K for it will result in an incorrect (even approximate) matrix.
   template<typename T>
-  static void K( const T* params , T* Kmat) {
+  CALIBU_HOST_DEVICE static void K( const T* params , T* Kmat) {
     CameraUtils::K( params , Kmat);
   }
 
   template<typename T>
-  static T Factor(const T rad, const T* params) {
+  CALIBU_HOST_DEVICE static T Factor(const T rad, const T* params) {
     T r2 = rad * rad;
     T r4 = r2 * r2;
     return (static_cast<T>(1.0) +
@@ -496,7 +567,7 @@ class Poly3Camera : public CameraImpl<Scalar, 7, Poly3Camera<Scalar> > {
   }
 
   template<typename T>
-  static T dFactor_drad(const T r, const T* params, T* fac) {
+  CALIBU_HOST_DEVICE static T dFactor_drad(const T r, const T* params, T* fac) {
     *fac = Factor(r, params);
     T r2 = r * r;
     T r3 = r2 * r;
@@ -506,7 +577,7 @@ class Poly3Camera : public CameraImpl<Scalar, 7, Poly3Camera<Scalar> > {
   }
 
   template<typename T>
-  static T Factor_inv(const T r, const T* params) {
+  CALIBU_HOST_DEVICE static T Factor_inv(const T r, const T* params) {
     T k1 = params[4];
     T k2 = params[5];
     T k3 = params[6];
@@ -538,8 +609,27 @@ class Poly3Camera : public CameraImpl<Scalar, 7, Poly3Camera<Scalar> > {
     return ru / r;
   }
 
+  // Distorted radius ru * Factor(ru) and its derivative, so that callers
+  // can invert the distortion with their own solver.
   template<typename T>
-  static void Unproject(const T* pix, const T* params, T* ray) {
+  CALIBU_HOST_DEVICE static T DistortRadius(const T ru, const T* params, T* d_dru) {
+    T fac;
+    const T dfac = dFactor_drad(ru, params, &fac);
+    *d_dru = fac + ru * dfac;
+    return ru * fac;
+  }
+
+  // Ray through the normalised point pix_kinv, of radius rd, once its
+  // undistorted radius ru is known.
+  template<typename T>
+  CALIBU_HOST_DEVICE static void RayFromRadius(const T* pix_kinv, const T rd, const T ru, T* ray) {
+    const T fac_inv = rd > T(0) ? ru / rd : T(1);
+    const T pix_u[2] = { pix_kinv[0] * fac_inv, pix_kinv[1] * fac_inv };
+    CameraUtils::Homogenize<T>(pix_u, ray);
+  }
+
+  template<typename T>
+  CALIBU_HOST_DEVICE static void Unproject(const T* pix, const T* params, T* ray) {
     // First multiply by inverse K and calculate distortion parameter.
     T pix_kinv[2];
     CameraUtils::MultInvK(params, pix, pix_kinv);
@@ -553,7 +643,7 @@ class Poly3Camera : public CameraImpl<Scalar, 7, Poly3Camera<Scalar> > {
   }
 
   template<typename T>
-  static void Project(const T* ray, const T* params, T* pix) {
+  CALIBU_HOST_DEVICE static void Project(const T* ray, const T* params, T* pix) {
     // De-homogenize and multiply by K.
     CameraUtils::Dehomogenize(ray, pix);
 
@@ -565,7 +655,7 @@ class Poly3Camera : public CameraImpl<Scalar, 7, Poly3Camera<Scalar> > {
   }
 
   template<typename T>
-  static void dProject_dray(const T* ray, const T* params, T* j) {
+  CALIBU_HOST_DEVICE static void dProject_dray(const T* ray, const T* params, T* j) {
     // De-homogenize and multiply by K.
     T pix[2];
     CameraUtils::Dehomogenize(ray, pix);
@@ -598,17 +688,61 @@ class Poly3Camera : public CameraImpl<Scalar, 7, Poly3Camera<Scalar> > {
   }
 
   template<typename T>
-  static void dProject_dparams(const T*, const T*, T* ) {
-    std::cerr << "dProjedt_dparams not defined for the poly3 model. "
-        " Throwing exception." << std::endl;
-    throw 0;
+  CALIBU_HOST_DEVICE static void dProject_dparams(const T* ray, const T* params, T* j) {
+    T pix[2];
+    CameraUtils::Dehomogenize(ray, pix);
+    const T r2 = pix[0] * pix[0] + pix[1] * pix[1];
+    const T fac = Factor(CameraUtils::PixNorm(pix), params);
+    CameraUtils::dMultK_dparams(params, pix, j);
+    j[0] *= fac;
+    j[3] *= fac;
+
+    // Coefficient k of the distortion multiplies r^(2k).
+    const T params0_pix0 = params[0] * pix[0];
+    const T params1_pix1 = params[1] * pix[1];
+    T r2k = r2;
+    for (int k = 4; k < NumParams; ++k, r2k *= r2) {
+      j[2 * k] = params0_pix0 * r2k;
+      j[2 * k + 1] = params1_pix1 * r2k;
+    }
   }
 
   template<typename T>
-  static void dUnproject_dparams(const T*, const T*, T* ) {
-    std::cerr << "dUnproject_dparams not defined for the poly3 model. "
-        " Throwing exception." << std::endl;
-    throw 0;
+  CALIBU_HOST_DEVICE static void dUnproject_dparams(const T* pix, const T* params, T* j) {
+    T pix_kinv[2];
+    CameraUtils::MultInvK(params, pix, pix_kinv);
+    CameraUtils::dMultInvK_dparams(params, pix, j);
+
+    // The ray is pix_kinv * s, with s = ru / rd and ru the root of
+    // ru * Factor(ru) = rd. The derivatives of ru follow from implicitly
+    // differentiating that equation.
+    const T rd = CameraUtils::PixNorm(pix_kinv);
+    const T s = Factor_inv(rd, params);
+    const T ru = s * rd;
+    T dd_dru;
+    DistortRadius(ru, params, &dd_dru);
+    const T ru2 = ru * ru;
+
+    // Derivatives w.r.t. the K parameters, through both pix_kinv and s.
+    // Each only moves one coordinate of pix_kinv.
+    for (int i = 0; i < 4; ++i) {
+      const int c = i % 2;
+      const T dp = j[3 * i + c];
+      const T ds = rd > T(0) ?
+          (pix_kinv[c] * dp / rd) * (1 / dd_dru - s) / rd : T(0);
+      j[3 * i] = pix_kinv[0] * ds;
+      j[3 * i + 1] = pix_kinv[1] * ds;
+      j[3 * i + c] += s * dp;
+    }
+
+    // Derivatives w.r.t. the distortion, which only moves ru.
+    T ru2k = ru2;
+    for (int k = 4; k < NumParams; ++k, ru2k *= ru2) {
+      const T ds = -s * ru2k / dd_dru;
+      j[3 * k] = pix_kinv[0] * ds;
+      j[3 * k + 1] = pix_kinv[1] * ds;
+      j[3 * k + 2] = 0;
+    }
   }
 };
 }
@@ -43,9 +43,12 @@ class Rational6Camera : public CameraImpl<Scalar, 10, Rational6Camera<Scalar> >
   using Base::Base;
 
   static constexpr int NumParams = 10;
+  static constexpr CameraModelId kModelId = CameraModelId::kRational6;
+  static const char* TypeName() { return "calibu_fu_fv_u0_v0_rational6"; }
+  static constexpr bool kPacketKernels = true;
 
   template<typename T>
-  static void Scale( const double s, T* params ) {
+  CALIBU_HOST_DEVICE static void Scale( const double s, T* params ) {
     CameraUtils::Scale( s, params );
   }
 
@@ -57,12 +60,12 @@ class Rational6Camera : public CameraImpl<Scalar, 10, Rational6Camera<Scalar> >
   // and sy. If your camera model doesn't respect this ordering, then evaluating
   // K for it will result in an incorrect (even approximate) matrix.
   template<typename T>
-  static void K( const T* params , T* Kmat) {
+  CALIBU_HOST_DEVICE static void K( const T* params , T* Kmat) {
     CameraUtils::K( params , Kmat);
   }
 
   template<typename T>
-  static T Factor(const T rad, const T* params) {
+  CALIBU_HOST_DEVICE static T Factor(const T rad, const T* params) {
     T r2 = rad * rad;
     T r4 = r2 * r2;
     return ((static_cast<T>(1.0) +
@@ -76,7 +79,7 @@ class Rational6Camera : public CameraImpl<Scalar, 10, Rational6Camera<Scalar> >
   }
 
   template<typename T>
-  static T dFactor_drad(const T ru, const T* params, T* fac) {
+  CALIBU_HOST_DEVICE static T dFactor_drad(const T ru, const T* params, T* fac) {
     *fac = Factor(ru, params);
 
     T k1 = params[4];
@@ -91,8 +94,8 @@ class Rational6Camera : public CameraImpl<Scalar, 10, Rational6Camera<Scalar> >
 	T ru6 = ru4 * ru2;
 	T numer = k1 * ru2 + k2 * ru4 + k3 * ru6 + 1;
 	T denom = k4 * ru2 + k5 * ru4 + k6 * ru6 + 1;
-	T d_numer = ru * (2*k1 + 4*k2*ru2 * 6*k3*ru4);
-	T d_denom = ru * (2*k4 + 4*k5*ru2 * 6*k6*ru4);
+	T d_numer = ru * (2*k1 + 4*k2*ru2 + 6*k3*ru4);
+	T d_denom = ru * (2*k4 + 4*k5*ru2 + 6*k6*ru4);
 	T denom2 = (denom * denom);
 	T numer2 = (d_numer * denom - numer * d_denom);
 	T d_pol = numer2 / denom2;
@@ -100,7 +103,7 @@ class Rational6Camera : public CameraImpl<Scalar, 10, Rational6Camera<Scalar> >
   }
 
   template<typename T>
-  static T Factor_inv(const T rd, const T* params) {
+  CALIBU_HOST_DEVICE static T Factor_inv(const T rd, const T* params) {
     T k1 = params[4];
     T k2 = params[5];
     T k3 = params[6];
@@ -121,8 +124,8 @@ class Rational6Camera : public CameraImpl<Scalar, 10, Rational6Camera<Scalar> >
       T numer = k1 * ru2 + k2 * ru4 + k3 * ru6 + 1;
       T denom = k4 * ru2 + k5 * ru4 + k6 * ru6 + 1;
       T pol = numer / denom;
-      T d_numer = ru * (2*k1 + 4*k2*ru2 * 6*k3*ru4);
-      T d_denom = ru * (2*k4 + 4*k5*ru2 * 6*k6*ru4);
+      T d_numer = ru * (2*k1 + 4*k2*ru2 + 6*k3*ru4);
+      T d_denom = ru * (2*k4 + 4*k5*ru2 + 6*k6*ru4);
       T denom2 = (denom * denom);
       T numer2 = (d_numer * denom - numer * d_denom);
       T d_pol = numer2 / denom2;
@@ -150,7 +153,7 @@ class Rational6Camera : public CameraImpl<Scalar, 10, Rational6Camera<Scalar> >
   }
 
   template<typename T>
-  static void Unproject(const T* pix, const T* params, T* ray) {
+  CALIBU_HOST_DEVICE static void Unproject(const T* pix, const T* params, T* ray) {
     // First multiply by inverse K and calculate distortion parameter.
     T pix_kinv[2];
     CameraUtils::MultInvK(params, pix, pix_kinv);
@@ -164,7 +167,7 @@ class Rational6Camera : public CameraImpl<Scalar, 10, Rational6Camera<Scalar> >
   }
 
   template<typename T>
-  static void Project(const T* ray, const T* params, T* pix) {
+  CALIBU_HOST_DEVICE static void Project(const T* ray, const T* params, T* pix) {
     // De-homogenize and multiply by K.
     CameraUtils::Dehomogenize(ray, pix);
 
@@ -176,7 +179,7 @@ class Rational6Camera : public CameraImpl<Scalar, 10, Rational6Camera<Scalar> >
   }
 
   template<typename T>
-  static void dProject_dray(const T* ray, const T* params, T* j) {
+  CALIBU_HOST_DEVICE static void dProject_dray(const T* ray, const T* params, T* j) {
     // De-homogenize and multiply by K.
     T pix[2];
     CameraUtils::Dehomogenize(ray, pix);
@@ -208,18 +211,78 @@ class Rational6Camera : public CameraImpl<Scalar, 10, Rational6Camera<Scalar> >
     j[5] = j_dehomog[4] * k10 + j_dehomog[5] * k11;
   }
 
+  // Derivatives of Factor w.r.t. k1..k6, given the radius squared.
   template<typename T>
-  static void dProject_dparams(const T*, const T*, T* ) {
-    std::cerr << "dProjedt_dparams not defined for the rational6 model. "
-        " Throwing exception." << std::endl;
-    throw 0;
+  CALIBU_HOST_DEVICE static void dFactor_dparams(const T r2, const T* params, T* dfac) {
+    const T r4 = r2 * r2;
+    const T r6 = r4 * r2;
+    const T numer = 1 + params[4] * r2 + params[5] * r4 + params[6] * r6;
+    const T denom = 1 + params[7] * r2 + params[8] * r4 + params[9] * r6;
+    const T fac_by_denom = numer / (denom * denom);
+    dfac[0] = r2 / denom;
+    dfac[1] = r4 / denom;
+    dfac[2] = r6 / denom;
+    dfac[3] = -r2 * fac_by_denom;
+    dfac[4] = -r4 * fac_by_denom;
+    dfac[5] = -r6 * fac_by_denom;
   }
 
   template<typename T>
-  static void dUnproject_dparams(const T*, const T*, T* ) {
-    std::cerr << "dUnproject_dparams not defined for the rational6 model. "
-        " Throwing exception." << std::endl;
-    throw 0;
+  CALIBU_HOST_DEVICE static void dProject_dparams(const T* ray, const T* params, T* j) {
+    T pix[2];
+    CameraUtils::Dehomogenize(ray, pix);
+    const T fac = Factor(CameraUtils::PixNorm(pix), params);
+    CameraUtils::dMultK_dparams(params, pix, j);
+    j[0] *= fac;
+    j[3] *= fac;
+
+    T dfac[6];
+    dFactor_dparams(pix[0] * pix[0] + pix[1] * pix[1], params, dfac);
+    const T params0_pix0 = params[0] * pix[0];
+    const T params1_pix1 = params[1] * pix[1];
+    for (int k = 0; k < 6; ++k) {
+      j[8 + 2 * k] = params0_pix0 * dfac[k];
+      j[9 + 2 * k] = params1_pix1 * dfac[k];
+    }
+  }
+
+  template<typename T>
+  CALIBU_HOST_DEVICE static void dUnproject_dparams(const T* pix, const T* params, T* j) {
+    T pix_kinv[2];
+    CameraUtils::MultInvK(params, pix, pix_kinv);
+    CameraUtils::dMultInvK_dparams(params, pix, j);
+
+    // The ray is pix_kinv * s, with s = ru / rd and ru the root of
+    // ru * Factor(ru) = rd. The derivatives of ru follow from implicitly
+    // differentiating that equation.
+    const T rd = CameraUtils::PixNorm(pix_kinv);
+    const T s = Factor_inv(rd, params);
+    const T ru = s * rd;
+    T fac;
+    const T dfac_dru = dFactor_drad(ru, params, &fac);
+    const T dd_dru = fac + ru * dfac_dru;
+
+    // Derivatives w.r.t. the K parameters, through both pix_kinv and s.
+    // Each only moves one coordinate of pix_kinv.
+    for (int i = 0; i < 4; ++i) {
+      const int c = i % 2;
+      const T dp = j[3 * i + c];
+      const T ds = rd > T(0) ?
+          (pix_kinv[c] * dp / rd) * (1 / dd_dru - s) / rd : T(0);
+      j[3 * i] = pix_kinv[0] * ds;
+      j[3 * i + 1] = pix_kinv[1] * ds;
+      j[3 * i + c] += s * dp;
+    }
+
+    // Derivatives w.r.t. the distortion, which only moves ru.
+    T dfac[6];
+    dFactor_dparams(ru * ru, params, dfac);
+    for (int k = 0; k < 6; ++k) {
+      const T ds = -s * dfac[k] / dd_dru;
+      j[12 + 3 * k] = pix_kinv[0] * ds;
+      j[13 + 3 * k] = pix_kinv[1] * ds;
+      j[14 + 3 * k] = 0;
+    }
   }
 };
 
@@ -0,0 +1,126 @@
+/*
+  This file is part of the Calibu Project.
+  https://github.com/arpg/Calibu
+
+  Copyright (C) 2013 George Washington University,
+  Copyright (C) 2015 University of Colorado,
+  Steven Lovegrove,
+  Nima Keivan,
+  Christoffer Heckman,
+  Gabe Sibley
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#pragma once
+#include <cmath>
+
+namespace calibu {
+
+/**
+ * Number of points evaluated at once by the batch camera kernels: 64 bytes
+ * of coordinates, so float cameras run twice as many lanes as double ones.
+ */
+template<typename Scalar>
+struct CameraPacketSize {
+  static constexpr int value = 64 / sizeof(Scalar);
+};
+
+constexpr int kCameraPacketSize = CameraPacketSize<double>::value;
+
+// Kept in their own namespace so that the math overloads below don't hide
+// the standard ones from unqualified calls elsewhere in calibu.
+namespace packet {
+
+/**
+ * A fixed number of scalars with elementwise arithmetic. Camera model
+ * kernels are templated on their scalar type so that they work with Ceres
+ * Jets; instantiated with a Packet they evaluate N points at once. Each
+ * operator is a loop over the lanes which the compiler can vectorise.
+ *
+ * Only branch free kernels can be used this way: models opt in by setting
+ * kPacketKernels, see CameraImpl.
+ */
+template<typename Scalar, int N>
+struct Packet {
+  Packet() {}
+
+  /** Broadcast s to every lane. */
+  Packet(Scalar s) {
+    for (int i = 0; i < N; ++i) v[i] = s;
+  }
+
+  Scalar& operator[](int i) { return v[i]; }
+  const Scalar& operator[](int i) const { return v[i]; }
+
+  Packet& operator+=(const Packet& o) {
+    for (int i = 0; i < N; ++i) v[i] += o.v[i];
+    return *this;
+  }
+
+  Packet& operator-=(const Packet& o) {
+    for (int i = 0; i < N; ++i) v[i] -= o.v[i];
+    return *this;
+  }
+
+  Packet& operator*=(const Packet& o) {
+    for (int i = 0; i < N; ++i) v[i] *= o.v[i];
+    return *this;
+  }
+
+  Packet& operator/=(const Packet& o) {
+    for (int i = 0; i < N; ++i) v[i] /= o.v[i];
+    return *this;
+  }
+
+  // Friends so that scalars on either side convert by broadcasting.
+  friend Packet operator+(Packet a, const Packet& b) { return a += b; }
+  friend Packet operator-(Packet a, const Packet& b) { return a -= b; }
+  friend Packet operator*(Packet a, const Packet& b) { return a *= b; }
+  friend Packet operator/(Packet a, const Packet& b) { return a /= b; }
+
+  friend Packet operator-(const Packet& a) {
+    Packet r;
+    for (int i = 0; i < N; ++i) r.v[i] = -a.v[i];
+    return r;
+  }
+
+  Scalar v[N];
+};
+
+// Math functions used by the camera models, found by argument dependent
+// lookup from within the kernels.
+#define CALIBU_PACKET_UNARY(fn)                                   \
+  template<typename Scalar, int N>                                \
+  inline Packet<Scalar, N> fn(const Packet<Scalar, N>& a) {       \
+    Packet<Scalar, N> r;                                          \
+    for (int i = 0; i < N; ++i) r.v[i] = std::fn(a.v[i]);         \
+    return r;                                                     \
+  }
+
+CALIBU_PACKET_UNARY(sqrt)
+CALIBU_PACKET_UNARY(sin)
+CALIBU_PACKET_UNARY(cos)
+CALIBU_PACKET_UNARY(tan)
+CALIBU_PACKET_UNARY(atan)
+#undef CALIBU_PACKET_UNARY
+
+template<typename Scalar, int N>
+inline Packet<Scalar, N> atan2(const Packet<Scalar, N>& y,
+                               const Packet<Scalar, N>& x) {
+  Packet<Scalar, N> r;
+  for (int i = 0; i < N; ++i) r.v[i] = std::atan2(y.v[i], x.v[i]);
+  return r;
+}
+
+}  // namespace packet
+}  // namespace calibu
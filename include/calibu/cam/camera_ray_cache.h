@@ -0,0 +1,205 @@
+/*
+  This file is part of the Calibu Project.
+  https://github.com/arpg/Calibu
+
+  Copyright (C) 2013 George Washington University,
+  Copyright (C) 2015 University of Colorado,
+  Steven Lovegrove,
+  Nima Keivan,
+  Christoffer Heckman,
+  Gabe Sibley
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#pragma once
+#include <cmath>
+#include <memory>
+#include <type_traits>
+#include <calibu/cam/camera_crtp.h>
+#include <calibu/cam/camera_handle.h>
+#include <calibu/cam/camera_models_poly.h>
+#include <calibu/cam/camera_models_kb4.h>
+#include <calibu/cam/camera_models_rational.h>
+
+namespace calibu {
+
+/**
+ * Camera model which serves Unproject of integer pixel coordinates from a
+ * table of rays computed once for the whole image. This suits models whose
+ * Unproject iterates (Poly2, Poly3, KB4, Rational6) when the same pixels are
+ * unprojected every frame, e.g. for depth back-projection.
+ *
+ * The table holds 3 Scalars per pixel and is built when the camera is
+ * constructed, and again by UpdateCache(), SetParams() or Scale() on this
+ * class. The parameters are checked once, as the table is built, rather than
+ * on every lookup: after changing them any other way, e.g. through
+ * GetParams() or a CameraInterface pointer, call UpdateCache(). Lookups stay
+ * within the image size the table was built for.
+ *
+ * Usage: RayCachedCamera<Poly3Camera> cam(params, size);
+ */
+template<template<typename> class Model, typename Scalar = double>
+class RayCachedCamera : public Model<Scalar> {
+  typedef Model<Scalar> Base;
+  // The models' static kernels hide the CameraImpl members of the same name
+  typedef CameraImpl<Scalar, Base::kParamSize, Base> Impl;
+  typedef Eigen::Matrix<Scalar, 2, 1> Vec2t;
+  typedef Eigen::Matrix<Scalar, 3, 1> Vec3t;
+  typedef Eigen::Matrix<Scalar, 2, Eigen::Dynamic> Mat2Xt;
+  typedef Eigen::Matrix<Scalar, 3, Eigen::Dynamic> Mat3Xt;
+
+ public:
+  RayCachedCamera(const Eigen::VectorXd& params, Eigen::Vector2i& image_size)
+      : Base(params, image_size) {
+    UpdateCache();
+  }
+
+  /** Copy of cam, including its pose and metadata. */
+  explicit RayCachedCamera(const Base& cam)
+      : Base(cam) {
+    // The CameraInterface copy constructor only copies the intrinsics
+    this->SetPose(cam.Pose());
+    this->SetRDF(cam.RDF());
+    this->SetName(cam.Name());
+    this->SetSerialNumber(cam.SerialNumber());
+    this->SetIndex(cam.Index());
+    this->SetVersion(cam.Version());
+    this->SetType(cam.Type());
+    UpdateCache();
+  }
+
+  /** Recompute the ray table from the current parameters. */
+  void UpdateCache() {
+    const int w = this->Width();
+    const int h = this->Height();
+    // Without a table, e.g. for parameters of the wrong size, every
+    // Unproject goes to the model
+    if (this->params_.size() != Base::kParamSize || !this->params_.allFinite() ||
+        w <= 0 || h <= 0) {
+      cache_size_.setZero();
+      rays_.resize(3, 0);
+      return;
+    }
+    cache_size_ = this->image_size_;
+    rays_.resize(3, w * h);
+
+    Mat2Xt pix(2, w);
+    for (int x = 0; x < w; ++x) pix(0, x) = x;
+    for (int y = 0; y < h; ++y) {
+      pix.row(1).setConstant(y);
+      Impl::Unproject(pix, rays_.middleCols(y * w, w));
+    }
+  }
+
+  void SetParams(const Eigen::VectorXd params) {
+    Impl::SetParams(params);
+    UpdateCache();
+  }
+
+  void Scale(const Scalar& s) override {
+    Impl::Scale(s);
+    UpdateCache();
+  }
+
+  Vec3t Unproject(const Vec2t& pix) const override {
+    int idx;
+    if (Lookup(pix, idx)) {
+      return rays_.col(idx);
+    }
+    return Impl::Unproject(pix);
+  }
+
+  void Unproject(const Eigen::Ref<const Mat2Xt>& pix,
+                 Eigen::Ref<Mat3Xt> rays) const override {
+    for (int i = 0; i < pix.cols(); ++i) {
+      int idx;
+      if (Lookup(pix.col(i), idx)) {
+        rays.col(i) = rays_.col(idx);
+      } else {
+        rays.col(i) = Impl::Unproject(Vec2t(pix.col(i)));
+      }
+    }
+  }
+
+  // Keep the batch Project visible next to the per point one
+  using Impl::Project;
+
+ protected:
+  // Table index for pixels within kTolerance of an integer position
+  template<typename Derived>
+  bool Lookup(const Eigen::MatrixBase<Derived>& pix, int& idx) const {
+    static const Scalar kTolerance = 1e-9;
+    const Scalar x = std::round(pix[0]);
+    const Scalar y = std::round(pix[1]);
+    if (std::abs(pix[0] - x) > kTolerance || std::abs(pix[1] - y) > kTolerance ||
+        x < 0 || y < 0 || x >= cache_size_[0] || y >= cache_size_[1]) {
+      return false;
+    }
+    idx = (int)y * cache_size_[0] + (int)x;
+    return true;
+  }
+
+  // Image size the table was built for, zero without a table
+  Eigen::Vector2i cache_size_;
+  Mat3Xt rays_;
+};
+
+/** Models whose Unproject iterates, and so gain from a RayCachedCamera. */
+template<template<typename> class Model>
+struct HasIterativeUnproject : std::false_type {};
+template<> struct HasIterativeUnproject<Poly2Camera> : std::true_type {};
+template<> struct HasIterativeUnproject<Poly3Camera> : std::true_type {};
+template<> struct HasIterativeUnproject<KannalaBrandtCamera> : std::true_type {};
+template<> struct HasIterativeUnproject<Rational6Camera> : std::true_type {};
+
+namespace internal {
+
+struct CacheRaysVisitor {
+  template<template<typename> class Model>
+  std::shared_ptr<CameraInterface<double>> operator()(CameraModelTag<Model>) const {
+    return Make<Model>(std::integral_constant<bool, HasIterativeUnproject<Model>::value>());
+  }
+
+  template<template<typename> class Model>
+  std::shared_ptr<CameraInterface<double>> Make(std::true_type) const {
+    return std::make_shared<RayCachedCamera<Model>>(
+        static_cast<const Model<double>&>(*cam));
+  }
+
+  template<template<typename> class Model>
+  std::shared_ptr<CameraInterface<double>> Make(std::false_type) const {
+    return cam;
+  }
+
+  const std::shared_ptr<CameraInterface<double>>& cam;
+};
+
+}  // namespace internal
+
+/**
+ * Ray cached copy of cam if it is exactly one of the models with an
+ * iterative Unproject, otherwise cam itself. The model is resolved as by
+ * CameraHandle, so derived cameras, including RayCachedCameras, are not
+ * wrapped again.
+ */
+inline std::shared_ptr<CameraInterface<double>> CacheRays(
+    const std::shared_ptr<CameraInterface<double>>& cam) {
+  const CameraModelId id = CameraHandle<double>::Identify(cam.get());
+  if (id == CameraModelId::kUnknown) {
+    return cam;
+  }
+  return VisitCameraModel<std::shared_ptr<CameraInterface<double>>>(
+      id, internal::CacheRaysVisitor{cam});
+}
+
+}  // namespace calibu
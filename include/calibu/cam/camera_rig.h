@@ -23,6 +23,8 @@
 
 #include <calibu/Platform.h>
 #include <calibu/cam/camera_crtp.h>
+#include <calibu/cam/camera_models_crtp.h>
+#include <calibu/cam/camera_model_registry.h>
 #include <Eigen/Eigen>
 #include <Eigen/StdVector>
 #include <sophus/se3.hpp>
@@ -69,4 +71,102 @@ inline std::shared_ptr<Rig<double>> ToCoordinateConvention(
   return ret;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+
+// Copy of cam at precision To if it is a Model<From>, otherwise nullptr.
+template<template<typename> class Model, typename To, typename From>
+inline std::shared_ptr<CameraInterface<To>> CastCameraModel(
+    const std::shared_ptr<CameraInterface<From>>& cam
+  )
+{
+  if(!std::dynamic_pointer_cast<Model<From>>(cam)) {
+    return nullptr;
+  }
+  Eigen::Vector2i size(cam->Width(), cam->Height());
+  std::shared_ptr<CameraInterface<To>> ret(
+      new Model<To>(cam->GetParams().template cast<double>(), size));
+  ret->SetPose(cam->Pose().template cast<To>());
+  ret->SetRDF(cam->RDF().template cast<To>());
+  ret->SetName(cam->Name());
+  ret->SetSerialNumber(cam->SerialNumber());
+  ret->SetIndex(cam->Index());
+  ret->SetVersion(cam->Version());
+  ret->SetType(cam->Type());
+  return ret;
+}
+
+namespace internal {
+template<typename To, typename From>
+struct CastCameraVisitor
+{
+  template<typename Tag>
+  std::shared_ptr<CameraInterface<To>> operator()(Tag) const
+  {
+    return CastCameraModel<Tag::template Camera, To>(cam);
+  }
+
+  const std::shared_ptr<CameraInterface<From>>& cam;
+};
+}
+
+/// Copy of cam with its parameters and pose at precision To, e.g. to run a
+/// rig read from XML in float. Returns nullptr for unknown camera models.
+template<typename To, typename From>
+inline std::shared_ptr<CameraInterface<To>> CastCamera(
+    const std::shared_ptr<CameraInterface<From>>& cam
+  )
+{
+  if(!cam || cam->ModelId() == CameraModelId::kUnknown) {
+    return nullptr;
+  }
+  return VisitCameraModel<std::shared_ptr<CameraInterface<To>>>(
+      cam->ModelId(), internal::CastCameraVisitor<To, From>{cam});
+}
+
+/// Copy of rig with every camera converted by CastCamera, or nullptr if
+/// any of its cameras is of an unknown model.
+template<typename To, typename From>
+inline std::shared_ptr<Rig<To>> CastRig(const std::shared_ptr<Rig<From>>& rig)
+{
+  std::shared_ptr<Rig<To>> ret(new Rig<To>());
+  for(const std::shared_ptr<CameraInterface<From>>& cam : rig->cameras_) {
+    std::shared_ptr<CameraInterface<To>> cast = CastCamera<To>(cam);
+    if(!cast) {
+      return nullptr;
+    }
+    ret->AddCamera(cast);
+  }
+  return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Transfer3d of rays of camera `from`, with inverse depths rho, into every
+/// camera b of the rig: pix[b] receives the pixels, and dpix_dray[b] the
+/// Jacobians if dpix_dray is given. Each relative pose is formed once.
+template<typename Scalar>
+inline void TransferToRig(
+    const Rig<Scalar>& rig,
+    size_t from,
+    const Eigen::Matrix<Scalar,3,Eigen::Dynamic>& rays,
+    const Eigen::Matrix<Scalar,Eigen::Dynamic,1>& rho,
+    std::vector<Eigen::Matrix<Scalar,2,Eigen::Dynamic>>& pix,
+    std::vector<Eigen::Matrix<Scalar,2,Eigen::Dynamic>>* dpix_dray = nullptr
+  )
+{
+  const size_t num_cams = rig.cameras_.size();
+  const Sophus::SE3Group<Scalar> t_ra = rig.cameras_[from]->Pose();
+  pix.resize(num_cams);
+  if(dpix_dray) {
+    dpix_dray->resize(num_cams);
+  }
+  for(size_t b = 0; b < num_cams; ++b) {
+    const std::shared_ptr<CameraInterface<Scalar>>& cam = rig.cameras_[b];
+    const Sophus::SE3Group<Scalar> t_ba = cam->Pose().inverse() * t_ra;
+    pix[b].resize(2, rays.cols());
+    cam->Transfer3d(t_ba, rays, rho, pix[b],
+                    dpix_dray ? &(*dpix_dray)[b] : nullptr);
+  }
+}
+
 }
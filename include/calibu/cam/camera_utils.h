@@ -25,16 +25,24 @@
 */
 
 #pragma once
+
+// Model kernels are also compiled as device functions by the CUDA backend
+#ifdef __CUDACC__
+#  define CALIBU_HOST_DEVICE __host__ __device__
+#else
+#  define CALIBU_HOST_DEVICE
+#endif
+
 namespace calibu {
 struct CameraUtils {
   /** Euclidean distance from (0, 0) to given pixel */
   template<typename T>
-  static inline T PixNorm(const T* pix) {
+  CALIBU_HOST_DEVICE static inline T PixNorm(const T* pix) {
     return sqrt(pix[0] * pix[0] + pix[1] * pix[1]);
   }
 
   template<typename T>
-  static void Scale(const double s, T* params) {
+  CALIBU_HOST_DEVICE static void Scale(const double s, T* params) {
     params[0] *= s;
     params[1] *= s;
     params[2] = s*(params[2]+0.5) - 0.5;
@@ -42,7 +50,7 @@ struct CameraUtils {
   }
 
   template<typename T>
-  static inline void K(const T* params, T* Kmat) {
+  CALIBU_HOST_DEVICE static inline void K(const T* params, T* Kmat) {
     Kmat[0] = params[0];
     Kmat[1] = 0;
     Kmat[2] = 0;
@@ -63,7 +71,7 @@ struct CameraUtils {
    * @param pix A 2-vector (x, y)
    * */
   template<typename T>
-  static inline void Dehomogenize(const T* ray, T* px_dehomogenized) {
+  CALIBU_HOST_DEVICE static inline void Dehomogenize(const T* ray, T* px_dehomogenized) {
     px_dehomogenized[0] = ray[0] / ray[2];
     px_dehomogenized[1] = ray[1] / ray[2];
   }
@@ -75,7 +83,7 @@ struct CameraUtils {
    * @param ray_homogenized A 3-vector to be filled in
    */
   template<typename T>
-  static inline void Homogenize(const T* pix, T* ray_homogenized) {
+  CALIBU_HOST_DEVICE static inline void Homogenize(const T* pix, T* ray_homogenized) {
     ray_homogenized[0] = pix[0];
     ray_homogenized[1] = pix[1];
     ray_homogenized[2] = (T)1.0;
@@ -89,7 +97,7 @@ struct CameraUtils {
    * @param j A 2x3 matrix stored in column-major order
    */
   template<typename T>
-  static inline void dDehomogenize_dray(const T* ray, T* j) {
+  CALIBU_HOST_DEVICE static inline void dDehomogenize_dray(const T* ray, T* j) {
     const T z_sq = ray[2] * ray[2];
     const T z_inv = 1.0 / ray[2];
     // Column major storage order.
@@ -98,13 +106,13 @@ struct CameraUtils {
   }
 
   template<typename T>
-  static inline void dMultK_dparams(const T*, const T* pix, T* j) {
+  CALIBU_HOST_DEVICE static inline void dMultK_dparams(const T*, const T* pix, T* j) {
     j[0] = pix[0];    j[2] = 0;       j[4] = 1;   j[6] = 0;
     j[1] = 0;         j[3] = pix[1];  j[5] = 0;   j[7] = 1;
   }
 
   template<typename T>
-  static inline void dMultInvK_dparams(const T* params, const T* pix, T* j) {
+  CALIBU_HOST_DEVICE static inline void dMultInvK_dparams(const T* params, const T* pix, T* j) {
     j[0] = -(pix[0] - params[2]) / (params[0] * params[0]);
     j[1] = 0;
     j[2] = 0;
@@ -127,7 +135,7 @@ struct CameraUtils {
    * length and principal point to place it in its imaged location.
    */
   template<typename T>
-  static inline void MultK(const T* params, const T* pix, T* pix_k) {
+  CALIBU_HOST_DEVICE static inline void MultK(const T* params, const T* pix, T* pix_k) {
     pix_k[0] = params[0] * pix[0] + params[2];
     pix_k[1] = params[1] * pix[1] + params[3];
   }
@@ -137,7 +145,7 @@ struct CameraUtils {
    * dehomogenized world coords.
    */
   template<typename T>
-  static inline void MultInvK(const T* params, const T* pix, T* pix_kinv) {
+  CALIBU_HOST_DEVICE static inline void MultInvK(const T* params, const T* pix, T* pix_kinv) {
     pix_kinv[0] = (pix[0] - params[2]) / params[0];
     pix_kinv[1] = (pix[1] - params[3]) / params[1];
   }
@@ -150,9 +158,12 @@ class LinearCamera : public CameraImpl<Scalar, 4, LinearCamera<Scalar> > {
   using Base::Base;
 
   static constexpr int NumParams = 4;
+  static constexpr CameraModelId kModelId = CameraModelId::kLinear;
+  static const char* TypeName() { return "calibu_fu_fv_u0_v0"; }
+  static constexpr bool kPacketKernels = true;
 
   template<typename T>
-  static void Scale( const double s, T* params ) {
+  CALIBU_HOST_DEVICE static void Scale( const double s, T* params ) {
     CameraUtils::Scale( s, params );
   }
 
@@ -160,12 +171,12 @@ class LinearCamera : public CameraImpl<Scalar, 4, LinearCamera<Scalar> > {
   // and sy. If your camera model doesn't respect this ordering, then evaluating
   // K for it will result in an incorrect matrix.
   template<typename T>
-  static void K( const T* params , T* Kmat) {
+  CALIBU_HOST_DEVICE static void K( const T* params , T* Kmat) {
     CameraUtils::K( params , Kmat);
   }
 
   template<typename T>
-  static void Unproject(const T* pix, const T* params, T* ray) {
+  CALIBU_HOST_DEVICE static void Unproject(const T* pix, const T* params, T* ray) {
     // First multiply by inverse K and calculate distortion parameter.
     T pix_kinv[2];
     CameraUtils::MultInvK(params, pix, pix_kinv);
@@ -174,26 +185,26 @@ class LinearCamera : public CameraImpl<Scalar, 4, LinearCamera<Scalar> > {
   }
 
   template<typename T>
-  static void Project(const T* ray, const T* params, T* pix) {
+  CALIBU_HOST_DEVICE static void Project(const T* ray, const T* params, T* pix) {
     // De-homogenize and multiply by K.
     CameraUtils::Dehomogenize(ray, pix);
     CameraUtils::MultK<T>(params, pix, pix);
   }
 
   template<typename T>
-  static void dProject_dparams(const T* ray, const T* params, T* j) {
+  CALIBU_HOST_DEVICE static void dProject_dparams(const T* ray, const T* params, T* j) {
     T pix[2];
     CameraUtils::Dehomogenize(ray, pix);
     CameraUtils::dMultK_dparams(params, pix, j);
   }
 
   template<typename T>
-  static void dUnproject_dparams(const T* pix, const T* params, T* j) {
+  CALIBU_HOST_DEVICE static void dUnproject_dparams(const T* pix, const T* params, T* j) {
     CameraUtils::dMultInvK_dparams(params, pix, j);
   }
 
   template<typename T>
-  static void dProject_dray(const T* ray, const T* params, T* j) {
+  CALIBU_HOST_DEVICE static void dProject_dray(const T* ray, const T* params, T* j) {
     // De-homogenize and multiply by K.
     T pix[2];
     CameraUtils::Dehomogenize(ray, pix);
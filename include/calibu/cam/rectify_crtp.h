@@ -22,13 +22,20 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <sophus/se3.hpp>
 
 #include <calibu/Platform.h>
 #include <calibu/cam/camera_crtp.h>
 #include <calibu/cam/camera_crtp_impl.h>
+#include <calibu/utils/ParallelFor.h>
 #include <calibu/utils/Range.h>
+#include <calibu/utils/Trace.h>
 
 #include <iostream>
 
@@ -85,7 +92,7 @@ namespace calibu
 
       inline unsigned int Height() const
       {
-        return m_vLutPixels.size() / m_nWidth;
+        return m_nWidth ? m_vLutPixels.size() / m_nWidth : 0;
       }
 
       inline void SetPoint( unsigned int nRow, unsigned int nCol, const BilinearLutPoint& p )
@@ -98,6 +105,73 @@ namespace calibu
       int m_nWidth; // so m_nHeight = m_vPixels.size()/m_nWidth
     };
 
+  ///////////////////////////////////////////////////////////////////////////////
+  /// LookupTable for 8 bit single channel images in 6 bytes per pixel: the
+  /// offset of the top left source pixel, and the horizontal and vertical
+  /// fractions in 1/256 of a pixel. Built from a LookupTable by
+  /// PackLookupTable().
+  CALIBU_EXPORT
+    struct PackedLookupTable
+    {
+      inline PackedLookupTable():m_nWidth(0),m_nSrcWidth(0),m_nSrcSize(0){};
+
+      inline unsigned int Width() const
+      {
+        return m_nWidth;
+      }
+
+      inline unsigned int Height() const
+      {
+        return m_nWidth ? m_vOffsets.size() / m_nWidth : 0;
+      }
+
+      std::vector<uint32_t> m_vOffsets; // to top left pixel in src image
+      std::vector<uint16_t> m_vFractions; // x | (y << 8)
+      int m_nWidth;
+      int m_nSrcWidth; // row stride of the src image
+      int m_nSrcSize; // one past the last src pixel the table reads
+    };
+
+  ///////////////////////////////////////////////////////////////////////////////
+  /// Rectification map holding the warped source coordinates only every
+  /// m_nStep output pixels in each direction; Rectify interpolates them
+  /// bilinearly for the pixels in between. Built by
+  /// CreateSubsampledLookupTable(), which records the largest deviation from
+  /// the exact coordinates it measured in m_fMaxError.
+  CALIBU_EXPORT
+    struct SubsampledLookupTable
+    {
+      inline SubsampledLookupTable()
+        : m_nWidth(0), m_nHeight(0), m_nStep(1), m_nGridWidth(0),
+          m_nSrcWidth(0), m_nSrcHeight(0), m_fMaxError(0) {};
+
+      inline unsigned int Width() const
+      {
+        return m_nWidth;
+      }
+
+      inline unsigned int Height() const
+      {
+        return m_nHeight;
+      }
+
+      /// Source coordinates of grid node (i, j), output pixel (i, j) * m_nStep.
+      inline const Eigen::Vector2f& Node( int i, int j ) const
+      {
+        return m_vGrid[ j*m_nGridWidth + i ];
+      }
+
+      // Covers output pixels up to and including the last row and column
+      std::vector<Eigen::Vector2f> m_vGrid;
+      int m_nWidth;
+      int m_nHeight;
+      int m_nStep;
+      int m_nGridWidth; // so grid height = m_vGrid.size()/m_nGridWidth
+      int m_nSrcWidth;
+      int m_nSrcHeight;
+      float m_fMaxError; // in source pixels
+    };
+
   enum BorderTreatment{
 	  BORDER_REPEAT,
 	  BORDER_BLACK
@@ -125,6 +199,198 @@ namespace calibu
 		int lookup_height = 0
         );
 
+    /// Float camera versions of the above, projecting in single precision.
+    CALIBU_EXPORT void CreateLookupTable(
+        const std::shared_ptr<calibu::CameraInterface<float>>& cam_from,
+        const Eigen::Matrix3f& R_onKinv,
+        LookupTable& lut,
+		int lookup_width = 0,
+		int lookup_height= 0
+        );
+
+    void CreateLookupTable(
+        const std::shared_ptr<calibu::CameraInterface<float>>& cam_from,
+        LookupTable& lut,
+		int lookup_width = 0,
+		int lookup_height = 0
+        );
+
+    /// CreateLookupTable with R_onKinv, its rows spread over executor. Each
+    /// band of rows is projected in one batch call to cam_from.
+    CALIBU_EXPORT void CreateLookupTable(
+        const std::shared_ptr<calibu::CameraInterface<double>>& cam_from,
+        const Eigen::Matrix3d& R_onKinv,
+        LookupTable& lut,
+        const Executor& executor,
+		int lookup_width = 0,
+		int lookup_height= 0
+        );
+
+    CALIBU_EXPORT void CreateLookupTable(
+        const std::shared_ptr<calibu::CameraInterface<float>>& cam_from,
+        const Eigen::Matrix3f& R_onKinv,
+        LookupTable& lut,
+        const Executor& executor,
+		int lookup_width = 0,
+		int lookup_height= 0
+        );
+
+  ///////////////////////////////////////////////////////////////////////////////
+  /// LookupTable rebuilt on a background thread, e.g. whenever an online
+  /// calibration updates the intrinsics. Rebuild() returns at once; the new
+  /// table is swapped in with a single atomic pointer exchange when it is
+  /// complete, so Table() never waits for a build and callers still holding
+  /// the previous table can keep rectifying with it.
+  class CALIBU_EXPORT AsyncLookupTable
+  {
+    public:
+      /// Builds run over executor, or serially on the background thread if
+      /// it is empty.
+      explicit AsyncLookupTable( const Executor& executor = Executor() );
+
+      /// Finishes the build in progress, dropping a queued one.
+      ~AsyncLookupTable();
+
+      /// Latest complete table, nullptr until the first build finishes.
+      inline std::shared_ptr<const LookupTable> Table() const
+      {
+        return std::atomic_load( &m_pTable );
+      }
+
+      /// Queue a build of the table CreateLookupTable would make. cam_from is
+      /// copied (see CastCamera; cameras of unknown model are shared, and
+      /// must not change until the build is done). A rebuild queued while
+      /// another is still waiting replaces it.
+      void Rebuild(
+          const std::shared_ptr<calibu::CameraInterface<double>>& cam_from,
+          const Eigen::Matrix3d& R_onKinv,
+          int lookup_width = 0,
+          int lookup_height = 0
+          );
+
+      /// Block until every queued build has been swapped in.
+      void Wait();
+
+      /// Number of tables swapped in so far.
+      inline uint64_t Generation() const
+      {
+        return m_nGeneration;
+      }
+
+    private:
+      AsyncLookupTable( const AsyncLookupTable& );
+      AsyncLookupTable& operator=( const AsyncLookupTable& );
+
+      void Run();
+
+      Executor m_Executor;
+      std::shared_ptr<const LookupTable> m_pTable;
+      std::atomic<uint64_t> m_nGeneration;
+
+      // Queued request and worker state, guarded by m_Mutex
+      std::mutex m_Mutex;
+      std::condition_variable m_Cond;
+      std::shared_ptr<calibu::CameraInterface<double>> m_pQueuedCam;
+      Eigen::Matrix3d m_QueuedR_onKinv;
+      int m_nQueuedWidth;
+      int m_nQueuedHeight;
+      bool m_bBusy;
+      bool m_bStop;
+      std::thread m_Thread;
+  };
+
+
+  /// Rows [nRowBegin, nRowEnd) of Rectify with the nWidth wide table at pLut,
+  /// for Channels interleaved channels. Channels is a compile time constant
+  /// so that the channel loop unrolls, or 0 to read the count from channels.
+  /// bNearest takes the source pixel nearest the remapped point instead of
+  /// blending, e.g. for depth images.
+  template <int Channels, bool bNearest, typename scalar>
+  void RectifyRowsN(
+          const BilinearLutPoint* pLut,
+          int nWidth,
+          const scalar* pInputImageData,
+          scalar* pOutputRectImageData,
+          int channels,
+          int nRowBegin, int nRowEnd
+          )
+  {
+    const int nChannels = Channels ? Channels : channels;
+    const BilinearLutPoint* ptr = pLut + nRowBegin * nWidth;
+    const BilinearLutPoint* end = pLut + nRowEnd * nWidth;
+    pOutputRectImageData += nRowBegin * nWidth * nChannels;
+
+    for( ; ptr != end; ++ptr, pOutputRectImageData += nChannels ) {
+      if( bNearest ) {
+        const int idx = (ptr->w10 + ptr->w11 < 0.5f ? ptr->idx0 : ptr->idx1) +
+                        (ptr->w01 + ptr->w11 < 0.5f ? 0 : 1);
+        const scalar* pIn = pInputImageData + idx * nChannels;
+        for( int n_channel = 0; n_channel < nChannels; ++n_channel ) {
+          pOutputRectImageData[n_channel] = pIn[n_channel];
+        }
+      } else {
+        const scalar* pIn0 = pInputImageData + ptr->idx0 * nChannels;
+        const scalar* pIn1 = pInputImageData + ptr->idx1 * nChannels;
+        for( int n_channel = 0; n_channel < nChannels; ++n_channel ) {
+          pOutputRectImageData[n_channel] =
+            (scalar) ( ptr->w00 * pIn0[n_channel] +
+                       ptr->w01 * pIn0[nChannels + n_channel] +
+                       ptr->w10 * pIn1[n_channel] +
+                       ptr->w11 * pIn1[nChannels + n_channel] );
+        }
+      }
+    }
+  }
+
+  enum Interpolation{
+	  INTERP_BILINEAR,
+	  INTERP_NEAREST
+  };
+
+  /// Rows [nRowBegin, nRowEnd) of Rectify with the nWidth wide table at pLut,
+  /// e.g. one mapped from a file. 1, 3 and 4 channel images run kernels
+  /// specialised for their channel count.
+  template <typename scalar>
+  void RectifyRows(
+          const BilinearLutPoint* pLut,
+          int nWidth,
+          const scalar* pInputImageData,
+          scalar* pOutputRectImageData,
+          int channels,
+          int nRowBegin, int nRowEnd,
+          Interpolation interp = INTERP_BILINEAR
+          )
+  {
+    typedef void (*RectifyRowsFn)(const BilinearLutPoint*, int, const scalar*,
+                                  scalar*, int, int, int);
+    static const RectifyRowsFn fns[2][5] = {
+      { &RectifyRowsN<0,false,scalar>, &RectifyRowsN<1,false,scalar>,
+        &RectifyRowsN<0,false,scalar>, &RectifyRowsN<3,false,scalar>,
+        &RectifyRowsN<4,false,scalar> },
+      { &RectifyRowsN<0,true,scalar>, &RectifyRowsN<1,true,scalar>,
+        &RectifyRowsN<0,true,scalar>, &RectifyRowsN<3,true,scalar>,
+        &RectifyRowsN<4,true,scalar> }
+    };
+    const RectifyRowsFn fn =
+        fns[interp == INTERP_NEAREST][(channels >= 0 && channels <= 4) ? channels : 0];
+    fn(pLut, nWidth, pInputImageData, pOutputRectImageData, channels,
+       nRowBegin, nRowEnd);
+  }
+
+  /// Rows [nRowBegin, nRowEnd) of Rectify.
+  template <typename scalar>
+  void RectifyRows(
+          const LookupTable& lut,
+          const scalar* pInputImageData,
+          scalar* pOutputRectImageData,
+          int channels,
+          int nRowBegin, int nRowEnd,
+          Interpolation interp = INTERP_BILINEAR
+          )
+  {
+    RectifyRows(lut.m_vLutPixels.data(), lut.Width(), pInputImageData,
+                pOutputRectImageData, channels, nRowBegin, nRowEnd, interp);
+  }
 
   /// Rectify image pInputImageData using lookup table generated by
   /// 'CreateLookupTable' to output image pOutputRectImageData.
@@ -133,36 +399,245 @@ namespace calibu
           const LookupTable& lut,
           const scalar* pInputImageData,
           scalar* pOutputRectImageData,
-          int w, int h, int channels = 1
+          int w, int h, int channels = 1,
+          Interpolation interp = INTERP_BILINEAR
           )
   {
-    // Make the most of the continuous block of memory!
-    const BilinearLutPoint* ptr   = &lut.m_vLutPixels[0];
+    // Make sure we have been given a correct lookup table.
+    assert(w == (int)lut.Width() && h == (int)lut.Height());
 
-    const int nHeight = lut.Height();
-    const int nWidth  = lut.Width();
+    RectifyRows(lut, pInputImageData, pOutputRectImageData, channels, 0, h,
+                interp);
+  }
 
-    // Make sure we have been given a correct lookup table.
-    assert(w== nWidth && h == nHeight);
-
-    for( int nRow = 0; nRow < nHeight; nRow++ ) {
-      for( int nCol = 0; nCol < nWidth; nCol++ ) {
-        for( int n_channel = 0; n_channel < channels; ++n_channel ) {
-          *pOutputRectImageData++ =
-            (scalar) ( ptr->w00 *
-                       pInputImageData[ptr->idx0 * channels + n_channel] +
-                ptr->w01 *
-                pInputImageData[(ptr->idx0 + 1) * channels + n_channel] +
-                ptr->w10 *
-                pInputImageData[ptr->idx1 * channels + n_channel] +
-                ptr->w11 *
-                pInputImageData[(ptr->idx1 + 1) * channels + n_channel] );
+  /// Output rows per task of the parallel Rectify overloads.
+  static const int kRectifyBandRows = 16;
+
+  inline int NumRectifyBands(int h)
+  {
+    return (h + kRectifyBandRows - 1) / kRectifyBandRows;
+  }
+
+  /// Rectify with bands of output rows run through executor, e.g.
+  /// MakeThreadExecutor(num_threads) or an application thread pool.
+  template <typename scalar>
+  void Rectify(
+          const LookupTable& lut,
+          const scalar* pInputImageData,
+          scalar* pOutputRectImageData,
+          int w, int h, int channels,
+          const Executor& executor,
+          Interpolation interp = INTERP_BILINEAR
+          )
+  {
+    assert(w == (int)lut.Width() && h == (int)lut.Height());
+
+    executor(NumRectifyBands(h), [&](size_t b) {
+      CALIBU_TRACE("Rectify band");
+      RectifyRows(lut, pInputImageData, pOutputRectImageData, channels,
+                  b * kRectifyBandRows,
+                  std::min<int>(h, (b + 1) * kRectifyBandRows), interp);
+    });
+  }
+
+  /// Rectify both images of a stereo pair, with the bands of the two
+  /// images shared out over one executor.
+  template <typename scalar>
+  void RectifyStereo(
+          const LookupTable& left_lut,
+          const LookupTable& right_lut,
+          const scalar* pLeftImageData,
+          const scalar* pRightImageData,
+          scalar* pLeftRectImageData,
+          scalar* pRightRectImageData,
+          int w, int h, int channels,
+          const Executor& executor,
+          Interpolation interp = INTERP_BILINEAR
+          )
+  {
+    assert(w == (int)left_lut.Width() && h == (int)left_lut.Height());
+    assert(w == (int)right_lut.Width() && h == (int)right_lut.Height());
+
+    const int bands = NumRectifyBands(h);
+    executor(2 * bands, [&](size_t i) {
+      const bool left = (int)i < bands;
+      const int b = left ? i : i - bands;
+      CALIBU_TRACE_IDS("Rectify band", -1, left ? 0 : 1);
+      RectifyRows(left ? left_lut : right_lut,
+                  left ? pLeftImageData : pRightImageData,
+                  left ? pLeftRectImageData : pRightRectImageData, channels,
+                  b * kRectifyBandRows,
+                  std::min<int>(h, (b + 1) * kRectifyBandRows), interp);
+    });
+  }
+
+  /// Create a SubsampledLookupTable for the same remapping as the
+  /// CreateLookupTable above, with the largest power of two grid step up to
+  /// max_step whose interpolation error, measured at the centre and edge
+  /// midpoints of every cell, is within max_error source pixels.
+  CALIBU_EXPORT void CreateSubsampledLookupTable(
+          const std::shared_ptr<calibu::CameraInterface<double>>& cam_from,
+          const Eigen::Matrix3d& R_onKinv,
+          SubsampledLookupTable& lut,
+          float max_error = 0.05f,
+          int max_step = 16,
+          int lookup_width = 0,
+          int lookup_height = 0
+          );
+
+  /// Grid nodes per row that RectifyRows of a SubsampledLookupTable keeps on
+  /// the stack, enough for 4096 pixel wide tables at a step of 8. Wider
+  /// grids fall back to the heap.
+  static const int kRectifyStackGridWidth = 513;
+
+  /// Rows [nRowBegin, nRowEnd) of Rectify with a SubsampledLookupTable.
+  /// Coordinates are clamped and blended as with a LookupTable.
+  template <typename scalar>
+  void RectifyRows(
+          const SubsampledLookupTable& lut,
+          const scalar* pInputImageData,
+          scalar* pOutputRectImageData,
+          int channels,
+          int nRowBegin, int nRowEnd
+          )
+  {
+    const int nWidth = lut.m_nWidth;
+    const int nStep = lut.m_nStep;
+    const int nSrcWidth = lut.m_nSrcWidth;
+    const int nSrcHeight = lut.m_nSrcHeight;
+    const float fInvStep = 1.0f / nStep;
+
+    // Grid row, on the stack unless the grid is unusually wide
+    Eigen::Vector2f stack_row[kRectifyStackGridWidth];
+    std::vector<Eigen::Vector2f> heap_row;
+    Eigen::Vector2f* row = stack_row;
+    if( lut.m_nGridWidth > kRectifyStackGridWidth ) {
+      heap_row.resize(lut.m_nGridWidth);
+      row = heap_row.data();
+    }
+    pOutputRectImageData += nRowBegin * nWidth * channels;
+
+    for( int nRow = nRowBegin; nRow < nRowEnd; nRow++ ) {
+      // Grid interpolated down to this row
+      const int gy = nRow / nStep;
+      const float fy = (nRow - gy*nStep) * fInvStep;
+      for( int gx = 0; gx < lut.m_nGridWidth; ++gx ) {
+        row[gx] = (1-fy) * lut.Node(gx, gy) + fy * lut.Node(gx, gy+1);
+      }
+
+      // Step along the row a cell at a time, without divisions
+      for( int nCell = 0; nCell * nStep < nWidth; ++nCell ) {
+        const int nCols = std::min(nStep, nWidth - nCell * nStep);
+        float px = row[nCell][0];
+        float py = row[nCell][1];
+        const float dx = (row[nCell+1][0] - px) * fInvStep;
+        const float dy = (row[nCell+1][1] - py) * fInvStep;
+        for( int k = 0; k < nCols; ++k, px += dx, py += dy ) {
+          const float x = std::min(std::max(0.0f, px), float(nSrcWidth - 1));
+          const float y = std::min(std::max(0.0f, py), float(nSrcHeight - 1));
+          int u = (int) x;
+          int v = (int) y;
+          float su = x - u;
+          float sv = y - v;
+          if(u == nSrcWidth-1) {
+            u -= 1;
+            su = 1.0;
+          }
+          if(v == nSrcHeight-1) {
+            v -= 1;
+            sv = 1.0;
+          }
+
+          const int idx0 = u + v*nSrcWidth;
+          const int idx1 = idx0 + nSrcWidth;
+          const float w00 = (1-su)*(1-sv);
+          const float w01 =    su *(1-sv);
+          const float w10 = (1-su)*sv;
+          const float w11 =     su*sv;
+          for( int n_channel = 0; n_channel < channels; ++n_channel ) {
+            *pOutputRectImageData++ =
+              (scalar) ( w00 * pInputImageData[idx0 * channels + n_channel] +
+                         w01 * pInputImageData[(idx0 + 1) * channels + n_channel] +
+                         w10 * pInputImageData[idx1 * channels + n_channel] +
+                         w11 * pInputImageData[(idx1 + 1) * channels + n_channel] );
+          }
         }
-        ptr++;
       }
     }
   }
 
+  /// Rectify with a SubsampledLookupTable.
+  template <typename scalar>
+  void Rectify(
+          const SubsampledLookupTable& lut,
+          const scalar* pInputImageData,
+          scalar* pOutputRectImageData,
+          int w, int h, int channels = 1
+          )
+  {
+    assert(w == (int)lut.Width() && h == (int)lut.Height());
+
+    RectifyRows(lut, pInputImageData, pOutputRectImageData, channels, 0, h);
+  }
+
+  /// Rectify with a SubsampledLookupTable in bands of rows over executor.
+  template <typename scalar>
+  void Rectify(
+          const SubsampledLookupTable& lut,
+          const scalar* pInputImageData,
+          scalar* pOutputRectImageData,
+          int w, int h, int channels,
+          const Executor& executor
+          )
+  {
+    assert(w == (int)lut.Width() && h == (int)lut.Height());
+
+    executor(NumRectifyBands(h), [&](size_t b) {
+      CALIBU_TRACE("Rectify band");
+      RectifyRows(lut, pInputImageData, pOutputRectImageData, channels,
+                  b * kRectifyBandRows,
+                  std::min<int>(h, (b + 1) * kRectifyBandRows));
+    });
+  }
+
+  /// Quantise lut for Rectify of 8 bit images. Interpolation weights are
+  /// rounded to 1/256 of a pixel, so results are within one grey level of
+  /// the rounded float blend (Rectify with a LookupTable truncates).
+  CALIBU_EXPORT void PackLookupTable(
+          const LookupTable& lut,
+          PackedLookupTable& packed
+          );
+
+  /// Rectify an 8 bit single channel image with a packed lookup table, in
+  /// fixed point. Uses AVX2 gathers where the CPU supports them.
+  CALIBU_EXPORT void Rectify(
+          const PackedLookupTable& lut,
+          const unsigned char* pInputImageData,
+          unsigned char* pOutputRectImageData,
+          int w, int h
+          );
+
+  /// Packed Rectify with bands of output rows run through executor.
+  CALIBU_EXPORT void Rectify(
+          const PackedLookupTable& lut,
+          const unsigned char* pInputImageData,
+          unsigned char* pOutputRectImageData,
+          int w, int h,
+          const Executor& executor
+          );
+
+  /// Packed Rectify of both images of a stereo pair over one executor.
+  CALIBU_EXPORT void RectifyStereo(
+          const PackedLookupTable& left_lut,
+          const PackedLookupTable& right_lut,
+          const unsigned char* pLeftImageData,
+          const unsigned char* pRightImageData,
+          unsigned char* pLeftRectImageData,
+          unsigned char* pRightRectImageData,
+          int w, int h,
+          const Executor& executor
+          );
+
   /// Some helper functions that were in the old Undistort/Distort world.
   template<typename T> inline
   Eigen::Matrix<T,2,1> Project(const Eigen::Matrix<T,3,1>& P)
@@ -210,5 +685,17 @@ namespace calibu
     }
     return range;
   }
+
+  /// MinMaxRotatedCol and MinMaxRotatedRow together, unprojecting the image
+  /// border in a single batch call: the largest rectangle range_x by range_y
+  /// of the z = 1 plane, for rays rotated by Rnl_l, inside the image of cam
+  /// (for borders which bulge no further out than their end points). Border
+  /// rays rotated behind the plane are ignored.
+  CALIBU_EXPORT void ValidRotatedRegion(
+          const std::shared_ptr<calibu::CameraInterface<double>>& cam,
+          const Eigen::Matrix3d& Rnl_l,
+          Range& range_x,
+          Range& range_y
+          );
 }
 
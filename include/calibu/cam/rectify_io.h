@@ -0,0 +1,162 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove,
+                      Gabe Sibley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <calibu/Platform.h>
+#include <calibu/cam/rectify_crtp.h>
+
+namespace calibu
+{
+  ///////////////////////////////////////////////////////////////////////////////
+  /// Version 1 binary rectification map files. A 128 byte header, giving the
+  /// map kind and size and the hash of the remapping it was built for, is
+  /// followed by the table in host byte order: BilinearLutPoint for a
+  /// LookupTable, Eigen::Vector2f grid nodes for a SubsampledLookupTable.
+  /// Files are rejected if their version, byte order or hash differ.
+
+  /// Hash of everything a map built by CreateLookupTable or
+  /// CreateSubsampledLookupTable depends on: the camera model, size and
+  /// parameters, R_onKinv and the lookup size.
+  CALIBU_EXPORT uint64_t RectificationHash(
+          const calibu::CameraInterface<double>& cam_from,
+          const Eigen::Matrix3d& R_onKinv,
+          int lookup_width = 0,
+          int lookup_height = 0
+          );
+
+  /// Write lut to filename, tagged with hash. Returns false on I/O errors.
+  CALIBU_EXPORT bool SaveLookupTable(
+          const std::string& filename,
+          const LookupTable& lut,
+          uint64_t hash
+          );
+
+  CALIBU_EXPORT bool SaveLookupTable(
+          const std::string& filename,
+          const SubsampledLookupTable& lut,
+          uint64_t hash
+          );
+
+  /// Read a map written by SaveLookupTable. Returns false, leaving lut
+  /// untouched, if the file cannot be read, holds the other kind of map or
+  /// was written for another hash (a stale map).
+  CALIBU_EXPORT bool LoadLookupTable(
+          const std::string& filename,
+          LookupTable& lut,
+          uint64_t hash
+          );
+
+  CALIBU_EXPORT bool LoadLookupTable(
+          const std::string& filename,
+          SubsampledLookupTable& lut,
+          uint64_t hash
+          );
+
+  ///////////////////////////////////////////////////////////////////////////////
+  /// Saved LookupTable used in place: the file is mapped read only, so every
+  /// process rectifying with it shares the one page cached copy. Falls back
+  /// to reading the file where mmap is not available.
+  class CALIBU_EXPORT MappedLookupTable
+  {
+    public:
+      inline MappedLookupTable()
+        : m_pMap(nullptr), m_nMapSize(0), m_pPixels(nullptr),
+          m_nWidth(0), m_nHeight(0) {};
+
+      ~MappedLookupTable();
+
+      /// Map filename, checked as by LoadLookupTable. Returns false, and
+      /// leaves the table closed, on failure.
+      bool Open( const std::string& filename, uint64_t hash );
+
+      void Close();
+
+      inline bool IsOpen() const
+      {
+        return m_pPixels != nullptr;
+      }
+
+      inline unsigned int Width() const
+      {
+        return m_nWidth;
+      }
+
+      inline unsigned int Height() const
+      {
+        return m_nHeight;
+      }
+
+      inline const BilinearLutPoint* Data() const
+      {
+        return m_pPixels;
+      }
+
+    private:
+      MappedLookupTable( const MappedLookupTable& );
+      MappedLookupTable& operator=( const MappedLookupTable& );
+
+      void* m_pMap;
+      size_t m_nMapSize;
+      std::vector<unsigned char> m_vBuffer; // without mmap
+      const BilinearLutPoint* m_pPixels;
+      int m_nWidth;
+      int m_nHeight;
+  };
+
+  /// Rectify with a MappedLookupTable, as with a LookupTable.
+  template <typename scalar>
+  void Rectify(
+          const MappedLookupTable& lut,
+          const scalar* pInputImageData,
+          scalar* pOutputRectImageData,
+          int w, int h, int channels = 1
+          )
+  {
+    assert(lut.IsOpen() && w == (int)lut.Width() && h == (int)lut.Height());
+
+    RectifyRows(lut.Data(), w, pInputImageData, pOutputRectImageData,
+                channels, 0, h);
+  }
+
+  /// Rectify with a MappedLookupTable in bands of rows over executor.
+  template <typename scalar>
+  void Rectify(
+          const MappedLookupTable& lut,
+          const scalar* pInputImageData,
+          scalar* pOutputRectImageData,
+          int w, int h, int channels,
+          const Executor& executor
+          )
+  {
+    assert(lut.IsOpen() && w == (int)lut.Width() && h == (int)lut.Height());
+
+    executor(NumRectifyBands(h), [&](size_t b) {
+      RectifyRows(lut.Data(), w, pInputImageData, pOutputRectImageData,
+                  channels, b * kRectifyBandRows,
+                  std::min<int>(h, (b + 1) * kRectifyBandRows));
+    });
+  }
+}
@@ -45,5 +45,21 @@ namespace calibu
         LookupTable& right_lut
         );
 
+/// As CreateScanlineRectifiedLookupAndCameras, with the new cameras and
+/// lookup tables cropped to the rectangle of the rectified image plane seen
+/// by both cameras (see ValidRotatedRegion), so that no output pixel is
+/// clamped border. Pixels are square, at no more than the central resolution
+/// of either source camera and in an image no larger than the left one.
+/// Returns nullptr if the cameras share no view.
+    CALIBU_EXPORT
+    std::shared_ptr<calibu::Rig<double> > CreateCroppedScanlineRectifiedLookupAndCameras(
+        const Sophus::SE3d& T_rl,
+        const std::shared_ptr<calibu::CameraInterface<double>> cam_left,
+        const std::shared_ptr<calibu::CameraInterface<double>> cam_right,
+        Sophus::SE3d& T_nr_nl,
+        LookupTable& left_lut,
+        LookupTable& right_lut
+        );
+
 }
 
@@ -62,9 +62,43 @@ std::pair<Eigen::Vector3d,Eigen::Matrix3d > PlaneFromConics(
     double plane_circle_radius,
     const Eigen::Matrix3d& K, double inlier_threshold
                                                             );
+/** Radius of the circle of the same area as ellipse c, the geometric mean
+ * of its semi-axes. Half the mean bbox side if c is degenerate. */
+CALIBU_EXPORT
+double ConicRadius( const Conic& c );
+
+/** Returns conic c moved by offset in the image (bbox moved to match). */
+CALIBU_EXPORT
+Conic TranslateConic( const Conic& c, const Eigen::Vector2i& offset );
+
 CALIBU_EXPORT
 Conic UnmapConic( const Conic& c, const std::shared_ptr<CameraInterface<double>> cam );
 
+CALIBU_EXPORT
+Conic UnmapConic( const Conic& c, const std::shared_ptr<CameraInterface<float>> cam );
+
+/** Sample points of UnmapConics, kept to avoid reallocation per frame */
+template<typename Scalar>
+struct UnmapConicsWorkspace {
+  Eigen::Matrix<Scalar,2,Eigen::Dynamic> d, u;
+  Eigen::Matrix<Scalar,3,Eigen::Dynamic> rays;
+  std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > dc, uc;
+};
+
+/** As UnmapConic for every conic, into unmapped. The sample points of all
+ * conics are unprojected and projected in one batch camera call each. */
+CALIBU_EXPORT
+void UnmapConics( const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+                  const std::shared_ptr<CameraInterface<double>> cam,
+                  std::vector<Conic, Eigen::aligned_allocator<Conic> >& unmapped,
+                  UnmapConicsWorkspace<double>& workspace );
+
+CALIBU_EXPORT
+void UnmapConics( const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+                  const std::shared_ptr<CameraInterface<float>> cam,
+                  std::vector<Conic, Eigen::aligned_allocator<Conic> >& unmapped,
+                  UnmapConicsWorkspace<float>& workspace );
+
 /** Returns the major and minor axes lengths of the conic */
 CALIBU_EXPORT
 Eigen::Vector2d GetAxesLengths(const Conic& c);
@@ -27,6 +27,9 @@
 #include <calibu/Platform.h>
 #include <calibu/image/ImageProcessing.h>
 #include <calibu/conics/Conic.h>
+#include <calibu/conics/ConicSet.h>
+#include <calibu/utils/ParallelFor.h>
+#include <calibu/utils/Stats.h>
 
 namespace calibu {
 
@@ -36,7 +39,10 @@ struct ParamsConicFinder
         conic_min_area(25),
         conic_max_area(4E4),
         conic_min_density(0.4),
-        conic_min_aspect(0.1)
+        conic_min_aspect(0.1),
+        conic_float_accumulate(false),
+        conic_min_gradient(0),
+        conic_threads(1)
     {
 
     }
@@ -45,6 +51,15 @@ struct ParamsConicFinder
     float conic_max_area;
     float conic_min_density;
     float conic_min_aspect;
+
+    // Accumulate ellipse fits in vectorised single precision
+    bool conic_float_accumulate;
+
+    // Ignore pixels with gradient magnitude below this when fitting
+    float conic_min_gradient;
+
+    // Threads used to fit candidates when no executor has been set
+    int conic_threads;
 };
 
 CALIBU_EXPORT
@@ -52,6 +67,9 @@ class ConicFinder
 {
 public:
     ConicFinder();
+
+    // Conics are reported in full frame coordinates, also when imgs only
+    // processed a region of the frame.
     void Find(const ImageProcessing& imgs);
 
   inline const std::vector<Conic, Eigen::aligned_allocator<Conic> >&
@@ -59,18 +77,41 @@ public:
         return conics;
     }
 
+    // Centres, radii and bounding boxes of Conics(), in the same order
+    inline const ConicSet& Columns() const {
+        return columns;
+    }
+
     ParamsConicFinder& Params() {
         return params;
     }
 
+    // Timings and counters for the last Find (requires BUILD_STATS)
+    const ConicFinderStats& Stats() const {
+        return stats;
+    }
+
+    // Fit candidates through executor, e.g. an application thread pool.
+    // Conics() keeps the candidate order regardless of executor.
+    void SetExecutor(const Executor& exec) {
+        executor = exec;
+    }
+
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 protected:
     // Output of this class
   std::vector<PixelClass> candidates;
   std::vector<Conic, Eigen::aligned_allocator<Conic> > conics;
+  ConicSet columns;
 
   ParamsConicFinder params;
+  ConicFinderStats stats;
+  Executor executor;
+
+  // Per candidate fitting results
+  std::vector<Conic, Eigen::aligned_allocator<Conic> > fitted;
+  std::vector<char> fitted_ok;
 };
 
 }
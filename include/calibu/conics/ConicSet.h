@@ -0,0 +1,90 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+#include <calibu/Platform.h>
+#include <calibu/conics/Conic.h>
+#include <calibu/utils/Rectangle.h>
+#include <calibu/utils/Span.h>
+
+namespace calibu {
+
+// The fields of conics read on every frame, stored column by column so that
+// passes over the centres (neighbour search, PnP, drawing) don't stream the
+// rest of each Conic through the cache. Conic i has centre center[i], equal
+// area radius radius[i] and bounding box bbox[i]. The quadratic forms C and
+// Dual are only kept in the Conic itself.
+CALIBU_EXPORT
+class ConicSet
+{
+public:
+    typedef std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > CenterVector;
+
+    void Clear()
+    {
+        center.clear();
+        radius.clear();
+        bbox.clear();
+    }
+
+    void Reserve(size_t n)
+    {
+        center.reserve(n);
+        radius.reserve(n);
+        bbox.reserve(n);
+    }
+
+    void Add(const Conic& c)
+    {
+        center.push_back(c.center);
+        radius.push_back(ConicRadius(c));
+        bbox.push_back(c.bbox);
+    }
+
+    // Replace contents with conics, keeping capacity
+    void Assign(const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics)
+    {
+        Clear();
+        Reserve(conics.size());
+        for(size_t i=0; i < conics.size(); ++i) {
+            Add(conics[i]);
+        }
+    }
+
+    size_t Size() const {
+        return center.size();
+    }
+
+    Span<Eigen::Vector2d> Centers() const { return center; }
+    Span<double> Radii() const { return radius; }
+    Span<IRectangle> BBoxes() const { return bbox; }
+
+    CenterVector center;
+    std::vector<double> radius;
+    std::vector<IRectangle> bbox;
+};
+
+}
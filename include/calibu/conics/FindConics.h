@@ -36,6 +36,27 @@ Eigen::Matrix3d FindEllipse(
         double& /*residual*/
         );
 
+// As above, ignoring pixels whose gradient magnitude is below min_gradient.
+template<typename TdI>
+Eigen::Matrix3d FindEllipse(
+        const int w, const int /*h*/,
+        const TdI* dI,
+        const IRectangle& r,
+        double& /*residual*/,
+        float min_gradient
+        );
+
+// Same estimate as FindEllipse, with the normal equations accumulated in
+// vectorised single precision (compensated) relative to the region centre.
+template<typename TdI>
+Eigen::Matrix3d FindEllipseFloat(
+        const int w, const int /*h*/,
+        const TdI* dI,
+        const IRectangle& r,
+        double& /*residual*/,
+        float min_gradient
+        );
+
 CALIBU_EXPORT
 void FindCandidateConicsFromLabels(
         unsigned w, unsigned h,
@@ -55,4 +76,26 @@ void FindConics(
         std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics
         );
 
+// Fit a single candidate region, returning false if the fitted centre lies
+// too far from the centre of the region.
+template<typename TdI>
+bool FitConic(
+        const int w, const int h,
+        const PixelClass& candidate,
+        const TdI* dI,
+        Conic& conic,
+        bool float_accumulate,
+        float min_gradient
+        );
+
+template<typename TdI>
+void FindConics(
+        const int w, const int h,
+        const std::vector<PixelClass>& candidates,
+        const TdI* dI,
+        std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+        bool float_accumulate,
+        float min_gradient
+        );
+
 }
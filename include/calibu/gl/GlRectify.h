@@ -0,0 +1,184 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <pangolin/gl.h>
+#include <pangolin/gldraw.h>
+#include <pangolin/glsl.h>
+
+#include <calibu/Platform.h>
+#include <calibu/cam/rectify_crtp.h>
+
+namespace calibu {
+
+/// Rectify with a LookupTable or SubsampledLookupTable on the GPU. The map
+/// is uploaded once as an RG32F texture of source pixel coordinates and the
+/// remap runs in a fragment shader, from a texture of the source image into
+/// a texture the size of the map, which can be drawn directly or read back
+/// into a pixel buffer. Source pixels are blended by the texture unit, to
+/// the 1/256 of a pixel of typical hardware, and a subsampled map is
+/// interpolated the same way. Needs a current GL context.
+class GlRectifier
+{
+public:
+    GlRectifier() : fbo_tid_(0), width_(0), height_(0), src_width_(0), src_height_(0), map_scale_(1)
+    {
+        prog_.AddShader(pangolin::GlSlFragmentShader,
+            "#version 120\n"
+            "uniform sampler2D src;\n"       // source image, linear sampling
+            "uniform sampler2D map;\n"       // source pixel coordinates
+            "uniform vec2 src_size;\n"
+            "uniform vec2 map_size;\n"
+            "uniform float map_scale;\n"     // 1 / grid step
+            "void main() {\n"
+            "  vec2 p = (gl_FragCoord.xy - 0.5) * map_scale + 0.5;\n"
+            "  vec2 uv = texture2D(map, p / map_size).xy;\n"
+            "  gl_FragColor = texture2D(src, (uv + 0.5) / src_size);\n"
+            "}\n");
+        prog_.Link();
+    }
+
+    /// Upload lut, built for a src_width x src_height source camera.
+    void SetLookupTable(const LookupTable& lut, int src_width, int src_height)
+    {
+        // Recover the clamped coordinates from the blend weights
+        std::vector<float> uv(2 * lut.m_vLutPixels.size());
+        for(size_t i = 0; i < lut.m_vLutPixels.size(); ++i) {
+            const BilinearLutPoint& p = lut.m_vLutPixels[i];
+            uv[2*i+0] = p.idx0 % src_width + p.w01 + p.w11;
+            uv[2*i+1] = p.idx0 / src_width + p.w10 + p.w11;
+        }
+        UploadMap(uv.data(), lut.Width(), lut.Height(), false);
+        width_ = lut.Width();
+        height_ = lut.Height();
+        src_width_ = src_width;
+        src_height_ = src_height;
+        map_scale_ = 1;
+    }
+
+    /// Upload the grid of lut; the GPU interpolates it between nodes.
+    void SetLookupTable(const SubsampledLookupTable& lut)
+    {
+        const int grid_height = lut.m_vGrid.size() / lut.m_nGridWidth;
+        UploadMap(lut.m_vGrid[0].data(), lut.m_nGridWidth, grid_height, true);
+        width_ = lut.Width();
+        height_ = lut.Height();
+        src_width_ = lut.m_nSrcWidth;
+        src_height_ = lut.m_nSrcHeight;
+        map_scale_ = 1.0f / lut.m_nStep;
+    }
+
+    int Width() const { return width_; }
+
+    int Height() const { return height_; }
+
+    /// Remap src, the source image, into dst, which must be Width() x
+    /// Height() and colour renderable (e.g. GL_RGBA8 or GL_R8). src should
+    /// sample linearly and clamp to its edges.
+    void Rectify(pangolin::GlTexture& src, pangolin::GlTexture& dst)
+    {
+        if(!fbo_ || fbo_tid_ != dst.tid) {
+            fbo_.reset(new pangolin::GlFramebuffer());
+            fbo_->AttachColour(dst);
+            fbo_tid_ = dst.tid;
+        }
+
+        fbo_->Bind();
+        glPushAttrib(GL_VIEWPORT_BIT | GL_ENABLE_BIT);
+        glViewport(0, 0, width_, height_);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+
+        prog_.Bind();
+        prog_.SetUniform("src", 0);
+        prog_.SetUniform("map", 1);
+        prog_.SetUniform("src_size", (float)src_width_, (float)src_height_);
+        prog_.SetUniform("map_size", (float)map_.width, (float)map_.height);
+        prog_.SetUniform("map_scale", map_scale_);
+
+        glActiveTexture(GL_TEXTURE1);
+        map_.Bind();
+        glActiveTexture(GL_TEXTURE0);
+        src.Bind();
+
+        // Full screen quad
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadIdentity();
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadIdentity();
+        const GLfloat quad[] = { -1,-1,  1,-1,  1,1,  -1,1 };
+        pangolin::glDrawVertices<float>(4, quad, GL_TRIANGLE_FAN, 2);
+        glPopMatrix();
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+
+        src.Unbind();
+        glActiveTexture(GL_TEXTURE1);
+        map_.Unbind();
+        glActiveTexture(GL_TEXTURE0);
+        prog_.Unbind();
+
+        glPopAttrib();
+        fbo_->Unbind();
+    }
+
+    /// Start an asynchronous read back of dst, last rendered by Rectify, into
+    /// pbo (a pangolin::GlPixelPackBuffer of at least the image size), e.g.
+    /// with format GL_RED and type GL_UNSIGNED_BYTE for a grey image.
+    void ReadPixels(pangolin::GlBuffer& pbo, GLenum format, GLenum type)
+    {
+        fbo_->Bind();
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        pbo.Bind();
+        glReadPixels(0, 0, width_, height_, format, type, 0);
+        pbo.Unbind();
+        fbo_->Unbind();
+    }
+
+protected:
+    void UploadMap(const float* uv, int w, int h, bool linear)
+    {
+        map_.Reinitialise(w, h, GL_RG32F, linear, 0, GL_RG, GL_FLOAT, (GLvoid*)uv);
+        map_.Bind();
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        map_.Unbind();
+    }
+
+    pangolin::GlSlProgram prog_;
+    pangolin::GlTexture map_;
+    std::unique_ptr<pangolin::GlFramebuffer> fbo_;
+    GLuint fbo_tid_;
+    int width_;
+    int height_;
+    int src_width_;
+    int src_height_;
+    float map_scale_;
+};
+
+}
@@ -23,6 +23,7 @@
 #include <calibu/Platform.h>
 
 #include <algorithm>
+#include <cstdint>
 
 namespace calibu {
 
@@ -81,4 +82,52 @@ void AdaptiveThreshold( int w, int h, const TI* I, const TintI* intI, Tout* out,
     }
 }
 
+// Non-template overloads for the greyscale / float integral image case used
+// by ImageProcessing. These are preferred over the templates above and
+// process interior pixels a row at a time with AVX2 (x86, selected at
+// runtime) or NEON (aarch64). Results are identical to the scalar versions.
+CALIBU_EXPORT
+void AdaptiveThreshold( int w, int h, const unsigned char* I, const float* intI, unsigned char* out, float threshold, int rad, unsigned char pass, unsigned char fail );
+
+CALIBU_EXPORT
+void AdaptiveThreshold( int w, int h, const unsigned char* I, const float* intI, unsigned char* out, float threshold, int rad, int min_diff, unsigned char pass, unsigned char fail );
+
+// As above, but reading I from a strided buffer with I_pitch elements per
+// row. intI and out are dense (w elements per row).
+CALIBU_EXPORT
+void AdaptiveThreshold( int w, int h, const unsigned char* I, int I_pitch, const float* intI, unsigned char* out, float threshold, int rad, unsigned char pass, unsigned char fail );
+
+CALIBU_EXPORT
+void AdaptiveThreshold( int w, int h, const unsigned char* I, int I_pitch, const float* intI, unsigned char* out, float threshold, int rad, int min_diff, unsigned char pass, unsigned char fail );
+
+// Threshold the single row j. intIy2 and intIy1m1 point to integral image
+// rows min(h-1,j+rad) and max(1,j-rad)-1, which lets callers keep only a
+// window of integral rows rather than the full image.
+CALIBU_EXPORT
+void AdaptiveThresholdRow( int w, int h, int j, const unsigned char* Ij, const float* intIy2, const float* intIy1m1, unsigned char* outj, float threshold, int rad, unsigned char pass, unsigned char fail );
+
+CALIBU_EXPORT
+void AdaptiveThresholdRow( int w, int h, int j, const unsigned char* Ij, const float* intIy2, const float* intIy1m1, unsigned char* outj, float threshold, int rad, int min_diff, unsigned char pass, unsigned char fail );
+
+// As above, only writing columns [x_begin,x_end) of row j.
+CALIBU_EXPORT
+void AdaptiveThresholdRow( int w, int h, int j, const unsigned char* Ij, const float* intIy2, const float* intIy1m1, unsigned char* outj, float threshold, int rad, unsigned char pass, unsigned char fail, int x_begin, int x_end );
+
+CALIBU_EXPORT
+void AdaptiveThresholdRow( int w, int h, int j, const unsigned char* Ij, const float* intIy2, const float* intIy1m1, unsigned char* outj, float threshold, int rad, int min_diff, unsigned char pass, unsigned char fail, int x_begin, int x_end );
+
+// Exact variants over an integer integral image, whose window sums stay
+// exact in uint32_t arithmetic for images of any size.
+CALIBU_EXPORT
+void AdaptiveThreshold( int w, int h, const unsigned char* I, int I_pitch, const uint32_t* intI, unsigned char* out, float threshold, int rad, unsigned char pass, unsigned char fail );
+
+CALIBU_EXPORT
+void AdaptiveThreshold( int w, int h, const unsigned char* I, int I_pitch, const uint32_t* intI, unsigned char* out, float threshold, int rad, int min_diff, unsigned char pass, unsigned char fail );
+
+CALIBU_EXPORT
+void AdaptiveThresholdRow( int w, int h, int j, const unsigned char* Ij, const uint32_t* intIy2, const uint32_t* intIy1m1, unsigned char* outj, float threshold, int rad, unsigned char pass, unsigned char fail, int x_begin, int x_end );
+
+CALIBU_EXPORT
+void AdaptiveThresholdRow( int w, int h, int j, const unsigned char* Ij, const uint32_t* intIy2, const uint32_t* intIy1m1, unsigned char* outj, float threshold, int rad, int min_diff, unsigned char pass, unsigned char fail, int x_begin, int x_end );
+
 }
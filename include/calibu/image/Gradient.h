@@ -40,4 +40,38 @@ void gradient(const int w, const int h, const TI* I, TD* grad)
     }
 }
 
+// Compute row y (1 <= y < h-1) of the strided gradient below. The first
+// and last columns see the same (row-wrapped) neighbours as they would in a
+// packed copy of I, so the output matches gradient() above.
+template<typename TI, typename TD>
+void gradient_row(const int w, const int h, const int pitch, const TI* I, TD* grad, const int y)
+{
+    const TI* pI = I + y*pitch;
+    TD* pOut = grad + y*w;
+    const int x_begin = (y == 1) ? 1 : 0;
+    const int x_end = (y == h-2) ? w-1 : w;
+
+    for(int x=x_begin; x < x_end; ++x) {
+        const TI left  = (x == 0)   ? *(pI-pitch+w-1) : pI[x-1];
+        const TI right = (x == w-1) ? *(pI+pitch)     : pI[x+1];
+        pOut[x][0] = right - left;
+        pOut[x][1] = pI[x+pitch] - pI[x-pitch];
+    }
+}
+
+// As above, but reading I from a strided buffer with pitch elements per row.
+// grad is dense.
+template<typename TI, typename TD>
+void gradient(const int w, const int h, const int pitch, const TI* I, TD* grad)
+{
+    if( pitch == w ) {
+        gradient(w, h, I, grad);
+        return;
+    }
+
+    for(int y=1; y < h-1; ++y) {
+        gradient_row(w, h, pitch, I, grad, y);
+    }
+}
+
 }
@@ -22,19 +22,75 @@
 
 #include <calibu/Platform.h>
 #include <calibu/image/Label.h>
+#include <calibu/utils/Rectangle.h>
+#include <calibu/utils/Stats.h>
 
 #include <Eigen/Eigen>
 #include <Eigen/StdVector>
 
+#include <cstdint>
+#include <memory>
+
 namespace calibu {
 
 struct ParamsImageProcessing {
   ParamsImageProcessing() : at_threshold(0.7),
                             at_window_ratio(3),
-                            black_on_white(true) {}
+                            black_on_white(true),
+                            zero_copy(false),
+                            fused_pipeline(false),
+                            label_threads(1),
+                            exact_integral(false),
+                            integral_threads(1),
+                            pyramid_levels(0),
+                            pyramid_max_area(4E4),
+                            pyramid_min_labels(0) {}
   float at_threshold;
   int at_window_ratio;
   bool black_on_white;
+
+  // Run the pipeline directly on the buffer passed to Process instead of
+  // taking a private copy. The buffer must then outlive any use of Img().
+  bool zero_copy;
+
+  // Compute gradient, integral image and threshold in a single pass over
+  // the rows, keeping only the window of integral rows the threshold needs.
+  // The output is identical; off by default, as the original pipeline.
+  // Ignored when integral_threads > 1, which needs the full integral image.
+  bool fused_pipeline;
+
+  // Number of threads used for connected component labelling
+  int label_threads;
+
+  // Accumulate the integral image in uint32_t rather than float. Float sums
+  // are only exact up to 2^24, which a 4096x4096 image of 255 exceeds, so
+  // the threshold of large images drifts towards their bottom right; window
+  // sums of the integer image are exact for any size.
+  bool exact_integral;
+
+  // Number of threads computing the integral image, also in the pyramid
+  // refinement. As the fused pipeline streams its rows on one thread, more
+  // than one selects the unfused pipeline.
+  int integral_threads;
+
+  // When > 0, threshold and label an image downsampled by 2^pyramid_levels
+  // first, then redo both at full resolution only inside the boxes of coarse
+  // components with full resolution area up to pyramid_max_area. Components
+  // found this way, and the gradient around them, are those of a full
+  // resolution pass, but not every component of a full resolution pass is
+  // found: those the coarse threshold misses (dots of a few coarse pixels or
+  // low contrast), those merged at the coarse level into a component over
+  // pyramid_max_area, and those not complete within 3 pixels of the
+  // refined box are lost. Outside the refined boxes ImgThresh() reads as
+  // background and ImgDeriv() as zero.
+  int pyramid_levels;
+  float pyramid_max_area;
+
+  // Rerun the whole image at full resolution when the pyramid finds fewer
+  // components than this, e.g. the number of dots of the target, so that
+  // pyramid_levels only trades recall for speed on frames where it can
+  // afford to. 0 never falls back.
+  int pyramid_min_labels;
 };
 
 CALIBU_EXPORT
@@ -45,33 +101,71 @@ class ImageProcessing {
 
   void Process(const unsigned char* greyscale_image, size_t w, size_t h, size_t pitch);
 
+  // Process only the region roi (inclusive, full frame coordinates) of the
+  // w x h image. The threshold window is still sized from the full width.
+  // All images, Width(), Height() and Labels() are then relative to Roi().
+  void Process(const unsigned char* greyscale_image, size_t w, size_t h, size_t pitch,
+               const IRectangle& roi);
+
   inline int Width()  const { return width; }
   inline int Height() const { return height; }
 
-  inline const unsigned char* Img() const { return &I[0]; }
+  // Region of the input frame that was processed
+  inline const IRectangle& Roi() const { return roi; }
+
+  // Greyscale input image, ImgPitch() bytes per row. This points at the
+  // caller's buffer when Params().zero_copy is set.
+  inline const unsigned char* Img() const { return img; }
+  inline size_t ImgPitch() const { return img_pitch; }
   inline const Eigen::Vector2f* ImgDeriv() const { return &dI[0]; }
   inline const unsigned char* ImgThresh() const { return &tI[0]; }
   inline const std::vector<PixelClass>& Labels() const { return labels; }
 
   ParamsImageProcessing& Params() { return params; }
 
+  // Timings and counters for the last Process (requires BUILD_STATS)
+  const ImageProcessingStats& Stats() const { return stats; }
+
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
 
  protected:
   void AllocateImageData(int maxPixels);
   void DeallocateImageData();
+  void ProcessRegion(const unsigned char* greyscale_image, size_t w, size_t h,
+                     size_t pitch, int rad);
+  template<typename TintI>
+  void ProcessUnfused(int rad, std::vector<TintI>& intI);
+  template<typename TintI>
+  void ProcessFused(int rad, std::vector<TintI>& intI);
+  void ProcessFullResolution(int rad);
+  void ProcessPyramid(int rad);
+  template<typename TintI>
+  void RefineRegion(const IRectangle& box, int rad, const std::vector<TintI>& intI);
 
   int width, height;
+  IRectangle roi;
+
+  // Image the pipeline runs over: either I or the caller's buffer
+  const unsigned char* img;
+  size_t img_pitch;
 
   // Images owned by this class
   std::vector<unsigned char> I;
-  std::vector<float> intI;
+  std::vector<float> intI;  // Full image, or a ring of rows when fused
+  std::vector<uint32_t> intI_exact;  // As intI, when params.exact_integral
   std::vector<Eigen::Vector2f, Eigen::aligned_allocator<Eigen::Vector2f> > dI;
-  std::vector<short> lI;
   std::vector<unsigned char> tI;
 
   std::vector<PixelClass> labels;
+  LabelWorkspace label_workspace;
   ParamsImageProcessing params;
+  ImageProcessingStats stats;
+
+  // Coarse level for pyramid detection
+  std::unique_ptr<ImageProcessing> coarse;
+  std::vector<unsigned char> coarse_img;
+  std::vector<unsigned char> box_thresh;
+  std::vector<PixelClass> box_labels;
 };
 
 }
@@ -21,6 +21,9 @@
 #pragma once
 
 #include <calibu/Platform.h>
+#include <calibu/utils/ParallelFor.h>
+
+#include <algorithm>
 
 namespace calibu {
 
@@ -49,4 +52,89 @@ void integral_image(const int w, const int h, const TI* in, TO* out)
     }
 }
 
+// As above, but reading in from a strided buffer with pitch elements per
+// row. out is dense.
+template<typename TI, typename TO>
+void integral_image(const int w, const int h, const int pitch, const TI* in, TO* out)
+{
+    out[0] = in[0];
+    
+    //Do the first row.
+    for(int x=1; x < w; x++)
+        out[x] =out[x-1] + in[x];
+    
+    //Do the first column.
+    for(int y=1; y < h; y++)
+        out[y*w] =out[(y-1)*w] + in[y*pitch];
+    
+    //Do the remainder of the image
+    for(int y=1; y < h; y++) {
+        const TI* inrow = in + y*pitch;
+        TO sum = inrow[0];
+        
+        for(int x=1; x < w; x++) {
+            sum += inrow[x];
+            out[y*w+x] = sum + out[(y-1)*w+x];
+        }
+    }
+}
+
+// Compute a single row of the integral image from its input row and the
+// previous output row (NULL for the first row). Summation order matches
+// integral_image() so the rows are identical.
+template<typename TI, typename TO>
+void integral_image_row(const int w, const TI* in, const TO* prev_out, TO* out)
+{
+    if(!prev_out) {
+        out[0] = in[0];
+        for(int x=1; x < w; x++)
+            out[x] = out[x-1] + in[x];
+    }else{
+        out[0] = prev_out[0] + in[0];
+        TO sum = in[0];
+        for(int x=1; x < w; x++) {
+            sum += in[x];
+            out[x] = sum + prev_out[x];
+        }
+    }
+}
+
+// As integral_image with pitch, over num_threads: prefix sums along each
+// row in blocks of rows, then down each column in blocks of columns. With
+// an integer TO the result is exact and equal to integral_image(); with
+// uint32_t, values wrap modulo 2^32 but the differences of any window sum
+// below 2^32 remain exact. Float sums may round differently.
+template<typename TI, typename TO>
+void integral_image_parallel(const int w, const int h, const int pitch,
+                             const TI* in, TO* out, int num_threads)
+{
+    if(num_threads <= 1) {
+        integral_image(w, h, pitch, in, out);
+        return;
+    }
+
+    ParallelFor(h, num_threads, [&](size_t y) {
+        const TI* inrow = in + y*pitch;
+        TO* outrow = out + y*w;
+        TO sum = 0;
+        for(int x=0; x < w; x++) {
+            sum += inrow[x];
+            outrow[x] = sum;
+        }
+    });
+
+    // Blocks of columns wide enough to vectorise and not share cache lines
+    const int block = 64;
+    ParallelFor((w + block - 1) / block, num_threads, [&](size_t b) {
+        const int x0 = b*block;
+        const int x1 = std::min(w, x0 + block);
+        for(int y=1; y < h; y++) {
+            const TO* prev = out + (y-1)*w;
+            TO* row = out + y*w;
+            for(int x=x0; x < x1; x++)
+                row[x] += prev[x];
+        }
+    });
+}
+
 }
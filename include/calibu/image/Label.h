@@ -34,6 +34,30 @@ struct PixelClass
     int size;
 };
 
+// Horizontal run of pass pixels [x1,x2] on row y
+struct LabelRun
+{
+    int y, x1, x2;
+    int label;
+};
+
+// Buffers used by LabelRuns and LabelRunsParallel. Keep one across frames so
+// that labelling doesn't allocate once they have grown to the image.
+struct LabelWorkspace
+{
+    std::vector<LabelRun> runs;
+    std::vector<int> parent;
+    std::vector<size_t> row_start;
+    std::vector<int> component;
+
+    // Per band, for LabelRunsParallel
+    std::vector<std::vector<LabelRun> > band_runs;
+    std::vector<std::vector<int> > band_parent;
+    std::vector<std::vector<size_t> > band_row_start;
+    std::vector<int> band_y0;
+    std::vector<size_t> band_offset;
+};
+
 CALIBU_EXPORT
 void Label(
         int w, int h,
@@ -43,4 +67,47 @@ void Label(
         unsigned char passval
         );
 
+// Run-length connected component labelling using union-find over runs of
+// passval pixels (4-connected, as Label). Appends one PixelClass per
+// component to labels, all with equiv == -1, in raster order of their first
+// pixel. No label image is produced, so there is no limit on the number of
+// components.
+CALIBU_EXPORT
+void LabelRuns(
+        int w, int h,
+        const unsigned char* I,
+        std::vector<PixelClass>& labels,
+        unsigned char passval
+        );
+
+CALIBU_EXPORT
+void LabelRuns(
+        int w, int h,
+        const unsigned char* I,
+        std::vector<PixelClass>& labels,
+        unsigned char passval,
+        LabelWorkspace& workspace
+        );
+
+// As LabelRuns, but labels num_threads horizontal bands concurrently and
+// merges components along the band seams. Output is identical to LabelRuns.
+CALIBU_EXPORT
+void LabelRunsParallel(
+        int w, int h,
+        const unsigned char* I,
+        std::vector<PixelClass>& labels,
+        unsigned char passval,
+        int num_threads
+        );
+
+CALIBU_EXPORT
+void LabelRunsParallel(
+        int w, int h,
+        const unsigned char* I,
+        std::vector<PixelClass>& labels,
+        unsigned char passval,
+        int num_threads,
+        LabelWorkspace& workspace
+        );
+
 }
@@ -0,0 +1,129 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Hauke Strasdat,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <sophus/se3.hpp>
+#include <calibu/Platform.h>
+#include <calibu/cam/camera_crtp.h>
+#include <calibu/pose/Ransac.h>
+
+// Pose from bearing vectors, for cameras of any field of view: points are
+// never divided by z, and no OpenCV types are involved.
+
+namespace calibu {
+
+    /// Up to 4 poses T_cw such that T_cw * P_w[i] lies along the unit
+    /// bearing f_c[i], i < 3 (Grunert's P3P). Returns the number of poses
+    /// written to T_cw.
+    CALIBU_EXPORT
+    int PoseP3P(const Eigen::Vector3d f_c[3], const Eigen::Vector3d P_w[3],
+                Sophus::SE3d T_cw[4]);
+
+    /// Gauss-Newton refinement of T_cw over the reprojection error, in
+    /// pixels, of the points with map2d_3d[i] >= 0, through the camera's
+    /// dProject_dray. Steps which do not decrease the error are rejected.
+    /// Returns the final RMS error.
+    CALIBU_EXPORT
+    double RefinePoseReprojection(
+        const std::shared_ptr<CameraInterface<double>> cam,
+        const std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> >& img_pts,
+        const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& ideal_pts,
+        const std::vector<int>& map2d_3d,
+        int max_iterations,
+        Sophus::SE3d* T_cw
+        );
+
+    /// Observations of the target by the camera at T_cr in a rig.
+    struct RigView
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        std::shared_ptr<CameraInterface<double>> cam;
+        Sophus::SE3d T_cr;
+        const std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> >* img_pts;
+        const std::vector<int>* map2d_3d;
+    };
+
+    /// As RefinePoseReprojection, for the pose T_rw of a rig, over the
+    /// points of all views together.
+    CALIBU_EXPORT
+    double RefineRigPoseReprojection(
+        const std::vector<RigView, Eigen::aligned_allocator<RigView> >& views,
+        const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& ideal_pts,
+        int max_iterations,
+        Sophus::SE3d* T_rw
+        );
+
+    /// Correspondences of PoseBearingPnPRansac, f_c[i] being the unit
+    /// bearing of P_w[i].
+    struct BearingData
+    {
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > f_c;
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > P_w;
+    };
+
+    /// Scratch for PoseBearingPnPRansac. Kept by the caller across frames,
+    /// the RANSAC state and all buffers are reused; the random sequence then
+    /// continues from call to call rather than restarting.
+    struct BearingPnpWorkspace
+    {
+        BearingData data;
+        std::vector<int> idx;           // candidate index of each datum
+        std::vector<int> inliers;
+        std::vector<int> refine_map;
+        AdaptiveRansac<Sophus::SE3d, 4> ransac;
+    };
+
+    /// As PosePnPRansac, from the unprojected rays of img_pts: P3P within
+    /// AdaptiveRansac for at most robust_3pt_its iterations, with inliers
+    /// within robust_3pt_tol pixels (as an angle through the focal length)
+    /// and consensus of at least half the candidates, then
+    /// RefinePoseReprojection over the inliers.
+    CALIBU_EXPORT
+    std::vector<int> PoseBearingPnPRansac(
+        const std::shared_ptr<CameraInterface<double>> cam,
+        const std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > & img_pts,
+        const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > & ideal_pts,
+        const std::vector<int> & candidate_map,
+        int robust_3pt_its,
+        float robust_3pt_tol,
+        Sophus::SE3d * T
+        );
+
+    /// As above, writing into inlier_map and using the buffers of workspace
+    /// so that nothing is allocated once they have grown. inlier_map must not
+    /// be candidate_map.
+    CALIBU_EXPORT
+    void PoseBearingPnPRansac(
+        const std::shared_ptr<CameraInterface<double>> cam,
+        const std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > & img_pts,
+        const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > & ideal_pts,
+        const std::vector<int> & candidate_map,
+        int robust_3pt_its,
+        float robust_3pt_tol,
+        Sophus::SE3d * T,
+        std::vector<int> & inlier_map,
+        BearingPnpWorkspace & workspace
+        );
+
+}
@@ -37,6 +37,20 @@ namespace calibu {
         Sophus::SE3d * T
         );
 
+    // As above, writing into inlier_map so that its capacity is reused.
+    // inlier_map must not be candidate_map. OpenCV still allocates
+    // internally.
+    void PosePnPRansac(
+        const std::shared_ptr<CameraInterface<double>> cam,
+        const std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > & img_pts,
+        const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > & ideal_pts,
+        const std::vector<int> & candidate_map,
+        int robust_3pt_its,
+        float robust_3pt_tol,
+        Sophus::SE3d * T,
+        std::vector<int> & inlier_map
+        );
+
     double ReprojectionErrorRMS(
         const std::shared_ptr<CameraInterface<double>> cam,
         const Sophus::SE3d& T_cw,
@@ -23,8 +23,10 @@
 #include <calibu/Platform.h>
 
 #include <algorithm>
-#include <vector>
+#include <cmath>
 #include <limits>
+#include <random>
+#include <vector>
 
 namespace calibu {
 
@@ -106,4 +108,128 @@ protected:
     Data data;
 };
 
+struct ParamsRansac
+{
+    ParamsRansac() :
+        max_iterations(1000),
+        confidence(0.99),
+        max_datum_fit_error(1.0),
+        min_consensus_size(0)
+    {
+    }
+
+    // Upper bound of the adaptive iteration count
+    int max_iterations;
+    // Probability of drawing at least one outlier free minimal set
+    double confidence;
+    double max_datum_fit_error;
+    unsigned int min_consensus_size;
+};
+
+// RANSAC over functors, with buffers kept between calls. The number of
+// iterations adapts to the inlier ratio of the best consensus so far,
+//   log(1 - confidence) / log(1 - w^minimum_set_size),
+// and a hypothesis is abandoned as soon as its remaining elements could not
+// beat the best consensus. Hypotheses are ranked by consensus size, ties by
+// their squared error, and the best consensus set is refit once at the end.
+//
+//   model_function(const std::vector<int>& elements, Model& model) -> bool
+//   cost_function(const Model& model, int element) -> double
+template<typename Model, int minimum_set_size>
+class AdaptiveRansac
+{
+public:
+    explicit AdaptiveRansac(unsigned int seed = 0)
+        : rng(seed), num_iterations(0)
+    {
+    }
+
+    template<typename ModelFunction, typename CostFunction>
+    bool Compute(unsigned int num_elements, const ModelFunction& model_function,
+                 const CostFunction& cost_function, const ParamsRansac& params,
+                 Model& best_model, std::vector<int>& inliers)
+    {
+        inliers.clear();
+        num_iterations = 0;
+        if (num_elements < (unsigned int)minimum_set_size)
+            return false;
+
+        const unsigned int min_consensus = std::max<unsigned int>(
+                    params.min_consensus_size, minimum_set_size);
+        std::uniform_int_distribution<unsigned int> element(0, num_elements - 1);
+        size_t best_size = 0;
+        double best_error = std::numeric_limits<double>::max();
+        int iterations = params.max_iterations;
+
+        Model model;
+        for (int k = 0; k < iterations; ++k)
+        {
+            ++num_iterations;
+
+            // Minimal set without repetition
+            sample.clear();
+            while (sample.size() < (size_t)minimum_set_size) {
+                const int i = element(rng);
+                if (std::find(sample.begin(), sample.end(), i) == sample.end())
+                    sample.push_back(i);
+            }
+            if (!model_function(sample, model))
+                continue;
+
+            consensus.clear();
+            double error = 0;
+            for (unsigned int i = 0; i < num_elements; ++i)
+            {
+                // Preemption: too few elements left to beat the best
+                if (consensus.size() + (num_elements - i) < best_size)
+                    break;
+                const double err = cost_function(model, i);
+                if (err < params.max_datum_fit_error) {
+                    consensus.push_back(i);
+                    error += err * err;
+                }
+            }
+
+            if (consensus.size() < min_consensus || consensus.size() < best_size ||
+                (consensus.size() == best_size && error >= best_error))
+                continue;
+
+            best_size = consensus.size();
+            best_error = error;
+            best_consensus.swap(consensus);
+
+            const double w = (double)best_size / num_elements;
+            const double p_outlier_set = 1.0 - std::pow(w, minimum_set_size);
+            if (p_outlier_set <= 0) {
+                break;
+            }
+            if (p_outlier_set < 1) {
+                const double needed = std::log(1.0 - params.confidence) / std::log(p_outlier_set);
+                if (needed < iterations) {
+                    iterations = std::max(k + 1, (int)std::ceil(needed));
+                }
+            }
+        }
+
+        if (best_size == 0 || !model_function(best_consensus, best_model))
+            return false;
+        inliers = best_consensus;
+        return true;
+    }
+
+    // Iterations run by the last Compute
+    int NumIterations() const
+    {
+        return num_iterations;
+    }
+
+protected:
+    std::mt19937 rng;
+    int num_iterations;
+
+    std::vector<int> sample;
+    std::vector<int> consensus;
+    std::vector<int> best_consensus;
+};
+
 }
@@ -0,0 +1,121 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <sophus/se3.hpp>
+
+#include <calibu/Platform.h>
+#include <calibu/pose/BearingPnp.h>
+#include <calibu/pose/Tracker.h>
+#include <calibu/utils/ParallelFor.h>
+
+namespace calibu {
+
+struct ParamsRigTracker
+{
+    ParamsRigTracker() :
+        num_threads(0),
+        refine_its(10),
+        max_rms(3.0) {}
+
+    // Threads detecting in the cameras' images, 0 for one per camera
+    int num_threads;
+
+    // Gauss-Newton iterations of the joint rig pose
+    int refine_its;
+    double max_rms;
+};
+
+// Tracks the target in every camera of a rig. Each camera runs its own
+// Tracker, concurrently, and the rig pose is then refined jointly over the
+// correspondences of all cameras that tracked, using the rig extrinsics.
+CALIBU_EXPORT
+class RigTracker
+{
+public:
+    // targets holds one instance of the same target per camera of rig, as
+    // detection keeps state in the target, or std::invalid_argument is
+    // thrown. Camera poses are taken as T_rc.
+    RigTracker(const std::vector<TargetInterface*>& targets,
+               const Rig<double>& rig);
+
+    // Track in images[c], each w x h of pitch bytes per row, from camera c.
+    // Returns true if the rig pose was found, from a joint solve over the
+    // cameras which tracked or, when that fails, from the best camera alone.
+    bool ProcessFrames(const std::vector<const unsigned char*>& images,
+                       size_t w, size_t h, size_t pitch);
+
+    size_t NumCameras() const {
+        return trackers.size();
+    }
+
+    // Whether camera c tracked the target in the last frame
+    bool Tracked(size_t c) const {
+        return tracked[c] != 0;
+    }
+
+    // Whether the last pose came from a joint solve over several cameras
+    bool Joint() const {
+        return joint;
+    }
+
+    const Tracker& CameraTracker(size_t c) const {
+        return *trackers[c];
+    }
+
+    Tracker& CameraTracker(size_t c) {
+        return *trackers[c];
+    }
+
+    // Rig pose in the target (world) frame
+    Sophus::SE3d PoseT_wr() const {
+        return T_rw.inverse();
+    }
+
+    // RMS reprojection error of the last pose, in pixels
+    double Rms() const {
+        return rms;
+    }
+
+    ParamsRigTracker& Params() {
+        return params;
+    }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+protected:
+    std::vector<std::shared_ptr<CameraInterface<double>>> cameras;
+    std::vector<std::unique_ptr<Tracker>> trackers;
+    std::vector<char> tracked;
+    std::vector<RigView, Eigen::aligned_allocator<RigView> > views;
+    std::vector<RigView, Eigen::aligned_allocator<RigView> > tracked_views;
+    const TargetInterface& target;
+
+    Sophus::SE3d T_rw;
+    double rms;
+    bool joint;
+
+    ParamsRigTracker params;
+};
+
+}
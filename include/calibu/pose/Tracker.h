@@ -30,6 +30,9 @@
 #include <calibu/cam/camera_crtp.h>
 #include <calibu/cam/camera_crtp_impl.h>
 #include <calibu/cam/camera_models_crtp.h>
+#include <calibu/pose/BearingPnp.h>
+#include <calibu/utils/PointIndex.h>
+#include <calibu/utils/Stats.h>
 
 namespace calibu {
 
@@ -39,12 +42,40 @@ struct ParamsTracker
         robust_3pt_inlier_tol(1.5),
         robust_3pt_its(100),
         inlier_num_required(10),
-        max_rms(3.0) {}
+        max_rms(3.0),
+        bearing_pnp(false),
+        motion_prediction(false),
+        prediction_its(10),
+        prediction_gate(1.5),
+        use_roi(false),
+        roi_margin(0.25) {}
     
     double robust_3pt_inlier_tol;
     int robust_3pt_its;
     int inlier_num_required;
     double max_rms;
+
+    // Find the pose with PoseBearingPnPRansac rather than OpenCV's PnP on
+    // points divided by z, e.g. for cameras of more than 180 degrees FOV.
+    bool bearing_pnp;
+
+    // After a good frame, associate conics directly from the pose predicted
+    // at constant velocity and refine it with prediction_its Gauss-Newton
+    // iterations, skipping the grid search and both RANSAC passes. A conic
+    // is associated with the nearest projected target point within
+    // prediction_gate times its radius. Falls back to the full two pass
+    // detection if that fails. Off by default, as a tracked frame then
+    // leaves Target() state such as TargetGridDot::Map() from the last full
+    // detection: read the associations from ConicsTargetMap() instead.
+    bool motion_prediction;
+    int prediction_its;
+    double prediction_gate;
+
+    // Search the last good target region first, grown by roi_margin times
+    // its larger side. Falls back to the full frame if that fails. Off
+    // by default, as it changes which pixels ImageProcessing sees.
+    bool use_roi;
+    double roi_margin;
 };
 
 class Tracker
@@ -67,35 +98,82 @@ public:
         return imgs;
     }
     
+    ParamsImageProcessing& ImageParams() {
+        return imgs.Params();
+    }
+    
     const std::vector<int>& ConicsTargetMap() const{
         return conics_target_map;
     }
+
+    // Centres of GetConicFinder().Conics(), as indexed by ConicsTargetMap()
+    const std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> >& ConicCenters() const{
+        return conic_finder.Columns().center;
+    }
     
     const Sophus::SE3d& PoseT_gw() const
     {
         return T_gw;
     }
     
+    ParamsTracker& Params() {
+        return params;
+    }
+    
+    // Timings and counters for the last ProcessFrame (requires BUILD_STATS).
+    // See also Images().Stats() and GetConicFinder().Stats().
+    const TrackerStats& Stats() const {
+        return stats;
+    }
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
 protected:
+    bool Detect( std::shared_ptr<CameraInterface<double>> cam,
+                 const unsigned char *I, size_t w, size_t h, size_t pitch,
+                 const IRectangle* region );
+    bool TrackPredicted( std::shared_ptr<CameraInterface<double>> cam );
+
+    // PnP RANSAC from candidate_map into conics_target_map and T_hw
+    void RobustPose( std::shared_ptr<CameraInterface<double>> cam,
+                     const std::vector<int>& candidate_map );
+    void SetGoodPose(const Sophus::SE3d& T);
+    void UpdateRoi();
+
     // Target
     TargetInterface& target;
     ImageProcessing imgs;
     ConicFinder conic_finder;
     
+    // Per frame scratch, reused so that it only grows with the number of
+    // conics. conics_camframe are the undistorted conics seen through the
+    // identity camera idcam. Centres are read from conic_finder.Columns().
+    std::vector<Conic, Eigen::aligned_allocator<Conic> > conics_camframe;
+    UnmapConicsWorkspace<double> unmap_workspace;
+    BearingPnpWorkspace pnp_workspace;
+    PointIndex conic_index;  // Conic centres, for motion_prediction
+    std::shared_ptr<CameraInterface<double>> idcam;
+
     // Hypothesis conics
     std::vector<int> conics_target_map;
     std::vector<int> conics_candidate_map_first_pass;
     std::vector<int> conics_candidate_map_second_pass;
     
-    // Last good pose
+    // Last good pose, and the one before when good_frames > 1
     Sophus::SE3d T_gw;
+    Sophus::SE3d T_prev_gw;
     std::clock_t last_good;
-    int good_frames;
+    int good_frames;  // Consecutive frames tracked
     
     // Pose hypothesis
     Sophus::SE3d T_hw;
+
+    // Region holding the last good target, full frame coordinates
+    IRectangle roi;
+    bool have_roi;
     
     ParamsTracker params;
+    TrackerStats stats;
 };
 
 }
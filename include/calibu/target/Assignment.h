@@ -0,0 +1,95 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <calibu/Platform.h>
+
+#include <limits>
+#include <vector>
+#include <Eigen/Dense>
+
+namespace calibu
+{
+
+// Candidate pairing for a sparse assignment problem
+struct AssignmentEdge
+{
+    int row;
+    int col;
+    double cost;
+};
+
+// Minimum cost assignment of rows to columns using Jonker-Volgenant style
+// shortest augmenting paths over compressed sparse rows. Every row is
+// assigned if possible; row_to_col[i] is -1 for rows left unassigned.
+// Returns the total cost of assigned pairs. A standalone utility, as is
+// Hungarian.h: no Calibu code calls either.
+class CALIBU_EXPORT AssignmentSolver
+{
+public:
+    AssignmentSolver();
+
+    // Dense problem; any shape is accepted.
+    double Solve(const Eigen::MatrixXd& cost, std::vector<int>& row_to_col);
+
+    // Sparse problem containing only the listed pairings. If
+    // unassigned_cost is finite, a row may instead be left unassigned for
+    // that cost, letting poor pairings be rejected.
+    double Solve(int rows, int cols, const std::vector<AssignmentEdge>& edges,
+                 std::vector<int>& row_to_col,
+                 double unassigned_cost = std::numeric_limits<double>::infinity());
+
+protected:
+    // Every row must have an augmenting path, i.e. be able to reach a free
+    // column, which the dummy columns used by Solve guarantee.
+    double SolveCsr(int rows, int cols, std::vector<int>& row_to_col);
+
+    // Map dummy columns (>= cols) to -1, returning the total cost of the
+    // remaining pairs
+    double RemoveDummies(int cols, std::vector<int>& row_to_col);
+
+    // Compressed sparse rows, reused between calls
+    std::vector<int> row_start_;
+    std::vector<int> edge_col_;
+    std::vector<double> edge_cost_;
+
+    // Solver state, reused between calls
+    std::vector<double> v_;
+    std::vector<double> dist_;
+    std::vector<int> pred_;
+    std::vector<double> pred_cost_;
+    std::vector<double> row_cost_;
+    std::vector<int> col_to_row_;
+    std::vector<char> done_;
+    std::vector<int> ready_;
+    std::vector<std::pair<double,int> > heap_;
+};
+
+// Single use convenience wrappers
+CALIBU_EXPORT
+double SolveAssignment(const Eigen::MatrixXd& cost, std::vector<int>& row_to_col);
+
+CALIBU_EXPORT
+double SolveAssignment(int rows, int cols, const std::vector<AssignmentEdge>& edges,
+                       std::vector<int>& row_to_col,
+                       double unassigned_cost = std::numeric_limits<double>::infinity());
+
+}
@@ -0,0 +1,159 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Eigen/Eigen>
+#include <Eigen/StdVector>
+#include <sophus/se3.hpp>
+
+#include <calibu/Platform.h>
+#include <calibu/cam/camera_crtp.h>
+#include <calibu/conics/ConicFinder.h>
+#include <calibu/image/ImageProcessing.h>
+#include <calibu/target/ObservationStore.h>
+#include <calibu/target/TargetGridDot.h>
+#include <calibu/utils/ParallelFor.h>
+
+namespace calibu {
+
+struct ParamsBatchDetection
+{
+    ParamsBatchDetection() :
+        num_threads(std::max(1u, std::thread::hardware_concurrency())),
+        frames_per_batch(0),
+        robust_3pt_its(0),
+        robust_3pt_tol(0)
+    {
+    }
+
+    ParamsImageProcessing image_processing;
+    ParamsConicFinder conic_finder;
+    ParamsGridDot grid_dot;
+
+    // Threads used when no executor has been set
+    int num_threads;
+    // Frames read before detecting them together; 0 for 4 per thread
+    size_t frames_per_batch;
+
+    // As for PosePnPRansac
+    int robust_3pt_its;
+    float robust_3pt_tol;
+};
+
+// One greyscale camera image of a frame, in memory owned by the source.
+struct BatchImage
+{
+    const unsigned char* data;
+    size_t width;
+    size_t height;
+    size_t pitch;
+};
+
+// Target seen by one camera of a frame. P_w[i] is target point grid_id[i],
+// seen at p_c[i], and T_cw the camera pose from PnP.
+struct CameraDetection
+{
+    bool found;
+    Sophus::SE3d T_cw;
+    std::vector<int> grid_id;
+    std::vector<Eigen::Vector3d> P_w;
+    std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > p_c;
+};
+
+typedef std::vector<CameraDetection> FrameDetections;
+
+// Reads the next frame of a dataset into images, one per camera, returning
+// false at its end. The images must stay valid until the source is next
+// called with the same slot, slot being in [0, frames_per_batch).
+typedef std::function<bool(size_t slot, std::vector<BatchImage>& images)> BatchFrameSource;
+
+// Receives the detections of each frame, in frame order.
+typedef std::function<void(size_t frame, const FrameDetections& detections)> BatchFrameSink;
+
+// Append the correspondences of detections to store as frame, with the
+// pose of the first camera to see the target as the frame's pose.
+CALIBU_EXPORT
+void AddDetections(size_t frame, const FrameDetections& detections,
+                   ObservationStore& store);
+
+// Pass the frames of store, e.g. loaded from a detection cache, to sink as
+// BatchDetector::Run would. Cameras with observations in a frame are found
+// at the frame's pose, so a sink sees the same first pose as it did when
+// the detections were made. Returns the number of frames replayed.
+CALIBU_EXPORT
+size_t ReplayDetections(const ObservationStore& store, const BatchFrameSink& sink);
+
+// Offline target detection over a whole dataset. Frames are read in
+// batches, then ImageProcessing, ConicFinder, TargetGridDot::FindTarget and
+// PosePnPRansac run over all images of the batch in parallel, each thread
+// with its own pipeline. Results do not depend on the number of threads, as
+// frames are detected independently: incremental target tracking is off.
+CALIBU_EXPORT
+class BatchDetector
+{
+public:
+    // cameras give the initial intrinsics used for PnP, and make_target
+    // creates the target of each pipeline.
+    BatchDetector(const std::vector<std::shared_ptr<CameraInterface<double>>>& cameras,
+                  const std::function<std::unique_ptr<TargetGridDot>()>& make_target,
+                  const ParamsBatchDetection& params = ParamsBatchDetection());
+    ~BatchDetector();
+
+    // Detect every frame of source, passing each to sink on the calling
+    // thread. Returns the number of frames read.
+    size_t Run(const BatchFrameSource& source, const BatchFrameSink& sink);
+
+    ParamsBatchDetection& Params() {
+        return params;
+    }
+
+    // Detect through executor, e.g. an application thread pool.
+    void SetExecutor(const Executor& exec) {
+        executor = exec;
+    }
+
+protected:
+    struct Pipeline;
+
+    void Detect(Pipeline& pipeline, size_t camera, const BatchImage& image,
+                CameraDetection& detection) const;
+    std::unique_ptr<Pipeline> AcquirePipeline();
+    void ReleasePipeline(std::unique_ptr<Pipeline> pipeline);
+
+    std::vector<std::shared_ptr<CameraInterface<double>>> cameras;
+    std::function<std::unique_ptr<TargetGridDot>()> make_target;
+    ParamsBatchDetection params;
+    Executor executor;
+
+    // Pipelines not in use by a thread
+    std::mutex pipelines_mutex;
+    std::vector<std::unique_ptr<Pipeline> > pipelines;
+};
+
+}
@@ -30,18 +30,26 @@
 
 #include <calibu/Platform.h>
 #include <calibu/conics/Conic.h>
+#include <calibu/utils/Arena.h>
 
 namespace calibu {
 
 const static int GRID_INVALID = std::numeric_limits<int>::min();
 
 struct Triple;
+struct Vertex;
+
+typedef std::set<Vertex*, std::less<Vertex*>, ArenaAllocator<Vertex*> > VertexSet;
 
 struct Vertex
 {
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
-    inline Vertex(size_t id, const Conic& c)
-        : id(id), conic(c), pc(c.center), pg(GRID_INVALID,GRID_INVALID), area(0.0), value(-1)
+    // Triples and neighbours are allocated from arena if given
+    inline Vertex(size_t id, const Conic& c, Arena* arena = nullptr)
+        : id(id), conic(c), pc(c.center), pg(GRID_INVALID,GRID_INVALID),
+          triples(ArenaAllocator<Triple>(arena)),
+          neighbours(std::less<Vertex*>(), ArenaAllocator<Vertex*>(arena)),
+          area(0.0), value(-1)
     {
     }
 
@@ -54,8 +62,8 @@ struct Vertex
     Conic conic;
     Eigen::Vector2d pc;
     Eigen::Vector2i pg;
-    std::vector<Triple> triples;
-    std::set<Vertex*> neighbours;
+    std::vector<Triple, ArenaAllocator<Triple> > triples;
+    VertexSet neighbours;
     double area;
     int value;
 };
@@ -64,7 +72,7 @@ struct Triple
 {
     inline Triple(Vertex& o1, Vertex& c, Vertex& o2)
     {
-      vs = {&o1, &c, &o2};
+      vs = {{&o1, &c, &o2}};
     }
 
     Triple(const Triple& triple) = default;
@@ -92,7 +100,7 @@ struct Triple
         return found;
     }
 
-    inline bool In(const std::set<Vertex*> bag) const
+    inline bool In(const VertexSet& bag) const
     {
         return bag.find(vs[0]) != bag.end() && bag.find(vs[2]) != bag.end();
     }
@@ -103,7 +111,7 @@ struct Triple
     }
 
     // Colinear sequence of vertices, v[0], v[1], v[2]. v[1] is center
-  std::vector<Vertex*> vs;
+  std::array<Vertex*,3> vs;
 };
 
 inline bool operator==(const Vertex& lhs, const Vertex& rhs)
@@ -135,8 +143,8 @@ inline std::ostream& operator<<(std::ostream& os, const Triple& t)
 
 struct LineGroup
 {
-    LineGroup(const Triple& o)
-        : ops({o.vs[0]->id, o.vs[1]->id, o.vs[2]->id})
+    LineGroup(const Triple& o, Arena* arena = nullptr)
+        : ops({o.vs[0]->id, o.vs[1]->id, o.vs[2]->id}, ArenaAllocator<size_t>(arena))
     {
     }
 
@@ -164,9 +172,7 @@ struct LineGroup
 
     void Reverse()
     {
-        std::list<size_t> rev_ops;
-        rev_ops.insert(rev_ops.begin(), ops.rbegin(), ops.rend());
-        ops = rev_ops;
+        ops.reverse();
     }
 
     size_t first() { return *ops.begin(); }
@@ -174,9 +180,11 @@ struct LineGroup
     size_t second() { return *std::next(ops.begin()); }
     size_t pen() { return *std::next(ops.rbegin()); }
 
-    std::list<size_t> ops;
+    std::list<size_t, ArenaAllocator<size_t> > ops;
     double theta;
     int k;
 };
 
+typedef std::list<LineGroup, ArenaAllocator<LineGroup> > LineGroupList;
+
 }
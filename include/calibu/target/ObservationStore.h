@@ -0,0 +1,132 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <Eigen/Eigen>
+#include <Eigen/StdVector>
+#include <sophus/se3.hpp>
+
+#include <calibu/Platform.h>
+
+namespace calibu {
+
+// Target observations of a dataset, stored column by column so that they
+// can be written and read back in bulk. Observation i is grid point
+// grid_id[i] of the target, at P_x/y/z[i] in target coordinates, seen at
+// pixel (u[i], v[i]) by camera[i] in frame[i]. T_kw[j] is the initial
+// rig pose of frame pose_frame[j], e.g. from PnP.
+CALIBU_EXPORT
+class ObservationStore
+{
+public:
+    void Add(uint32_t frame_id, uint16_t camera_id, int32_t grid,
+             const Eigen::Vector3d& P_w, const Eigen::Vector2d& p_c)
+    {
+        frame.push_back(frame_id);
+        camera.push_back(camera_id);
+        grid_id.push_back(grid);
+        P_x.push_back(P_w[0]);
+        P_y.push_back(P_w[1]);
+        P_z.push_back(P_w[2]);
+        u.push_back(p_c[0]);
+        v.push_back(p_c[1]);
+    }
+
+    void AddPose(uint32_t frame_id, const Sophus::SE3d& T)
+    {
+        pose_frame.push_back(frame_id);
+        T_kw.push_back(T);
+    }
+
+    // Append the observations and poses of other
+    void Append(const ObservationStore& other);
+
+    void Clear();
+
+    size_t Size() const {
+        return frame.size();
+    }
+
+    size_t NumPoses() const {
+        return pose_frame.size();
+    }
+
+    Eigen::Vector3d Point(size_t i) const {
+        return Eigen::Vector3d(P_x[i], P_y[i], P_z[i]);
+    }
+
+    Eigen::Vector2d Pixel(size_t i) const {
+        return Eigen::Vector2d(u[i], v[i]);
+    }
+
+    std::vector<uint32_t> frame;
+    std::vector<uint16_t> camera;
+    std::vector<int32_t> grid_id;
+    std::vector<double> P_x, P_y, P_z;
+    std::vector<double> u, v;
+
+    std::vector<uint32_t> pose_frame;
+    std::vector<Sophus::SE3d, Eigen::aligned_allocator<Sophus::SE3d> > T_kw;
+
+    // Width and height of the images of each camera
+    std::vector<Eigen::Vector2i> image_sizes;
+};
+
+// Writes observations to a binary file as they are detected, in chunks of
+// whole columns. Errors are reported to std::cerr, and make Write and Close
+// return false.
+CALIBU_EXPORT
+class ObservationWriter
+{
+public:
+    ~ObservationWriter();
+
+    // Start filename, for cameras of the given image sizes
+    bool Open(const std::string& filename,
+              const std::vector<Eigen::Vector2i>& image_sizes);
+
+    // Append the observations and poses of chunk
+    bool Write(const ObservationStore& chunk);
+
+    bool Close();
+
+    bool IsOpen() const {
+        return out.is_open();
+    }
+
+protected:
+    std::string filename;
+    std::ofstream out;
+};
+
+// Read every chunk of a file written by ObservationWriter into store,
+// replacing its contents. False, with a message on std::cerr, if the file
+// is missing, truncated or from a host of another byte order.
+CALIBU_EXPORT
+bool LoadObservations(const std::string& filename, ObservationStore& store);
+
+}
@@ -27,13 +27,43 @@
 #include <random>
 #include <iostream>
 #include <array>
+#include <atomic>
 #include <signal.h>
 #include <fstream>
 #include <stdint.h>
+#include <vector>
+#include <functional>
 
 namespace calibu
 {
 
+// Binary pattern packed one bit per dot into 64 bit words, with each row
+// starting on a new word. Cells which are negative in the source matrix are
+// unknown and never counted as a mismatch.
+CALIBU_EXPORT
+struct BitGrid
+{
+    BitGrid() : rows(0), cols(0), words(0) {}
+    explicit BitGrid(const Eigen::MatrixXi& M) { Assign(M); }
+
+    // Pack M, reusing existing storage
+    void Assign(const Eigen::MatrixXi& M);
+
+    // Copy the nr x nc window at (r,c) into out, reusing its storage
+    void Block(int r, int c, int nr, int nc, BitGrid& out) const;
+
+    Eigen::MatrixXi ToMatrix() const;
+
+    int rows;
+    int cols;
+    int words;  // words per row
+    std::vector<uint64_t> value;
+    std::vector<uint64_t> known;
+};
+
+CALIBU_EXPORT
+std::array<BitGrid, 4> MakeBitGroup(const std::array<Eigen::MatrixXi, 4>& PG);
+
 CALIBU_EXPORT
 void SaveEPS(
     std::string filename, const Eigen::MatrixXi& M,
@@ -54,12 +84,21 @@ std::array<Eigen::MatrixXi, 4> FillGroup(const Eigen::MatrixXi& m);
 CALIBU_EXPORT
 int HammingDistance(const Eigen::MatrixXi& M, const Eigen::MatrixXi& m, int r, int c);
 
+CALIBU_EXPORT
+int HammingDistance(const BitGrid& M, const BitGrid& m, int r, int c);
+
 CALIBU_EXPORT
 int NumExactMatches(const Eigen::MatrixXi& M, const Eigen::MatrixXi& m, int& best_score, int& best_r, int& best_c);
 
 CALIBU_EXPORT
 int NumExactMatches(const std::array<Eigen::MatrixXi, 4>& PG, const Eigen::MatrixXi& m, int& best_score, int& best_g, int& best_r, int& best_c);
 
+CALIBU_EXPORT
+int NumExactMatches(const BitGrid& M, const BitGrid& m, int& best_score, int& best_r, int& best_c);
+
+CALIBU_EXPORT
+int NumExactMatches(const std::array<BitGrid, 4>& PG, const BitGrid& m, int& best_score, int& best_g, int& best_r, int& best_c);
+
 CALIBU_EXPORT
 int AutoCorrelation(const std::array<Eigen::MatrixXi, 4>& PG, int minr = 2, int minc = 2);
 
@@ -72,6 +111,19 @@ int SeedScore(uint32_t seed, int r, int c);
 CALIBU_EXPORT
 uint32_t FindBestSeed(int r, int c, bool& should_run);
 
+// Reports seeds scored so far and the best seed and score among them
+typedef std::function<void(uint64_t num_scored, uint32_t best_seed, int best_score)> SeedSearchProgress;
+
+// Search seeds in [seed_begin, seed_end) over num_threads threads for the
+// lowest SeedScore, preferring the lowest seed amongst equal scores. Stops
+// early once should_run is cleared, e.g. from a signal handler or another
+// thread, returning the best seed scored so far. progress is called as
+// batches of seeds complete, from worker threads, one call at a time.
+CALIBU_EXPORT
+uint32_t FindBestSeed(int r, int c, uint32_t seed_begin, uint32_t seed_end,
+                      int num_threads, const std::atomic<bool>& should_run,
+                      const SeedSearchProgress& progress = SeedSearchProgress());
+
 CALIBU_EXPORT
 void PrintPattern(const Eigen::MatrixXi& M);
 
@@ -30,6 +30,9 @@
 #include <calibu/Platform.h>
 #include <calibu/target/Target.h>
 #include <calibu/target/LineGroup.h>
+#include <calibu/target/RandomGrid.h>
+#include <calibu/target/VertexGrid.h>
+#include <calibu/utils/Stats.h>
 #include <Eigen/Eigen>
 #include <Eigen/StdVector>
 
@@ -54,7 +57,10 @@ struct ParamsGridDot
         min_cross_area(1.5),
         max_cross_area(9.0),
         cross_radius_ratio(0.058),
-        cross_line_ratio(0.036)
+        cross_line_ratio(0.036),
+        incremental(false),
+        max_prediction_ratio(0.4),
+        min_tracked_ratio(0.75)
     {}
 
     double max_line_dist_ratio;
@@ -63,6 +69,33 @@ struct ParamsGridDot
     double max_cross_area;
     double cross_radius_ratio;
     double cross_line_ratio;
+
+    // Match conics against the previous frame's grid (or the projected
+    // target when a pose is given) before falling back to full search.
+    bool incremental;
+    // Max distance from a prediction, as a fraction of local grid spacing
+    double max_prediction_ratio;
+    // Fraction of predicted grid points which must be matched
+    double min_tracked_ratio;
+};
+
+// Board id read at the code points of a TargetGridDot. Column c of pixels
+// is Code3D()[c] projected into the image. Bit c of visible is set when
+// that pixel lies border pixels or more inside the processed region, and
+// bit c of bits when ImgThresh() is also dark there.
+struct TargetCode
+{
+    TargetCode() : bits(0), visible(0) {}
+
+    // Every code point was sampled
+    bool Complete() const {
+        return visible == (uint32_t)((1ull << pixels.cols()) - 1);
+    }
+
+    Eigen::Matrix3Xd rays;
+    Eigen::Matrix2Xd pixels;
+    uint32_t bits;
+    uint32_t visible;
 };
 
 CALIBU_EXPORT
@@ -99,6 +132,16 @@ public:
             std::vector<int>& ellipse_target_map
             );
 
+    // As above, ignoring conics flagged in claimed (resized to match conics
+    // if need be). Conics belonging to the target found are then flagged,
+    // so several targets can share one set of conics by taking turns.
+    bool FindTarget(
+            const ImageProcessing& images,
+            const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+            std::vector<char>& claimed,
+            std::vector<int>& ellipse_target_map
+            );
+
     ////////////////////////////////////////////////////////////////////////////
 
     inline double CircleRadius() const
@@ -130,6 +173,16 @@ public:
         return codepts3d;
     }
 
+    // Read the board id below the grid with the target at T_cw, projecting
+    // all code points in one call to cam. code keeps its storage.
+    void SampleCode(
+            const std::shared_ptr<CameraInterface<double>> cam,
+            const Sophus::SE3d& T_cw,
+            const ImageProcessing& images,
+            TargetCode& code,
+            int border = 10
+            ) const;
+
     ////////////////////////////////////////////////////////////////////////////
 
   const std::vector<Vertex,
@@ -137,10 +190,23 @@ public:
         return vs_;
     }
 
-    const std::list<LineGroup>& LineGroups() const {
+    const LineGroupList& LineGroups() const {
         return line_groups_;
     }
 
+    ParamsGridDot& Params() {
+        return params_;
+    }
+
+    const ParamsGridDot& Params() const {
+        return params_;
+    }
+
+    // Timings and counters for the last FindTarget (requires BUILD_STATS)
+    const TargetGridDotStats& Stats() const {
+        return stats_;
+    }
+
     Eigen::MatrixXi GetBinaryPattern( unsigned int idx = 0 ) const
     {
         return PG_[idx];
@@ -165,10 +231,31 @@ public:
     void Init();
     void Clear();
     void SetGrid(Vertex& v, const Eigen::Vector2i& g);
-  bool Match(std::map<Eigen::Vector2i, Vertex*,
-             std::less<Eigen::Vector2i>,
-             Eigen::aligned_allocator<std::pair<Eigen::Vector2i, Vertex*> > >& obs,
-             const std::array<Eigen::MatrixXi,4>& PG);
+    bool FindTargetFull(
+            const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+            const std::vector<char>& excluded,
+            std::vector<int>& ellipse_target_map
+            );
+    // FindTargetFull over the unclaimed conics, retrying up to
+    // MAX_GRID_ATTEMPTS times without the conics of each grid that failed
+    // to match. ellipse_target_map is left empty on failure.
+    bool SearchGrids(
+            const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+            const std::vector<char>& claimed,
+            std::vector<int>& ellipse_target_map
+            );
+    bool MatchPredicted(
+            const std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> >& predicted,
+            const std::vector<char>& valid,
+            const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+            const std::vector<char>& excluded,
+            std::vector<int>& ellipse_target_map
+            );
+    void StorePrevious(
+            const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+            const std::vector<int>& ellipse_target_map
+            );
+  bool Match(VertexGrid& obs, const std::array<Eigen::MatrixXi,4>& PG);
 
     std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > tpts2d;
     std::vector<double> tpts2d_radius;
@@ -178,16 +265,49 @@ public:
     double grid_spacing_;
     Eigen::Vector2i grid_size_;
     std::array<Eigen::MatrixXi,4> PG_;
+    std::array<BitGrid,4> PG_bits_;
+    BitGrid observed_bits_;
 
     ParamsGridDot params_;
 
+    // Per frame storage for vertex triples, neighbours and line groups.
+    // Declared first so it outlives the containers allocating from it.
+    Arena arena_;
+
   std::vector<Vertex, Eigen::aligned_allocator<Vertex> > vs_;
-    std::map<Eigen::Vector2i, Vertex*,
-             std::less<Eigen::Vector2i>,
-             Eigen::aligned_allocator<
-               std::pair<Eigen::Vector2i, Vertex*> > > map_grid_ellipse_;
+    VertexGrid map_grid_ellipse_;
+
+    LineGroupList line_groups_;
 
-    std::list<LineGroup> line_groups_;
+    // Image positions of grid points from the last successful detection
+    std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > prev_centres_;
+    std::vector<char> prev_valid_;
+    bool have_prev_;
+
+    // Reused buffers for prediction based matching
+    std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > projected_;
+    std::vector<char> projected_valid_;
+    std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > homography_src_;
+    std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > homography_dst_;
+
+    // Conics ignored by the current search
+    std::vector<char> claimed_;
+    std::vector<char> excluded_;
+
+    TargetGridDotStats stats_;
 };
 
+// Find several targets visible in the same image from one set of conics,
+// so that thresholding and conic fitting happen once per frame. Targets are
+// searched in order, each ignoring conics claimed by those found before it.
+// Returns the number found; ellipse_target_maps[i] is empty if targets[i]
+// wasn't. Poses can then be found per target as usual, e.g. PosePnPRansac.
+CALIBU_EXPORT
+int FindTargets(
+        const std::vector<TargetGridDot*>& targets,
+        const ImageProcessing& images,
+        const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+        std::vector<std::vector<int> >& ellipse_target_maps
+        );
+
 }
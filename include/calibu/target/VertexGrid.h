@@ -0,0 +1,141 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove,
+                      Nima Keivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include <Eigen/Eigen>
+
+#include <calibu/Platform.h>
+#include <calibu/target/LineGroup.h>
+
+namespace calibu {
+
+// Dense occupancy grid mapping integer grid positions to vertices.
+// Positions are stored relative to an offset so that negative coordinates
+// (relative to the seed vertex) can be used directly. Storage is kept
+// between frames and only grows if a position falls outside it.
+class VertexGrid
+{
+public:
+    VertexGrid()
+        : offset_(0,0), size_(0,0)
+    {
+    }
+
+    // Ensure positions in [-half_extent, half_extent] are covered and
+    // remove all vertices.
+    inline void Reset(const Eigen::Vector2i& half_extent)
+    {
+        Clear();
+        const Eigen::Vector2i offset = offset_.cwiseMax(half_extent);
+        const Eigen::Vector2i size = (size_ - offset_ + offset).cwiseMax(
+                    offset + half_extent + Eigen::Vector2i(1,1));
+        if( size != size_ ) {
+            Resize(offset, size);
+        }
+    }
+
+    // Remove all vertices, touching only occupied cells.
+    inline void Clear()
+    {
+        for(size_t i=0; i < occupied_.size(); ++i) {
+            cells_[occupied_[i]] = nullptr;
+        }
+        occupied_.clear();
+    }
+
+    inline Vertex* Get(const Eigen::Vector2i& g) const
+    {
+        const Eigen::Vector2i p = g + offset_;
+        if( 0 <= p[0] && p[0] < size_[0] && 0 <= p[1] && p[1] < size_[1] ) {
+            return cells_[p[1]*size_[0] + p[0]];
+        }
+        return nullptr;
+    }
+
+    inline void Set(const Eigen::Vector2i& g, Vertex* v)
+    {
+        Eigen::Vector2i p = g + offset_;
+        if( p[0] < 0 || p[0] >= size_[0] || p[1] < 0 || p[1] >= size_[1] ) {
+            Grow(g);
+            p = g + offset_;
+        }
+        Vertex*& cell = cells_[p[1]*size_[0] + p[0]];
+        if( !cell ) occupied_.push_back(p[1]*size_[0] + p[0]);
+        cell = v;
+    }
+
+    // Number of occupied grid positions
+    inline size_t size() const
+    {
+        return occupied_.size();
+    }
+
+    // Grid position of the i'th occupied cell
+    inline Eigen::Vector2i Position(size_t i) const
+    {
+        return Eigen::Vector2i(occupied_[i] % size_[0], occupied_[i] / size_[0]) - offset_;
+    }
+
+    // Vertex of the i'th occupied cell
+    inline Vertex* At(size_t i) const
+    {
+        return cells_[occupied_[i]];
+    }
+
+protected:
+    inline void Grow(const Eigen::Vector2i& g)
+    {
+        // Double the extent in any direction that doesn't fit g
+        Eigen::Vector2i offset = offset_;
+        Eigen::Vector2i size = size_;
+        for(int d=0; d < 2; ++d) {
+            const int grow = std::max(size[d], 4);
+            while( g[d] + offset[d] < 0 ) { offset[d] += grow; size[d] += grow; }
+            while( g[d] + offset[d] >= size[d] ) { size[d] += grow; }
+        }
+        Resize(offset, size);
+    }
+
+    inline void Resize(const Eigen::Vector2i& offset, const Eigen::Vector2i& size)
+    {
+        std::vector<Vertex*> cells(size[0]*size[1], nullptr);
+        for(size_t i=0; i < occupied_.size(); ++i) {
+            const Eigen::Vector2i p = Position(i) + offset;
+            const int idx = p[1]*size[0] + p[0];
+            cells[idx] = cells_[occupied_[i]];
+            occupied_[i] = idx;
+        }
+        cells_.swap(cells);
+        offset_ = offset;
+        size_ = size;
+    }
+
+    Eigen::Vector2i offset_;
+    Eigen::Vector2i size_;
+    std::vector<Vertex*> cells_;
+    std::vector<int> occupied_;
+};
+
+}
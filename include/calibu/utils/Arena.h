@@ -0,0 +1,170 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <calibu/Platform.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <new>
+#include <vector>
+#include <type_traits>
+
+namespace calibu
+{
+
+/// Bump allocator for per-frame scratch structures. Memory is only given
+/// back by Reset(), which keeps the storage for the next frame. If a frame
+/// needed more than one block, the blocks are merged into one on Reset so
+/// that steady state use doesn't touch the heap.
+class Arena
+{
+public:
+    explicit Arena(size_t block_size = 64*1024)
+        : block_size_(block_size), used_(0), total_(0), num_blocks_allocated_(0)
+    {
+    }
+
+    ~Arena()
+    {
+        for(size_t i=0; i < blocks_.size(); ++i) {
+            ::operator delete(blocks_[i].data);
+        }
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* Allocate(size_t bytes, size_t align)
+    {
+        if(!blocks_.empty()) {
+            Block& b = blocks_.back();
+            const size_t start = (used_ + align - 1) & ~(align - 1);
+            if(start + bytes <= b.size) {
+                used_ = start + bytes;
+                total_ += bytes;
+                return b.data + start;
+            }
+        }
+
+        const size_t size = std::max(block_size_, bytes + align);
+        Block b = { static_cast<char*>(::operator new(size)), size };
+        blocks_.push_back(b);
+        ++num_blocks_allocated_;
+
+        const size_t start = ((size_t)(-(intptr_t)b.data)) & (align - 1);
+        used_ = start + bytes;
+        total_ += bytes;
+        return b.data + start;
+    }
+
+    /// Invalidate everything allocated so far.
+    void Reset()
+    {
+        if(blocks_.size() > 1) {
+            size_t size = 0;
+            for(size_t i=0; i < blocks_.size(); ++i) {
+                size += blocks_[i].size;
+                ::operator delete(blocks_[i].data);
+            }
+            blocks_.clear();
+            block_size_ = std::max(block_size_, size);
+        }
+        used_ = 0;
+        total_ = 0;
+    }
+
+    /// Bytes handed out since the last Reset
+    size_t BytesUsed() const { return total_; }
+
+    /// Number of times the arena has gone to the heap
+    size_t NumBlocksAllocated() const { return num_blocks_allocated_; }
+
+protected:
+    struct Block { char* data; size_t size; };
+
+    std::vector<Block> blocks_;
+    size_t block_size_;
+    size_t used_;
+    size_t total_;
+    size_t num_blocks_allocated_;
+};
+
+/// Standard allocator drawing from an Arena. Deallocation is a no-op; a
+/// default constructed allocator has no arena and uses the heap instead,
+/// so containers using it behave normally outside of an arena.
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template<typename U> struct rebind { typedef ArenaAllocator<U> other; };
+
+    ArenaAllocator(Arena* arena = nullptr)
+        : arena_(arena)
+    {
+    }
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& o)
+        : arena_(o.arena())
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        if(arena_) {
+            return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t)
+    {
+        if(!arena_) {
+            ::operator delete(p);
+        }
+    }
+
+    Arena* arena() const { return arena_; }
+
+protected:
+    Arena* arena_;
+};
+
+template<typename T, typename U>
+inline bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena() == b.arena();
+}
+
+template<typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena() != b.arena();
+}
+
+}
@@ -0,0 +1,209 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <calibu/Platform.h>
+#include <calibu/utils/Trace.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace calibu
+{
+
+/// Runs body(i) for every i in [0,n), possibly concurrently. Lets callers
+/// supply their own thread pool in place of ParallelFor.
+typedef std::function<void(size_t n, const std::function<void(size_t)>& body)> Executor;
+
+/// Call body(i) for i in [0,n) over num_threads threads, each taking a
+/// contiguous block of indices. Runs inline when num_threads <= 1.
+template<typename F>
+void ParallelFor(size_t n, int num_threads, const F& body)
+{
+    const size_t num_blocks = std::min<size_t>(std::max(num_threads, 1), n);
+    if( num_blocks <= 1 ) {
+        for( size_t i = 0; i < n; ++i ) body(i);
+        return;
+    }
+
+    // Workers trace with the frame and camera of the calling thread
+    const TraceContext context = CurrentTraceContext();
+
+    std::vector<std::thread> workers;
+    workers.reserve(num_blocks - 1);
+    for( size_t b = 1; b < num_blocks; ++b ) {
+        const size_t begin = n * b / num_blocks;
+        const size_t end = n * (b + 1) / num_blocks;
+        workers.push_back(std::thread([&body, begin, end, context]() {
+            ScopedTraceContext scope(context);
+            for( size_t i = begin; i < end; ++i ) body(i);
+        }));
+    }
+
+    // Calling thread takes the first block
+    for( size_t i = 0; i < n / num_blocks; ++i ) body(i);
+
+    for( size_t t = 0; t < workers.size(); ++t ) {
+        workers[t].join();
+    }
+}
+
+/// Fixed set of threads running the blocks of ParallelFor, started once
+/// rather than on every call. The calling thread takes part, so num_threads
+/// - 1 threads are started. Calls from several threads run one at a time,
+/// and a call from within a body runs inline.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int num_threads)
+        : n_(0), num_blocks_(0), next_block_(0), body_(nullptr),
+          generation_(0), busy_(0), stop_(false)
+    {
+        for( int t = 1; t < num_threads; ++t ) {
+            workers_.push_back(std::thread(&ThreadPool::Work, this));
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_cond_.notify_all();
+        for( size_t t = 0; t < workers_.size(); ++t ) {
+            workers_[t].join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t NumThreads() const { return workers_.size() + 1; }
+
+    /// As ParallelFor(n, NumThreads(), body)
+    void Run(size_t n, const std::function<void(size_t)>& body)
+    {
+        const size_t num_blocks = std::min(NumThreads(), n);
+        if( num_blocks <= 1 || IsWorker() ) {
+            for( size_t i = 0; i < n; ++i ) body(i);
+            return;
+        }
+
+        std::lock_guard<std::mutex> run_lock(run_mutex_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            n_ = n;
+            num_blocks_ = num_blocks;
+            next_block_ = 0;
+            body_ = &body;
+            context_ = CurrentTraceContext();
+            busy_ = workers_.size();
+            ++generation_;
+        }
+        work_cond_.notify_all();
+        RunBlocks();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cond_.wait(lock, [this]() { return busy_ == 0; });
+        body_ = nullptr;
+    }
+
+protected:
+    bool IsWorker() const
+    {
+        const std::thread::id id = std::this_thread::get_id();
+        for( size_t t = 0; t < workers_.size(); ++t ) {
+            if( workers_[t].get_id() == id ) return true;
+        }
+        return false;
+    }
+
+    void RunBlocks()
+    {
+        for( size_t b = next_block_++; b < num_blocks_; b = next_block_++ ) {
+            const size_t end = n_ * (b + 1) / num_blocks_;
+            for( size_t i = n_ * b / num_blocks_; i < end; ++i ) (*body_)(i);
+        }
+    }
+
+    void Work()
+    {
+        size_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for(;;) {
+            work_cond_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+            if( stop_ ) return;
+            seen = generation_;
+
+            // Workers trace with the frame and camera of the calling thread
+            const TraceContext context = context_;
+            lock.unlock();
+            {
+                ScopedTraceContext scope(context);
+                RunBlocks();
+            }
+            lock.lock();
+            if( --busy_ == 0 ) done_cond_.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+
+    // Call in progress, set under mutex_ before generation_ is bumped
+    size_t n_;
+    size_t num_blocks_;
+    std::atomic<size_t> next_block_;
+    const std::function<void(size_t)>* body_;
+    TraceContext context_;
+
+    std::mutex run_mutex_;
+    std::mutex mutex_;
+    std::condition_variable work_cond_;
+    std::condition_variable done_cond_;
+    size_t generation_;
+    size_t busy_;
+    bool stop_;
+};
+
+/// Executor running ParallelFor blocks over a ThreadPool of num_threads,
+/// which its copies share. The threads live as long as the executor, so
+/// per frame callers should keep one rather than make one for each call.
+inline Executor MakeThreadExecutor(int num_threads)
+{
+    if( num_threads <= 1 ) {
+        return [](size_t n, const std::function<void(size_t)>& body) {
+            for( size_t i = 0; i < n; ++i ) body(i);
+        };
+    }
+    const std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>(num_threads);
+    return [pool](size_t n, const std::function<void(size_t)>& body) {
+        pool->Run(n, body);
+    };
+}
+
+}
@@ -0,0 +1,137 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <calibu/utils/Arena.h>
+
+#include <Eigen/Eigen>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace calibu
+{
+
+/// Uniform bucket grid over 2D points for radius limited nearest neighbour
+/// queries. Its buffers come from arena, or from the heap without one, in
+/// which case they keep their capacity from one Build to the next.
+class PointIndex
+{
+public:
+    PointIndex(Arena* arena = nullptr)
+        : pts_(ArenaAllocator<Eigen::Vector2d>(arena)), ids_(ArenaAllocator<int>(arena)),
+          start_(ArenaAllocator<int>(arena)), idx_(ArenaAllocator<int>(arena)),
+          cell_ids_(ArenaAllocator<int>(arena)), fill_(ArenaAllocator<int>(arena))
+    {
+    }
+
+    /// Index point(i) for i in [0,n), except where (*excluded)[i] is set.
+    /// Those are never returned.
+    template<typename Point>
+    void Build(size_t n, const Point& point, const std::vector<char>* excluded = nullptr)
+    {
+        start_.clear();
+        idx_.clear();
+        pts_.clear();
+        ids_.clear();
+
+        pts_.reserve(n);
+        ids_.reserve(n);
+        for(size_t i=0; i < n; ++i) {
+            if(excluded && (*excluded)[i]) continue;
+            pts_.push_back(point(i));
+            ids_.push_back(i);
+        }
+        if(pts_.empty()) return;
+
+        pmin_ = pts_[0];
+        Eigen::Vector2d pmax = pts_[0];
+        for(const Eigen::Vector2d& p : pts_) {
+            pmin_ = pmin_.cwiseMin(p);
+            pmax = pmax.cwiseMax(p);
+        }
+        const Eigen::Vector2d extent = (pmax - pmin_).cwiseMax(Eigen::Vector2d(1,1));
+        cell_ = std::max(1e-6, std::sqrt(extent[0]*extent[1] / pts_.size()));
+        w_ = std::min<int>(pts_.size(), (int)(extent[0] / cell_) + 1);
+        h_ = std::min<int>(pts_.size(), (int)(extent[1] / cell_) + 1);
+
+        cell_ids_.assign(pts_.size(), 0);
+        start_.assign(w_*h_+1, 0);
+        for(size_t i=0; i < pts_.size(); ++i) {
+            cell_ids_[i] = Cell(pts_[i]);
+            ++start_[cell_ids_[i]+1];
+        }
+        for(int c=0; c < w_*h_; ++c) start_[c+1] += start_[c];
+        idx_.resize(pts_.size());
+        fill_.assign(start_.begin(), start_.end()-1);
+        for(size_t i=0; i < pts_.size(); ++i) idx_[fill_[cell_ids_[i]]++] = i;
+    }
+
+    /// Index of the closest point within max_dist of p, or -1
+    int Nearest(const Eigen::Vector2d& p, double max_dist) const
+    {
+        if(pts_.empty()) return -1;
+        const int x0 = std::max(0, (int)std::floor((p[0] - max_dist - pmin_[0]) / cell_));
+        const int x1 = std::min(w_-1, (int)std::floor((p[0] + max_dist - pmin_[0]) / cell_));
+        const int y0 = std::max(0, (int)std::floor((p[1] - max_dist - pmin_[1]) / cell_));
+        const int y1 = std::min(h_-1, (int)std::floor((p[1] + max_dist - pmin_[1]) / cell_));
+
+        int best = -1;
+        double best_d2 = max_dist*max_dist;
+        for(int y=y0; y <= y1; ++y) {
+            for(int x=x0; x <= x1; ++x) {
+                const int c = y*w_ + x;
+                for(int i=start_[c]; i < start_[c+1]; ++i) {
+                    const double d2 = (pts_[idx_[i]] - p).squaredNorm();
+                    if(d2 < best_d2) {
+                        best_d2 = d2;
+                        best = ids_[idx_[i]];
+                    }
+                }
+            }
+        }
+        return best;
+    }
+
+protected:
+    template<typename T>
+    using Vector = std::vector<T, ArenaAllocator<T> >;
+
+    int Cell(const Eigen::Vector2d& p) const
+    {
+        const int cx = std::min(w_-1, (int)((p[0] - pmin_[0]) / cell_));
+        const int cy = std::min(h_-1, (int)((p[1] - pmin_[1]) / cell_));
+        return cy*w_ + cx;
+    }
+
+    Vector<Eigen::Vector2d> pts_;
+    Vector<int> ids_;
+    Vector<int> start_;
+    Vector<int> idx_;
+    Vector<int> cell_ids_;
+    Vector<int> fill_;
+    Eigen::Vector2d pmin_;
+    double cell_;
+    int w_, h_;
+};
+
+}
@@ -0,0 +1,52 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace calibu {
+
+/// Read only view of n contiguous elements, valid while the owner is.
+template<typename T>
+struct Span
+{
+    Span() : ptr(NULL), n(0) {}
+
+    Span(const T* ptr, size_t n) : ptr(ptr), n(n) {}
+
+    template<typename Alloc>
+    Span(const std::vector<T,Alloc>& v) : ptr(v.data()), n(v.size()) {}
+
+    const T* data() const { return ptr; }
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + n; }
+
+    const T& operator[](size_t i) const { return ptr[i]; }
+
+    const T* ptr;
+    size_t n;
+};
+
+}
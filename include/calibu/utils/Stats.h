@@ -0,0 +1,146 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <calibu/Platform.h>
+
+#include <chrono>
+
+// Per frame timings and counters for the detection pipeline. The stats
+// structs are always present so that client code compiles either way, but
+// they are only filled in when Calibu is configured with BUILD_STATS.
+// Otherwise the macros below expand to nothing.
+
+namespace calibu
+{
+
+/// Adds the lifetime of the object, in seconds, to a counter.
+class ScopedStatTimer
+{
+public:
+    explicit ScopedStatTimer(double& seconds)
+        : seconds_(seconds), start_(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ScopedStatTimer()
+    {
+        seconds_ += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    double& seconds_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+struct ImageProcessingStats
+{
+    ImageProcessingStats()
+        : copy(0), gradient(0), integral_image(0), threshold(0), fused(0),
+          pyramid(0), label(0), num_labels(0), num_allocations(0),
+          num_pyramid_fallbacks(0) {}
+
+    void Reset() { *this = ImageProcessingStats(); }
+
+    double copy;            // Copy of the input into the private image
+    double gradient;
+    double integral_image;
+    double threshold;
+    double fused;           // Gradient, integral and threshold in one pass
+    double pyramid;         // Coarse level and full resolution refinement
+    double label;
+    int num_labels;
+    int num_allocations;    // Image buffer (re)allocations this frame
+    int num_pyramid_fallbacks;  // Full resolution passes after the pyramid
+};
+
+struct ConicFinderStats
+{
+    ConicFinderStats()
+        : candidates(0), fit(0), num_candidates(0), num_conics(0),
+          num_allocations(0) {}
+
+    void Reset() { *this = ConicFinderStats(); }
+
+    double candidates;
+    double fit;
+    int num_candidates;
+    int num_conics;
+    int num_allocations;    // Growth of the per candidate fit buffers
+};
+
+struct TargetGridDotStats
+{
+    TargetGridDotStats()
+        : closest_points(0), triples(0), grow(0), total(0), num_vertices(0),
+          num_line_groups(0), num_allocations(0), num_predicted(0) {}
+
+    void Reset() { *this = TargetGridDotStats(); }
+
+    double closest_points;
+    double triples;
+    double grow;            // Growing and matching the grid
+    double total;
+    int num_vertices;
+    int num_line_groups;
+    int num_allocations;    // Growth of the vertex store
+    int num_predicted;      // Grid points matched from a prediction
+};
+
+struct TrackerStats
+{
+    TrackerStats()
+        : detect(0), unmap(0), find_target(0), pnp(0), total(0),
+          num_attempts(0), num_inliers(0), predicted(0),
+          num_allocations(0) {}
+
+    void Reset() { *this = TrackerStats(); }
+
+    double detect;          // ImageProcessing and ConicFinder
+    double unmap;
+    double find_target;
+    double pnp;
+    double total;
+    int num_attempts;       // 2 when the ROI attempt failed
+    int num_inliers;
+    int predicted;          // 1 when tracked from the predicted pose
+    // Growth of the Tracker's per conic buffers. Allocations made inside
+    // pose estimation (OpenCV, or the growth of pnp_workspace for
+    // bearing_pnp) are not counted.
+    int num_allocations;
+};
+
+}
+
+#define CALIBU_STATS_CAT_(a,b) a##b
+#define CALIBU_STATS_CAT(a,b) CALIBU_STATS_CAT_(a,b)
+
+#ifdef CALIBU_WITH_STATS
+/// Time the rest of the enclosing scope into the double 'seconds'
+#  define CALIBU_STATS_TIME(seconds) \
+    calibu::ScopedStatTimer CALIBU_STATS_CAT(calibu_stat_timer_, __LINE__)(seconds)
+/// Execute statement only when stats are enabled
+#  define CALIBU_STATS(statement) do { statement; } while(0)
+#else
+#  define CALIBU_STATS_TIME(seconds)
+#  define CALIBU_STATS(statement) do {} while(0)
+#endif
@@ -0,0 +1,164 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <calibu/Platform.h>
+
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timeline of spans across threads, for seeing how detection, rectification
+// and the solver overlap. The functions below are always present, but spans
+// are only recorded when Calibu is configured with BUILD_TRACE; otherwise
+// the macros at the end expand to nothing (or a plain lock). Recording is
+// off until StartTrace().
+
+namespace calibu
+{
+
+/// Frame and camera ids given to spans opened on a thread, -1 if unknown.
+struct TraceContext
+{
+    TraceContext() : frame(-1), camera(-1) {}
+    TraceContext(int frame, int camera) : frame(frame), camera(camera) {}
+
+    int frame;
+    int camera;
+};
+
+/// A completed span. name must outlive the trace, e.g. a string literal.
+struct TraceEvent
+{
+    const char* name;
+    int64_t begin_us;       // since an arbitrary steady clock epoch
+    int64_t duration_us;
+    uint32_t thread;        // small id, in order of each thread's first span
+    TraceContext context;
+};
+
+/// Clear recorded spans and start recording.
+CALIBU_EXPORT void StartTrace();
+
+/// Stop recording, keeping the spans recorded so far.
+CALIBU_EXPORT void StopTrace();
+
+CALIBU_EXPORT bool TraceEnabled();
+
+/// Name the calling thread in exported traces.
+CALIBU_EXPORT void SetTraceThreadName(const std::string& name);
+
+CALIBU_EXPORT const TraceContext& CurrentTraceContext();
+
+CALIBU_EXPORT int64_t TraceNowUs();
+
+/// Append a span recorded on the calling thread.
+CALIBU_EXPORT void RecordTrace(const char* name, int64_t begin_us,
+                               int64_t duration_us, const TraceContext& context);
+
+/// Spans of every thread recorded so far, ordered by begin time.
+CALIBU_EXPORT std::vector<TraceEvent> TraceEvents();
+
+/// Write recorded spans as Chrome trace event JSON, which chrome://tracing
+/// and the Perfetto UI both open. False, with a message on std::cerr, if the
+/// file can't be written.
+CALIBU_EXPORT bool WriteChromeTrace(std::ostream& out);
+CALIBU_EXPORT bool WriteChromeTrace(const std::string& filename);
+
+/// Sets the TraceContext of the calling thread for the lifetime of the
+/// object. Ids left at -1 are inherited from the enclosing context.
+CALIBU_EXPORT
+class ScopedTraceContext
+{
+public:
+    explicit ScopedTraceContext(const TraceContext& context);
+    ScopedTraceContext(int frame, int camera);
+    ~ScopedTraceContext();
+
+private:
+    TraceContext previous_;
+};
+
+/// Records a span over the lifetime of the object, if tracing is enabled
+/// when it is created. Spans carry the thread's TraceContext unless given
+/// their own ids.
+class ScopedTrace
+{
+public:
+    explicit ScopedTrace(const char* name, int frame = -1, int camera = -1)
+        : name_(TraceEnabled() ? name : NULL), context_(CurrentTraceContext()),
+          begin_us_(0)
+    {
+        if(name_) {
+            if(frame >= 0) context_.frame = frame;
+            if(camera >= 0) context_.camera = camera;
+            begin_us_ = TraceNowUs();
+        }
+    }
+
+    ~ScopedTrace()
+    {
+        if(name_) {
+            RecordTrace(name_, begin_us_, TraceNowUs() - begin_us_, context_);
+        }
+    }
+
+private:
+    const char* name_;
+    TraceContext context_;
+    int64_t begin_us_;
+};
+
+/// Lock m, recording a span named name only if the lock was contended.
+template<typename Mutex>
+std::unique_lock<Mutex> TraceLock(Mutex& m, const char* name)
+{
+    if(!m.try_lock()) {
+        ScopedTrace wait(name);
+        m.lock();
+    }
+    return std::unique_lock<Mutex>(m, std::adopt_lock);
+}
+
+}
+
+#define CALIBU_TRACE_CAT_(a,b) a##b
+#define CALIBU_TRACE_CAT(a,b) CALIBU_TRACE_CAT_(a,b)
+
+#ifdef CALIBU_WITH_TRACE
+#  define CALIBU_TRACE(name) \
+    ::calibu::ScopedTrace CALIBU_TRACE_CAT(calibu_trace_, __LINE__)(name)
+#  define CALIBU_TRACE_IDS(name, frame, camera) \
+    ::calibu::ScopedTrace CALIBU_TRACE_CAT(calibu_trace_, __LINE__)(name, frame, camera)
+#  define CALIBU_TRACE_CONTEXT(frame, camera) \
+    ::calibu::ScopedTraceContext CALIBU_TRACE_CAT(calibu_trace_context_, __LINE__)(frame, camera)
+#  define CALIBU_TRACE_THREAD(name) ::calibu::SetTraceThreadName(name)
+#  define CALIBU_TRACE_LOCK(lock, m) \
+    std::unique_lock<std::mutex> lock = ::calibu::TraceLock(m, "Wait " #m)
+#else
+#  define CALIBU_TRACE(name)
+#  define CALIBU_TRACE_IDS(name, frame, camera)
+#  define CALIBU_TRACE_CONTEXT(frame, camera)
+#  define CALIBU_TRACE_THREAD(name)
+#  define CALIBU_TRACE_LOCK(lock, m) std::lock_guard<std::mutex> lock(m)
+#endif
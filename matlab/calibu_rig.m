@@ -30,7 +30,7 @@ classdef calibu_rig
         %%% Project Points.
         function [pixel_coordinate] = project_points(obj, camera_id, points)
             pixel_coordinate = calibu_mex('project_points', obj.cpp_calibu_rig_ptr_, ...
-                       camera_id, length(points), points);
+                       camera_id, size(points, 2), points);
         end
         
         %%% Unproject.
@@ -42,7 +42,7 @@ classdef calibu_rig
         %%% Unproject Pixels.
         function [rays] = unproject_pixels(obj, camera_id, pixels)
             rays = calibu_mex('unproject_pixels', obj.cpp_calibu_rig_ptr_, ...
-                       camera_id, length(pixels), pixels);
+                       camera_id, size(pixels, 2), pixels);
         end
         
         %%% Transfer3d.
@@ -52,6 +52,14 @@ classdef calibu_rig
                                           camera_id, Tab, ray, rho);
         end
 
+        %%% Rectification maps, from pixels of a linear camera of
+        %%% intrinsics K_new (default the camera's K) rotated by R_on, to
+        %%% 0 based source pixels.
+        function [map_x, map_y] = lut(obj, camera_id, varargin)
+            [map_x, map_y] = calibu_mex('lut', obj.cpp_calibu_rig_ptr_, ...
+                                        camera_id, varargin{:});
+        end
+
         %%% Get K.
         function [K] = get_K(obj, camera_id)
             K = calibu_mex('get_K', obj.cpp_calibu_rig_ptr_, camera_id);
@@ -0,0 +1,292 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove,
+                      Gabe Sibley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <calibu/cam/camera_binary.h>
+#include <calibu/cam/camera_model_registry.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+namespace calibu {
+
+namespace {
+
+  const char kRigMagic[8] = { 'C','A','L','I','B','R','I','G' };
+  const uint32_t kRigVersion = 1;
+  const uint32_t kRigByteOrder = 0x01020304;
+
+  struct RigFileHeader
+  {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t num_cameras;
+    unsigned char pad[44];
+  };
+  static_assert(sizeof(RigFileHeader) == 64, "RigFileHeader is 64 bytes");
+
+  // Followed by the params, name and type, padded to a multiple of 8 bytes
+  struct RigCameraRecord
+  {
+    uint32_t model_id;
+    uint32_t num_params;
+    int32_t  width, height;
+    int32_t  index, version;
+    uint64_t serialno;
+    uint32_t name_length;
+    uint32_t type_length;
+    double   rdf[9];
+    double   T_rc[12];
+  };
+  static_assert(sizeof(RigCameraRecord) == 208, "RigCameraRecord is 208 bytes");
+
+  size_t Padded(size_t bytes)
+  {
+    return (bytes + 7) & ~size_t(7);
+  }
+
+  size_t RecordBytes(const RigCameraRecord& r)
+  {
+    return sizeof(RigCameraRecord) +
+        Padded(r.num_params * sizeof(double) + r.name_length + r.type_length);
+  }
+
+  // Camera of the visited model, parameters to be set
+  struct NewBinaryCamera
+  {
+    template<typename Tag>
+    CameraInterface<double>* operator()(Tag) const
+    {
+      return new typename Tag::template Camera<double>();
+    }
+  };
+
+}
+
+bool BinaryRigView::Open(const void* buffer, size_t bytes)
+{
+  data = NULL;
+  size = 0;
+  num_cameras = 0;
+
+  if( reinterpret_cast<uintptr_t>(buffer) % 8 != 0 ) {
+    std::cerr << "Binary rig buffer is not 8 byte aligned" << std::endl;
+    return false;
+  }
+  if( bytes < sizeof(RigFileHeader) ) {
+    std::cerr << "Binary rig is truncated" << std::endl;
+    return false;
+  }
+
+  const RigFileHeader& header = *static_cast<const RigFileHeader*>(buffer);
+  if( std::memcmp(header.magic, kRigMagic, sizeof(kRigMagic)) != 0 ) {
+    std::cerr << "Not a binary rig" << std::endl;
+    return false;
+  }
+  if( header.byte_order != kRigByteOrder ) {
+    std::cerr << "Binary rig was written on a host of another byte order" << std::endl;
+    return false;
+  }
+  if( header.version != kRigVersion ) {
+    std::cerr << "Unsupported binary rig version " << header.version << std::endl;
+    return false;
+  }
+
+  // Walk every record once so that Camera() needs no bounds checks
+  const unsigned char* bytes_begin = static_cast<const unsigned char*>(buffer);
+  size_t offset = sizeof(RigFileHeader);
+  for( uint32_t c=0; c < header.num_cameras; ++c ) {
+    if( bytes - offset < sizeof(RigCameraRecord) ) {
+      std::cerr << "Binary rig is truncated" << std::endl;
+      return false;
+    }
+    const RigCameraRecord& r =
+        *reinterpret_cast<const RigCameraRecord*>(bytes_begin + offset);
+    const uint64_t tail = (uint64_t)r.num_params * sizeof(double) +
+        r.name_length + r.type_length;
+    if( tail > bytes - offset - sizeof(RigCameraRecord) ||
+        Padded(tail) > bytes - offset - sizeof(RigCameraRecord) ) {
+      std::cerr << "Binary rig is truncated" << std::endl;
+      return false;
+    }
+    offset += RecordBytes(r);
+  }
+
+  data = bytes_begin;
+  size = bytes;
+  num_cameras = header.num_cameras;
+  return true;
+}
+
+BinaryRigCamera BinaryRigView::Camera(size_t c) const
+{
+  size_t offset = sizeof(RigFileHeader);
+  for( size_t i=0; i < c; ++i ) {
+    offset += RecordBytes(*reinterpret_cast<const RigCameraRecord*>(data + offset));
+  }
+  const RigCameraRecord& r = *reinterpret_cast<const RigCameraRecord*>(data + offset);
+  const unsigned char* tail = data + offset + sizeof(RigCameraRecord);
+
+  BinaryRigCamera cam;
+  cam.model = (CameraModelId)r.model_id;
+  cam.width = r.width;
+  cam.height = r.height;
+  cam.index = r.index;
+  cam.version = r.version;
+  cam.serialno = r.serialno;
+  cam.params = reinterpret_cast<const double*>(tail);
+  cam.num_params = r.num_params;
+  cam.rdf = r.rdf;
+  cam.T_rc = r.T_rc;
+  cam.name = reinterpret_cast<const char*>(tail + r.num_params * sizeof(double));
+  cam.name_length = r.name_length;
+  cam.type = cam.name + r.name_length;
+  cam.type_length = r.type_length;
+  return cam;
+}
+
+void WriteBinaryRig(std::ostream& out, const std::shared_ptr<Rig<double>> rig)
+{
+  RigFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kRigMagic, sizeof(kRigMagic));
+  header.version = kRigVersion;
+  header.byte_order = kRigByteOrder;
+  header.num_cameras = rig->cameras_.size();
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  for( const std::shared_ptr<CameraInterface<double>>& cam : rig->cameras_ ) {
+    const Eigen::VectorXd params = cam->GetParams();
+    const std::string name = cam->Name();
+    // As WriteXmlCamera, which falls back to the model's type name
+    const std::string type = cam->Type().empty() ?
+        CameraModelTypeName(cam->ModelId()) : cam->Type();
+
+    RigCameraRecord r;
+    std::memset(&r, 0, sizeof(r));
+    r.model_id = (uint32_t)cam->ModelId();
+    r.num_params = params.size();
+    r.width = cam->Width();
+    r.height = cam->Height();
+    r.index = cam->Index();
+    r.version = cam->Version();
+    r.serialno = cam->SerialNumber();
+    r.name_length = name.size();
+    r.type_length = type.size();
+    Eigen::Map<Eigen::Matrix3d> rdf(r.rdf);
+    Eigen::Map<Eigen::Matrix<double,3,4> > T_rc(r.T_rc);
+    rdf = cam->RDF();
+    T_rc = cam->Pose().matrix3x4();
+
+    out.write(reinterpret_cast<const char*>(&r), sizeof(r));
+    out.write(reinterpret_cast<const char*>(params.data()), params.size() * sizeof(double));
+    out.write(name.data(), name.size());
+    out.write(type.data(), type.size());
+    const char pad[8] = {0};
+    const size_t tail = params.size() * sizeof(double) + name.size() + type.size();
+    out.write(pad, Padded(tail) - tail);
+  }
+}
+
+bool WriteBinaryRig(const std::string& filename, const std::shared_ptr<Rig<double>> rig)
+{
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  if( !out ) {
+    std::cerr << "Unable to open '" << filename << "' for writing" << std::endl;
+    return false;
+  }
+  WriteBinaryRig(out, rig);
+  out.close();
+  if( !out ) {
+    std::cerr << "Error writing '" << filename << "'" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<Rig<double>> ReadBinaryRig(const BinaryRigView& view)
+{
+  std::shared_ptr<Rig<double>> rig(new Rig<double>());
+  for( size_t c=0; c < view.NumCameras(); ++c ) {
+    const BinaryRigCamera r = view.Camera(c);
+
+    std::shared_ptr<CameraInterface<double>> cam;
+    try {
+      cam.reset(VisitCameraModel<CameraInterface<double>*>(r.model, NewBinaryCamera()));
+    } catch(const std::invalid_argument&) {
+      std::cerr << "Unknown camera model " << (int)r.model << " in binary rig" << std::endl;
+      return std::shared_ptr<Rig<double>>();
+    }
+    if( r.num_params != cam->NumParams() ) {
+      std::cerr << "Camera " << c << " of binary rig has " << r.num_params
+                << " parameters, its model " << cam->NumParams() << std::endl;
+      return std::shared_ptr<Rig<double>>();
+    }
+
+    const Eigen::Map<const Eigen::Matrix3d> rdf(r.rdf);
+    const Eigen::Map<const Eigen::Matrix<double,3,4> > T_rc(r.T_rc);
+    cam->SetParams(Eigen::Map<const Eigen::VectorXd>(r.params, r.num_params));
+    cam->SetImageDimensions(r.width, r.height);
+    cam->SetIndex(r.index);
+    cam->SetVersion(r.version);
+    cam->SetSerialNumber(r.serialno);
+    cam->SetName(std::string(r.name, r.name_length));
+    cam->SetType(std::string(r.type, r.type_length));
+    cam->SetRDF(rdf);
+    cam->SetPose(Sophus::SE3d(T_rc.leftCols<3>(), T_rc.col(3)));
+    rig->AddCamera(cam);
+  }
+  return rig;
+}
+
+std::shared_ptr<Rig<double>> ReadBinaryRig(const void* data, size_t size)
+{
+  BinaryRigView view;
+  if( !view.Open(data, size) ) {
+    return std::shared_ptr<Rig<double>>();
+  }
+  return ReadBinaryRig(view);
+}
+
+std::shared_ptr<Rig<double>> ReadBinaryRig(const std::string& filename)
+{
+  std::ifstream in(filename.c_str(), std::ios::binary | std::ios::ate);
+  if( !in ) {
+    std::cerr << "Unable to open '" << filename << "'" << std::endl;
+    return std::shared_ptr<Rig<double>>();
+  }
+  const std::streamoff bytes = in.tellg();
+  in.seekg(0);
+
+  // Doubles, so that the buffer is 8 byte aligned for the view
+  std::vector<double> buffer((bytes + sizeof(double) - 1) / sizeof(double));
+  if( !in.read(reinterpret_cast<char*>(buffer.data()), bytes) ) {
+    std::cerr << "Error reading '" << filename << "'" << std::endl;
+    return std::shared_ptr<Rig<double>>();
+  }
+  return ReadBinaryRig(buffer.data(), bytes);
+}
+
+}
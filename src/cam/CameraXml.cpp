@@ -25,6 +25,7 @@
 #include <calibu/cam/camera_crtp.h>
 #include <calibu/cam/camera_crtp_impl.h>
 #include <calibu/cam/camera_models_crtp.h>
+#include <calibu/cam/camera_model_registry.h>
 #include <fstream>
 
 namespace calibu
@@ -77,7 +78,8 @@ void WriteXmlCamera(std::ostream& out,
       << "<" << NODE_CAM << " name=\"" << cam->Name() << "\" "
       << "index=\"" << cam->Index() << "\" "
       << "serialno=\"" << cam->SerialNumber() << "\" "
-      << "type=\"" << cam->Type() << "\" "
+      << "type=\"" << (cam->Type().empty() ?
+                        CameraModelTypeName(cam->ModelId()) : cam->Type()) << "\" "
       << "version=\"" << cam->Version() << "\">\n";
 
   out << dd2 << "<width> " << cam->Width() << " </width>\n";
@@ -104,34 +106,31 @@ void WriteXmlCamera(const std::string& filename,
   WriteXmlCamera(of, cam, indent);
 }
 
+// Camera of the visited model with all parameters 1, to be read into
+struct NewDefaultCamera
+{
+  template<typename Tag>
+  CameraInterfaced* operator()(Tag) const
+  {
+    typedef typename Tag::template Camera<double> Model;
+    CameraInterfaced* cam = new Model();
+    cam->SetParams(Eigen::VectorXd::Constant(Model::NumParams,1));
+    return cam;
+  }
+};
+
 std::shared_ptr<CameraInterfaced> ReadXmlCamera(tinyxml2::XMLElement* pEl)
 {    
   std::string sType = CameraType( pEl->Attribute("type"));
   std::shared_ptr<CameraInterfaced> rCam;
 
-    if (sType == "calibu_fu_fv_u0_v0_w") {
-    rCam.reset(new calibu::FovCamera<double>());
-    rCam->SetParams(Eigen::VectorXd::Constant(FovCamera<double>::NumParams,1));
-  } else if (sType == "calibu_fu_fv_u0_v0") {
-    rCam.reset(new calibu::LinearCamera<double>());
-    rCam->SetParams(Eigen::VectorXd::Constant(LinearCamera<double>::NumParams,1));
-  } else if (sType == "calibu_fu_fv_u0_v0_k1_k2") {
-    rCam.reset(new calibu::Poly2Camera<double>());
-    rCam->SetParams(Eigen::VectorXd::Constant(Poly2Camera<double>::NumParams,1));
-  } else if (sType == "calibu_fu_fv_u0_v0_kb4") {
-    rCam.reset(new calibu::KannalaBrandtCamera<double>());
-    rCam->SetParams(Eigen::VectorXd::Constant(KannalaBrandtCamera<double>::NumParams,1));
-  } else if (sType == "calibu_fu_fv_u0_v0_k1_k2_k3") {
-    rCam.reset(new calibu::Poly3Camera<double>());
-    rCam->SetParams(Eigen::VectorXd::Constant(Poly3Camera<double>::NumParams,1));
-  } else if (sType == "calibu_fu_fv_u0_v0_rational6") {
-	rCam.reset(new calibu::Rational6Camera<double>());
-	rCam->SetParams(Eigen::VectorXd::Constant(Rational6Camera<double>::NumParams,1));
-  } else {
+  const CameraModelId id = CameraModelIdFromTypeName(sType);
+  if (id == CameraModelId::kUnknown) {
     std::cerr << "Unknown old camera type " << sType << " please implement this"
                  " camera before initializing it. " << std::endl;
     throw 0;
   }
+  rCam.reset(VisitCameraModel<CameraInterfaced*>(id, NewDefaultCamera()));
 
   if(rCam->IsInitialized()) {
     std::string sVer    = pEl->Attribute("version");
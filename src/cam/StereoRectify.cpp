@@ -28,13 +28,12 @@
 namespace calibu
 {
 
-std::shared_ptr<calibu::Rig<double>> CreateScanlineRectifiedLookupAndCameras(const Sophus::SE3d& T_rl,
-        const std::shared_ptr<calibu::CameraInterface<double> > cam_left,
-        const std::shared_ptr<calibu::CameraInterface<double> > cam_right,
-        Sophus::SE3d& T_nr_nl,
-        LookupTable& left_lut,
-        LookupTable& right_lut
-        )
+namespace {
+
+// Rotation Rnl_l taking rays of the left camera to the common rectified
+// frame, and the rectified extrinsics T_nr_nl.
+Eigen::Matrix3d ScanlineRectifyingRotation(const Sophus::SE3d& T_rl,
+                                          Sophus::SE3d& T_nr_nl)
 {
     const Sophus::SO3d R_rl = T_rl.so3();
     const Sophus::SO3d R_lr = R_rl.inverse();
@@ -65,6 +64,47 @@ std::shared_ptr<calibu::Rig<double>> CreateScanlineRectifiedLookupAndCameras(con
     // as the left camera.
     T_nr_nl = Sophus::SE3d(Eigen::Matrix3d::Identity(), Eigen::Vector3d(-r_l.norm(),0,0) );
 
+    return Rnl_l;
+}
+
+// Focal length, in pixels per unit of the z = 1 plane, at the image centre.
+double CentralFocalLength(const std::shared_ptr<calibu::CameraInterface<double> >& cam)
+{
+    const Eigen::Vector2d c(cam->Width() / 2.0, cam->Height() / 2.0);
+    Eigen::Matrix2Xd pix(2, 4);
+    pix << c[0] - 0.5, c[0] + 0.5, c[0], c[0],
+           c[1], c[1], c[1] - 0.5, c[1] + 0.5;
+    Eigen::Matrix3Xd rays(3, 4);
+    cam->Unproject(pix, rays);
+    const Eigen::Matrix2Xd xy = rays.colwise().hnormalized();
+    return 2.0 / ((xy.col(1) - xy.col(0)).norm() + (xy.col(3) - xy.col(2)).norm());
+}
+
+// Shift of the pixel grid that makes CreateLookupTable, which centres a
+// lookup of a different size on the camera, see lookup pixel (c, r) as
+// (c, r) itself.
+Eigen::Matrix3d LookupOffset(const LookupTable& lut,
+                             const std::shared_ptr<calibu::CameraInterface<double> >& cam)
+{
+    Eigen::Matrix3d T = Eigen::Matrix3d::Identity();
+    T(0,2) = ((int)lut.Width() - (int)cam->Width()) / 2.0;
+    T(1,2) = ((int)lut.Height() - (int)cam->Height()) / 2.0;
+    return T;
+}
+
+}
+
+std::shared_ptr<calibu::Rig<double>> CreateScanlineRectifiedLookupAndCameras(const Sophus::SE3d& T_rl,
+        const std::shared_ptr<calibu::CameraInterface<double> > cam_left,
+        const std::shared_ptr<calibu::CameraInterface<double> > cam_right,
+        Sophus::SE3d& T_nr_nl,
+        LookupTable& left_lut,
+        LookupTable& right_lut
+        )
+{
+    const Sophus::SO3d R_lr = T_rl.so3().inverse();
+    const Eigen::Matrix3d Rnl_l = ScanlineRectifyingRotation(T_rl, T_nr_nl);
+
     // Work out parameters of new linear camera
     const Range range_width = //Intersection(
                 MinMaxRotatedCol(cam_left, Rnl_l);
@@ -94,7 +134,7 @@ std::shared_ptr<calibu::Rig<double>> CreateScanlineRectifiedLookupAndCameras(con
     new_cam_left->SetPose(Sophus::SE3d());
     std::shared_ptr<calibu::CameraInterface<double>>
         new_cam_right(new calibu::LinearCamera<double>(params_, size_));
-    new_cam_left->SetPose(T_nr_nl);
+    new_cam_right->SetPose(T_nr_nl);
 
     new_rig->AddCamera(new_cam_left);
     new_rig->AddCamera(new_cam_right);
@@ -108,4 +148,62 @@ std::shared_ptr<calibu::Rig<double>> CreateScanlineRectifiedLookupAndCameras(con
     return new_rig;
 }
 
+std::shared_ptr<calibu::Rig<double>> CreateCroppedScanlineRectifiedLookupAndCameras(const Sophus::SE3d& T_rl,
+        const std::shared_ptr<calibu::CameraInterface<double> > cam_left,
+        const std::shared_ptr<calibu::CameraInterface<double> > cam_right,
+        Sophus::SE3d& T_nr_nl,
+        LookupTable& left_lut,
+        LookupTable& right_lut
+        )
+{
+    const Sophus::SO3d R_lr = T_rl.so3().inverse();
+    const Eigen::Matrix3d Rnl_l = ScanlineRectifyingRotation(T_rl, T_nr_nl);
+    const Eigen::Matrix3d Rnr_r = Rnl_l * R_lr.matrix();
+
+    // Region of the rectified image plane seen by both cameras
+    Range left_x, left_y, right_x, right_y;
+    ValidRotatedRegion(cam_left, Rnl_l, left_x, left_y);
+    ValidRotatedRegion(cam_right, Rnr_r, right_x, right_y);
+    const Range range_width = Intersection(left_x, right_x);
+    const Range range_height = Intersection(left_y, right_y);
+    if(range_width.Empty() || range_height.Empty()) {
+        return nullptr;
+    }
+
+    // Square pixels, no finer than the source at its centre and no larger
+    // than the left image.
+    double f = std::min(CentralFocalLength(cam_left), CentralFocalLength(cam_right));
+    f = std::min(f, (cam_left->Width()-1) / range_width.Size());
+    f = std::min(f, (cam_left->Height()-1) / range_height.Size());
+
+    Eigen::Vector2i size_;
+    Eigen::VectorXd params_(calibu::LinearCamera<double>::NumParams);
+    size_ << (int)(f * range_width.Size()) + 1, (int)(f * range_height.Size()) + 1;
+    params_ << f, f, -f * range_width.minr, -f * range_height.minr;
+
+    std::shared_ptr<calibu::Rig<double>> new_rig(new calibu::Rig<double>());
+
+    std::shared_ptr<calibu::CameraInterface<double>>
+        new_cam_left(new calibu::LinearCamera<double>(params_, size_));
+    new_cam_left->SetPose(Sophus::SE3d());
+    std::shared_ptr<calibu::CameraInterface<double>>
+        new_cam_right(new calibu::LinearCamera<double>(params_, size_));
+    new_cam_right->SetPose(T_nr_nl);
+
+    new_rig->AddCamera(new_cam_left);
+    new_rig->AddCamera(new_cam_right);
+
+    left_lut = LookupTable(size_[0], size_[1]);
+    right_lut = LookupTable(size_[0], size_[1]);
+    const Eigen::Matrix3d Klinv = new_cam_left->K().inverse();
+    const Eigen::Matrix3d Rl_nlKlinv =
+        Rnl_l.transpose() * Klinv * LookupOffset(left_lut, cam_left);
+    const Eigen::Matrix3d Rr_nrKlinv =
+        Rnr_r.transpose() * Klinv * LookupOffset(right_lut, cam_right);
+
+    CreateLookupTable(cam_left, Rl_nlKlinv, left_lut);
+    CreateLookupTable(cam_right, Rr_nrKlinv, right_lut);
+    return new_rig;
+}
+
 }
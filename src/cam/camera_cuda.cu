@@ -0,0 +1,175 @@
+/*
+  This file is part of the Calibu Project.
+  https://github.com/arpg/Calibu
+
+  Copyright (C) 2013 George Washington University,
+  Copyright (C) 2015 University of Colorado,
+  Steven Lovegrove,
+  Nima Keivan,
+  Christoffer Heckman,
+  Gabe Sibley
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <calibu/cam/camera_cuda.h>
+#include <calibu/cam/camera_model_registry.h>
+
+namespace calibu {
+namespace cuda {
+
+static const int kBlockSize = 256;
+
+template<typename Model, typename Scalar>
+__global__ void UnprojectKernel(const DeviceCamera<Scalar> cam,
+                                const Scalar* pix, Scalar* rays, int n) {
+  const int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < n) {
+    Model::Unproject(pix + 2 * i, cam.params, rays + 3 * i);
+  }
+}
+
+template<typename Model, typename Scalar>
+__global__ void ProjectKernel(const DeviceCamera<Scalar> cam,
+                              const Scalar* rays, Scalar* pix, int n) {
+  const int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < n) {
+    Model::Project(rays + 3 * i, cam.params, pix + 2 * i);
+  }
+}
+
+template<typename Model, typename Scalar>
+__global__ void UnprojectDepthKernel(const DeviceCamera<Scalar> cam,
+                                     const float* depth, Scalar* points) {
+  const int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < cam.width * cam.height) {
+    const Scalar pix[2] = { Scalar(i % cam.width), Scalar(i / cam.width) };
+    Scalar ray[3];
+    Model::Unproject(pix, cam.params, ray);
+    const Scalar d = depth[i];
+    const Scalar s = (d > 0 && ray[2] > 0) ? d / ray[2] : Scalar(NAN);
+    points[3 * i + 0] = s * ray[0];
+    points[3 * i + 1] = s * ray[1];
+    points[3 * i + 2] = s * ray[2];
+  }
+}
+
+static int NumBlocks(int n) {
+  return (n + kBlockSize - 1) / kBlockSize;
+}
+
+// Kernel launches for the model visited by VisitCameraModel
+template<typename Scalar>
+struct Launch {
+  enum Op { kUnproject, kProject, kUnprojectDepth };
+
+  template<typename Tag>
+  cudaError_t operator()(Tag) const {
+    typedef typename Tag::template Camera<Scalar> Model;
+    static_assert(Model::NumParams <= DeviceCamera<Scalar>::kMaxParams,
+                  "Increase DeviceCamera::kMaxParams");
+    switch (op) {
+      case kUnproject:
+        UnprojectKernel<Model><<<NumBlocks(n), kBlockSize, 0, stream>>>(
+            cam, in, out, n);
+        break;
+      case kProject:
+        ProjectKernel<Model><<<NumBlocks(n), kBlockSize, 0, stream>>>(
+            cam, in, out, n);
+        break;
+      case kUnprojectDepth:
+        UnprojectDepthKernel<Model><<<NumBlocks(n), kBlockSize, 0, stream>>>(
+            cam, depth, out);
+        break;
+    }
+    return cudaGetLastError();
+  }
+
+  Op op;
+  const DeviceCamera<Scalar>& cam;
+  const Scalar* in;
+  const float* depth;
+  Scalar* out;
+  int n;
+  cudaStream_t stream;
+};
+
+template<typename Scalar>
+static cudaError_t Run(const std::vector<DeviceCamera<Scalar>>& cameras,
+                       const Launch<Scalar>& launch, size_t cam) {
+  if (cam >= cameras.size() || cameras[cam].model == CameraModelId::kUnknown) {
+    return cudaErrorInvalidValue;
+  }
+  if (launch.n == 0) {
+    return cudaSuccess;
+  }
+  return VisitCameraModel<cudaError_t>(cameras[cam].model, launch);
+}
+
+template<typename Scalar>
+DeviceRig<Scalar>::DeviceRig(const Rig<Scalar>& rig) {
+  Update(rig);
+}
+
+template<typename Scalar>
+void DeviceRig<Scalar>::Update(const Rig<Scalar>& rig) {
+  cameras_.resize(rig.cameras_.size());
+  for (size_t c = 0; c < rig.cameras_.size(); ++c) {
+    const CameraInterface<Scalar>& cam = *rig.cameras_[c];
+    DeviceCamera<Scalar>& dcam = cameras_[c];
+    dcam.model = cam.ModelId();
+    if (cam.NumParams() > (uint32_t)DeviceCamera<Scalar>::kMaxParams) {
+      dcam.model = CameraModelId::kUnknown;
+    }
+    dcam.width = cam.Width();
+    dcam.height = cam.Height();
+    for (uint32_t k = 0; k < cam.NumParams() &&
+             k < (uint32_t)DeviceCamera<Scalar>::kMaxParams; ++k) {
+      dcam.params[k] = cam.GetParams()[k];
+    }
+  }
+}
+
+template<typename Scalar>
+cudaError_t DeviceRig<Scalar>::Unproject(size_t cam, const Scalar* d_pix,
+                                         Scalar* d_rays, int n,
+                                         cudaStream_t stream) const {
+  if (cam >= cameras_.size()) return cudaErrorInvalidValue;
+  return Run(cameras_, Launch<Scalar>{Launch<Scalar>::kUnproject,
+          cameras_[cam], d_pix, nullptr, d_rays, n, stream}, cam);
+}
+
+template<typename Scalar>
+cudaError_t DeviceRig<Scalar>::Project(size_t cam, const Scalar* d_rays,
+                                       Scalar* d_pix, int n,
+                                       cudaStream_t stream) const {
+  if (cam >= cameras_.size()) return cudaErrorInvalidValue;
+  return Run(cameras_, Launch<Scalar>{Launch<Scalar>::kProject,
+          cameras_[cam], d_rays, nullptr, d_pix, n, stream}, cam);
+}
+
+template<typename Scalar>
+cudaError_t DeviceRig<Scalar>::UnprojectDepth(size_t cam, const float* d_depth,
+                                              Scalar* d_points,
+                                              cudaStream_t stream) const {
+  if (cam >= cameras_.size()) return cudaErrorInvalidValue;
+  const int n = cameras_[cam].width * cameras_[cam].height;
+  return Run(cameras_, Launch<Scalar>{Launch<Scalar>::kUnprojectDepth,
+          cameras_[cam], nullptr, d_depth, d_points, n, stream}, cam);
+}
+
+template class DeviceRig<float>;
+template class DeviceRig<double>;
+
+}  // namespace cuda
+}  // namespace calibu
@@ -20,14 +20,136 @@
  */
 
 #include <calibu/cam/rectify_crtp.h>
+#include <calibu/cam/camera_rig.h>
+#include <cmath>
 #include <calibu/utils/Range.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define CALIBU_RECT_AVX2
+#  include <immintrin.h>
+#endif
+
 namespace calibu
 {
 
+namespace {
+
+  // Bilinear blend of the 2x2 pixels at in + off, in 8 bit fixed point.
+  inline unsigned char RectifyPackedPixel(const unsigned char* in,
+                                          uint32_t off, uint16_t frac,
+                                          int stride)
+  {
+    const int fx = frac & 0xff;
+    const int fy = frac >> 8;
+    const unsigned char* p = in + off;
+    const int top = (p[0] << 8) + (p[1] - p[0]) * fx;
+    const int bot = (p[stride] << 8) + (p[stride + 1] - p[stride]) * fx;
+    return (unsigned char)(((top << 8) + (bot - top) * fy + (1 << 15)) >> 16);
+  }
+
+  // Remap n pixels. Vector kernels load 4 bytes per row from each offset, so
+  // they leave offsets beyond limit to RectifyPackedPixel.
+  typedef void (*RectifyPackedFn)(const unsigned char* in,
+                                  const uint32_t* off, const uint16_t* frac,
+                                  unsigned char* out, int n, int stride,
+                                  int limit);
+
+  void RectifyPackedScalar(const unsigned char* in, const uint32_t* off,
+                           const uint16_t* frac, unsigned char* out, int n,
+                           int stride, int)
+  {
+    for( int i = 0; i < n; ++i ) {
+      out[i] = RectifyPackedPixel(in, off[i], frac[i], stride);
+    }
+  }
+
+#ifdef CALIBU_RECT_AVX2
+
+  __attribute__((target("avx2")))
+  void RectifyPackedAvx2(const unsigned char* in, const uint32_t* off,
+                         const uint16_t* frac, unsigned char* out, int n,
+                         int stride, int limit)
+  {
+    const __m256i vstride = _mm256_set1_epi32(stride);
+    const __m256i vlimit = _mm256_set1_epi32(limit);
+    const __m256i vbyte = _mm256_set1_epi32(0xff);
+    const __m256i vhalf = _mm256_set1_epi32(1 << 15);
+    const __m256i vfirst_dwords = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+
+    int i = 0;
+    for( ; i + 8 <= n; i += 8 ) {
+      const __m256i o = _mm256_loadu_si256((const __m256i*)(off + i));
+      if( _mm256_movemask_epi8(_mm256_cmpgt_epi32(o, vlimit)) ) {
+        for( int k = i; k < i + 8; ++k ) {
+          out[k] = RectifyPackedPixel(in, off[k], frac[k], stride);
+        }
+        continue;
+      }
+      const __m256i g0 = _mm256_i32gather_epi32((const int*)in, o, 1);
+      const __m256i g1 = _mm256_i32gather_epi32(
+                  (const int*)in, _mm256_add_epi32(o, vstride), 1);
+      const __m256i f = _mm256_cvtepu16_epi32(
+                  _mm_loadu_si128((const __m128i*)(frac + i)));
+      const __m256i fx = _mm256_and_si256(f, vbyte);
+      const __m256i fy = _mm256_srli_epi32(f, 8);
+
+      const __m256i a = _mm256_and_si256(g0, vbyte);
+      const __m256i b = _mm256_and_si256(_mm256_srli_epi32(g0, 8), vbyte);
+      const __m256i c = _mm256_and_si256(g1, vbyte);
+      const __m256i d = _mm256_and_si256(_mm256_srli_epi32(g1, 8), vbyte);
+
+      const __m256i top = _mm256_add_epi32(_mm256_slli_epi32(a, 8),
+              _mm256_mullo_epi32(_mm256_sub_epi32(b, a), fx));
+      const __m256i bot = _mm256_add_epi32(_mm256_slli_epi32(c, 8),
+              _mm256_mullo_epi32(_mm256_sub_epi32(d, c), fx));
+      const __m256i r = _mm256_srli_epi32(_mm256_add_epi32(
+              _mm256_add_epi32(_mm256_slli_epi32(top, 8),
+                               _mm256_mullo_epi32(_mm256_sub_epi32(bot, top), fy)),
+              vhalf), 16);
+
+      // Bytes 0-3 of each 128 bit lane hold the results, move them together
+      const __m256i r16 = _mm256_packus_epi32(r, r);
+      const __m256i r8 = _mm256_packus_epi16(r16, r16);
+      const __m256i packed = _mm256_permutevar8x32_epi32(r8, vfirst_dwords);
+      _mm_storel_epi64((__m128i*)(out + i), _mm256_castsi256_si128(packed));
+    }
+    RectifyPackedScalar(in, off + i, frac + i, out + i, n - i, stride, limit);
+  }
+
+  RectifyPackedFn SelectRectifyPacked()
+  {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? RectifyPackedAvx2 : RectifyPackedScalar;
+  }
+
+#else
+
+  RectifyPackedFn SelectRectifyPacked()
+  {
+    return RectifyPackedScalar;
+  }
+
+#endif
+
+  void RectifyPackedRows(RectifyPackedFn rectify_fn,
+                         const PackedLookupTable& lut,
+                         const unsigned char* in, unsigned char* out,
+                         int row_begin, int row_end)
+  {
+    // Largest offset whose 4 byte loads stay within the image
+    const int limit = lut.m_nSrcSize - lut.m_nSrcWidth - 4;
+    const size_t begin = (size_t)row_begin * lut.m_nWidth;
+    rectify_fn(in, lut.m_vOffsets.data() + begin, lut.m_vFractions.data() + begin,
+               out + begin, (row_end - row_begin) * lut.m_nWidth,
+               lut.m_nSrcWidth, limit);
+  }
+
+} // anonymous namespace
+
   ///////////////////////////////////////////////////////////////////////////////
-  void CreateLookupTable(
-      const std::shared_ptr<calibu::CameraInterface<double> >& cam_from,
+  template<typename Scalar>
+  static void CreateLinearLookupTable(
+      const std::shared_ptr<calibu::CameraInterface<Scalar> >& cam_from,
       LookupTable& lut, int lookup_width, int lookup_height )
   {
     /*
@@ -56,13 +178,13 @@ namespace calibu
     // matrix.  Really we should workout what a good linear model would be
     // based on what portion of the original image is on the z=1 plane (e.g.,
     // cameras with FOV > 180 will need to ignore some pixels).
-    double fu = cam_from->GetParams()[0];
-    double fv = cam_from->GetParams()[1];
-    double u0 = cam_from->GetParams()[2];
-    double v0 = cam_from->GetParams()[3];
+    Scalar fu = cam_from->GetParams()[0];
+    Scalar fv = cam_from->GetParams()[1];
+    Scalar u0 = cam_from->GetParams()[2];
+    Scalar v0 = cam_from->GetParams()[3];
 
     // linear camera model inv(K) matrix
-    Eigen::Matrix3d R_onKinv;
+    Eigen::Matrix<Scalar,3,3> R_onKinv;
     R_onKinv << 1.0/fu,        0,   -u0 / fu,
                      0,   1.0/fv,   -v0 / fv,
                      0,        0,           1;
@@ -70,24 +192,36 @@ namespace calibu
     CreateLookupTable( cam_from, R_onKinv, lut, lookup_width, lookup_height );
   }
 
+  void CreateLookupTable(
+      const std::shared_ptr<calibu::CameraInterface<double> >& cam_from,
+      LookupTable& lut, int lookup_width, int lookup_height )
+  {
+    CreateLinearLookupTable( cam_from, lut, lookup_width, lookup_height );
+  }
+
+  void CreateLookupTable(
+      const std::shared_ptr<calibu::CameraInterface<float> >& cam_from,
+      LookupTable& lut, int lookup_width, int lookup_height )
+  {
+    CreateLinearLookupTable( cam_from, lut, lookup_width, lookup_height );
+  }
+
 
 
   ///////////////////////////////////////////////////////////////////////////////
-  void CreateLookupTable(
-      const std::shared_ptr<calibu::CameraInterface<double>>& cam_from,
-      const Eigen::Matrix3d& R_onKinv,
+  // Resolve the size of the table, as documented for CreateLookupTable
+  template<typename Scalar>
+  static void SizeLookupTable(
+      const std::shared_ptr<calibu::CameraInterface<Scalar>>& cam_from,
       LookupTable& lut,
-	  int lookup_width,
-	  int lookup_height
+	  int& lookup_width,
+	  int& lookup_height
       )
   {
-    const int cam_width = cam_from->Width();
-    const int cam_height = cam_from->Height();
-
     if(lookup_width < 1 || lookup_height < 1){
     	if(lut.Height() == 0){
-			lookup_width = cam_width;
-			lookup_height = cam_height;
+			lookup_width = cam_from->Width();
+			lookup_height = cam_from->Height();
 			// make sure we have mem in the look up table
 			lut.m_vLutPixels.resize( lookup_width*lookup_height );
 			lut.m_nWidth = lookup_width;
@@ -96,34 +230,62 @@ namespace calibu
 			lookup_height = lut.Height();
     	}
     }
+  }
 
-    double x_offset = (lookup_width - cam_width) / 2.0;
-    double y_offset = (lookup_height - cam_height) / 2.0;
+  ///////////////////////////////////////////////////////////////////////////////
+  // Rows [row_begin, row_end) of a lookup_width x lookup_height table
+  template<typename Scalar>
+  static void CreateRotatedLookupTableRows(
+      const std::shared_ptr<calibu::CameraInterface<Scalar>>& cam_from,
+      const Eigen::Matrix<Scalar,3,3>& R_onKinv,
+      LookupTable& lut,
+	  int lookup_width,
+	  int lookup_height,
+	  int row_begin,
+	  int row_end
+      )
+  {
+    typedef Eigen::Matrix<Scalar,2,1> Vec2t;
+    typedef Eigen::Matrix<Scalar,3,1> Vec3t;
+
+    const int cam_width = cam_from->Width();
+    const int cam_height = cam_from->Height();
+
+    Scalar x_offset = (lookup_width - cam_width) / Scalar(2);
+    Scalar y_offset = (lookup_height - cam_height) / Scalar(2);
+
+    // Project a row at a time through the batch interface
+    Eigen::Matrix<Scalar,3,Eigen::Dynamic> rays(3, lookup_width);
+    Eigen::Matrix<Scalar,2,Eigen::Dynamic> pix(2, lookup_width);
+
+    for( int r = row_begin; r < row_end; ++r) {
+      for( int c = 0; c < lookup_width; ++c) {
+        rays.col(c) = R_onKinv * Vec3t(c - x_offset,r - y_offset,1);
+      }
+      cam_from->Project(rays, pix);
 
-    for( int r = 0; r < lookup_height; ++r) {
       for( int c = 0; c < lookup_width; ++c) {
         // Remap
-        const Eigen::Vector3d p_o = R_onKinv * Eigen::Vector3d(c - x_offset,r - y_offset,1);
-        Eigen::Vector2d p_warped = cam_from->Project(p_o);
+        Vec2t p_warped = pix.col(c);
 
         // Clamp to valid image coords. This will cause out of image
         // data to be stretched from nearest valid coords with
         // no branching in rectify function.
-        p_warped[0] = std::min(std::max(0.0, p_warped[0]), cam_width - 1.0 );
-        p_warped[1] = std::min(std::max(0.0, p_warped[1]), cam_height - 1.0 );
+        p_warped[0] = std::min(std::max(Scalar(0), p_warped[0]), Scalar(cam_width - 1) );
+        p_warped[1] = std::min(std::max(Scalar(0), p_warped[1]), Scalar(cam_height - 1) );
 
         // Truncates the values for the left image
         int u  = (int) p_warped[0];
         int v  = (int) p_warped[1];
-        float su = p_warped[0] - (double)u;
-        float sv = p_warped[1] - (double)v;
+        float su = p_warped[0] - (Scalar)u;
+        float sv = p_warped[1] - (Scalar)v;
 
         // Fix pixel access for last row/column to ensure all accesses are in bounds
         if(u == (cam_width-1)) {
           u -= 1;
           su = 1.0;
         }
-        if(v == (cam_width-1)) {
+        if(v == (cam_height-1)) {
           v -= 1;
           sv = 1.0;
         }
@@ -142,17 +304,232 @@ namespace calibu
     }
   }
 
+  template<typename Scalar>
+  static void CreateRotatedLookupTable(
+      const std::shared_ptr<calibu::CameraInterface<Scalar>>& cam_from,
+      const Eigen::Matrix<Scalar,3,3>& R_onKinv,
+      LookupTable& lut,
+	  int lookup_width,
+	  int lookup_height
+      )
+  {
+    CALIBU_TRACE("CreateLookupTable");
+    SizeLookupTable( cam_from, lut, lookup_width, lookup_height );
+    CreateRotatedLookupTableRows( cam_from, R_onKinv, lut,
+                                  lookup_width, lookup_height,
+                                  0, lookup_height );
+  }
+
+  template<typename Scalar>
+  static void CreateRotatedLookupTable(
+      const std::shared_ptr<calibu::CameraInterface<Scalar>>& cam_from,
+      const Eigen::Matrix<Scalar,3,3>& R_onKinv,
+      LookupTable& lut,
+      const Executor& executor,
+	  int lookup_width,
+	  int lookup_height
+      )
+  {
+    SizeLookupTable( cam_from, lut, lookup_width, lookup_height );
+    executor(NumRectifyBands(lookup_height), [&](size_t b) {
+      CALIBU_TRACE("CreateLookupTable band");
+      CreateRotatedLookupTableRows( cam_from, R_onKinv, lut,
+                                    lookup_width, lookup_height,
+                                    b * kRectifyBandRows,
+                                    std::min<int>(lookup_height, (b + 1) * kRectifyBandRows) );
+    });
+  }
+
+  void CreateLookupTable(
+      const std::shared_ptr<calibu::CameraInterface<double>>& cam_from,
+      const Eigen::Matrix3d& R_onKinv,
+      LookupTable& lut,
+	  int lookup_width,
+	  int lookup_height
+      )
+  {
+    CreateRotatedLookupTable( cam_from, R_onKinv, lut, lookup_width, lookup_height );
+  }
+
+  void CreateLookupTable(
+      const std::shared_ptr<calibu::CameraInterface<float>>& cam_from,
+      const Eigen::Matrix3f& R_onKinv,
+      LookupTable& lut,
+	  int lookup_width,
+	  int lookup_height
+      )
+  {
+    CreateRotatedLookupTable( cam_from, R_onKinv, lut, lookup_width, lookup_height );
+  }
+
+  void CreateLookupTable(
+      const std::shared_ptr<calibu::CameraInterface<double>>& cam_from,
+      const Eigen::Matrix3d& R_onKinv,
+      LookupTable& lut,
+      const Executor& executor,
+	  int lookup_width,
+	  int lookup_height
+      )
+  {
+    CreateRotatedLookupTable( cam_from, R_onKinv, lut, executor, lookup_width, lookup_height );
+  }
+
+  void CreateLookupTable(
+      const std::shared_ptr<calibu::CameraInterface<float>>& cam_from,
+      const Eigen::Matrix3f& R_onKinv,
+      LookupTable& lut,
+      const Executor& executor,
+	  int lookup_width,
+	  int lookup_height
+      )
+  {
+    CreateRotatedLookupTable( cam_from, R_onKinv, lut, executor, lookup_width, lookup_height );
+  }
+
+  ///////////////////////////////////////////////////////////////////////////////
+  void ValidRotatedRegion(
+      const std::shared_ptr<calibu::CameraInterface<double>>& cam,
+      const Eigen::Matrix3d& Rnl_l,
+      Range& range_x,
+      Range& range_y
+      )
+  {
+    const int w = cam->Width();
+    const int h = cam->Height();
+
+    // Left and right columns, then top and bottom rows
+    Eigen::Matrix2Xd pix(2, 2*h + 2*w);
+    for( int r = 0; r < h; ++r ) {
+      pix.col(r) = Eigen::Vector2d(0, r);
+      pix.col(h + r) = Eigen::Vector2d(w - 1, r);
+    }
+    for( int c = 0; c < w; ++c ) {
+      pix.col(2*h + c) = Eigen::Vector2d(c, 0);
+      pix.col(2*h + w + c) = Eigen::Vector2d(c, h - 1);
+    }
+    Eigen::Matrix3Xd rays(3, pix.cols());
+    cam->Unproject(pix, rays);
+    rays = Rnl_l * rays;
+
+    range_x = Range::Open();
+    range_y = Range::Open();
+    for( int i = 0; i < rays.cols(); ++i ) {
+      if( rays(2,i) <= 0 ) continue;
+      const double x = rays(0,i) / rays(2,i);
+      const double y = rays(1,i) / rays(2,i);
+      if( i < h ) {
+        range_x.ExcludeLessThan(x);
+      } else if( i < 2*h ) {
+        range_x.ExcludeGreaterThan(x);
+      } else if( i < 2*h + w ) {
+        range_y.ExcludeLessThan(y);
+      } else {
+        range_y.ExcludeGreaterThan(y);
+      }
+    }
+  }
+
+  ///////////////////////////////////////////////////////////////////////////////
+  AsyncLookupTable::AsyncLookupTable( const Executor& executor )
+    : m_Executor(executor), m_nGeneration(0),
+      m_nQueuedWidth(0), m_nQueuedHeight(0), m_bBusy(false), m_bStop(false)
+  {
+    m_Thread = std::thread( &AsyncLookupTable::Run, this );
+  }
+
+  AsyncLookupTable::~AsyncLookupTable()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_bStop = true;
+    }
+    m_Cond.notify_all();
+    m_Thread.join();
+  }
+
+  void AsyncLookupTable::Rebuild(
+      const std::shared_ptr<calibu::CameraInterface<double>>& cam_from,
+      const Eigen::Matrix3d& R_onKinv,
+      int lookup_width,
+      int lookup_height
+      )
+  {
+    // Copy outside the lock, the caller may go on changing cam_from
+    std::shared_ptr<calibu::CameraInterface<double>> cam = CastCamera<double>(cam_from);
+    if( !cam ) {
+      cam = cam_from;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_pQueuedCam = cam;
+      m_QueuedR_onKinv = R_onKinv;
+      m_nQueuedWidth = lookup_width;
+      m_nQueuedHeight = lookup_height;
+    }
+    m_Cond.notify_all();
+  }
+
+  void AsyncLookupTable::Wait()
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Cond.wait( lock, [this]() { return !m_pQueuedCam && !m_bBusy; } );
+  }
+
+  void AsyncLookupTable::Run()
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while( true ) {
+      m_Cond.wait( lock, [this]() { return m_bStop || m_pQueuedCam; } );
+      if( m_bStop ) {
+        break;
+      }
+
+      std::shared_ptr<calibu::CameraInterface<double>> cam;
+      cam.swap( m_pQueuedCam );
+      const Eigen::Matrix3d R_onKinv = m_QueuedR_onKinv;
+      int lookup_width = m_nQueuedWidth;
+      int lookup_height = m_nQueuedHeight;
+      if( lookup_width < 1 || lookup_height < 1 ) {
+        lookup_width = cam->Width();
+        lookup_height = cam->Height();
+      }
+      m_bBusy = true;
+      lock.unlock();
+
+      std::shared_ptr<LookupTable> lut =
+          std::make_shared<LookupTable>( lookup_width, lookup_height );
+      if( m_Executor ) {
+        CreateLookupTable( cam, R_onKinv, *lut, m_Executor, lookup_width, lookup_height );
+      } else {
+        CreateLookupTable( cam, R_onKinv, *lut, lookup_width, lookup_height );
+      }
+      std::atomic_store( &m_pTable, std::shared_ptr<const LookupTable>(lut) );
+      ++m_nGeneration;
+
+      lock.lock();
+      m_bBusy = false;
+      m_Cond.notify_all();
+    }
+  }
+
   void CreateLookupTable(
       const std::shared_ptr<calibu::CameraInterface<double>>& cam_from,
       const Eigen::Matrix3d& R_onKinv,
       Eigen::Matrix<Eigen::Vector2f, Eigen::Dynamic, Eigen::Dynamic>& lookup_warp
       )
   {
+    Eigen::Matrix3Xd rays(3, cam_from->Width());
+    Eigen::Matrix2Xd pix(2, cam_from->Width());
+
     for(size_t r = 0; r < cam_from->Height(); ++r) {
+      for(size_t c = 0; c < cam_from->Width(); ++c) {
+        rays.col(c) = R_onKinv * Eigen::Vector3d(c,r,1);
+      }
+      cam_from->Project(rays, pix);
+
       for(size_t c = 0; c < cam_from->Width(); ++c) {
         // Remap
-        const Eigen::Vector3d p_o = R_onKinv * Eigen::Vector3d(c,r,1);
-        Eigen::Vector2d p_warped = cam_from->Project(p_o);
+        Eigen::Vector2d p_warped = pix.col(c);
 
         // Clamp to valid image coords
         p_warped[0] = std::min(std::max(0.0, p_warped[0]), cam_from->Width() - 1.0 );
@@ -163,6 +540,226 @@ namespace calibu
     }
   }
 
+  ///////////////////////////////////////////////////////////////////////////////
+  namespace {
+
+    // Fill the grid of lut for a given step from exact projections.
+    void FillSubsampledGrid(
+        const std::shared_ptr<calibu::CameraInterface<double>>& cam_from,
+        const Eigen::Matrix3d& R_onKinv,
+        double x_offset, double y_offset, int step,
+        SubsampledLookupTable& lut )
+    {
+      lut.m_nStep = step;
+      lut.m_nGridWidth = (lut.m_nWidth - 1) / step + 2;
+      const int grid_height = (lut.m_nHeight - 1) / step + 2;
+      lut.m_vGrid.resize( lut.m_nGridWidth * grid_height );
+
+      Eigen::Matrix3Xd rays(3, lut.m_nGridWidth);
+      Eigen::Matrix2Xd pix(2, lut.m_nGridWidth);
+      for( int j = 0; j < grid_height; ++j ) {
+        for( int i = 0; i < lut.m_nGridWidth; ++i ) {
+          rays.col(i) = R_onKinv * Eigen::Vector3d(i*step - x_offset, j*step - y_offset, 1);
+        }
+        cam_from->Project(rays, pix);
+        for( int i = 0; i < lut.m_nGridWidth; ++i ) {
+          lut.m_vGrid[ j*lut.m_nGridWidth + i ] = pix.col(i).cast<float>();
+        }
+      }
+    }
+
+    inline Eigen::Vector2d ClampToImage( const Eigen::Vector2d& p, int w, int h )
+    {
+      return Eigen::Vector2d( std::min(std::max(0.0, p[0]), w - 1.0),
+                              std::min(std::max(0.0, p[1]), h - 1.0) );
+    }
+
+    // Largest distance between the interpolated and exact source coordinates
+    // at the centre and edge midpoints of each grid cell, after clamping.
+    float MeasureSubsampledError(
+        const std::shared_ptr<calibu::CameraInterface<double>>& cam_from,
+        const Eigen::Matrix3d& R_onKinv,
+        double x_offset, double y_offset,
+        const SubsampledLookupTable& lut )
+    {
+      const int step = lut.m_nStep;
+      const int half = step / 2;
+      const int cells_x = lut.m_nGridWidth - 1;
+      const int cells_y = lut.m_vGrid.size() / lut.m_nGridWidth - 1;
+      static const int kSamples = 3;
+      const int dx[kSamples] = { half, 0, half };
+      const int dy[kSamples] = { 0, half, half };
+
+      Eigen::Matrix3Xd rays(3, kSamples * cells_x);
+      Eigen::Matrix2Xd pix(2, kSamples * cells_x);
+      double max_error = 0;
+      for( int j = 0; j < cells_y; ++j ) {
+        for( int i = 0; i < cells_x; ++i ) {
+          for( int k = 0; k < kSamples; ++k ) {
+            rays.col(kSamples*i + k) = R_onKinv * Eigen::Vector3d(
+                  i*step + dx[k] - x_offset, j*step + dy[k] - y_offset, 1);
+          }
+        }
+        cam_from->Project(rays, pix);
+
+        for( int i = 0; i < cells_x; ++i ) {
+          const Eigen::Vector2d n00 = lut.Node(i, j).cast<double>();
+          const Eigen::Vector2d n01 = lut.Node(i+1, j).cast<double>();
+          const Eigen::Vector2d n10 = lut.Node(i, j+1).cast<double>();
+          const Eigen::Vector2d n11 = lut.Node(i+1, j+1).cast<double>();
+          for( int k = 0; k < kSamples; ++k ) {
+            const int x = i*step + dx[k];
+            const int y = j*step + dy[k];
+            if( x >= lut.m_nWidth || y >= lut.m_nHeight ) continue;
+            const Eigen::Vector2d exact = pix.col(kSamples*i + k);
+            if( !std::isfinite(exact[0]) || !std::isfinite(exact[1]) ) continue;
+
+            const double fx = double(dx[k]) / step;
+            const double fy = double(dy[k]) / step;
+            const Eigen::Vector2d interp = (1-fy) * ((1-fx)*n00 + fx*n01) +
+                                           fy * ((1-fx)*n10 + fx*n11);
+            const double error =
+                (ClampToImage(interp, lut.m_nSrcWidth, lut.m_nSrcHeight) -
+                 ClampToImage(exact, lut.m_nSrcWidth, lut.m_nSrcHeight)).norm();
+            max_error = std::max(max_error, error);
+          }
+        }
+      }
+      return max_error;
+    }
+
+  } // anonymous namespace
+
+  void CreateSubsampledLookupTable(
+      const std::shared_ptr<calibu::CameraInterface<double>>& cam_from,
+      const Eigen::Matrix3d& R_onKinv,
+      SubsampledLookupTable& lut,
+      float max_error,
+      int max_step,
+      int lookup_width,
+      int lookup_height
+      )
+  {
+    const int cam_width = cam_from->Width();
+    const int cam_height = cam_from->Height();
+    if(lookup_width < 1 || lookup_height < 1) {
+      lookup_width = cam_width;
+      lookup_height = cam_height;
+    }
+
+    lut.m_nWidth = lookup_width;
+    lut.m_nHeight = lookup_height;
+    lut.m_nSrcWidth = cam_width;
+    lut.m_nSrcHeight = cam_height;
+    const double x_offset = (lookup_width - cam_width) / 2.0;
+    const double y_offset = (lookup_height - cam_height) / 2.0;
+
+    int step = 1;
+    while( step * 2 <= max_step ) step *= 2;
+
+    for( ; ; step /= 2 ) {
+      FillSubsampledGrid( cam_from, R_onKinv, x_offset, y_offset, step, lut );
+      if( step == 1 ) {
+        // Every pixel is a node
+        lut.m_fMaxError = 0;
+        break;
+      }
+      lut.m_fMaxError = MeasureSubsampledError( cam_from, R_onKinv, x_offset, y_offset, lut );
+      if( lut.m_fMaxError <= max_error ) break;
+    }
+  }
+
+  ///////////////////////////////////////////////////////////////////////////////
+  void PackLookupTable(
+      const LookupTable& lut,
+      PackedLookupTable& packed
+      )
+  {
+    const size_t n = lut.m_vLutPixels.size();
+    packed.m_nWidth = lut.m_nWidth;
+    packed.m_vOffsets.resize(n);
+    packed.m_vFractions.resize(n);
+    packed.m_nSrcWidth = n ? lut.m_vLutPixels[0].idx1 - lut.m_vLutPixels[0].idx0 : 0;
+    packed.m_nSrcSize = 0;
+
+    for( size_t i = 0; i < n; ++i ) {
+      const BilinearLutPoint& p = lut.m_vLutPixels[i];
+      // Fractions recovered from the weights, 1.0 at the last row and column
+      // is rounded down to 255/256.
+      const int fx = std::min(255, (int)((p.w01 + p.w11) * 256.0f + 0.5f));
+      const int fy = std::min(255, (int)((p.w10 + p.w11) * 256.0f + 0.5f));
+      packed.m_vOffsets[i] = p.idx0;
+      packed.m_vFractions[i] = (uint16_t)(fx | (fy << 8));
+      packed.m_nSrcSize = std::max(packed.m_nSrcSize, p.idx1 + 2);
+    }
+  }
+
+  ///////////////////////////////////////////////////////////////////////////////
+  void Rectify(
+      const PackedLookupTable& lut,
+      const unsigned char* pInputImageData,
+      unsigned char* pOutputRectImageData,
+      int w,
+      int h
+      )
+  {
+    static const RectifyPackedFn rectify_fn = SelectRectifyPacked();
+
+    // Make sure we have been given a correct lookup table.
+    assert(w == (int)lut.Width() && h == (int)lut.Height());
+
+    RectifyPackedRows(rectify_fn, lut, pInputImageData, pOutputRectImageData, 0, h);
+  }
+
+  void Rectify(
+      const PackedLookupTable& lut,
+      const unsigned char* pInputImageData,
+      unsigned char* pOutputRectImageData,
+      int w,
+      int h,
+      const Executor& executor
+      )
+  {
+    static const RectifyPackedFn rectify_fn = SelectRectifyPacked();
+    assert(w == (int)lut.Width() && h == (int)lut.Height());
+
+    executor(NumRectifyBands(h), [&](size_t b) {
+      CALIBU_TRACE("Rectify band");
+      RectifyPackedRows(rectify_fn, lut, pInputImageData, pOutputRectImageData,
+                        b * kRectifyBandRows,
+                        std::min<int>(h, (b + 1) * kRectifyBandRows));
+    });
+  }
+
+  void RectifyStereo(
+      const PackedLookupTable& left_lut,
+      const PackedLookupTable& right_lut,
+      const unsigned char* pLeftImageData,
+      const unsigned char* pRightImageData,
+      unsigned char* pLeftRectImageData,
+      unsigned char* pRightRectImageData,
+      int w,
+      int h,
+      const Executor& executor
+      )
+  {
+    static const RectifyPackedFn rectify_fn = SelectRectifyPacked();
+    assert(w == (int)left_lut.Width() && h == (int)left_lut.Height());
+    assert(w == (int)right_lut.Width() && h == (int)right_lut.Height());
+
+    const int bands = NumRectifyBands(h);
+    executor(2 * bands, [&](size_t i) {
+      const bool left = (int)i < bands;
+      const int b = left ? i : i - bands;
+      CALIBU_TRACE_IDS("Rectify band", -1, left ? 0 : 1);
+      RectifyPackedRows(rectify_fn, left ? left_lut : right_lut,
+                        left ? pLeftImageData : pRightImageData,
+                        left ? pLeftRectImageData : pRightRectImageData,
+                        b * kRectifyBandRows,
+                        std::min<int>(h, (b + 1) * kRectifyBandRows));
+    });
+  }
+
   ///////////////////////////////////////////////////////////////////////////////
   void Rectify(
       const LookupTable& lut,
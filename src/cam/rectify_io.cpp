@@ -0,0 +1,335 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove,
+                      Gabe Sibley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <calibu/cam/rectify_io.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#  define CALIBU_LUT_MMAP
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace calibu
+{
+
+namespace {
+
+  const char kLutMagic[8] = { 'C','A','L','I','B','L','U','T' };
+  const uint32_t kLutVersion = 1;
+  const uint32_t kLutByteOrder = 0x01020304;
+
+  enum LutKind {
+    kDenseLut = 1,
+    kSubsampledLut = 2
+  };
+
+  struct LutFileHeader
+  {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t hash;
+    int32_t  width;
+    int32_t  height;
+    int32_t  src_width;
+    int32_t  src_height;
+    int32_t  step;
+    int32_t  grid_width;
+    float    max_error;
+    int32_t  grid_height;
+    uint64_t data_offset;
+    uint64_t data_size;
+    unsigned char pad[48];
+  };
+  static_assert(sizeof(LutFileHeader) == 128, "LutFileHeader is 128 bytes");
+
+  // FNV-1a
+  inline void HashBytes( uint64_t& h, const void* data, size_t size )
+  {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for( size_t i = 0; i < size; ++i ) {
+      h ^= bytes[i];
+      h *= 1099511628211ull;
+    }
+  }
+
+  LutFileHeader NewHeader( LutKind kind, uint64_t hash, uint64_t data_size )
+  {
+    LutFileHeader header;
+    std::memset( &header, 0, sizeof(header) );
+    std::memcpy( header.magic, kLutMagic, sizeof(kLutMagic) );
+    header.version = kLutVersion;
+    header.byte_order = kLutByteOrder;
+    header.kind = kind;
+    header.hash = hash;
+    header.data_offset = sizeof(LutFileHeader);
+    header.data_size = data_size;
+    return header;
+  }
+
+  // Check header against what the caller expects, given the file size.
+  bool CheckHeader( const std::string& filename, const LutFileHeader& header,
+                    LutKind kind, uint64_t hash, uint64_t file_size )
+  {
+    if( std::memcmp( header.magic, kLutMagic, sizeof(kLutMagic) ) != 0 ||
+        header.byte_order != kLutByteOrder ) {
+      std::cerr << "Not a rectification map for this host: '" << filename << "'" << std::endl;
+      return false;
+    }
+    if( header.version != kLutVersion ) {
+      std::cerr << "Unsupported rectification map version " << header.version
+                << ": '" << filename << "'" << std::endl;
+      return false;
+    }
+    if( header.kind != (uint32_t)kind ) {
+      std::cerr << "Wrong kind of rectification map: '" << filename << "'" << std::endl;
+      return false;
+    }
+    if( header.hash != hash ) {
+      std::cerr << "Stale rectification map: '" << filename << "'" << std::endl;
+      return false;
+    }
+
+    uint64_t expected_size = 0;
+    if( kind == kDenseLut ) {
+      expected_size = uint64_t(header.width) * header.height * sizeof(BilinearLutPoint);
+    } else {
+      expected_size = uint64_t(header.grid_width) * header.grid_height * sizeof(Eigen::Vector2f);
+    }
+    if( header.width < 1 || header.height < 1 ||
+        header.data_size != expected_size ||
+        header.data_offset + header.data_size > file_size ) {
+      std::cerr << "Corrupt rectification map: '" << filename << "'" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool WriteLutFile( const std::string& filename, const LutFileHeader& header,
+                     const void* data )
+  {
+    std::ofstream of( filename.c_str(), std::ios::binary | std::ios::trunc );
+    of.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+    of.write( static_cast<const char*>(data), header.data_size );
+    if( !of ) {
+      std::cerr << "Error writing rectification map: '" << filename << "'" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Read the header and data of filename into data, if it checks out.
+  bool ReadLutFile( const std::string& filename, LutKind kind, uint64_t hash,
+                    LutFileHeader& header, std::vector<unsigned char>& data )
+  {
+    std::ifstream in( filename.c_str(), std::ios::binary | std::ios::ate );
+    if( !in ) {
+      std::cerr << "Error opening rectification map: '" << filename << "'" << std::endl;
+      return false;
+    }
+    const uint64_t file_size = in.tellg();
+    in.seekg( 0 );
+    if( file_size < sizeof(header) ||
+        !in.read( reinterpret_cast<char*>(&header), sizeof(header) ) ||
+        !CheckHeader( filename, header, kind, hash, file_size ) ) {
+      return false;
+    }
+    data.resize( header.data_size );
+    in.seekg( header.data_offset );
+    if( !in.read( reinterpret_cast<char*>(data.data()), data.size() ) ) {
+      std::cerr << "Error reading rectification map: '" << filename << "'" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+} // anonymous namespace
+
+  ///////////////////////////////////////////////////////////////////////////////
+  uint64_t RectificationHash(
+      const calibu::CameraInterface<double>& cam_from,
+      const Eigen::Matrix3d& R_onKinv,
+      int lookup_width,
+      int lookup_height
+      )
+  {
+    if( lookup_width < 1 || lookup_height < 1 ) {
+      lookup_width = cam_from.Width();
+      lookup_height = cam_from.Height();
+    }
+    const int32_t sizes[5] = { (int32_t)cam_from.ModelId(),
+                               (int32_t)cam_from.Width(), (int32_t)cam_from.Height(),
+                               lookup_width, lookup_height };
+    const std::string type = cam_from.Type();
+
+    uint64_t h = 14695981039346656037ull;
+    HashBytes( h, sizes, sizeof(sizes) );
+    HashBytes( h, type.data(), type.size() );
+    HashBytes( h, cam_from.GetParams().data(),
+               cam_from.NumParams() * sizeof(double) );
+    HashBytes( h, R_onKinv.data(), 9 * sizeof(double) );
+    return h;
+  }
+
+  ///////////////////////////////////////////////////////////////////////////////
+  bool SaveLookupTable(
+      const std::string& filename,
+      const LookupTable& lut,
+      uint64_t hash
+      )
+  {
+    LutFileHeader header = NewHeader( kDenseLut, hash,
+        lut.m_vLutPixels.size() * sizeof(BilinearLutPoint) );
+    header.width = lut.Width();
+    header.height = lut.Height();
+    return WriteLutFile( filename, header, lut.m_vLutPixels.data() );
+  }
+
+  bool SaveLookupTable(
+      const std::string& filename,
+      const SubsampledLookupTable& lut,
+      uint64_t hash
+      )
+  {
+    LutFileHeader header = NewHeader( kSubsampledLut, hash,
+        lut.m_vGrid.size() * sizeof(Eigen::Vector2f) );
+    header.width = lut.m_nWidth;
+    header.height = lut.m_nHeight;
+    header.src_width = lut.m_nSrcWidth;
+    header.src_height = lut.m_nSrcHeight;
+    header.step = lut.m_nStep;
+    header.grid_width = lut.m_nGridWidth;
+    header.grid_height = lut.m_nGridWidth ? lut.m_vGrid.size() / lut.m_nGridWidth : 0;
+    header.max_error = lut.m_fMaxError;
+    return WriteLutFile( filename, header, lut.m_vGrid.data() );
+  }
+
+  bool LoadLookupTable(
+      const std::string& filename,
+      LookupTable& lut,
+      uint64_t hash
+      )
+  {
+    LutFileHeader header;
+    std::vector<unsigned char> data;
+    if( !ReadLutFile( filename, kDenseLut, hash, header, data ) ) {
+      return false;
+    }
+    lut.m_nWidth = header.width;
+    lut.m_vLutPixels.resize( header.width * header.height );
+    std::memcpy( lut.m_vLutPixels.data(), data.data(), data.size() );
+    return true;
+  }
+
+  bool LoadLookupTable(
+      const std::string& filename,
+      SubsampledLookupTable& lut,
+      uint64_t hash
+      )
+  {
+    LutFileHeader header;
+    std::vector<unsigned char> data;
+    if( !ReadLutFile( filename, kSubsampledLut, hash, header, data ) ) {
+      return false;
+    }
+    lut.m_nWidth = header.width;
+    lut.m_nHeight = header.height;
+    lut.m_nSrcWidth = header.src_width;
+    lut.m_nSrcHeight = header.src_height;
+    lut.m_nStep = header.step;
+    lut.m_nGridWidth = header.grid_width;
+    lut.m_fMaxError = header.max_error;
+    lut.m_vGrid.resize( header.grid_width * header.grid_height );
+    std::memcpy( static_cast<void*>(lut.m_vGrid.data()), data.data(), data.size() );
+    return true;
+  }
+
+  ///////////////////////////////////////////////////////////////////////////////
+  MappedLookupTable::~MappedLookupTable()
+  {
+    Close();
+  }
+
+  void MappedLookupTable::Close()
+  {
+#ifdef CALIBU_LUT_MMAP
+    if( m_pMap ) {
+      munmap( m_pMap, m_nMapSize );
+    }
+#endif
+    m_pMap = nullptr;
+    m_nMapSize = 0;
+    m_vBuffer.clear();
+    m_pPixels = nullptr;
+    m_nWidth = 0;
+    m_nHeight = 0;
+  }
+
+  bool MappedLookupTable::Open( const std::string& filename, uint64_t hash )
+  {
+    Close();
+
+    LutFileHeader header;
+#ifdef CALIBU_LUT_MMAP
+    const int fd = open( filename.c_str(), O_RDONLY );
+    if( fd < 0 ) {
+      std::cerr << "Error opening rectification map: '" << filename << "'" << std::endl;
+      return false;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if( fstat( fd, &st ) == 0 && st.st_size >= (off_t)sizeof(header) ) {
+      map = mmap( nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    }
+    close( fd );
+    if( map == MAP_FAILED ) {
+      std::cerr << "Error mapping rectification map: '" << filename << "'" << std::endl;
+      return false;
+    }
+    std::memcpy( &header, map, sizeof(header) );
+    if( !CheckHeader( filename, header, kDenseLut, hash, st.st_size ) ) {
+      munmap( map, st.st_size );
+      return false;
+    }
+    m_pMap = map;
+    m_nMapSize = st.st_size;
+    m_pPixels = reinterpret_cast<const BilinearLutPoint*>(
+          static_cast<const unsigned char*>(map) + header.data_offset );
+#else
+    if( !ReadLutFile( filename, kDenseLut, hash, header, m_vBuffer ) ) {
+      return false;
+    }
+    m_pPixels = reinterpret_cast<const BilinearLutPoint*>( m_vBuffer.data() );
+#endif
+    m_nWidth = header.width;
+    m_nHeight = header.height;
+    return true;
+  }
+
+}
@@ -43,6 +43,30 @@ Eigen::Vector2d GetAxesLengths(const Conic& c) {
                          sqrt(det_ratio / eigenval[1]));
 }
 
+double ConicRadius( const Conic& c )
+{
+    const Eigen::Vector2d axes = GetAxesLengths(c);
+    const double r = std::sqrt(axes[0] * axes[1]);
+    return std::isfinite(r) && r > 0 ? r : 0.25 * (c.bbox.Width() + c.bbox.Height());
+}
+
+Conic TranslateConic( const Conic& c, const Eigen::Vector2i& offset )
+{
+    // x' = H x with H = [I offset; 0 1], so C' = H^-T C H^-1, C*' = H C* H^T
+    Matrix3d Hinv = Matrix3d::Identity();
+    Hinv.topRightCorner<2,1>() = -offset.cast<double>();
+    Matrix3d H = Matrix3d::Identity();
+    H.topRightCorner<2,1>() = offset.cast<double>();
+
+    Conic ret;
+    ret.bbox = IRectangle(c.bbox.x1 + offset[0], c.bbox.y1 + offset[1],
+                          c.bbox.x2 + offset[0], c.bbox.y2 + offset[1]);
+    ret.C = Hinv.transpose() * c.C * Hinv;
+    ret.Dual = H * c.Dual * H.transpose();
+    ret.center = c.center + offset.cast<double>();
+    return ret;
+}
+
 double Distance( const Conic& c1, const Conic& c2, double circle_radius )
 {
     const Matrix3d Q = c1.Dual * c2.C;
@@ -144,20 +168,23 @@ pair<Vector3d,Matrix3d > PlaneFromConics( const vector<Conic,
     return best;
 }
 
-Conic UnmapConic(const Conic& c, const std::shared_ptr<CameraInterface<double> > cam )
+// Points of c sampled to estimate the local distortion: centre then bbox
+// corners
+static void ConicSamples(const Conic& c, Eigen::Vector2d d[5])
 {
-    std::vector<Eigen::Vector2d , Eigen::aligned_allocator<Eigen::Vector2d> > d;
-    std::vector<Eigen::Vector2d , Eigen::aligned_allocator<Eigen::Vector2d> > u;
-
-    d.push_back(c.center);
-    d.push_back(Eigen::Vector2d(c.bbox.x1,c.bbox.y1));
-    d.push_back(Eigen::Vector2d(c.bbox.x1,c.bbox.y2));
-    d.push_back(Eigen::Vector2d(c.bbox.x2,c.bbox.y1));
-    d.push_back(Eigen::Vector2d(c.bbox.x2,c.bbox.y2));
-
-    for( int i=0; i<5; ++i )
-        u.push_back( cam->Project(cam->Unproject(d[i])) );
+    d[0] = c.center;
+    d[1] = Eigen::Vector2d(c.bbox.x1,c.bbox.y1);
+    d[2] = Eigen::Vector2d(c.bbox.x1,c.bbox.y2);
+    d[3] = Eigen::Vector2d(c.bbox.x2,c.bbox.y1);
+    d[4] = Eigen::Vector2d(c.bbox.x2,c.bbox.y2);
+}
 
+// c seen through the samples d mapped to u
+static Conic UnmapConicSamples(
+        const Conic& c,
+        const std::vector<Eigen::Vector2d , Eigen::aligned_allocator<Eigen::Vector2d> >& d,
+        const std::vector<Eigen::Vector2d , Eigen::aligned_allocator<Eigen::Vector2d> >& u)
+{
     // Distortion locally estimated by homography
     const Matrix3d H_du = EstimateH_ba(u,d);
 
@@ -169,4 +196,85 @@ Conic UnmapConic(const Conic& c, const std::shared_ptr<CameraInterface<double> >
     return ret;
 }
 
+template<typename Scalar>
+static Conic UnmapConicT(const Conic& c, const std::shared_ptr<CameraInterface<Scalar> > cam )
+{
+    typedef Eigen::Matrix<Scalar,2,1> Vec2t;
+    std::vector<Eigen::Vector2d , Eigen::aligned_allocator<Eigen::Vector2d> > d(5);
+    std::vector<Eigen::Vector2d , Eigen::aligned_allocator<Eigen::Vector2d> > u;
+
+    ConicSamples(c, &d[0]);
+
+    for( int i=0; i<5; ++i )
+        u.push_back( cam->Project(cam->Unproject(Vec2t(d[i].template cast<Scalar>()))).template cast<double>() );
+
+    return UnmapConicSamples(c, d, u);
+}
+
+template<typename Scalar>
+static void UnmapConicsT(
+        const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+        const std::shared_ptr<CameraInterface<Scalar> > cam,
+        std::vector<Conic, Eigen::aligned_allocator<Conic> >& unmapped,
+        UnmapConicsWorkspace<Scalar>& ws )
+{
+    const int n = 5 * conics.size();
+    // Only grow, so that steady state frames don't reallocate
+    if( ws.d.cols() < n ) {
+        ws.d.resize(2,n);
+        ws.u.resize(2,n);
+        ws.rays.resize(3,n);
+    }
+    ws.dc.resize(5);
+    ws.uc.resize(5);
+
+    Eigen::Vector2d samples[5];
+    for( size_t i=0; i < conics.size(); ++i ) {
+        ConicSamples(conics[i], samples);
+        for( int k=0; k<5; ++k )
+            ws.d.col(5*i+k) = samples[k].cast<Scalar>();
+    }
+
+    auto d = ws.d.leftCols(n);
+    auto rays = ws.rays.leftCols(n);
+    auto u = ws.u.leftCols(n);
+    cam->Unproject(d, rays);
+    cam->Project(rays, u);
+
+    unmapped.resize(conics.size());
+    for( size_t i=0; i < conics.size(); ++i ) {
+        for( int k=0; k<5; ++k ) {
+            ws.dc[k] = ws.d.col(5*i+k).template cast<double>();
+            ws.uc[k] = ws.u.col(5*i+k).template cast<double>();
+        }
+        unmapped[i] = UnmapConicSamples(conics[i], ws.dc, ws.uc);
+    }
+}
+
+Conic UnmapConic(const Conic& c, const std::shared_ptr<CameraInterface<double> > cam )
+{
+    return UnmapConicT(c, cam);
+}
+
+Conic UnmapConic(const Conic& c, const std::shared_ptr<CameraInterface<float> > cam )
+{
+    return UnmapConicT(c, cam);
+}
+
+void UnmapConics( const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+                  const std::shared_ptr<CameraInterface<double> > cam,
+                  std::vector<Conic, Eigen::aligned_allocator<Conic> >& unmapped,
+                  UnmapConicsWorkspace<double>& workspace )
+{
+    UnmapConicsT(conics, cam, unmapped, workspace);
+}
+
+void UnmapConics( const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+                  const std::shared_ptr<CameraInterface<float> > cam,
+                  std::vector<Conic, Eigen::aligned_allocator<Conic> >& unmapped,
+                  UnmapConicsWorkspace<float>& workspace )
+{
+    UnmapConicsT(conics, cam, unmapped, workspace);
+}
+
 }
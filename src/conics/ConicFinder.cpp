@@ -23,6 +23,7 @@
 #include <calibu/conics/ConicFinder.h>
 #include <calibu/conics/FindConics.h>
 #include <calibu/image/ImageProcessing.h>
+#include <calibu/utils/Trace.h>
 
 namespace calibu {
 
@@ -32,19 +33,63 @@ ConicFinder::ConicFinder()
 
 void ConicFinder::Find(const ImageProcessing& imgs)
 {
+    CALIBU_TRACE("ConicFinder::Find");
+    CALIBU_STATS(stats.Reset());
     candidates.clear();
     conics.clear();
     
     // Find candidate regions for conics
-    FindCandidateConicsFromLabels(
-                imgs.Width(), imgs.Height(), imgs.Labels(), candidates,
-                params.conic_min_area, params.conic_max_area,
-                params.conic_min_density,
-                params.conic_min_aspect
-                );
+    {
+        CALIBU_STATS_TIME(stats.candidates);
+        FindCandidateConicsFromLabels(
+                    imgs.Width(), imgs.Height(), imgs.Labels(), candidates,
+                    params.conic_min_area, params.conic_max_area,
+                    params.conic_min_density,
+                    params.conic_min_aspect
+                    );
+    }
+    CALIBU_STATS(stats.num_candidates = candidates.size());
     
     // Find conic parameters
-    FindConics(imgs.Width(), imgs.Height(), candidates, imgs.ImgDeriv(), conics );
+    CALIBU_STATS_TIME(stats.fit);
+    if( !executor && params.conic_threads <= 1 ) {
+        FindConics(imgs.Width(), imgs.Height(), candidates, imgs.ImgDeriv(), conics,
+                   params.conic_float_accumulate, params.conic_min_gradient );
+    }else{
+        // Fit candidates concurrently into per-candidate slots, then gather
+        // in candidate order so the output matches the serial path.
+        CALIBU_STATS(if( fitted.capacity() < candidates.size() ) ++stats.num_allocations);
+        fitted.resize(candidates.size());
+        fitted_ok.assign(candidates.size(), 0);
+        const std::function<void(size_t)> fit = [&](size_t i) {
+            fitted_ok[i] = FitConic(
+                        imgs.Width(), imgs.Height(), candidates[i], imgs.ImgDeriv(),
+                        fitted[i], params.conic_float_accumulate,
+                        params.conic_min_gradient );
+        };
+
+        if( executor ) {
+            executor(candidates.size(), fit);
+        }else{
+            ParallelFor(candidates.size(), params.conic_threads, fit);
+        }
+
+        for( size_t i=0; i < candidates.size(); ++i ) {
+            if( fitted_ok[i] ) conics.push_back( fitted[i] );
+        }
+    }
+
+    // Report conics in full frame coordinates when a region was processed,
+    // filling the columns in the same pass
+    const Eigen::Vector2i offset(imgs.Roi().x1, imgs.Roi().y1);
+    const bool translate = offset != Eigen::Vector2i::Zero();
+    columns.Clear();
+    columns.Reserve(conics.size());
+    for( size_t i=0; i < conics.size(); ++i ) {
+        if( translate ) conics[i] = TranslateConic(conics[i], offset);
+        columns.Add(conics[i]);
+    }
+    CALIBU_STATS(stats.num_conics = conics.size());
 }
 
 }
@@ -25,12 +25,25 @@ namespace calibu
 
 ////////////////////////////////////////////////////////////////////////////
 
+template<typename TdI>
+Eigen::Matrix3d FindEllipse(
+        const int w, const int h,
+        const TdI* dI,
+        const IRectangle& r,
+        double& residual
+        ) {
+    return FindEllipse(w, h, dI, r, residual, 0.0f);
+}
+
+////////////////////////////////////////////////////////////////////////////
+
 template<typename TdI>
 Eigen::Matrix3d FindEllipse(
         const int w, const int /*h*/,
         const TdI* dI,
         const IRectangle& r,
-        double& /*residual*/
+        double& /*residual*/,
+        float min_gradient
         ) {
     //Precise ellipse estimation without contour point extraction
     //Jean-Nicolas Ouellet, Patrick Hebert
@@ -64,6 +77,7 @@ Eigen::Matrix3d FindEllipse(
     // Form system Ax = b to solve
     Eigen::Matrix<double,5,5> A = Eigen::Matrix<double,5,5>::Zero();
     Eigen::Matrix<double,5,1> b = Eigen::Matrix<double,5,1>::Zero();
+    const float min_gradient_sq = min_gradient * min_gradient;
 
 //    float elementCount = 0;
     for( int v=r.y1; v<=r.y2; ++v )
@@ -71,6 +85,9 @@ Eigen::Matrix3d FindEllipse(
         const TdI* dIv = dI + v*w;
         for( int u=r.x1; u<=r.x2; ++u )
         {
+            if( dIv[u][0]*dIv[u][0] + dIv[u][1]*dIv[u][1] < min_gradient_sq )
+                continue;
+
             // li = (ai,bi,ci)' = (I_ui,I_vi, -dI' x_i)'
             const Eigen::Vector3d d =
                     Eigen::Vector3d(dIv[u][0],dIv[u][1],-(dIv[u][0] * u + dIv[u][1] * v) );
@@ -106,6 +123,119 @@ Eigen::Matrix3d FindEllipse(
 
 ////////////////////////////////////////////////////////////////////////////
 
+template<typename TdI>
+Eigen::Matrix3d FindEllipseFloat(
+        const int w, const int /*h*/,
+        const TdI* dI,
+        const IRectangle& r,
+        double& /*residual*/,
+        float min_gradient
+        ) {
+    // Same estimator as FindEllipse, accumulated eight pixels at a time in
+    // single precision with Kahan summation per lane. Pixel coordinates are
+    // taken relative to the region centre so that the terms stay well within
+    // float range. Translating the lines l' = H^T l leaves l' C* l' unchanged
+    // and keeps C*(2,2) = 1, so the least squares problem is the same one; the
+    // dual conic is mapped back to image coordinates afterwards.
+    typedef Eigen::Array<float,8,1> Packet;
+    const int N = 8;
+
+    // Integer centre so that the local pixel offsets are exact
+    const float cu = (r.x1 + r.x2) / 2;
+    const float cv = (r.y1 + r.y2) / 2;
+    const float min_gradient_sq = min_gradient * min_gradient;
+
+    // 15 unique entries of symmetric A followed by the 5 of b
+    Packet sum[20];
+    Packet comp[20];
+    for( int k=0; k<20; ++k ) {
+        sum[k].setZero();
+        comp[k].setZero();
+    }
+
+    Packet a, bb, uu;
+    const Packet offsets = Packet::LinSpaced(N, 0, N-1);
+
+    for( int v=r.y1; v<=r.y2; ++v )
+    {
+        const TdI* dIv = dI + v*w;
+        const float vl = v - cv;
+        for( int u=r.x1; u<=r.x2; u+=N )
+        {
+            // Pixels past the region edge or with small gradient are given a
+            // zero gradient, which zeroes all of their terms.
+            for( int k=0; k<N; ++k ) {
+                const int uk = u + k;
+                if( uk <= r.x2 ) {
+                    const float gx = dIv[uk][0];
+                    const float gy = dIv[uk][1];
+                    const bool use = gx*gx + gy*gy >= min_gradient_sq;
+                    a[k] = use ? gx : 0.0f;
+                    bb[k] = use ? gy : 0.0f;
+                }else{
+                    a[k] = 0.0f;
+                    bb[k] = 0.0f;
+                }
+            }
+            uu = offsets + (u - cu);
+
+            const Packet c = -(a * uu + bb * vl);
+            const Packet K[5] = { a*a, a*bb, bb*bb, a*c, bb*c };
+            const Packet c2 = c*c;
+
+            int idx = 0;
+            for( int i=0; i<5; ++i ) {
+                for( int j=i; j<5; ++j, ++idx ) {
+                    const Packet y = K[i]*K[j] - comp[idx];
+                    const Packet t = sum[idx] + y;
+                    comp[idx] = (t - sum[idx]) - y;
+                    sum[idx] = t;
+                }
+            }
+            for( int i=0; i<5; ++i, ++idx ) {
+                const Packet y = -(K[i]*c2) - comp[idx];
+                const Packet t = sum[idx] + y;
+                comp[idx] = (t - sum[idx]) - y;
+                sum[idx] = t;
+            }
+        }
+    }
+
+    // Reduce lanes in double
+    double total[20];
+    for( int k=0; k<20; ++k ) {
+        total[k] = sum[k].cast<double>().sum() - comp[k].cast<double>().sum();
+    }
+
+    Eigen::Matrix<double,5,5> A;
+    Eigen::Matrix<double,5,1> b;
+    int idx = 0;
+    for( int i=0; i<5; ++i ) {
+        for( int j=i; j<5; ++j, ++idx ) {
+            A(i,j) = A(j,i) = total[idx];
+        }
+    }
+    for( int i=0; i<5; ++i, ++idx ) {
+        b[i] = total[idx];
+    }
+
+    const Eigen::Matrix<double,5,1> x = A.jacobiSvd(Eigen::ComputeFullU | Eigen::ComputeFullV).solve(b);
+
+    Eigen::Matrix3d C_star_local;
+    C_star_local << x[0],x[1]/2.0,x[3]/2.0,  x[1]/2.0,x[2],x[4]/2.0,  x[3]/2.0,x[4]/2.0,1.0;
+
+    Eigen::Matrix3d H;
+    H << 1, 0, cu,
+         0, 1, cv,
+         0, 0, 1;
+
+    const Eigen::Matrix3d C_star_norm = H * C_star_local * H.transpose();
+    const Eigen::Matrix3d C = C_star_norm.inverse();
+    return C;
+}
+
+////////////////////////////////////////////////////////////////////////////
+
 template<typename TdI>
 void FindConics(
         const int w, const int h,
@@ -113,21 +243,49 @@ void FindConics(
         const TdI* dI,
         std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics
         ) {
-    for( unsigned int i=0; i<candidates.size(); ++i )
-    {
-        const IRectangle region = candidates[i].bbox;
+    FindConics(w, h, candidates, dI, conics, false, 0.0f);
+}
 
-        Conic conic;
-        double residual = 0;
-        conic.C = FindEllipse(w,h,dI,region, residual);
+////////////////////////////////////////////////////////////////////////////
 
-        conic.bbox = region;
-        conic.Dual = conic.C.inverse();
-        conic.Dual /= conic.Dual(2,2);
-        conic.center = Eigen::Vector2d(conic.Dual(0,2),conic.Dual(1,2));
+template<typename TdI>
+bool FitConic(
+        const int w, const int h,
+        const PixelClass& candidate,
+        const TdI* dI,
+        Conic& conic,
+        bool float_accumulate, float min_gradient
+        ) {
+    const IRectangle region = candidate.bbox;
+
+    double residual = 0;
+    conic.C = float_accumulate ?
+                FindEllipseFloat(w,h,dI,region, residual, min_gradient) :
+                FindEllipse(w,h,dI,region, residual, min_gradient);
 
-        const double max_dist = (region.Width() + region.Height()) / 8.0;
-        if( (conic.center - region.Center()).norm() < max_dist)
+    conic.bbox = region;
+    conic.Dual = conic.C.inverse();
+    conic.Dual /= conic.Dual(2,2);
+    conic.center = Eigen::Vector2d(conic.Dual(0,2),conic.Dual(1,2));
+
+    const double max_dist = (region.Width() + region.Height()) / 8.0;
+    return (conic.center - region.Center()).norm() < max_dist;
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+template<typename TdI>
+void FindConics(
+        const int w, const int h,
+        const std::vector<PixelClass>& candidates,
+        const TdI* dI,
+        std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+        bool float_accumulate, float min_gradient
+        ) {
+    for( unsigned int i=0; i<candidates.size(); ++i )
+    {
+        Conic conic;
+        if( FitConic(w, h, candidates[i], dI, conic, float_accumulate, min_gradient) )
             conics.push_back( conic );
     }
 }
@@ -176,6 +334,10 @@ void FindCandidateConicsFromLabels(
 #include <Eigen/Eigen>
 
 template Eigen::Matrix3d FindEllipse( const int, const int, const Eigen::Vector2f*, const IRectangle&, double& );
+template Eigen::Matrix3d FindEllipse( const int, const int, const Eigen::Vector2f*, const IRectangle&, double&, float );
+template Eigen::Matrix3d FindEllipseFloat( const int, const int, const Eigen::Vector2f*, const IRectangle&, double&, float );
 template void FindConics( const int, const int, const std::vector<PixelClass>& candidates, const Eigen::Vector2f* dI, std::vector<Conic, Eigen::aligned_allocator<Conic>>& conics );
+template void FindConics( const int, const int, const std::vector<PixelClass>& candidates, const Eigen::Vector2f* dI, std::vector<Conic, Eigen::aligned_allocator<Conic>>& conics, bool, float );
+template bool FitConic( const int, const int, const PixelClass&, const Eigen::Vector2f*, Conic&, bool, float );
 
 }
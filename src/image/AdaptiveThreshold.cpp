@@ -0,0 +1,415 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <calibu/image/AdaptiveThreshold.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define CALIBU_AT_AVX2
+#  include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  define CALIBU_AT_NEON
+#  include <arm_neon.h>
+#endif
+
+namespace calibu {
+
+namespace {
+
+// Row kernels process interior pixels i in [i0,i1), for which the window
+// is never clamped horizontally: x1 = i-rad, x2 = i+rad. They return the
+// first pixel they did not handle so the caller can finish the row. The
+// arithmetic is written in the same order as the scalar templates so that
+// every comparison sees exactly the same floating point values.
+typedef int (*ThresholdRowFn)(const unsigned char* I, const float* intIy2,
+                              const float* intIy1m1, unsigned char* out,
+                              int i0, int i1, int rad, int count,
+                              float threshold, unsigned char pass,
+                              unsigned char fail);
+
+typedef int (*ThresholdMinDiffRowFn)(const unsigned char* I,
+                                     const float* intIy2,
+                                     const float* intIy1m1, unsigned char* out,
+                                     int i0, int i1, int rad, int count,
+                                     float threshold, int min_diff,
+                                     unsigned char pass, unsigned char fail);
+
+int ThresholdRowScalar(const unsigned char*, const float*, const float*,
+                       unsigned char*, int i0, int, int, int, float,
+                       unsigned char, unsigned char)
+{
+    return i0;
+}
+
+int ThresholdMinDiffRowScalar(const unsigned char*, const float*,
+                              const float*, unsigned char*, int i0, int, int,
+                              int, float, int, unsigned char, unsigned char)
+{
+    return i0;
+}
+
+#ifdef CALIBU_AT_AVX2
+
+__attribute__((target("avx2")))
+inline __m128i PackMask8(__m256 mask)
+{
+    const __m256i m = _mm256_castps_si256(mask);
+    const __m128i m16 = _mm_packs_epi32(_mm256_castsi256_si128(m),
+                                        _mm256_extracti128_si256(m, 1));
+    return _mm_packs_epi16(m16, m16);
+}
+
+__attribute__((target("avx2")))
+inline __m256 WindowSum(const float* intIy2, const float* intIy1m1,
+                        int i, int rad)
+{
+    const __m256 a = _mm256_loadu_ps(intIy2 + i + rad);
+    const __m256 b = _mm256_loadu_ps(intIy1m1 + i + rad);
+    const __m256 c = _mm256_loadu_ps(intIy2 + i - rad - 1);
+    const __m256 d = _mm256_loadu_ps(intIy1m1 + i - rad - 1);
+    return _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(a, b), c), d);
+}
+
+__attribute__((target("avx2")))
+int ThresholdRowAvx2(const unsigned char* I, const float* intIy2,
+                     const float* intIy1m1, unsigned char* out,
+                     int i0, int i1, int rad, int count, float threshold,
+                     unsigned char pass, unsigned char fail)
+{
+    const __m256i vcount = _mm256_set1_epi32(count);
+    const __m256 vthresh = _mm256_set1_ps(threshold);
+    const __m128i vpass = _mm_set1_epi8((char)pass);
+    const __m128i vfail = _mm_set1_epi8((char)fail);
+
+    int i = i0;
+    for( ; i + 8 <= i1; i += 8 )
+    {
+        const __m256i px = _mm256_cvtepu8_epi32(
+                    _mm_loadl_epi64((const __m128i*)(I + i)));
+        const __m256 lhs = _mm256_cvtepi32_ps(_mm256_mullo_epi32(px, vcount));
+        const __m256 rhs = _mm256_mul_ps(vthresh, WindowSum(intIy2, intIy1m1, i, rad));
+        const __m128i m = PackMask8(_mm256_cmp_ps(lhs, rhs, _CMP_LT_OQ));
+        _mm_storel_epi64((__m128i*)(out + i), _mm_blendv_epi8(vfail, vpass, m));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+int ThresholdMinDiffRowAvx2(const unsigned char* I, const float* intIy2,
+                            const float* intIy1m1, unsigned char* out,
+                            int i0, int i1, int rad, int count,
+                            float threshold, int min_diff,
+                            unsigned char pass, unsigned char fail)
+{
+    const __m256 vcount = _mm256_set1_ps((float)count);
+    const __m256 vmin_diff = _mm256_set1_ps((float)min_diff);
+    const __m256 vthresh = _mm256_set1_ps(threshold);
+    const __m128i vpass = _mm_set1_epi8((char)pass);
+    const __m128i vfail = _mm_set1_epi8((char)fail);
+
+    int i = i0;
+    for( ; i + 8 <= i1; i += 8 )
+    {
+        const __m256 lhs = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+                    _mm_loadl_epi64((const __m128i*)(I + i))));
+        const __m256 avg = _mm256_div_ps(WindowSum(intIy2, intIy1m1, i, rad), vcount);
+        const __m256 rhs = _mm256_mul_ps(vthresh, _mm256_sub_ps(avg, vmin_diff));
+        const __m128i m = PackMask8(_mm256_cmp_ps(lhs, rhs, _CMP_LT_OQ));
+        _mm_storel_epi64((__m128i*)(out + i), _mm_blendv_epi8(vfail, vpass, m));
+    }
+    return i;
+}
+
+bool HaveAvx2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+ThresholdRowFn SelectThresholdRow()
+{
+    return HaveAvx2() ? ThresholdRowAvx2 : ThresholdRowScalar;
+}
+
+ThresholdMinDiffRowFn SelectThresholdMinDiffRow()
+{
+    return HaveAvx2() ? ThresholdMinDiffRowAvx2 : ThresholdMinDiffRowScalar;
+}
+
+#elif defined(CALIBU_AT_NEON)
+
+inline float32x4_t WindowSum(const float* intIy2, const float* intIy1m1,
+                             int i, int rad)
+{
+    const float32x4_t a = vld1q_f32(intIy2 + i + rad);
+    const float32x4_t b = vld1q_f32(intIy1m1 + i + rad);
+    const float32x4_t c = vld1q_f32(intIy2 + i - rad - 1);
+    const float32x4_t d = vld1q_f32(intIy1m1 + i - rad - 1);
+    return vaddq_f32(vsubq_f32(vsubq_f32(a, b), c), d);
+}
+
+inline uint8x8_t PackMask8(uint32x4_t lo, uint32x4_t hi)
+{
+    return vmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+}
+
+int ThresholdRowNeon(const unsigned char* I, const float* intIy2,
+                     const float* intIy1m1, unsigned char* out,
+                     int i0, int i1, int rad, int count, float threshold,
+                     unsigned char pass, unsigned char fail)
+{
+    const uint32x4_t vcount = vdupq_n_u32((uint32_t)count);
+    const float32x4_t vthresh = vdupq_n_f32(threshold);
+    const uint8x8_t vpass = vdup_n_u8(pass);
+    const uint8x8_t vfail = vdup_n_u8(fail);
+
+    int i = i0;
+    for( ; i + 8 <= i1; i += 8 )
+    {
+        const uint16x8_t px = vmovl_u8(vld1_u8(I + i));
+        const float32x4_t lhs_lo = vcvtq_f32_u32(vmulq_u32(vmovl_u16(vget_low_u16(px)), vcount));
+        const float32x4_t lhs_hi = vcvtq_f32_u32(vmulq_u32(vmovl_u16(vget_high_u16(px)), vcount));
+        const float32x4_t rhs_lo = vmulq_f32(vthresh, WindowSum(intIy2, intIy1m1, i, rad));
+        const float32x4_t rhs_hi = vmulq_f32(vthresh, WindowSum(intIy2, intIy1m1, i + 4, rad));
+        const uint8x8_t m = PackMask8(vcltq_f32(lhs_lo, rhs_lo), vcltq_f32(lhs_hi, rhs_hi));
+        vst1_u8(out + i, vbsl_u8(m, vpass, vfail));
+    }
+    return i;
+}
+
+int ThresholdMinDiffRowNeon(const unsigned char* I, const float* intIy2,
+                            const float* intIy1m1, unsigned char* out,
+                            int i0, int i1, int rad, int count,
+                            float threshold, int min_diff,
+                            unsigned char pass, unsigned char fail)
+{
+    const float32x4_t vcount = vdupq_n_f32((float)count);
+    const float32x4_t vmin_diff = vdupq_n_f32((float)min_diff);
+    const float32x4_t vthresh = vdupq_n_f32(threshold);
+    const uint8x8_t vpass = vdup_n_u8(pass);
+    const uint8x8_t vfail = vdup_n_u8(fail);
+
+    int i = i0;
+    for( ; i + 8 <= i1; i += 8 )
+    {
+        const uint16x8_t px = vmovl_u8(vld1_u8(I + i));
+        const float32x4_t lhs_lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(px)));
+        const float32x4_t lhs_hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(px)));
+        const float32x4_t avg_lo = vdivq_f32(WindowSum(intIy2, intIy1m1, i, rad), vcount);
+        const float32x4_t avg_hi = vdivq_f32(WindowSum(intIy2, intIy1m1, i + 4, rad), vcount);
+        const float32x4_t rhs_lo = vmulq_f32(vthresh, vsubq_f32(avg_lo, vmin_diff));
+        const float32x4_t rhs_hi = vmulq_f32(vthresh, vsubq_f32(avg_hi, vmin_diff));
+        const uint8x8_t m = PackMask8(vcltq_f32(lhs_lo, rhs_lo), vcltq_f32(lhs_hi, rhs_hi));
+        vst1_u8(out + i, vbsl_u8(m, vpass, vfail));
+    }
+    return i;
+}
+
+ThresholdRowFn SelectThresholdRow()
+{
+    return ThresholdRowNeon;
+}
+
+ThresholdMinDiffRowFn SelectThresholdMinDiffRow()
+{
+    return ThresholdMinDiffRowNeon;
+}
+
+#else
+
+ThresholdRowFn SelectThresholdRow()
+{
+    return ThresholdRowScalar;
+}
+
+ThresholdMinDiffRowFn SelectThresholdMinDiffRow()
+{
+    return ThresholdMinDiffRowScalar;
+}
+
+#endif
+
+} // anonymous namespace
+
+//////////////////////////////////////////////////////////////////////////////
+
+void AdaptiveThresholdRow( int w, int h, int j, const unsigned char* Ij, const float* intIy2, const float* intIy1m1, unsigned char* outj, float threshold, int rad, unsigned char pass, unsigned char fail, int x_begin, int x_end )
+{
+    static const ThresholdRowFn row_fn = SelectThresholdRow();
+
+    const int y1 = std::max(1,j-rad);
+    const int y2 = std::min(h-1,j+rad);
+
+    // Columns with an unclamped window
+    const int i_begin = rad+1;
+    const int i_end = std::max(i_begin, w-rad);
+
+    const int v0 = std::max(i_begin, x_begin);
+    const int v1 = std::min(i_end, x_end);
+    const int vec_end = (v0 < v1) ?
+                row_fn(Ij, intIy2, intIy1m1, outj, v0, v1, rad,
+                       (2*rad)*(y2-y1), threshold, pass, fail) : v0;
+
+    for( int i=x_begin; i<x_end; ++i )
+    {
+        if( i == v0 && vec_end > v0 ) i = vec_end;
+        if( i >= x_end ) break;
+        const int x1 = std::max(1,i-rad);
+        const int x2 = std::min(w-1,i+rad);
+        const int count = (x2-x1)*(y2-y1);
+        const float sum = intIy2[x2] - intIy1m1[x2] - intIy2[x1-1] + intIy1m1[x1-1];
+        outj[i] = (Ij[i]*count < threshold*sum) ? pass : fail;
+    }
+}
+
+void AdaptiveThresholdRow( int w, int h, int j, const unsigned char* Ij, const float* intIy2, const float* intIy1m1, unsigned char* outj, float threshold, int rad, unsigned char pass, unsigned char fail )
+{
+    AdaptiveThresholdRow(w, h, j, Ij, intIy2, intIy1m1, outj, threshold, rad, pass, fail, 0, w);
+}
+
+void AdaptiveThresholdRow( int w, int h, int j, const unsigned char* Ij, const float* intIy2, const float* intIy1m1, unsigned char* outj, float threshold, int rad, int min_diff, unsigned char pass, unsigned char fail, int x_begin, int x_end )
+{
+    static const ThresholdMinDiffRowFn row_fn = SelectThresholdMinDiffRow();
+
+    const int y1 = std::max(1,j-rad);
+    const int y2 = std::min(h-1,j+rad);
+
+    // Columns with an unclamped window
+    const int i_begin = rad+1;
+    const int i_end = std::max(i_begin, w-rad);
+
+    const int v0 = std::max(i_begin, x_begin);
+    const int v1 = std::min(i_end, x_end);
+    const int vec_end = (v0 < v1) ?
+                row_fn(Ij, intIy2, intIy1m1, outj, v0, v1, rad,
+                       (2*rad)*(y2-y1), threshold, min_diff, pass, fail) : v0;
+
+    for( int i=x_begin; i<x_end; ++i )
+    {
+        if( i == v0 && vec_end > v0 ) i = vec_end;
+        if( i >= x_end ) break;
+        const int x1 = std::max(1,i-rad);
+        const int x2 = std::min(w-1,i+rad);
+        const int count = (x2-x1)*(y2-y1);
+        const float sum = intIy2[x2] - intIy1m1[x2] - intIy2[x1-1] + intIy1m1[x1-1];
+        const float avg = sum/count;
+        outj[i] = (Ij[i] < threshold*(avg-min_diff)) ? pass : fail;
+    }
+}
+
+void AdaptiveThresholdRow( int w, int h, int j, const unsigned char* Ij, const float* intIy2, const float* intIy1m1, unsigned char* outj, float threshold, int rad, int min_diff, unsigned char pass, unsigned char fail )
+{
+    AdaptiveThresholdRow(w, h, j, Ij, intIy2, intIy1m1, outj, threshold, rad, min_diff, pass, fail, 0, w);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void AdaptiveThreshold( int w, int h, const unsigned char* I, int I_pitch, const float* intI, unsigned char* out, float threshold, int rad, unsigned char pass, unsigned char fail )
+{
+    for ( int j=0; j<h; ++j )
+    {
+        const int y1 = std::max(1,j-rad);
+        const int y2 = std::min(h-1,j+rad);
+        AdaptiveThresholdRow(w, h, j, I + j*I_pitch, intI + y2*w,
+                             intI + (y1-1)*w, out + j*w, threshold, rad,
+                             pass, fail);
+    }
+}
+
+void AdaptiveThreshold( int w, int h, const unsigned char* I, int I_pitch, const float* intI, unsigned char* out, float threshold, int rad, int min_diff, unsigned char pass, unsigned char fail )
+{
+    for ( int j=0; j<h; ++j )
+    {
+        const int y1 = std::max(1,j-rad);
+        const int y2 = std::min(h-1,j+rad);
+        AdaptiveThresholdRow(w, h, j, I + j*I_pitch, intI + y2*w,
+                             intI + (y1-1)*w, out + j*w, threshold, rad,
+                             min_diff, pass, fail);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void AdaptiveThreshold( int w, int h, const unsigned char* I, const float* intI, unsigned char* out, float threshold, int rad, unsigned char pass, unsigned char fail )
+{
+    AdaptiveThreshold(w, h, I, w, intI, out, threshold, rad, pass, fail);
+}
+
+void AdaptiveThreshold( int w, int h, const unsigned char* I, const float* intI, unsigned char* out, float threshold, int rad, int min_diff, unsigned char pass, unsigned char fail )
+{
+    AdaptiveThreshold(w, h, I, w, intI, out, threshold, rad, min_diff, pass, fail);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void AdaptiveThresholdRow( int w, int h, int j, const unsigned char* Ij, const uint32_t* intIy2, const uint32_t* intIy1m1, unsigned char* outj, float threshold, int rad, unsigned char pass, unsigned char fail, int x_begin, int x_end )
+{
+    const int y1 = std::max(1,j-rad);
+    const int y2 = std::min(h-1,j+rad);
+    for( int i=x_begin; i<x_end; ++i )
+    {
+        const int x1 = std::max(1,i-rad);
+        const int x2 = std::min(w-1,i+rad);
+        const int count = (x2-x1)*(y2-y1);
+        // Modulo 2^32, exact as the true sum fits
+        const uint32_t sum = intIy2[x2] - intIy1m1[x2] - intIy2[x1-1] + intIy1m1[x1-1];
+        outj[i] = (Ij[i]*count < threshold*sum) ? pass : fail;
+    }
+}
+
+void AdaptiveThresholdRow( int w, int h, int j, const unsigned char* Ij, const uint32_t* intIy2, const uint32_t* intIy1m1, unsigned char* outj, float threshold, int rad, int min_diff, unsigned char pass, unsigned char fail, int x_begin, int x_end )
+{
+    const int y1 = std::max(1,j-rad);
+    const int y2 = std::min(h-1,j+rad);
+    for( int i=x_begin; i<x_end; ++i )
+    {
+        const int x1 = std::max(1,i-rad);
+        const int x2 = std::min(w-1,i+rad);
+        const int count = (x2-x1)*(y2-y1);
+        const uint32_t sum = intIy2[x2] - intIy1m1[x2] - intIy2[x1-1] + intIy1m1[x1-1];
+        const float avg = (float)sum/count;
+        outj[i] = (Ij[i] < threshold*(avg-min_diff)) ? pass : fail;
+    }
+}
+
+void AdaptiveThreshold( int w, int h, const unsigned char* I, int I_pitch, const uint32_t* intI, unsigned char* out, float threshold, int rad, unsigned char pass, unsigned char fail )
+{
+    for ( int j=0; j<h; ++j )
+    {
+        const int y1 = std::max(1,j-rad);
+        const int y2 = std::min(h-1,j+rad);
+        AdaptiveThresholdRow(w, h, j, I + j*I_pitch, intI + y2*w,
+                             intI + (y1-1)*w, out + j*w, threshold, rad,
+                             pass, fail, 0, w);
+    }
+}
+
+void AdaptiveThreshold( int w, int h, const unsigned char* I, int I_pitch, const uint32_t* intI, unsigned char* out, float threshold, int rad, int min_diff, unsigned char pass, unsigned char fail )
+{
+    for ( int j=0; j<h; ++j )
+    {
+        const int y1 = std::max(1,j-rad);
+        const int y2 = std::min(h-1,j+rad);
+        AdaptiveThresholdRow(w, h, j, I + j*I_pitch, intI + y2*w,
+                             intI + (y1-1)*w, out + j*w, threshold, rad,
+                             min_diff, pass, fail, 0, w);
+    }
+}
+
+}
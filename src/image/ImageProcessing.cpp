@@ -23,12 +23,19 @@
 #include <calibu/image/AdaptiveThreshold.h>
 #include <calibu/image/IntegralImage.h>
 #include <calibu/image/Label.h>
+#include <calibu/utils/Trace.h>
+
+#include <algorithm>
+#include <set>
+#include <tuple>
 
 namespace calibu {
 
 ImageProcessing::ImageProcessing(int maxWidth, int maxHeight)
-    : width(maxWidth), height(maxHeight) {
+    : width(maxWidth), height(maxHeight),
+      roi(0, 0, maxWidth-1, maxHeight-1), img_pitch(maxWidth) {
   AllocateImageData(maxWidth*maxHeight);
+  img = &I[0];
 }
 
 ImageProcessing::~ImageProcessing() {
@@ -36,10 +43,9 @@ ImageProcessing::~ImageProcessing() {
 }
 
 void ImageProcessing::AllocateImageData(int maxPixels) {
+  CALIBU_STATS(++stats.num_allocations);
   I.resize(maxPixels);
-  intI.resize(maxPixels);
   dI.resize(maxPixels);
-  lI.resize(maxPixels);
   tI.resize(maxPixels);
 }
 
@@ -47,39 +53,297 @@ void ImageProcessing::DeallocateImageData() {}
 
 void ImageProcessing::Process(const unsigned char* greyscale_image,
                               size_t w, size_t h, size_t pitch) {
+  roi = IRectangle(0, 0, w-1, h-1);
+  ProcessRegion(greyscale_image, w, h, pitch, w / params.at_window_ratio);
+}
+
+void ImageProcessing::Process(const unsigned char* greyscale_image,
+                              size_t w, size_t h, size_t pitch,
+                              const IRectangle& r) {
+  pitch = std::max(pitch, w*sizeof(unsigned char));
+  roi = r.Clamp(0, 0, w-1, h-1);
+  if (roi.Area() == 0) {
+    CALIBU_STATS(stats.Reset());
+    width = 0;
+    height = 0;
+    labels.clear();
+    return;
+  }
+
+  ProcessRegion(greyscale_image + roi.y1*pitch + roi.x1,
+                roi.Width(), roi.Height(), pitch, w / params.at_window_ratio);
+}
+
+void ImageProcessing::ProcessRegion(const unsigned char* greyscale_image,
+                                    size_t w, size_t h, size_t pitch,
+                                    int rad) {
+  CALIBU_TRACE("ImageProcessing::Process");
   width = w;
   height = h;
+  CALIBU_STATS(stats.Reset());
 
   size_t img_size = width * height * sizeof(unsigned char);
   if (img_size > I.size()) {
     AllocateImageData(img_size);
   }
 
-  // Copy input image
-  if(pitch > width*sizeof(unsigned char) ) {
-    // Copy line by line
-    for(int y=0; y < height; ++y) {
-      memcpy(&I[y*width], greyscale_image+y*pitch, width * sizeof(unsigned char));
+  if (params.zero_copy) {
+    img = greyscale_image;
+    img_pitch = std::max(pitch, width*sizeof(unsigned char));
+  } else {
+    CALIBU_STATS_TIME(stats.copy);
+    // Copy input image
+    if(pitch > width*sizeof(unsigned char) ) {
+      // Copy line by line
+      for(int y=0; y < height; ++y) {
+        memcpy(&I[y*width], greyscale_image+y*pitch, width * sizeof(unsigned char));
+      }
+    }else{
+      memcpy(&I[0], greyscale_image, img_size);
     }
-  }else{
-    memcpy(&I[0], greyscale_image, img_size);
+    img = &I[0];
+    img_pitch = width;
+  }
+
+  const int scale = 1 << std::max(params.pyramid_levels, 0);
+  if (scale > 1 && width / scale >= 8 && height / scale >= 8) {
+    {
+      CALIBU_STATS_TIME(stats.pyramid);
+      ProcessPyramid(rad);
+    }
+    if (labels.size() >= (size_t)std::max(params.pyramid_min_labels, 0)) {
+      CALIBU_STATS(stats.num_labels = labels.size());
+      return;
+    }
+    CALIBU_STATS(++stats.num_pyramid_fallbacks);
+  }
+
+  ProcessFullResolution(rad);
+  CALIBU_STATS(stats.num_labels = labels.size());
+}
+
+void ImageProcessing::ProcessFullResolution(int rad) {
+  if (params.fused_pipeline && params.integral_threads <= 1) {
+    CALIBU_STATS_TIME(stats.fused);
+    if (params.exact_integral) {
+      ProcessFused(rad, intI_exact);
+    } else {
+      ProcessFused(rad, intI);
+    }
+  } else {
+    if (params.exact_integral) {
+      ProcessUnfused(rad, intI_exact);
+    } else {
+      ProcessUnfused(rad, intI);
+    }
+  }
+
+  // Label image (connected components)
+  CALIBU_STATS_TIME(stats.label);
+  labels.clear();
+  if (params.label_threads > 1) {
+    LabelRunsParallel(width, height, &tI[0], labels,
+                      params.black_on_white ? 0 : 255, params.label_threads,
+                      label_workspace);
+  } else {
+    LabelRuns(width, height, &tI[0], labels,
+              params.black_on_white ? 0 : 255, label_workspace);
+  }
+}
+
+template<typename TintI>
+void ImageProcessing::ProcessUnfused(int rad, std::vector<TintI>& intI) {
+  const size_t img_size = width * height;
+  if (intI.size() < img_size) {
+    intI.resize(img_size);
+    CALIBU_STATS(++stats.num_allocations);
   }
 
   // Process image
-  gradient<>(width, height, &I[0],  &dI[0]);
-  integral_image(width, height, &I[0], &intI[0] );
+  {
+    CALIBU_STATS_TIME(stats.gradient);
+    gradient<>(width, height, img_pitch, img, &dI[0]);
+  }
+  {
+    CALIBU_STATS_TIME(stats.integral_image);
+    integral_image_parallel(width, height, (int)img_pitch, img, &intI[0],
+                            params.integral_threads);
+  }
 
   // Threshold image
-  AdaptiveThreshold(
-      width, height, &I[0], &intI[0], &tI[0], params.at_threshold,
-      width / params.at_window_ratio, 20,
-      (unsigned char)0, (unsigned char)255
-                    );
+  {
+    CALIBU_STATS_TIME(stats.threshold);
+    AdaptiveThreshold(
+        width, height, img, img_pitch, &intI[0], &tI[0], params.at_threshold,
+        rad, 20, (unsigned char)0, (unsigned char)255
+                      );
+  }
+}
+
+template<typename TintI>
+void ImageProcessing::ProcessFused(int rad, std::vector<TintI>& intI) {
+  // Integral rows j-rad-1 .. j+rad are needed to threshold row j, so a ring
+  // of 2*rad+2 rows is enough.
+  const int ring = std::min(height, 2*rad+2);
+  if (intI.size() < (size_t)ring*width) {
+    intI.resize(ring*width);
+    CALIBU_STATS(++stats.num_allocations);
+  }
+  TintI* ring_rows = &intI[0];
+
+  for(int y=0; y < height; ++y) {
+    const unsigned char* Iy = img + y*img_pitch;
+    TintI* intIy = ring_rows + (y%ring)*width;
+    const TintI* intIym1 = y > 0 ? ring_rows + ((y-1)%ring)*width : NULL;
+    integral_image_row(width, Iy, intIym1, intIy);
+
+    if(0 < y && y < height-1) {
+      gradient_row(width, height, (int)img_pitch, img, &dI[0], y);
+    }
+
+    // Threshold the rows whose window ends at y. Rows within rad of the
+    // bottom all end at the last row.
+    const int j_begin = std::max(0, y-rad);
+    const int j_end = (y == height-1) ? height : y-rad+1;
+    for(int j=j_begin; j < j_end; ++j) {
+      const int y1 = std::max(1,j-rad);
+      const int y2 = std::min(height-1,j+rad);
+      AdaptiveThresholdRow(
+          width, height, j, img + j*img_pitch,
+          ring_rows + (y2%ring)*width, ring_rows + ((y1-1)%ring)*width,
+          &tI[j*width], params.at_threshold, rad, 20,
+          (unsigned char)0, (unsigned char)255, 0, width
+                           );
+    }
+  }
+}
+
+void ImageProcessing::ProcessPyramid(int rad) {
+  const int scale = 1 << params.pyramid_levels;
+  const int cw = width / scale;
+  const int ch = height / scale;
+
+  // Box filtered coarse level
+  coarse_img.resize(cw*ch);
+  const int area = scale*scale;
+  for(int cy=0; cy < ch; ++cy) {
+    for(int cx=0; cx < cw; ++cx) {
+      int sum = 0;
+      for(int dy=0; dy < scale; ++dy) {
+        const unsigned char* row = img + (cy*scale+dy)*img_pitch + cx*scale;
+        for(int dx=0; dx < scale; ++dx) {
+          sum += row[dx];
+        }
+      }
+      coarse_img[cy*cw+cx] = (sum + area/2) / area;
+    }
+  }
+
+  if (!coarse) {
+    coarse.reset(new ImageProcessing(cw, ch));
+  }
+  coarse->Params() = params;
+  coarse->Params().pyramid_levels = 0;
+  coarse->Params().zero_copy = true;
+  coarse->Process(&coarse_img[0], cw, ch, cw);
+
+  // Full resolution integral image, from which the threshold of any full
+  // resolution pixel can be evaluated exactly.
+  const size_t img_size = width * height;
+  if (params.exact_integral) {
+    if (intI_exact.size() < img_size) {
+      intI_exact.resize(img_size);
+      CALIBU_STATS(++stats.num_allocations);
+    }
+    integral_image_parallel(width, height, (int)img_pitch, img, &intI_exact[0],
+                            params.integral_threads);
+  } else {
+    if (intI.size() < img_size) {
+      intI.resize(img_size);
+      CALIBU_STATS(++stats.num_allocations);
+    }
+    integral_image_parallel(width, height, (int)img_pitch, img, &intI[0],
+                            params.integral_threads);
+  }
+
+  // Only the refined boxes are written below: clear what the last frame
+  // left elsewhere to background
+  std::fill(tI.begin(), tI.begin() + img_size,
+            (unsigned char)(params.black_on_white ? 255 : 0));
+  std::fill(dI.begin(), dI.begin() + img_size, Eigen::Vector2f::Zero());
 
-  // Label image (connected components)
   labels.clear();
-  Label(width, height, &tI[0], &lI[0], labels,
-        params.black_on_white ? 0 : 255 );
+  const std::vector<PixelClass>& coarse_labels = coarse->Labels();
+  for(size_t i=0; i < coarse_labels.size(); ++i) {
+    if (coarse_labels[i].equiv != -1) continue;
+    const IRectangle& cb = coarse_labels[i].bbox;
+    const IRectangle fb(cb.x1*scale, cb.y1*scale,
+                        (cb.x2+1)*scale-1, (cb.y2+1)*scale-1);
+    if (fb.Area() > params.pyramid_max_area) continue;
+    const IRectangle box = fb.Grow(scale+3).Clamp(1, 1, width-2, height-2);
+    if (params.exact_integral) {
+      RefineRegion(box, rad, intI_exact);
+    } else {
+      RefineRegion(box, rad, intI);
+    }
+  }
+
+  // Neighbouring boxes can overlap and find the same component twice
+  std::set<std::tuple<int,int,int,int,int> > seen;
+  size_t n = 0;
+  for(size_t i=0; i < labels.size(); ++i) {
+    const PixelClass& pc = labels[i];
+    if (seen.insert(std::make_tuple(pc.bbox.x1, pc.bbox.y1, pc.bbox.x2,
+                                    pc.bbox.y2, pc.size)).second) {
+      labels[n++] = pc;
+    }
+  }
+  labels.resize(n);
+}
+
+template<typename TintI>
+void ImageProcessing::RefineRegion(const IRectangle& box, int rad,
+                                   const std::vector<TintI>& intI) {
+  const int bw = box.Width();
+  const int bh = box.Height();
+  if (bw <= 0 || bh <= 0) return;
+
+  const unsigned char passval = params.black_on_white ? 0 : 255;
+  box_thresh.resize(bw*bh);
+
+  for(int y=box.y1; y <= box.y2; ++y) {
+    const int y1 = std::max(1,y-rad);
+    const int y2 = std::min(height-1,y+rad);
+    const unsigned char* Iy = img + y*img_pitch;
+    AdaptiveThresholdRow(
+        width, height, y, Iy, &intI[y2*width], &intI[(y1-1)*width],
+        &tI[y*width], params.at_threshold, rad, 20,
+        (unsigned char)0, (unsigned char)255, box.x1, box.x2+1
+                         );
+    memcpy(&box_thresh[(y-box.y1)*bw], &tI[y*width+box.x1], bw);
+
+    // Same values as gradient() for these interior pixels
+    Eigen::Vector2f* dIy = &dI[y*width];
+    for(int x=box.x1; x <= box.x2; ++x) {
+      dIy[x][0] = Iy[x+1] - Iy[x-1];
+      dIy[x][1] = Iy[x+img_pitch] - Iy[x-img_pitch];
+    }
+  }
+
+  // Keep only components that are complete within the box, with room for
+  // the region grown by FindCandidateConicsFromLabels.
+  box_labels.clear();
+  LabelRuns(bw, bh, &box_thresh[0], box_labels, passval, label_workspace);
+  for(size_t i=0; i < box_labels.size(); ++i) {
+    PixelClass pc = box_labels[i];
+    if (pc.bbox.x1 < 3 || pc.bbox.y1 < 3 ||
+        pc.bbox.x2 > bw-4 || pc.bbox.y2 > bh-4) {
+      continue;
+    }
+    pc.bbox = IRectangle(pc.bbox.x1 + box.x1, pc.bbox.y1 + box.y1,
+                         pc.bbox.x2 + box.x1, pc.bbox.y2 + box.y1);
+    labels.push_back(pc);
+  }
 }
 
 }
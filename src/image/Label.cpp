@@ -21,6 +21,8 @@
 #include <calibu/image/Label.h>
 
 #include <vector>
+#include <thread>
+#include <functional>
 
 using namespace std;
 using namespace Eigen;
@@ -96,4 +98,188 @@ void Label( int w, int h, const unsigned char* I, short* label, vector<PixelClas
     
 }
 
+////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+inline int FindRoot(vector<int>& parent, int l)
+{
+    // Path halving
+    while( parent[l] != l ) {
+        parent[l] = parent[parent[l]];
+        l = parent[l];
+    }
+    return l;
+}
+
+inline void Union(vector<int>& parent, int a, int b)
+{
+    a = FindRoot(parent, a);
+    b = FindRoot(parent, b);
+    // Lowest label wins so roots always refer to the first run of a component
+    if( a < b ) parent[b] = a;
+    else if( b < a ) parent[a] = b;
+}
+
+// Append the runs of row y to runs
+inline void ExtractRuns(int w, int y, const unsigned char* Irow, unsigned char passval, vector<LabelRun>& runs)
+{
+    int x = 0;
+    while( x < w ) {
+        while( x < w && Irow[x] != passval ) ++x;
+        if( x == w ) break;
+        const int x1 = x;
+        while( x < w && Irow[x] == passval ) ++x;
+        LabelRun run = { y, x1, x-1, (int)runs.size() };
+        runs.push_back(run);
+    }
+}
+
+// Union 4-connected runs in consecutive rows. prev_begin..prev_end and
+// cur_begin..cur_end index the runs of the two rows in increasing x.
+inline void UnionRows(vector<LabelRun>& runs, vector<int>& parent,
+                      size_t prev_begin, size_t prev_end,
+                      size_t cur_begin, size_t cur_end)
+{
+    size_t p = prev_begin;
+    for( size_t c = cur_begin; c < cur_end; ++c ) {
+        const LabelRun& cr = runs[c];
+        while( p < prev_end && runs[p].x2 < cr.x1 ) ++p;
+        for( size_t q = p; q < prev_end && runs[q].x1 <= cr.x2; ++q ) {
+            Union(parent, runs[q].label, cr.label);
+        }
+    }
+}
+
+// Extract and union all runs of rows [y0,y1). row_start receives the index
+// of the first run of each row, plus one final entry.
+void LabelRowRange(int w, int y0, int y1, const unsigned char* I, unsigned char passval,
+                   vector<LabelRun>& runs, vector<int>& parent, vector<size_t>& row_start)
+{
+    runs.clear();
+    row_start.clear();
+    for( int y = y0; y < y1; ++y ) {
+        row_start.push_back(runs.size());
+        ExtractRuns(w, y, I + y*w, passval, runs);
+    }
+    row_start.push_back(runs.size());
+
+    parent.resize(runs.size());
+    for( size_t i = 0; i < parent.size(); ++i ) parent[i] = i;
+
+    for( int r = 1; r < y1 - y0; ++r ) {
+        UnionRows(runs, parent, row_start[r-1], row_start[r], row_start[r], row_start[r+1]);
+    }
+}
+
+// Collapse resolved runs into one PixelClass per component, ordered by the
+// first run of each component in raster order.
+void AccumulateRuns(const vector<LabelRun>& runs, vector<int>& parent,
+                    vector<int>& component, vector<PixelClass>& labels)
+{
+    component.assign(runs.size(), -1);
+    for( size_t i = 0; i < runs.size(); ++i ) {
+        const LabelRun& run = runs[i];
+        const int root = FindRoot(parent, run.label);
+        int& c = component[root];
+        if( c < 0 ) {
+            c = labels.size();
+            PixelClass pc = { -1, IRectangle(run.x1, run.y, run.x2, run.y), 0 };
+            labels.push_back(pc);
+        }
+        PixelClass& pc = labels[c];
+        pc.size += run.x2 - run.x1 + 1;
+        pc.bbox.Insert(run.x1, run.y);
+        pc.bbox.Insert(run.x2, run.y);
+    }
+}
+
+} // anonymous namespace
+
+void LabelRuns( int w, int h, const unsigned char* I, vector<PixelClass>& labels, unsigned char passval )
+{
+    LabelWorkspace workspace;
+    LabelRuns(w, h, I, labels, passval, workspace);
+}
+
+void LabelRuns( int w, int h, const unsigned char* I, vector<PixelClass>& labels, unsigned char passval,
+                LabelWorkspace& ws )
+{
+    LabelRowRange(w, 0, h, I, passval, ws.runs, ws.parent, ws.row_start);
+    AccumulateRuns(ws.runs, ws.parent, ws.component, labels);
+}
+
+void LabelRunsParallel( int w, int h, const unsigned char* I, vector<PixelClass>& labels, unsigned char passval, int num_threads )
+{
+    LabelWorkspace workspace;
+    LabelRunsParallel(w, h, I, labels, passval, num_threads, workspace);
+}
+
+void LabelRunsParallel( int w, int h, const unsigned char* I, vector<PixelClass>& labels, unsigned char passval, int num_threads,
+                        LabelWorkspace& ws )
+{
+    const int num_bands = std::max(1, std::min(num_threads, h));
+    if( num_bands == 1 ) {
+        LabelRuns(w, h, I, labels, passval, ws);
+        return;
+    }
+
+    // Label each band of rows independently. Band buffers are only ever
+    // added to, so each keeps its capacity from frame to frame.
+    if( (int)ws.band_runs.size() < num_bands ) {
+        ws.band_runs.resize(num_bands);
+        ws.band_parent.resize(num_bands);
+        ws.band_row_start.resize(num_bands);
+    }
+    ws.band_y0.resize(num_bands+1);
+    for( int b = 0; b <= num_bands; ++b ) {
+        ws.band_y0[b] = (int)(((long)h * b) / num_bands);
+    }
+
+    vector<std::thread> workers;
+    workers.reserve(num_bands);
+    for( int b = 0; b < num_bands; ++b ) {
+        workers.push_back(std::thread(
+            LabelRowRange, w, ws.band_y0[b], ws.band_y0[b+1], I, passval,
+            std::ref(ws.band_runs[b]), std::ref(ws.band_parent[b]), std::ref(ws.band_row_start[b])
+            ));
+    }
+    for( size_t t = 0; t < workers.size(); ++t ) {
+        workers[t].join();
+    }
+
+    // Concatenate bands into global label space
+    vector<LabelRun>& runs = ws.runs;
+    vector<int>& parent = ws.parent;
+    vector<size_t>& band_offset = ws.band_offset;
+    band_offset.assign(num_bands+1, 0);
+    for( int b = 0; b < num_bands; ++b ) {
+        band_offset[b+1] = band_offset[b] + ws.band_runs[b].size();
+    }
+    runs.clear();
+    parent.clear();
+    runs.reserve(band_offset[num_bands]);
+    parent.reserve(band_offset[num_bands]);
+    for( int b = 0; b < num_bands; ++b ) {
+        const int offset = band_offset[b];
+        for( size_t i = 0; i < ws.band_runs[b].size(); ++i ) {
+            LabelRun run = ws.band_runs[b][i];
+            run.label += offset;
+            runs.push_back(run);
+            parent.push_back(ws.band_parent[b][i] + offset);
+        }
+    }
+
+    // Merge equivalences across the seams between bands
+    for( int b = 1; b < num_bands; ++b ) {
+        const vector<size_t>& prev = ws.band_row_start[b-1];
+        const vector<size_t>& cur = ws.band_row_start[b];
+        UnionRows(runs, parent,
+                  band_offset[b-1] + prev[prev.size()-2], band_offset[b-1] + prev.back(),
+                  band_offset[b] + cur[0], band_offset[b] + cur[1]);
+    }
+
+    AccumulateRuns(runs, parent, ws.component, labels);
+}
+
 }
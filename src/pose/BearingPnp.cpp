@@ -0,0 +1,470 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Hauke Strasdat,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <calibu/pose/BearingPnp.h>
+#include <calibu/cam/camera_handle.h>
+
+#include <Eigen/Eigenvalues>
+#include <Eigen/SVD>
+
+using namespace std;
+using namespace Eigen;
+
+namespace calibu {
+
+namespace {
+
+// Product of the polynomials a and b, coefficients by increasing degree
+template<int A, int B>
+Matrix<double, A + B - 1, 1> PolyMul(const Matrix<double, A, 1>& a,
+                                     const Matrix<double, B, 1>& b)
+{
+    Matrix<double, A + B - 1, 1> c = Matrix<double, A + B - 1, 1>::Zero();
+    for (int i = 0; i < A; ++i) {
+        for (int j = 0; j < B; ++j) {
+            c[i + j] += a[i] * b[j];
+        }
+    }
+    return c;
+}
+
+// Real roots of the quartic p, by the eigenvalues of its companion matrix,
+// polished by Newton steps
+int QuarticRealRoots(const Matrix<double, 5, 1>& p, double roots[4])
+{
+    int degree = 4;
+    const double scale = p.cwiseAbs().maxCoeff();
+    while (degree > 0 && std::abs(p[degree]) <= 1e-12 * scale) {
+        --degree;
+    }
+    if (degree == 0) {
+        return 0;
+    }
+
+    MatrixXd companion = MatrixXd::Zero(degree, degree);
+    for (int i = 0; i < degree; ++i) {
+        companion(0, i) = -p[degree - 1 - i] / p[degree];
+        if (i + 1 < degree) {
+            companion(i + 1, i) = 1;
+        }
+    }
+    const EigenSolver<MatrixXd> solver(companion, false);
+
+    int n = 0;
+    for (int i = 0; i < degree; ++i) {
+        const std::complex<double> z = solver.eigenvalues()[i];
+        if (std::abs(z.imag()) > 1e-6 * std::max(1.0, std::abs(z.real()))) {
+            continue;
+        }
+        double x = z.real();
+        for (int it = 0; it < 2; ++it) {
+            double f = 0, df = 0;
+            for (int k = degree; k >= 0; --k) {
+                df = df * x + f;
+                f = f * x + p[k];
+            }
+            if (df == 0) break;
+            x -= f / df;
+        }
+        roots[n++] = x;
+    }
+    return n;
+}
+
+// T_cw best aligning points P_w to X_c, X_c = T_cw * P_w (Kabsch)
+Sophus::SE3d AlignPoints(const Vector3d* P_w, const Vector3d* X_c, size_t n)
+{
+    Vector3d P_mean = Vector3d::Zero(), X_mean = Vector3d::Zero();
+    for (size_t i = 0; i < n; ++i) {
+        P_mean += P_w[i];
+        X_mean += X_c[i];
+    }
+    P_mean /= n;
+    X_mean /= n;
+
+    Matrix3d H = Matrix3d::Zero();
+    for (size_t i = 0; i < n; ++i) {
+        H += (P_w[i] - P_mean) * (X_c[i] - X_mean).transpose();
+    }
+    const JacobiSVD<Matrix3d> svd(H, ComputeFullU | ComputeFullV);
+    Matrix3d D = Matrix3d::Identity();
+    D(2, 2) = (svd.matrixV() * svd.matrixU().transpose()).determinant() < 0 ? -1 : 1;
+    const Matrix3d R = svd.matrixV() * D * svd.matrixU().transpose();
+    return Sophus::SE3d(R, X_mean - R * P_mean);
+}
+
+// Angle between bearing f and the direction to point X
+double BearingError(const Vector3d& f, const Vector3d& X)
+{
+    return std::atan2(f.cross(X).norm(), f.dot(X));
+}
+
+// Gauss-Newton over the tangent plane errors of the bearings of set
+void RefinePoseBearings(const std::vector<int>& set, const BearingData& data,
+                        int iterations, Sophus::SE3d& T_cw)
+{
+    for (int it = 0; it < iterations; ++it) {
+        Matrix<double, 6, 6> JtJ = Matrix<double, 6, 6>::Zero();
+        Matrix<double, 6, 1> Jtr = Matrix<double, 6, 1>::Zero();
+        for (size_t k = 0; k < set.size(); ++k) {
+            const Vector3d& f = data.f_c[set[k]];
+            const Vector3d X = T_cw * data.P_w[set[k]];
+            const double d = X.norm();
+            const Vector3d x = X / d;
+
+            // Basis of the tangent plane of f
+            Matrix<double, 3, 2> B;
+            B.col(0) = f.unitOrthogonal();
+            B.col(1) = f.cross(B.col(0));
+
+            Matrix<double, 3, 6> dX;
+            dX.leftCols<3>() = Matrix3d::Identity();
+            dX.rightCols<3>() = -Sophus::SO3d::hat(X);
+            const Matrix<double, 2, 6> J = B.transpose() *
+                    ((Matrix3d::Identity() - x * x.transpose()) / d) * dX;
+            const Vector2d r = B.transpose() * x;
+            JtJ += J.transpose() * J;
+            Jtr += J.transpose() * r;
+        }
+        const Matrix<double, 6, 1> delta = -JtJ.ldlt().solve(Jtr);
+        if (!delta.allFinite()) {
+            return;
+        }
+        const Sophus::SO3d dR = Sophus::SO3d::exp(delta.tail<3>());
+        T_cw = Sophus::SE3d(dR * T_cw.so3(), dR * T_cw.translation() + delta.head<3>());
+        if (delta.norm() < 1e-10) {
+            return;
+        }
+    }
+}
+
+double BearingCost(const Sophus::SE3d& T_cw, int i, const BearingData* data)
+{
+    return BearingError(data->f_c[i], T_cw * data->P_w[i]);
+}
+
+// P3P on three spread elements of set, keeping the pose of least error
+// over set, refined over set when it has more than the minimal points.
+// False if P3P has no solution.
+bool BearingModel(const std::vector<int>& set, const BearingData* data,
+                  Sophus::SE3d& T_cw)
+{
+    const size_t n = set.size();
+    const int sample[3] = { set[0], set[n / 2], set[n - 1] };
+    const Vector3d f[3] = { data->f_c[sample[0]], data->f_c[sample[1]], data->f_c[sample[2]] };
+    const Vector3d P[3] = { data->P_w[sample[0]], data->P_w[sample[1]], data->P_w[sample[2]] };
+
+    Sophus::SE3d poses[4];
+    const int num_poses = PoseP3P(f, P, poses);
+    int best = -1;
+    double best_error = std::numeric_limits<double>::max();
+    for (int p = 0; p < num_poses; ++p) {
+        double error = 0;
+        for (size_t k = 0; k < n; ++k) {
+            const double e = BearingCost(poses[p], set[k], data);
+            error += e * e;
+        }
+        if (error < best_error) {
+            best_error = error;
+            best = p;
+        }
+    }
+    if (best < 0) {
+        return false;
+    }
+
+    T_cw = poses[best];
+    if (n > 4) {
+        RefinePoseBearings(set, *data, 5, T_cw);
+    }
+    return true;
+}
+
+// Normal equations of the reprojection error of a camera at T_cr in a rig at
+// T_rw, over perturbations of T_rw, added to JtJ and Jtr. Instantiated per
+// camera model.
+struct ReprojectionNormalEquations {
+    template<typename CameraView>
+    double operator()(const CameraView& cam) const
+    {
+        const Matrix3d R_cr = T_cr.rotationMatrix();
+        double sse = 0;
+        for (size_t i = 0; i < pts2d.size(); ++i) {
+            const int ti = map2d_3d[i];
+            if (ti < 0) continue;
+            const Vector3d X_r = T_rw * pts3d[ti];
+            const Vector3d X = T_cr * X_r;
+            const Vector2d r = cam.Project(X) - pts2d[i];
+            sse += r.squaredNorm();
+
+            Matrix<double, 3, 6> dX;
+            dX.leftCols<3>() = R_cr;
+            dX.rightCols<3>() = -R_cr * Sophus::SO3d::hat(X_r);
+            const Matrix<double, 2, 6> J = cam.dProject_dray(X) * dX;
+            JtJ += J.transpose() * J;
+            Jtr += J.transpose() * r;
+        }
+        return sse;
+    }
+
+    const Sophus::SE3d& T_rw;
+    const Sophus::SE3d& T_cr;
+    const std::vector<Vector3d, aligned_allocator<Vector3d> >& pts3d;
+    const std::vector<Vector2d, aligned_allocator<Vector2d> >& pts2d;
+    const vector<int>& map2d_3d;
+    Matrix<double, 6, 6>& JtJ;
+    Matrix<double, 6, 1>& Jtr;
+};
+
+// Sum of squared errors and normal equations over all views at T_rw
+double RigNormalEquations(const RigView* views, size_t num_views,
+                          const std::vector<Vector3d, aligned_allocator<Vector3d> >& ideal_pts,
+                          const Sophus::SE3d& T_rw,
+                          Matrix<double, 6, 6>& JtJ, Matrix<double, 6, 1>& Jtr)
+{
+    JtJ.setZero();
+    Jtr.setZero();
+    double sse = 0;
+    for (size_t v = 0; v < num_views; ++v) {
+        const RigView& view = views[v];
+        sse += CameraHandle<double>(view.cam).Visit(ReprojectionNormalEquations{
+                T_rw, view.T_cr, ideal_pts, *view.img_pts, *view.map2d_3d, JtJ, Jtr});
+    }
+    return sse;
+}
+
+}
+
+int PoseP3P(const Vector3d f_c[3], const Vector3d P_w[3], Sophus::SE3d T_cw[4])
+{
+    const double a2 = (P_w[1] - P_w[2]).squaredNorm();
+    const double b2 = (P_w[0] - P_w[2]).squaredNorm();
+    const double c2 = (P_w[0] - P_w[1]).squaredNorm();
+    if (b2 == 0) {
+        return 0;
+    }
+    const Vector3d f[3] = { f_c[0].normalized(), f_c[1].normalized(), f_c[2].normalized() };
+    const double ca = f[1].dot(f[2]);
+    const double cb = f[0].dot(f[2]);
+    const double cg = f[0].dot(f[1]);
+    const double A = a2 / b2;
+    const double C = c2 / b2;
+
+    // With distances s1, s2 = u s1 and s3 = v s1 along the bearings,
+    // u = N(v) / D(v), and the quartic in v is
+    //   N^2 - 2 cos(gamma) N D + (1 - C (1 + v^2 - 2 v cos(beta))) D^2 = 0
+    const Vector3d N((A - C) + 1, -2 * (A - C) * cb, (A - C) - 1);
+    const Vector2d D(2 * cg, -2 * ca);
+    const Vector3d Q(1 - C, 2 * C * cb, -C);
+    const Matrix<double, 5, 1> quartic = PolyMul<3, 3>(N, N)
+            - 2 * cg * PolyMul<3, 3>(N, Vector3d(D[0], D[1], 0))
+            + PolyMul<3, 3>(Q, PolyMul<2, 2>(D, D));
+
+    double roots[4];
+    const int num_roots = QuarticRealRoots(quartic, roots);
+
+    int n = 0;
+    for (int r = 0; r < num_roots; ++r) {
+        const double v = roots[r];
+        const double d = D[0] + D[1] * v;
+        const double s1_2 = 1 + v * v - 2 * v * cb;
+        if (v <= 0 || d == 0 || s1_2 <= 0) {
+            continue;
+        }
+        const double u = (N[0] + N[1] * v + N[2] * v * v) / d;
+        if (u <= 0) {
+            continue;
+        }
+        const double s1 = std::sqrt(b2 / s1_2);
+        const Vector3d X_c[3] = { s1 * f[0], u * s1 * f[1], v * s1 * f[2] };
+        T_cw[n++] = AlignPoints(P_w, X_c, 3);
+    }
+    return n;
+}
+
+namespace {
+
+// RefineRigPoseReprojection over num_views views, which needn't be in a vector
+double RefineRigPose(
+    const RigView* views, size_t num_views,
+    const std::vector<Vector3d, aligned_allocator<Vector3d> >& ideal_pts,
+    int max_iterations,
+    Sophus::SE3d* T_rw)
+{
+    int n = 0;
+    for (size_t v = 0; v < num_views; ++v) {
+        const vector<int>& map2d_3d = *views[v].map2d_3d;
+        for (size_t i = 0; i < map2d_3d.size(); ++i) {
+            n += map2d_3d[i] >= 0 ? 1 : 0;
+        }
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    Matrix<double, 6, 6> JtJ;
+    Matrix<double, 6, 1> Jtr;
+    double sse = RigNormalEquations(views, num_views, ideal_pts, *T_rw, JtJ, Jtr);
+    for (int it = 0; it < max_iterations; ++it) {
+        const Matrix<double, 6, 1> delta = -JtJ.ldlt().solve(Jtr);
+        if (!delta.allFinite()) {
+            break;
+        }
+        const Sophus::SO3d dR = Sophus::SO3d::exp(delta.tail<3>());
+        const Sophus::SE3d T_new(dR * T_rw->so3(), dR * T_rw->translation() + delta.head<3>());
+
+        Matrix<double, 6, 6> JtJ_new;
+        Matrix<double, 6, 1> Jtr_new;
+        const double sse_new = RigNormalEquations(views, num_views, ideal_pts, T_new, JtJ_new, Jtr_new);
+        if (!(sse_new < sse)) {
+            break;
+        }
+        const bool converged = sse - sse_new < 1e-12 * sse;
+        *T_rw = T_new;
+        sse = sse_new;
+        JtJ = JtJ_new;
+        Jtr = Jtr_new;
+        if (converged) {
+            break;
+        }
+    }
+    return std::sqrt(sse / n);
+}
+
+}
+
+double RefineRigPoseReprojection(
+    const vector<RigView, aligned_allocator<RigView> >& views,
+    const std::vector<Vector3d, aligned_allocator<Vector3d> >& ideal_pts,
+    int max_iterations,
+    Sophus::SE3d* T_rw)
+{
+    return views.empty() ? 0 :
+        RefineRigPose(&views[0], views.size(), ideal_pts, max_iterations, T_rw);
+}
+
+double RefinePoseReprojection(
+    const std::shared_ptr<CameraInterface<double>> cam,
+    const std::vector<Vector2d, aligned_allocator<Vector2d> >& img_pts,
+    const std::vector<Vector3d, aligned_allocator<Vector3d> >& ideal_pts,
+    const vector<int>& map2d_3d,
+    int max_iterations,
+    Sophus::SE3d* T_cw)
+{
+    // A rig of one camera at its origin
+    RigView view;
+    view.cam = cam;
+    view.img_pts = &img_pts;
+    view.map2d_3d = &map2d_3d;
+    return RefineRigPose(&view, 1, ideal_pts, max_iterations, T_cw);
+}
+
+vector<int> PoseBearingPnPRansac(
+    const std::shared_ptr<CameraInterface<double>> cam,
+    const std::vector<Vector2d, aligned_allocator<Vector2d> >& img_pts,
+    const std::vector<Vector3d, aligned_allocator<Vector3d> >& ideal_pts,
+    const vector<int> & candidate_map,
+    int robust_3pt_its,
+    float robust_3pt_tol,
+    Sophus::SE3d * T)
+{
+    vector<int> inlier_map;
+    BearingPnpWorkspace workspace;
+    PoseBearingPnPRansac(cam, img_pts, ideal_pts, candidate_map, robust_3pt_its,
+                         robust_3pt_tol, T, inlier_map, workspace);
+    return inlier_map;
+}
+
+void PoseBearingPnPRansac(
+    const std::shared_ptr<CameraInterface<double>> cam,
+    const std::vector<Vector2d, aligned_allocator<Vector2d> >& img_pts,
+    const std::vector<Vector3d, aligned_allocator<Vector3d> >& ideal_pts,
+    const vector<int> & candidate_map,
+    int robust_3pt_its,
+    float robust_3pt_tol,
+    Sophus::SE3d * T,
+    vector<int>& inlier_map,
+    BearingPnpWorkspace& workspace)
+{
+    inlier_map.assign(candidate_map.size(), -1);
+
+    BearingData& data = workspace.data;
+    std::vector<int>& idx_vec = workspace.idx;
+    data.f_c.clear();
+    data.P_w.clear();
+    idx_vec.clear();
+    for (size_t i = 0; i < img_pts.size(); ++i) {
+        const int ideal_point_id = candidate_map[i];
+        if (ideal_point_id >= 0) {
+            data.f_c.push_back(cam->Unproject(img_pts[i]).normalized());
+            data.P_w.push_back(ideal_pts[ideal_point_id]);
+            idx_vec.push_back(i);
+        }
+    }
+    if (data.f_c.size() < 4) {
+        return;
+    }
+
+    // Pixel tolerance as an angle, through the focal length
+    const double angle_tol = robust_3pt_tol / cam->K()(0, 0);
+
+    std::vector<int>& inliers = workspace.inliers;
+    inliers.clear();
+    Sophus::SE3d T_cw;
+    if (robust_3pt_its > 0) {
+        ParamsRansac params;
+        params.max_iterations = robust_3pt_its;
+        params.max_datum_fit_error = angle_tol;
+        params.min_consensus_size = data.f_c.size() / 2;
+        const BearingData* d = &data;
+        if (!workspace.ransac.Compute(data.f_c.size(),
+                [d](const std::vector<int>& set, Sophus::SE3d& T) {
+                    return BearingModel(set, d, T);
+                },
+                [d](const Sophus::SE3d& T, int i) {
+                    return BearingCost(T, i, d);
+                }, params, T_cw, inliers)) {
+            return;
+        }
+    }else{
+        for (size_t k = 0; k < data.f_c.size(); ++k) {
+            inliers.push_back(k);
+        }
+        if (!BearingModel(inliers, &data, T_cw)) {
+            return;
+        }
+    }
+
+    std::vector<int>& refine_map = workspace.refine_map;
+    refine_map.assign(candidate_map.size(), -1);
+    for (size_t k = 0; k < inliers.size(); ++k) {
+        refine_map[idx_vec[inliers[k]]] = candidate_map[idx_vec[inliers[k]]];
+    }
+    RefinePoseReprojection(cam, img_pts, ideal_pts, refine_map, 10, &T_cw);
+    if (!T_cw.translation().allFinite()) {
+        return;
+    }
+
+    inlier_map = refine_map;
+    *T = T_cw;
+}
+
+}
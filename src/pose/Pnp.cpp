@@ -20,6 +20,7 @@
  */
 
 #include <calibu/pose/Pnp.h>
+#include <calibu/cam/camera_handle.h>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core.hpp>
@@ -38,7 +39,22 @@ vector<int> PosePnPRansac(
     int robust_3pt_its,
     float robust_3pt_tol,
     Sophus::SE3d * T) {
-    vector<int> inlier_map(candidate_map.size(), -1);
+    vector<int> inlier_map;
+    PosePnPRansac(cam, img_pts, ideal_pts, candidate_map, robust_3pt_its,
+                  robust_3pt_tol, T, inlier_map);
+    return inlier_map;
+}
+
+void PosePnPRansac(
+    const std::shared_ptr<CameraInterface<double>> cam,
+    const std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> >& img_pts,
+    const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& ideal_pts,
+    const vector<int> & candidate_map,
+    int robust_3pt_its,
+    float robust_3pt_tol,
+    Sophus::SE3d * T,
+    vector<int>& inlier_map) {
+    inlier_map.assign(candidate_map.size(), -1);
     std::vector<cv::Point3f> cv_obj;
     std::vector<cv::Point2f> cv_img;
     std::vector<int> idx_vec;
@@ -71,7 +87,7 @@ vector<int> PosePnPRansac(
     std::vector<int> cv_inliers;
 
     if(cv_img.size() < 4)
-        return cv_inliers;
+        return;
 
     if(robust_3pt_its > 0) {
         cv::solvePnPRansac(cv_obj, cv_img, cv_K, cv_coeff, cv_rot, cv_trans,
@@ -85,7 +101,7 @@ vector<int> PosePnPRansac(
     cv::cv2eigen(cv_trans, trans);
 
     if(std::isnan(rot[0]) || std::isnan(rot[1]) || std::isnan(rot[2]))
-        return inlier_map;
+        return;
 
     for (size_t i = 0; i<cv_inliers.size(); ++i)
     {
@@ -94,7 +110,6 @@ vector<int> PosePnPRansac(
     }
 
     *T =  Sophus::SE3d(Sophus::SO3d::exp(rot), trans);
-    return inlier_map;
 }
 
 int CountInliers(const vector<int> & conics_target_map)
@@ -110,6 +125,38 @@ int CountInliers(const vector<int> & conics_target_map)
     return inliers;
 }
 
+namespace {
+
+// Sum of squared reprojection errors, instantiated per camera model
+struct ReprojectionSSE {
+    template<typename CameraView>
+    double operator()(const CameraView& cam) const
+    {
+        double sse = 0;
+        for( unsigned i=0; i<pts2d.size(); ++i )
+        {
+            const int ti = map2d_3d[i];
+            if( ti >= 0 )
+            {
+                const Vector2d t = cam.Project(T_cw * pts3d[ti]);
+                sse += (t - pts2d[i].head<2>()).squaredNorm();
+                ++n;
+            }
+        }
+        return sse;
+    }
+
+    const Sophus::SE3d& T_cw;
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d> >& pts3d;
+    const std::vector<Eigen::Vector2d,
+                      Eigen::aligned_allocator<Eigen::Vector2d> >& pts2d;
+    const vector<int>& map2d_3d;
+    int& n;
+};
+
+}
+
 double ReprojectionErrorRMS(const std::shared_ptr<CameraInterface<double>> cam,
                             const Sophus::SE3d& T_cw,
                             const std::vector<Eigen::Vector3d,
@@ -119,18 +166,8 @@ double ReprojectionErrorRMS(const std::shared_ptr<CameraInterface<double>> cam,
                             const vector<int>& map2d_3d)
 {
     int n=0;
-    double sse =0;
-    for( unsigned i=0; i<pts2d.size(); ++i )
-    {
-        const int ti = map2d_3d[i];
-        if( ti >= 0 )
-        {
-            const Vector2d t = cam->Project(T_cw * pts3d[ti]);
-            Vector2d err = t - pts2d[i].head<2>();
-            sse += (err).squaredNorm();
-            ++n;
-        }
-    }
+    const double sse = CameraHandle<double>(cam).Visit(
+                ReprojectionSSE{T_cw, pts3d, pts2d, map2d_3d, n});
     return sqrt(sse / n);
 }
 
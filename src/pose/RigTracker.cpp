@@ -0,0 +1,129 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <calibu/pose/RigTracker.h>
+#include <calibu/pose/Pnp.h>
+#include <calibu/utils/Trace.h>
+
+#include <cmath>
+#include <stdexcept>
+
+namespace calibu {
+
+namespace {
+
+// Target of the first camera, once targets is checked to hold one target
+// per camera of rig, so that the initialiser list never reads past it
+TargetInterface& FirstTarget(const std::vector<TargetInterface*>& targets,
+                             const Rig<double>& rig)
+{
+    if( targets.empty() || targets.size() != rig.cameras_.size() ) {
+        throw std::invalid_argument("RigTracker needs one target per camera");
+    }
+    for( TargetInterface* t : targets ) {
+        if( !t ) {
+            throw std::invalid_argument("RigTracker target is null");
+        }
+    }
+    return *targets[0];
+}
+
+}
+
+RigTracker::RigTracker(const std::vector<TargetInterface*>& targets,
+                       const Rig<double>& rig)
+    : cameras(rig.cameras_), tracked(rig.cameras_.size(), 0),
+      views(rig.cameras_.size()), target(FirstTarget(targets, rig)),
+      rms(0), joint(false)
+{
+    for( size_t c=0; c < cameras.size(); ++c ) {
+        trackers.emplace_back(new Tracker(*targets[c], cameras[c]->Width(),
+                                          cameras[c]->Height()));
+        views[c].cam = cameras[c];
+        views[c].T_cr = cameras[c]->Pose().inverse();
+    }
+    tracked_views.reserve(cameras.size());
+}
+
+bool RigTracker::ProcessFrames(const std::vector<const unsigned char*>& images,
+                               size_t w, size_t h, size_t pitch)
+{
+    CALIBU_TRACE("RigTracker::ProcessFrames");
+    joint = false;
+    const size_t n = std::min(images.size(), cameras.size());
+    std::fill(tracked.begin(), tracked.end(), 0);
+
+    // Cameras are independent until the joint solve
+    ParallelFor(n, params.num_threads > 0 ? params.num_threads : (int)n,
+                [&](size_t c) {
+        CALIBU_TRACE_CONTEXT(-1, (int)c);
+        tracked[c] = trackers[c]->ProcessFrame(cameras[c], images[c], w, h, pitch);
+    });
+
+    // Start from the camera with most inliers
+    int best = -1;
+    int best_inliers = 0;
+    size_t num_tracked = 0;
+    for( size_t c=0; c < n; ++c ) {
+        if( !tracked[c] ) continue;
+        ++num_tracked;
+        const int inliers = CountInliers(trackers[c]->ConicsTargetMap());
+        if( best < 0 || inliers > best_inliers ) {
+            best = c;
+            best_inliers = inliers;
+        }
+    }
+    if( best < 0 ) {
+        return false;
+    }
+
+    const Sophus::SE3d T_rw_best = views[best].T_cr.inverse() * trackers[best]->PoseT_gw();
+    const double rms_best = ReprojectionErrorRMS(
+            cameras[best], trackers[best]->PoseT_gw(), target.Circles3D(),
+            trackers[best]->ConicCenters(), trackers[best]->ConicsTargetMap());
+
+    if( num_tracked > 1 ) {
+        tracked_views.clear();
+        for( size_t c=0; c < n; ++c ) {
+            if( !tracked[c] ) continue;
+            RigView view = views[c];
+            view.img_pts = &trackers[c]->ConicCenters();
+            view.map2d_3d = &trackers[c]->ConicsTargetMap();
+            tracked_views.push_back(view);
+        }
+
+        Sophus::SE3d T = T_rw_best;
+        const double joint_rms = RefineRigPoseReprojection(
+                tracked_views, target.Circles3D(), params.refine_its, &T);
+        if( std::isfinite(joint_rms) && joint_rms < params.max_rms ) {
+            T_rw = T;
+            rms = joint_rms;
+            joint = true;
+            return true;
+        }
+    }
+
+    // A single camera, or views which disagree with the extrinsics
+    T_rw = T_rw_best;
+    rms = rms_best;
+    return true;
+}
+
+}
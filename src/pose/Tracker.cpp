@@ -20,9 +20,12 @@
  */
 
 #include <calibu/pose/Tracker.h>
+#include <calibu/pose/BearingPnp.h>
 #include <calibu/pose/Pnp.h>
 #include <calibu/image/ImageProcessing.h>
+#include <calibu/utils/Trace.h>
 
+#include <algorithm>
 #include <iostream>
 
 using namespace std;
@@ -31,42 +34,225 @@ using namespace Eigen;
 namespace calibu {
 
 Tracker::Tracker(TargetInterface& target, int w, int h)
-    : target(target), imgs(w,h),
-      last_good(0), good_frames(0)
+    : target(target), imgs(w,h), idcam(new LinearCamera<double>()),
+      last_good(0), good_frames(0), have_roi(false)
 {
 
 }
 
+namespace {
+
+// Grow the capacity of scratch buffer v to n, counting reallocations
+template<typename V>
+void ReserveScratch(V& v, size_t n, TrackerStats& stats)
+{
+    (void)stats;  // Unused without BUILD_STATS
+    if( v.capacity() < n ) {
+        v.reserve(n);
+        CALIBU_STATS(++stats.num_allocations);
+    }
+}
+
+// Associate each conic with the target point projected nearest to it by
+// T_cw, if within gate times the conic's radius. A conic nearest to more
+// than one point, or a point nearest to a conic already taken, is ambiguous
+// and left unassociated. index is rebuilt over the conic centres.
+void AssociatePredicted(
+    const std::shared_ptr<CameraInterface<double>>& cam,
+    const Sophus::SE3d& T_cw,
+    const vector<Vector3d, aligned_allocator<Vector3d> >& pts3d,
+    const ConicSet& conics, double gate,
+    PointIndex& index, std::vector<int>& conics_target_map)
+{
+    const int AMBIGUOUS = -2;
+    const Span<Vector2d> centers = conics.Centers();
+    const Span<double> radii = conics.Radii();
+    conics_target_map.assign(centers.size(), -1);
+    if( centers.empty() ) return;
+
+    // The nearest centre passes the gate only if it is within the gate of
+    // the largest conic
+    index.Build(centers.size(), [&centers](size_t i) { return centers[i]; });
+    const double max_radius = *std::max_element(radii.begin(), radii.end());
+
+    for( size_t t=0; t < pts3d.size(); ++t ) {
+        const Vector3d p_c = T_cw * pts3d[t];
+        if( p_c[2] <= 0 ) continue;
+        const Vector2d p = cam->Project(p_c);
+
+        const int best = index.Nearest(p, gate * max_radius);
+        if( best >= 0 &&
+            (centers[best] - p).squaredNorm() <= gate*gate * radii[best]*radii[best] ) {
+            int& m = conics_target_map[best];
+            m = (m == -1) ? (int)t : AMBIGUOUS;
+        }
+    }
+
+    for( size_t i=0; i < conics_target_map.size(); ++i ) {
+        if( conics_target_map[i] == AMBIGUOUS ) conics_target_map[i] = -1;
+    }
+}
+
+}
+
 bool Tracker::ProcessFrame(
     std::shared_ptr<CameraInterface<double>> cam,
     const unsigned char* I, size_t w, size_t h, size_t pitch)
+{
+    CALIBU_TRACE("Tracker::ProcessFrame");
+    CALIBU_STATS(stats.Reset());
+    CALIBU_STATS_TIME(stats.total);
+
+    // Look near the last good target first, then over the whole frame
+    if( params.use_roi && have_roi && Detect(cam, I, w, h, pitch, &roi) ) {
+        return true;
+    }
+    have_roi = false;
+    if( Detect(cam, I, w, h, pitch, NULL) ) {
+        return true;
+    }
+    good_frames = 0;
+    return false;
+}
+
+void Tracker::SetGoodPose(const Sophus::SE3d& T)
+{
+    T_prev_gw = T_gw;
+    T_gw = T;
+    last_good = std::clock();
+    ++good_frames;
+    UpdateRoi();
+}
+
+bool Tracker::TrackPredicted(std::shared_ptr<CameraInterface<double>> cam)
+{
+    // Constant velocity, in camera frame, from the last two good poses
+    T_hw = good_frames > 1 ? T_gw * T_prev_gw.inverse() * T_gw : T_gw;
+
+    const ConicSet::CenterVector& ellipses = conic_finder.Columns().center;
+    const vector<Vector3d, aligned_allocator<Vector3d> >& pts3d =
+        target.Circles3D();
+    {
+        CALIBU_STATS_TIME(stats.find_target);
+        AssociatePredicted(cam, T_hw, pts3d, conic_finder.Columns(),
+                           params.prediction_gate, conic_index, conics_target_map);
+    }
+    if( CountInliers(conics_target_map) < params.inlier_num_required ) {
+        return false;
+    }
+
+    double rms = 0;
+    {
+        CALIBU_STATS_TIME(stats.pnp);
+        RefinePoseReprojection(cam, ellipses, pts3d, conics_target_map,
+                               params.prediction_its, &T_hw);
+
+        // Drop associations the refined pose doesn't explain, as RANSAC would
+        for( size_t i=0; i < conics_target_map.size(); ++i ) {
+            const int t = conics_target_map[i];
+            if( t >= 0 && (cam->Project(T_hw * pts3d[t]) - ellipses[i]).norm()
+                    > params.robust_3pt_inlier_tol ) {
+                conics_target_map[i] = -1;
+            }
+        }
+        rms = ReprojectionErrorRMS(cam, T_hw, pts3d, ellipses, conics_target_map);
+    }
+
+    const int inliers = CountInliers(conics_target_map);
+    if( isfinite(rms) && rms < params.max_rms && inliers >= params.inlier_num_required ) {
+        CALIBU_STATS(stats.num_inliers = inliers);
+        CALIBU_STATS(stats.predicted = 1);
+        SetGoodPose(T_hw);
+        return true;
+    }
+    return false;
+}
+
+void Tracker::RobustPose(std::shared_ptr<CameraInterface<double>> cam,
+                         const std::vector<int>& candidate_map)
+{
+    const ConicSet::CenterVector& ellipses = conic_finder.Columns().center;
+    if( params.bearing_pnp ) {
+        PoseBearingPnPRansac(cam, ellipses, target.Circles3D(), candidate_map,
+                             params.robust_3pt_its, params.robust_3pt_inlier_tol,
+                             &T_hw, conics_target_map, pnp_workspace);
+    }else{
+        PosePnPRansac(cam, ellipses, target.Circles3D(), candidate_map,
+                      params.robust_3pt_its, params.robust_3pt_inlier_tol,
+                      &T_hw, conics_target_map);
+    }
+}
+
+void Tracker::UpdateRoi()
+{
+    const Span<IRectangle> bboxes = conic_finder.Columns().BBoxes();
+
+    bool first = true;
+    for( size_t i=0; i < bboxes.size(); ++i ) {
+        if( conics_target_map[i] >= 0 ) {
+            if( first ) {
+                roi = bboxes[i];
+                first = false;
+            }else{
+                roi.Insert(bboxes[i]);
+            }
+        }
+    }
+
+    if( !first ) {
+        const int margin = params.roi_margin * std::max(roi.Width(), roi.Height());
+        roi = roi.Grow(margin);
+        have_roi = true;
+    }
+}
+
+bool Tracker::Detect(
+    std::shared_ptr<CameraInterface<double>> cam,
+    const unsigned char* I, size_t w, size_t h, size_t pitch,
+    const IRectangle* region)
 {
     double rms = 0;
+    CALIBU_STATS(++stats.num_attempts);
 
-    imgs.Process(I, w, h, pitch );
-    conic_finder.Find(imgs);
+    {
+        CALIBU_STATS_TIME(stats.detect);
+        if( region ) {
+            imgs.Process(I, w, h, pitch, *region );
+        }else{
+            imgs.Process(I, w, h, pitch );
+        }
+        conic_finder.Find(imgs);
+    }
 
     const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics =
         conic_finder.Conics();
+    const ConicSet::CenterVector& ellipses = conic_finder.Columns().center;
 
-    // Generate map and point structures
-    conics_target_map.clear();
-    conics_target_map.resize(conics.size(),-1);
-    vector<Vector2d, aligned_allocator<Vector2d> > ellipses;
-    for( size_t i=0; i < conics.size(); ++i ) {
-        ellipses.push_back(Vector2d(conics[i].center.x(),conics[i].center.y()));
+    // Generate map structures, in buffers kept across frames
+    ReserveScratch(conics_target_map, conics.size(), stats);
+    ReserveScratch(conics_candidate_map_first_pass, conics.size(), stats);
+    ReserveScratch(conics_candidate_map_second_pass, conics.size(), stats);
+    ReserveScratch(conics_camframe, conics.size(), stats);
+
+    conics_target_map.assign(conics.size(), -1);
+
+    if( params.motion_prediction && good_frames > 0 &&
+            TrackPredicted(cam) ) {
+        return true;
     }
+    conics_target_map.assign(conics.size(), -1);
 
     // Undistort Conics
-    vector<Conic, Eigen::aligned_allocator<Conic> > conics_camframe;
-    for( unsigned int i=0; i<conics.size(); ++i ) {
-        conics_camframe.push_back(UnmapConic(conics[i],cam));
+    {
+        CALIBU_STATS_TIME(stats.unmap);
+        UnmapConics(conics, cam, conics_camframe, unmap_workspace);
     }
 
-    // Find target given (approximately) undistorted conics
-    std::shared_ptr<CameraInterface<double>> idcam(new LinearCamera<double>());
-
-    target.FindTarget( idcam, imgs, conics_camframe, conics_target_map );
+    // Find target given (approximately) undistorted conics, through idcam
+    {
+        CALIBU_STATS_TIME(stats.find_target);
+        target.FindTarget( idcam, imgs, conics_camframe, conics_target_map );
+    }
     conics_candidate_map_first_pass = conics_target_map;
     int inliers = CountInliers(conics_candidate_map_first_pass);
     if (inliers<params.inlier_num_required) {
@@ -74,13 +260,17 @@ bool Tracker::ProcessFrame(
       return false;
     }
 
-    conics_target_map = PosePnPRansac( cam, ellipses, target.Circles3D(),
-            conics_candidate_map_first_pass, params.robust_3pt_its,
-            params.robust_3pt_inlier_tol, &T_hw );
+    {
+        CALIBU_STATS_TIME(stats.pnp);
+        RobustPose(cam, conics_candidate_map_first_pass);
 
-    rms = ReprojectionErrorRMS(cam, T_hw, target.Circles3D(), ellipses,
-                               conics_target_map);
-    target.FindTarget( T_hw, cam, imgs, conics, conics_target_map);
+        rms = ReprojectionErrorRMS(cam, T_hw, target.Circles3D(), ellipses,
+                                   conics_target_map);
+    }
+    {
+        CALIBU_STATS_TIME(stats.find_target);
+        target.FindTarget( T_hw, cam, imgs, conics, conics_target_map);
+    }
 
     conics_candidate_map_second_pass = conics_target_map;
 
@@ -91,18 +281,20 @@ bool Tracker::ProcessFrame(
         return false;
     }
 
-    conics_target_map = PosePnPRansac( cam, ellipses, target.Circles3D(),
-            conics_candidate_map_second_pass, params.robust_3pt_its,
-            params.robust_3pt_inlier_tol, &T_hw );
+    {
+        CALIBU_STATS_TIME(stats.pnp);
+        RobustPose(cam, conics_candidate_map_second_pass);
 
-    rms = ReprojectionErrorRMS(cam, T_hw, target.Circles3D(), ellipses,
-                               conics_target_map);
+        rms = ReprojectionErrorRMS(cam, T_hw, target.Circles3D(), ellipses,
+                                   conics_target_map);
+    }
 
     inliers = CountInliers(conics_target_map);
+    CALIBU_STATS(stats.num_inliers = inliers);
 
     if( isfinite((double)rms) && rms < params.max_rms
             &&  inliers>=params.inlier_num_required) {
-        T_gw = T_hw;
+        SetGoodPose(T_hw);
         return true;
     }
     printf("Failed:     if( isfinite((double)rms) && rms < params.max_rms &&  inliers>=params.inlier_num_required) {\n");
@@ -0,0 +1,241 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <calibu/target/Assignment.h>
+
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+namespace calibu
+{
+
+// Cost for leaving a row unassigned when the most rows possible must be
+// assigned: more than any set of real pairings could cost.
+template<typename It, typename CostFn>
+static double ForcedAssignmentCost(It begin, It end, CostFn cost)
+{
+    double sum = 1.0;
+    for(It it = begin; it != end; ++it) sum += std::abs(cost(*it));
+    return 2.0 * sum;
+}
+
+AssignmentSolver::AssignmentSolver()
+{
+}
+
+double AssignmentSolver::Solve(const Eigen::MatrixXd& cost, std::vector<int>& row_to_col)
+{
+    const int rows = cost.rows();
+    const int cols = cost.cols();
+
+    // With more rows than columns, some must go to a dummy column
+    const bool dummies = rows > cols;
+    const int stride = dummies ? cols + 1 : cols;
+    const double dummy_cost = dummies ?
+                ForcedAssignmentCost(cost.data(), cost.data() + cost.size(),
+                                     [](double c) { return c; }) : 0.0;
+
+    row_start_.resize(rows+1);
+    edge_col_.resize(rows*stride);
+    edge_cost_.resize(rows*stride);
+    for(int i=0; i < rows; ++i) {
+        row_start_[i] = i*stride;
+        for(int j=0; j < cols; ++j) {
+            edge_col_[i*stride + j] = j;
+            edge_cost_[i*stride + j] = cost(i,j);
+        }
+        if(dummies) {
+            edge_col_[i*stride + cols] = cols + i;
+            edge_cost_[i*stride + cols] = dummy_cost;
+        }
+    }
+    row_start_[rows] = rows*stride;
+
+    const double total = SolveCsr(rows, dummies ? cols + rows : cols, row_to_col);
+    return dummies ? RemoveDummies(cols, row_to_col) : total;
+}
+
+double AssignmentSolver::RemoveDummies(int cols, std::vector<int>& row_to_col)
+{
+    // Summed over the real pairs, rather than subtracted from a total that
+    // the much larger dummy costs would round
+    double total = 0;
+    for(size_t i=0; i < row_to_col.size(); ++i) {
+        if(row_to_col[i] >= cols) {
+            row_to_col[i] = -1;
+        }else if(row_to_col[i] >= 0) {
+            total += row_cost_[i];
+        }
+    }
+    return total;
+}
+
+double AssignmentSolver::Solve(int rows, int cols, const std::vector<AssignmentEdge>& edges,
+                               std::vector<int>& row_to_col, double unassigned_cost)
+{
+    // Per row dummy column standing for 'unassigned'. Without an explicit
+    // cost, it is priced so that as many rows as possible are assigned.
+    const double dummy_cost = unassigned_cost < std::numeric_limits<double>::infinity() ?
+                unassigned_cost :
+                ForcedAssignmentCost(edges.begin(), edges.end(),
+                                     [](const AssignmentEdge& e) { return e.cost; });
+
+    // Bucket edges by row
+    row_start_.assign(rows+1, 0);
+    for(const AssignmentEdge& e : edges) {
+        if(0 <= e.row && e.row < rows && 0 <= e.col && e.col < cols) ++row_start_[e.row+1];
+    }
+    for(int i=0; i < rows; ++i) ++row_start_[i+1];
+    for(int i=0; i < rows; ++i) row_start_[i+1] += row_start_[i];
+
+    edge_col_.resize(row_start_[rows]);
+    edge_cost_.resize(row_start_[rows]);
+    ready_.assign(row_start_.begin(), row_start_.end()-1);
+    for(const AssignmentEdge& e : edges) {
+        if(0 <= e.row && e.row < rows && 0 <= e.col && e.col < cols) {
+            const int k = ready_[e.row]++;
+            edge_col_[k] = e.col;
+            edge_cost_[k] = e.cost;
+        }
+    }
+    for(int i=0; i < rows; ++i) {
+        const int k = ready_[i]++;
+        edge_col_[k] = cols + i;
+        edge_cost_[k] = dummy_cost;
+    }
+
+    SolveCsr(rows, cols + rows, row_to_col);
+    return RemoveDummies(cols, row_to_col);
+}
+
+double AssignmentSolver::SolveCsr(int rows, int cols, std::vector<int>& row_to_col)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+
+    row_to_col.assign(rows, -1);
+    col_to_row_.assign(cols, -1);
+    v_.assign(cols, 0.0);
+    dist_.assign(cols, inf);
+    pred_.assign(cols, -1);
+    done_.assign(cols, 0);
+
+    // Cost of the edge matching each row, giving its implied dual value
+    row_cost_.assign(rows, 0.0);
+    pred_cost_.assign(cols, 0.0);
+
+    const std::greater<std::pair<double,int> > heap_order;
+
+    for(int s=0; s < rows; ++s)
+    {
+        // Dijkstra over columns using reduced costs c(i,j) - v[j] - u[i]
+        ready_.clear();
+        heap_.clear();
+        for(int k=row_start_[s]; k < row_start_[s+1]; ++k) {
+            const int j = edge_col_[k];
+            const double d = edge_cost_[k] - v_[j];
+            if(d < dist_[j]) {
+                dist_[j] = d;
+                pred_[j] = s;
+                pred_cost_[j] = edge_cost_[k];
+                heap_.push_back(std::make_pair(d,j));
+                std::push_heap(heap_.begin(), heap_.end(), heap_order);
+            }
+        }
+
+        int sink = -1;
+        double min_dist = inf;
+        while(!heap_.empty()) {
+            std::pop_heap(heap_.begin(), heap_.end(), heap_order);
+            const double d = heap_.back().first;
+            const int j = heap_.back().second;
+            heap_.pop_back();
+            if(done_[j] || d > dist_[j]) continue;
+
+            done_[j] = 1;
+            ready_.push_back(j);
+
+            const int i = col_to_row_[j];
+            if(i < 0) {
+                sink = j;
+                min_dist = d;
+                break;
+            }
+
+            // Continue along the matched row i, whose dual is tight on j
+            const double h = row_cost_[i] - v_[j] - d;
+            for(int k=row_start_[i]; k < row_start_[i+1]; ++k) {
+                const int jn = edge_col_[k];
+                if(done_[jn]) continue;
+                const double dn = edge_cost_[k] - v_[jn] - h;
+                if(dn < dist_[jn]) {
+                    dist_[jn] = dn;
+                    pred_[jn] = i;
+                    pred_cost_[jn] = edge_cost_[k];
+                    heap_.push_back(std::make_pair(dn,jn));
+                    std::push_heap(heap_.begin(), heap_.end(), heap_order);
+                }
+            }
+        }
+
+        if(sink >= 0) {
+            // Update column duals so that the augmenting path is tight
+            for(int j : ready_) {
+                v_[j] += dist_[j] - min_dist;
+            }
+
+            // Augment along the path back to s
+            int j = sink;
+            while(true) {
+                const int i = pred_[j];
+                col_to_row_[j] = i;
+                row_cost_[i] = pred_cost_[j];
+                std::swap(row_to_col[i], j);
+                if(i == s) break;
+            }
+        }
+
+        // Reset the columns this search touched
+        for(int j : ready_) done_[j] = 0;
+        for(const std::pair<double,int>& h : heap_) dist_[h.second] = inf;
+        for(int j : ready_) dist_[j] = inf;
+    }
+
+    double total = 0;
+    for(int i=0; i < rows; ++i) {
+        if(row_to_col[i] >= 0) total += row_cost_[i];
+    }
+    return total;
+}
+
+double SolveAssignment(const Eigen::MatrixXd& cost, std::vector<int>& row_to_col)
+{
+    AssignmentSolver solver;
+    return solver.Solve(cost, row_to_col);
+}
+
+double SolveAssignment(int rows, int cols, const std::vector<AssignmentEdge>& edges,
+                       std::vector<int>& row_to_col, double unassigned_cost)
+{
+    AssignmentSolver solver;
+    return solver.Solve(rows, cols, edges, row_to_col, unassigned_cost);
+}
+
+}
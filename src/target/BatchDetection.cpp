@@ -0,0 +1,232 @@
+/* 
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <calibu/target/BatchDetection.h>
+#include <calibu/pose/Pnp.h>
+#include <calibu/utils/Trace.h>
+
+namespace calibu {
+
+struct BatchDetector::Pipeline
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Pipeline(int w, int h) : image_processing(w, h), width(w), height(h) {}
+
+    ImageProcessing image_processing;
+    ConicFinder conic_finder;
+    std::unique_ptr<TargetGridDot> target;
+    int width, height;
+
+    std::vector<int> ellipse_target_map;
+};
+
+BatchDetector::BatchDetector(
+        const std::vector<std::shared_ptr<CameraInterface<double>>>& cameras,
+        const std::function<std::unique_ptr<TargetGridDot>()>& make_target,
+        const ParamsBatchDetection& params)
+    : cameras(cameras), make_target(make_target), params(params)
+{
+}
+
+BatchDetector::~BatchDetector()
+{
+}
+
+std::unique_ptr<BatchDetector::Pipeline> BatchDetector::AcquirePipeline()
+{
+    {
+        CALIBU_TRACE_LOCK(lock, pipelines_mutex);
+        if(!pipelines.empty()) {
+            std::unique_ptr<Pipeline> pipeline = std::move(pipelines.back());
+            pipelines.pop_back();
+            return pipeline;
+        }
+    }
+
+    int w = 0, h = 0;
+    for(const std::shared_ptr<CameraInterface<double>>& cam : cameras) {
+        w = std::max(w, (int)cam->Width());
+        h = std::max(h, (int)cam->Height());
+    }
+    std::unique_ptr<Pipeline> pipeline(new Pipeline(w, h));
+    pipeline->target = make_target();
+    return pipeline;
+}
+
+void BatchDetector::ReleasePipeline(std::unique_ptr<Pipeline> pipeline)
+{
+    CALIBU_TRACE_LOCK(lock, pipelines_mutex);
+    pipelines.push_back(std::move(pipeline));
+}
+
+void BatchDetector::Detect(Pipeline& pipeline, size_t camera,
+                           const BatchImage& image,
+                           CameraDetection& detection) const
+{
+    detection.found = false;
+    detection.grid_id.clear();
+    detection.P_w.clear();
+    detection.p_c.clear();
+    if(!image.data || (int)image.width > pipeline.width ||
+       (int)image.height > pipeline.height) {
+        return;
+    }
+
+    pipeline.image_processing.Params() = params.image_processing;
+    pipeline.conic_finder.Params() = params.conic_finder;
+    pipeline.target->Params() = params.grid_dot;
+    pipeline.target->Params().incremental = false;
+
+    pipeline.image_processing.Process(image.data, image.width, image.height, image.pitch);
+    pipeline.conic_finder.Find(pipeline.image_processing);
+
+    const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics =
+            pipeline.conic_finder.Conics();
+    if(!pipeline.target->FindTarget(pipeline.image_processing, conics,
+                                    pipeline.ellipse_target_map)) {
+        return;
+    }
+
+    const ConicSet::CenterVector& centers = pipeline.conic_finder.Columns().center;
+    const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >&
+            circles = pipeline.target->Circles3D();
+    PosePnPRansac(cameras[camera], centers, circles,
+                  pipeline.ellipse_target_map, params.robust_3pt_its,
+                  params.robust_3pt_tol, &detection.T_cw);
+
+    for(size_t i = 0; i < conics.size(); ++i) {
+        const int t = pipeline.ellipse_target_map[i];
+        if(t >= 0) {
+            detection.grid_id.push_back(t);
+            detection.P_w.push_back(circles[t]);
+            detection.p_c.push_back(centers[i]);
+        }
+    }
+    detection.found = true;
+}
+
+size_t BatchDetector::Run(const BatchFrameSource& source,
+                          const BatchFrameSink& sink)
+{
+    const size_t num_cams = cameras.size();
+    const int num_threads = std::max(params.num_threads, 1);
+    const size_t batch = params.frames_per_batch ?
+                params.frames_per_batch : 4 * (size_t)num_threads;
+    const Executor exec = executor ? executor : MakeThreadExecutor(num_threads);
+
+    std::vector<std::vector<BatchImage> > images(batch);
+    std::vector<FrameDetections> detections(batch, FrameDetections(num_cams));
+
+    size_t num_frames = 0;
+    for(bool more = true; more; ) {
+        // Reading is sequential, as for most video sources
+        size_t n = 0;
+        while(n < batch && (more = source(n, images[n]))) {
+            images[n].resize(num_cams, BatchImage{nullptr, 0, 0, 0});
+            ++n;
+        }
+
+        exec(n * num_cams, [&](size_t i) {
+            std::unique_ptr<Pipeline> pipeline = AcquirePipeline();
+            const size_t f = i / num_cams;
+            const size_t c = i % num_cams;
+            CALIBU_TRACE_CONTEXT((int)(num_frames + f), (int)c);
+            CALIBU_TRACE("BatchDetector::Detect");
+            Detect(*pipeline, c, images[f][c], detections[f][c]);
+            ReleasePipeline(std::move(pipeline));
+        });
+
+        for(size_t f = 0; f < n; ++f) {
+            sink(num_frames + f, detections[f]);
+        }
+        num_frames += n;
+    }
+    return num_frames;
+}
+
+void AddDetections(size_t frame, const FrameDetections& detections,
+                   ObservationStore& store)
+{
+    bool has_pose = false;
+    for(size_t c = 0; c < detections.size(); ++c) {
+        const CameraDetection& d = detections[c];
+        if(!d.found) {
+            continue;
+        }
+        for(size_t i = 0; i < d.p_c.size(); ++i) {
+            store.Add(frame, c, d.grid_id[i], d.P_w[i], d.p_c[i]);
+        }
+        if(!has_pose) {
+            store.AddPose(frame, d.T_cw);
+            has_pose = true;
+        }
+    }
+}
+
+size_t ReplayDetections(const ObservationStore& store, const BatchFrameSink& sink)
+{
+    const size_t num_cameras = store.image_sizes.size();
+    FrameDetections detections(num_cameras);
+
+    size_t num_frames = 0;
+    size_t pose = 0;
+    for(size_t begin = 0; begin < store.Size(); ) {
+        const uint32_t frame = store.frame[begin];
+        for(CameraDetection& d : detections) {
+            d.found = false;
+            d.grid_id.clear();
+            d.P_w.clear();
+            d.p_c.clear();
+        }
+
+        size_t end = begin;
+        for(; end < store.Size() && store.frame[end] == frame; ++end) {
+            const size_t c = store.camera[end];
+            if(c >= num_cameras) {
+                continue;
+            }
+            CameraDetection& d = detections[c];
+            d.found = true;
+            d.grid_id.push_back(store.grid_id[end]);
+            d.P_w.push_back(store.Point(end));
+            d.p_c.push_back(store.Pixel(end));
+        }
+
+        // Poses are written in frame order, alongside the observations
+        while(pose < store.NumPoses() && store.pose_frame[pose] < frame) {
+            ++pose;
+        }
+        const Sophus::SE3d T_kw = (pose < store.NumPoses() &&
+                                   store.pose_frame[pose] == frame) ?
+                    store.T_kw[pose] : Sophus::SE3d();
+        for(CameraDetection& d : detections) {
+            d.T_cw = T_kw;
+        }
+
+        sink(frame, detections);
+        ++num_frames;
+        begin = end;
+    }
+    return num_frames;
+}
+
+}
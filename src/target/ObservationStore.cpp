@@ -0,0 +1,273 @@
+/* 
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <calibu/target/ObservationStore.h>
+
+#include <cstring>
+#include <iostream>
+
+namespace calibu {
+
+namespace {
+
+  const char kObsMagic[8] = { 'C','A','L','I','B','O','B','S' };
+  const uint32_t kObsVersion = 1;
+  const uint32_t kObsByteOrder = 0x01020304;
+
+  struct ObsFileHeader
+  {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t num_cameras;
+    unsigned char pad[44];
+  };
+  static_assert(sizeof(ObsFileHeader) == 64, "ObsFileHeader is 64 bytes");
+
+  // Precedes the columns of each chunk
+  struct ObsChunkHeader
+  {
+    uint64_t num_observations;
+    uint64_t num_poses;
+  };
+
+  // Bytes per observation and per pose, over all columns
+  const uint64_t kObservationBytes = sizeof(uint32_t) + sizeof(uint16_t) +
+      sizeof(int32_t) + 5 * sizeof(double);
+  // Poses are stored as quaternion x, y, z, w then translation
+  const int kPoseParams = 7;
+  const uint64_t kPoseBytes = sizeof(uint32_t) + kPoseParams * sizeof(double);
+
+  void PoseToParams( const Sophus::SE3d& T, double* params )
+  {
+    Eigen::Map<Eigen::Vector4d> q( params );
+    Eigen::Map<Eigen::Vector3d> t( params + 4 );
+    q = Eigen::Quaterniond( T.rotationMatrix() ).coeffs();
+    t = T.translation();
+  }
+
+  Sophus::SE3d ParamsToPose( const double* params )
+  {
+    const Eigen::Quaterniond q( params[3], params[0], params[1], params[2] );
+    const Eigen::Vector3d t = Eigen::Map<const Eigen::Vector3d>( params + 4 );
+    return Sophus::SE3d( q.normalized().toRotationMatrix(), t );
+  }
+
+  template<typename T>
+  void WriteColumn( std::ofstream& out, const std::vector<T>& column )
+  {
+    out.write( reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T) );
+  }
+
+  template<typename T>
+  void ReadColumn( std::ifstream& in, std::vector<T>& column, size_t n )
+  {
+    const size_t offset = column.size();
+    column.resize( offset + n );
+    in.read( reinterpret_cast<char*>(column.data() + offset), n * sizeof(T) );
+  }
+
+}
+
+void ObservationStore::Append(const ObservationStore& other)
+{
+    frame.insert(frame.end(), other.frame.begin(), other.frame.end());
+    camera.insert(camera.end(), other.camera.begin(), other.camera.end());
+    grid_id.insert(grid_id.end(), other.grid_id.begin(), other.grid_id.end());
+    P_x.insert(P_x.end(), other.P_x.begin(), other.P_x.end());
+    P_y.insert(P_y.end(), other.P_y.begin(), other.P_y.end());
+    P_z.insert(P_z.end(), other.P_z.begin(), other.P_z.end());
+    u.insert(u.end(), other.u.begin(), other.u.end());
+    v.insert(v.end(), other.v.begin(), other.v.end());
+    pose_frame.insert(pose_frame.end(), other.pose_frame.begin(), other.pose_frame.end());
+    T_kw.insert(T_kw.end(), other.T_kw.begin(), other.T_kw.end());
+}
+
+void ObservationStore::Clear()
+{
+    frame.clear();
+    camera.clear();
+    grid_id.clear();
+    P_x.clear();
+    P_y.clear();
+    P_z.clear();
+    u.clear();
+    v.clear();
+    pose_frame.clear();
+    T_kw.clear();
+}
+
+ObservationWriter::~ObservationWriter()
+{
+    if( out.is_open() ) {
+        Close();
+    }
+}
+
+bool ObservationWriter::Open(const std::string& filename,
+                             const std::vector<Eigen::Vector2i>& image_sizes)
+{
+    this->filename = filename;
+    out.open( filename.c_str(), std::ios::binary | std::ios::trunc );
+
+    ObsFileHeader header;
+    std::memset( &header, 0, sizeof(header) );
+    std::memcpy( header.magic, kObsMagic, sizeof(kObsMagic) );
+    header.version = kObsVersion;
+    header.byte_order = kObsByteOrder;
+    header.num_cameras = image_sizes.size();
+    out.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+    for( const Eigen::Vector2i& size : image_sizes ) {
+        const int32_t wh[2] = { size[0], size[1] };
+        out.write( reinterpret_cast<const char*>(wh), sizeof(wh) );
+    }
+
+    if( !out ) {
+        std::cerr << "Unable to write observations to '" << filename << "'" << std::endl;
+        out.close();
+        return false;
+    }
+    return true;
+}
+
+bool ObservationWriter::Write(const ObservationStore& chunk)
+{
+    if( !out.is_open() ) {
+        return false;
+    }
+
+    ObsChunkHeader header;
+    header.num_observations = chunk.Size();
+    header.num_poses = chunk.NumPoses();
+    if( header.num_observations == 0 && header.num_poses == 0 ) {
+        return true;
+    }
+
+    out.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+    WriteColumn( out, chunk.frame );
+    WriteColumn( out, chunk.camera );
+    WriteColumn( out, chunk.grid_id );
+    WriteColumn( out, chunk.P_x );
+    WriteColumn( out, chunk.P_y );
+    WriteColumn( out, chunk.P_z );
+    WriteColumn( out, chunk.u );
+    WriteColumn( out, chunk.v );
+    WriteColumn( out, chunk.pose_frame );
+    for( const Sophus::SE3d& T : chunk.T_kw ) {
+        double params[kPoseParams];
+        PoseToParams( T, params );
+        out.write( reinterpret_cast<const char*>(params), sizeof(params) );
+    }
+
+    if( !out ) {
+        std::cerr << "Unable to write observations to '" << filename << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ObservationWriter::Close()
+{
+    out.close();
+    if( out.fail() ) {
+        std::cerr << "Unable to write observations to '" << filename << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool LoadObservations(const std::string& filename, ObservationStore& store)
+{
+    store.Clear();
+    store.image_sizes.clear();
+
+    std::ifstream in( filename.c_str(), std::ios::binary | std::ios::ate );
+    if( !in ) {
+        std::cerr << "Unable to open observations '" << filename << "'" << std::endl;
+        return false;
+    }
+    const uint64_t file_size = in.tellg();
+    in.seekg( 0 );
+
+    ObsFileHeader header;
+    in.read( reinterpret_cast<char*>(&header), sizeof(header) );
+    if( !in || std::memcmp( header.magic, kObsMagic, sizeof(kObsMagic) ) != 0 ||
+        header.byte_order != kObsByteOrder ) {
+        std::cerr << "Not an observation file for this host: '" << filename << "'" << std::endl;
+        return false;
+    }
+    if( header.version != kObsVersion ) {
+        std::cerr << "Unsupported observation file version " << header.version
+                  << ": '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    uint64_t offset = sizeof(header) + uint64_t(header.num_cameras) * 2 * sizeof(int32_t);
+    if( offset > file_size ) {
+        std::cerr << "Corrupt observation file: '" << filename << "'" << std::endl;
+        return false;
+    }
+    for( uint32_t c = 0; c < header.num_cameras; ++c ) {
+        int32_t wh[2];
+        in.read( reinterpret_cast<char*>(wh), sizeof(wh) );
+        store.image_sizes.push_back( Eigen::Vector2i(wh[0], wh[1]) );
+    }
+
+    while( offset < file_size ) {
+        ObsChunkHeader chunk;
+        in.read( reinterpret_cast<char*>(&chunk), sizeof(chunk) );
+        offset += sizeof(chunk);
+        const uint64_t chunk_size = chunk.num_observations * kObservationBytes +
+                chunk.num_poses * kPoseBytes;
+        if( !in || offset + chunk_size > file_size ||
+            chunk.num_observations > file_size || chunk.num_poses > file_size ) {
+            std::cerr << "Corrupt observation file: '" << filename << "'" << std::endl;
+            store.Clear();
+            return false;
+        }
+
+        const size_t n = chunk.num_observations;
+        ReadColumn( in, store.frame, n );
+        ReadColumn( in, store.camera, n );
+        ReadColumn( in, store.grid_id, n );
+        ReadColumn( in, store.P_x, n );
+        ReadColumn( in, store.P_y, n );
+        ReadColumn( in, store.P_z, n );
+        ReadColumn( in, store.u, n );
+        ReadColumn( in, store.v, n );
+        ReadColumn( in, store.pose_frame, chunk.num_poses );
+        for( uint64_t j = 0; j < chunk.num_poses; ++j ) {
+            double params[kPoseParams];
+            in.read( reinterpret_cast<char*>(params), sizeof(params) );
+            store.T_kw.push_back( ParamsToPose( params ) );
+        }
+        offset += chunk_size;
+    }
+
+    if( !in ) {
+        std::cerr << "Corrupt observation file: '" << filename << "'" << std::endl;
+        store.Clear();
+        return false;
+    }
+    return true;
+}
+
+}
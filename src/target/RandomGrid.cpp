@@ -21,6 +21,10 @@
 
 #include <calibu/target/RandomGrid.h>
 #include <calibu/utils/StreamOperatorsEigen.h>
+#include <calibu/utils/ParallelFor.h>
+
+#include <atomic>
+#include <mutex>
 
 namespace calibu
 {
@@ -113,37 +117,249 @@ std::array<Eigen::MatrixXi, 4> FillGroup(const Eigen::MatrixXi& m)
   return patterns;
 }
 
-int HammingDistance(const Eigen::MatrixXi& M, const Eigen::MatrixXi& m, int r, int c)
+namespace
+{
+
+inline int PopCount(uint64_t x)
+{
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__POPCNT__) || defined(__aarch64__))
+    return __builtin_popcountll(x);
+#else
+    // Without a popcount instruction the builtin becomes a library call
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Bits [lo,hi) set, for 0 <= lo <= hi <= 64
+inline uint64_t BitRange(int lo, int hi)
+{
+    if(hi <= lo) return 0;
+    const uint64_t upto_hi = hi >= 64 ? ~0ULL : ((1ULL << hi) - 1);
+    return upto_hi & ~((1ULL << lo) - 1);
+}
+
+// Bits of row starting at column c (which may be outside of the row), with
+// zeros shifted in outside of the row.
+inline uint64_t Window(const uint64_t* row, int words, int c)
+{
+    if(c >= 64*words || c <= -64) return 0;
+    const int w = (c >= 0) ? c / 64 : -((-c + 63) / 64);
+    const int b = c - 64*w;
+    const uint64_t lo = (0 <= w && w < words) ? row[w] : 0;
+    const uint64_t hi = (0 <= w+1 && w+1 < words) ? row[w+1] : 0;
+    return b ? ((lo >> b) | (hi << (64-b))) : lo;
+}
+
+// Hamming distance, giving up once limit has been reached
+int HammingDistance(const BitGrid& M, const BitGrid& m, int r, int c, int limit)
 {
     int diff = 0;
-    for(int mr=0; mr<m.rows(); ++mr) {
-        for(int mc=0; mc<m.cols(); ++mc) {
-            const int vm = m(mr,mc);
-            if(vm >=0) {
-                const int Mr = mr+r;
-                const int Mc = mc+c;
-                if(vm >=0 && 0 <= Mr && Mr < M.rows() && 0 <= Mc && Mc < M.cols() ) {
-                    diff += abs( M(Mr,Mc) - vm);
-                }else{
-                    diff += 1;
-                }
+    for(int mr=0; mr < m.rows; ++mr) {
+        const uint64_t* mk = &m.known[mr*m.words];
+        const uint64_t* mv = &m.value[mr*m.words];
+        const int Mr = mr + r;
+        if(Mr < 0 || Mr >= M.rows) {
+            // Known cells falling outside of M all count
+            for(int k=0; k < m.words; ++k) diff += PopCount(mk[k]);
+        }else{
+            const uint64_t* Mv = &M.value[Mr*M.words];
+            for(int k=0; k < m.words; ++k) {
+                const int start = c + 64*k;
+                const uint64_t inside = BitRange(std::max(0,-start), std::min(64, M.cols-start));
+                const uint64_t W = Window(Mv, M.words, start);
+                diff += PopCount(mk[k] & ((W ^ mv[k]) | ~inside));
             }
         }
+        if(diff >= limit) break;
     }
     return diff;
 }
 
+}
+
+void BitGrid::Assign(const Eigen::MatrixXi& M)
+{
+    rows = M.rows();
+    cols = M.cols();
+    words = (cols + 63) / 64;
+    value.assign(rows*words, 0);
+    known.assign(rows*words, 0);
+    for(int r=0; r < rows; ++r) {
+        for(int c=0; c < cols; ++c) {
+            const int v = M(r,c);
+            const uint64_t bit = 1ULL << (c % 64);
+            if(v >= 0) known[r*words + c/64] |= bit;
+            if(v > 0) value[r*words + c/64] |= bit;
+        }
+    }
+}
+
+void BitGrid::Block(int r, int c, int nr, int nc, BitGrid& out) const
+{
+    out.rows = nr;
+    out.cols = nc;
+    out.words = (nc + 63) / 64;
+    out.value.resize(nr*out.words);
+    out.known.resize(nr*out.words);
+    for(int br=0; br < nr; ++br) {
+        for(int k=0; k < out.words; ++k) {
+            const uint64_t mask = BitRange(0, std::min(64, nc - 64*k));
+            const int i = br*out.words + k;
+            out.value[i] = Window(&value[(r+br)*words], words, c + 64*k) & mask;
+            out.known[i] = Window(&known[(r+br)*words], words, c + 64*k) & mask;
+        }
+    }
+}
+
+Eigen::MatrixXi BitGrid::ToMatrix() const
+{
+    Eigen::MatrixXi M(rows, cols);
+    for(int r=0; r < rows; ++r) {
+        for(int c=0; c < cols; ++c) {
+            const uint64_t bit = 1ULL << (c % 64);
+            const int i = r*words + c/64;
+            M(r,c) = (known[i] & bit) ? ((value[i] & bit) ? 1 : 0) : -1;
+        }
+    }
+    return M;
+}
+
+std::array<BitGrid, 4> MakeBitGroup(const std::array<Eigen::MatrixXi, 4>& PG)
+{
+    std::array<BitGrid, 4> bits;
+    for(int g=0; g < 4; ++g) bits[g].Assign(PG[g]);
+    return bits;
+}
+
+int HammingDistance(const Eigen::MatrixXi& M, const Eigen::MatrixXi& m, int r, int c)
+{
+    return HammingDistance(BitGrid(M), BitGrid(m), r, c);
+}
+
+int HammingDistance(const BitGrid& M, const BitGrid& m, int r, int c)
+{
+    return HammingDistance(M, m, r, c, std::numeric_limits<int>::max());
+}
 
 int NumExactMatches(const Eigen::MatrixXi& M, const Eigen::MatrixXi& m, int& best_score, int& best_r, int& best_c)
 {
-    const int border = std::min((int)std::min(m.rows(),m.cols())-2, 2);
+    return NumExactMatches(BitGrid(M), BitGrid(m), best_score, best_r, best_c);
+}
+
+namespace
+{
+
+// Rows of M shifted to column offset c, in words matching m, plus the mask
+// of bits falling outside of M. Shared by all row offsets.
+class ShiftedRows
+{
+public:
+    ShiftedRows(const BitGrid& M, const BitGrid& m)
+        : M_(M), words_(m.words)
+    {
+        // Small patterns stay on the stack
+        const size_t num_words = M.rows * m.words;
+        W_ = stack_words_;
+        if(num_words > 256) {
+            heap_words_.resize(2*num_words);
+            W_ = heap_words_.data();
+        }
+        outside_ = W_ + num_words;
+    }
+
+    void Shift(int c)
+    {
+        for(int Mr=0; Mr < M_.rows; ++Mr) {
+            for(int k=0; k < words_; ++k) {
+                const int start = c + 64*k;
+                W_[Mr*words_ + k] = Window(&M_.value[Mr*M_.words], M_.words, start);
+                outside_[Mr*words_ + k] = ~BitRange(std::max(0,-start), std::min(64, M_.cols-start));
+            }
+        }
+    }
+
+    // Hamming distance of m placed at row offset r, giving up at limit
+    int Distance(const BitGrid& m, int r, int limit) const
+    {
+        int hd = 0;
+        for(int mr=0; mr < m.rows && hd < limit; ++mr) {
+            const uint64_t* mk = &m.known[mr*m.words];
+            const int Mr = mr + r;
+            if(Mr < 0 || Mr >= M_.rows) {
+                for(int k=0; k < m.words; ++k) hd += PopCount(mk[k]);
+            }else{
+                const uint64_t* mv = &m.value[mr*m.words];
+                const uint64_t* Wr = &W_[Mr*words_];
+                const uint64_t* Or = &outside_[Mr*words_];
+                for(int k=0; k < m.words; ++k) {
+                    hd += PopCount(mk[k] & ((Wr[k] ^ mv[k]) | Or[k]));
+                }
+            }
+        }
+        return hd;
+    }
+
+protected:
+    const BitGrid& M_;
+    const int words_;
+    uint64_t stack_words_[2*256];
+    std::vector<uint64_t> heap_words_;
+    uint64_t* W_;
+    uint64_t* outside_;
+};
+
+// Number of exact placements of m within M, as counted by NumExactMatches,
+// stopping once max_count is reached.
+int CountExactMatches(const BitGrid& M, const BitGrid& m, int max_count)
+{
+    const int border = std::min(std::min(m.rows,m.cols)-2, 2);
+    const Eigen::Vector2i rcmax( 2*border + M.rows - m.rows, 2*border + M.cols - m.cols);
+    ShiftedRows shifted(M, m);
+    int num_zeros = 0;
+    for(int c=-border; c < rcmax(1); ++c) {
+        shifted.Shift(c);
+        for(int r=-border; r < rcmax(0); ++r ) {
+            if(shifted.Distance(m, r, 1) == 0) {
+                if(++num_zeros >= max_count) return num_zeros;
+            }
+        }
+    }
+    return num_zeros;
+}
+
+// True if m is found more than once over all rotations of the pattern
+bool IsAmbiguous(const std::array<BitGrid,4>& PG, const BitGrid& m)
+{
+    int num_exact = 0;
+    for(int g=0; g < 4 && num_exact < 2; ++g) {
+        num_exact += CountExactMatches(PG[g], m, 2 - num_exact);
+    }
+    return num_exact > 1;
+}
+
+}
+
+int NumExactMatches(const BitGrid& M, const BitGrid& m, int& best_score, int& best_r, int& best_c)
+{
+    const int border = std::min(std::min(m.rows,m.cols)-2, 2);
     best_score = std::numeric_limits<int>::max();
-    const Eigen::Vector2i rcmax( 2*border + M.rows() - m.rows(), 2*border + M.cols() - m.cols());
+    const Eigen::Vector2i rcmax( 2*border + M.rows - m.rows, 2*border + M.cols - m.cols);
     int num_zeros = 0;
-    for(int r=-border; r < rcmax(0); ++r ) {
-        for(int c=-border; c < rcmax(1); ++c) {
-            const int hd = HammingDistance(M, m, r,c );
-            if(hd < best_score) {
+
+    ShiftedRows shifted(M, m);
+    for(int c=-border; c < rcmax(1); ++c) {
+        shifted.Shift(c);
+        for(int r=-border; r < rcmax(0); ++r ) {
+            // Only distances up to the best so far (or exact) are of interest
+            const int limit = best_score == std::numeric_limits<int>::max() ?
+                        best_score : std::max(best_score + 1, 1);
+            const int hd = shifted.Distance(m, r, limit);
+
+            // Keep the original raster order for ties
+            if(hd < best_score || (hd == best_score && (r < best_r || (r == best_r && c < best_c)))) {
                 best_score = hd;
                 best_r = r;
                 best_c = c;
@@ -158,6 +374,11 @@ int NumExactMatches(const Eigen::MatrixXi& M, const Eigen::MatrixXi& m, int& bes
 }
 
 int NumExactMatches(const std::array<Eigen::MatrixXi,4>& PG, const Eigen::MatrixXi& m, int& best_score, int& best_g, int& best_r, int& best_c)
+{
+    return NumExactMatches(MakeBitGroup(PG), BitGrid(m), best_score, best_g, best_r, best_c);
+}
+
+int NumExactMatches(const std::array<BitGrid,4>& PG, const BitGrid& m, int& best_score, int& best_g, int& best_r, int& best_c)
 {
     best_score = std::numeric_limits<int>::max();
     int num_exact = 0;
@@ -178,11 +399,13 @@ int NumExactMatches(const std::array<Eigen::MatrixXi,4>& PG, const Eigen::Matrix
 
 int AutoCorrelation(const std::array<Eigen::MatrixXi,4>& PG, int minr, int minc )
 {
-    const Eigen::MatrixXi& M = PG[0];
-    const int R = PG[0].rows();
-    const int C = PG[0].cols();
+    const std::array<BitGrid,4> PB = MakeBitGroup(PG);
+    const BitGrid& M = PB[0];
+    const int R = M.rows;
+    const int C = M.cols;
 
     int num_bad_matches = 0;
+    BitGrid m;
 
     // For all sizes
     for(int nr = minr; nr < R; ++nr ) {
@@ -192,10 +415,10 @@ int AutoCorrelation(const std::array<Eigen::MatrixXi,4>& PG, int minr, int minc
             // For all offsets
             for(int r=0; r < MR; ++r) {
                 for(int c=0; c < MC; ++c ) {
-                    const Eigen::MatrixXi m = M.block(r,c,nr,nc);
+                    M.Block(r,c,nr,nc,m);
                     // Don't count the known good match (-1)
                     int bs,bg,br,bc;
-                    num_bad_matches += NumExactMatches(PG, m, bs,bg,br,bc) - 1;
+                    num_bad_matches += NumExactMatches(PB, m, bs,bg,br,bc) - 1;
                 }
             }
         }
@@ -205,31 +428,41 @@ int AutoCorrelation(const std::array<Eigen::MatrixXi,4>& PG, int minr, int minc
 
 int AutoCorrelationMinArea(const std::array<Eigen::MatrixXi,4>& PG )
 {
-    const Eigen::MatrixXi& M = PG[0];
-    const int R = PG[0].rows();
-    const int C = PG[0].cols();
-
-    int min_area = 0;
-
-    // For all sizes
+    const std::array<BitGrid,4> PB = MakeBitGroup(PG);
+    const BitGrid& M = PB[0];
+    const int R = M.rows;
+    const int C = M.cols;
+
+    // Visit window sizes largest first: the first ambiguous window found
+    // then determines the result.
+    std::vector<std::pair<int,int> > sizes;
     for(int nr = 2; nr < R; ++nr ) {
         for(int nc = 2; nc < C; ++nc ) {
-            const int MR = R - nr-1;
-            const int MC = C - nc-1;
-            // For all offsets
-            for(int r=0; r < MR; ++r) {
-                for(int c=0; c < MC; ++c ) {
-                    const Eigen::MatrixXi m = M.block(r,c,nr,nc);
-                    // Don't count the known good match (-1)
-                    int bs,bg,br,bc;
-                    if(NumExactMatches(PG, m, bs,bg,br,bc) > 1) {
-                        min_area = std::max(min_area, nr*nc+1 );
-                    }
+            sizes.push_back(std::make_pair(nr,nc));
+        }
+    }
+    std::stable_sort(sizes.begin(), sizes.end(),
+        [](const std::pair<int,int>& a, const std::pair<int,int>& b) {
+            return a.first*a.second > b.first*b.second;
+        });
+
+    BitGrid m;
+    for(const std::pair<int,int>& size : sizes) {
+        const int nr = size.first;
+        const int nc = size.second;
+        const int MR = R - nr-1;
+        const int MC = C - nc-1;
+        // For all offsets
+        for(int r=0; r < MR; ++r) {
+            for(int c=0; c < MC; ++c ) {
+                M.Block(r,c,nr,nc,m);
+                if(IsAmbiguous(PB, m)) {
+                    return nr*nc+1;
                 }
             }
         }
     }
-    return min_area;
+    return 0;
 }
 
 
@@ -256,6 +489,56 @@ uint32_t FindBestSeed(int r, int c, bool& should_run) {
     return best_seed;
 }
 
+uint32_t FindBestSeed(int r, int c, uint32_t seed_begin, uint32_t seed_end,
+                      int num_threads, const std::atomic<bool>& should_run,
+                      const SeedSearchProgress& progress)
+{
+    // Threads take batches of seeds from a shared counter, so slow seeds
+    // don't hold up a fixed partition.
+    const uint64_t begin = seed_begin;
+    const uint64_t end = std::max<uint64_t>(seed_end, begin);
+    const uint64_t batch = 8;
+    std::atomic<uint64_t> next(begin);
+    std::atomic<uint64_t> num_scored(0);
+
+    // Best (score, seed) so far. Ordering on both keeps the result
+    // independent of the order seeds were scored in.
+    std::mutex best_mutex;
+    uint32_t best_seed = seed_begin;
+    int best_score = std::numeric_limits<int>::max();
+
+    const int threads = std::max(num_threads, 1);
+    ParallelFor(threads, threads, [&](size_t) {
+        while(should_run) {
+            const uint64_t b = next.fetch_add(batch);
+            if(b >= end) break;
+            const uint64_t e = std::min(b + batch, end);
+
+            uint32_t batch_seed = 0;
+            int batch_score = std::numeric_limits<int>::max();
+            uint64_t done = 0;
+            for(uint64_t seed = b; seed < e && should_run; ++seed, ++done) {
+                const int score = SeedScore((uint32_t)seed, r, c);
+                if(score < batch_score) {
+                    batch_score = score;
+                    batch_seed = (uint32_t)seed;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(best_mutex);
+            if(done && (batch_score < best_score ||
+                        (batch_score == best_score && batch_seed < best_seed))) {
+                best_score = batch_score;
+                best_seed = batch_seed;
+            }
+            const uint64_t total = (num_scored += done);
+            if(progress) progress(total, best_seed, best_score);
+        }
+    });
+
+    return best_seed;
+}
+
 void PrintPattern(const Eigen::MatrixXi& M)
 {
     for(int r=0; r< M.rows(); ++r) {
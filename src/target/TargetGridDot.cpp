@@ -23,13 +23,16 @@
 #include <calibu/target/GridDefinitions.h>
 #include <calibu/target/RandomGrid.h>
 #include <calibu/cam/camera_crtp.h>
+#include <calibu/cam/camera_handle.h>
+#include <calibu/utils/PointIndex.h>
+#include <calibu/utils/Trace.h>
+#include <calibu/utils/Utils.h>
 
 #include <map>
 #include <set>
 #include <algorithm>
 #include <iostream>
 #include <iomanip>
-#include <deque>
 
 namespace calibu {
 
@@ -89,61 +92,142 @@ void TargetGridDot::Init()
   for( int c = 0; c < 8; c++ ){
     codepts3d[c] = base + Eigen::Vector3d( dx*c, r, 0 );
   }
+
+  PG_bits_ = MakeBitGroup(PG_);
+
+  line_groups_ = LineGroupList(ArenaAllocator<LineGroup>(&arena_));
+
+  prev_centres_.resize(tpts2d.size());
+  prev_valid_.assign(tpts2d.size(), 0);
+  have_prev_ = false;
 }
 
-std::vector<std::vector<Dist> > ClosestPoints(
-    std::vector<Vertex, Eigen::aligned_allocator<Vertex> >& pts)
-{
-    std::vector<std::vector<Dist> > ret;
+// Number of closest points (including itself) considered per vertex
+const size_t NUM_CLOSEST = 9;
 
-    // Set size of arrays
-    ret.resize(pts.size());
-    for(size_t p1=0; p1 < pts.size(); ++p1)  ret[p1].resize(pts.size());
+// Number of grids tried per target when earlier ones fail to match
+const int MAX_GRID_ATTEMPTS = 4;
 
-    // Compute distances between all points
-    for(size_t p1=0; p1 < pts.size(); ++p1)
+// Per frame scratch containers, drawing from the target's arena
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+// Excluded points have no closest points and are nobody's closest point.
+ArenaVector<ArenaVector<Dist> > ClosestPoints(
+    std::vector<Vertex, Eigen::aligned_allocator<Vertex> >& pts, size_t k,
+    const std::vector<char>& excluded, Arena* arena)
+{
+    const ArenaAllocator<Dist> alloc(arena);
+    ArenaVector<ArenaVector<Dist> > ret(pts.size(), ArenaVector<Dist>(alloc), alloc);
+    const size_t num_pts = pts.size() - std::count(excluded.begin(), excluded.end(), 1);
+    if(num_pts == 0) return ret;
+    k = std::min(k, num_pts);
+
+    // Bucket points into a uniform grid with roughly one point per cell
+    Eigen::Vector2d pmin = Eigen::Vector2d::Constant(std::numeric_limits<double>::max());
+    Eigen::Vector2d pmax = -pmin;
+    for(size_t p=0; p < pts.size(); ++p) {
+        if(excluded[p]) continue;
+        pmin = pmin.cwiseMin(pts[p].pc);
+        pmax = pmax.cwiseMax(pts[p].pc);
+    }
+    const Eigen::Vector2d extent = (pmax - pmin).cwiseMax(Eigen::Vector2d(1,1));
+    const double cell = std::max(1e-6, std::sqrt(extent[0]*extent[1] / num_pts));
+    const int gw = std::min<int>(num_pts, (int)(extent[0] / cell) + 1);
+    const int gh = std::min<int>(num_pts, (int)(extent[1] / cell) + 1);
+
+    ArenaVector<int> point_cell(pts.size(), 0, alloc);
+    ArenaVector<int> cell_start(gw*gh+1, 0, alloc);
+    for(size_t p=0; p < pts.size(); ++p) {
+        if(excluded[p]) continue;
+        const int cx = std::min(gw-1, (int)((pts[p].pc[0] - pmin[0]) / cell));
+        const int cy = std::min(gh-1, (int)((pts[p].pc[1] - pmin[1]) / cell));
+        point_cell[p] = cy*gw + cx;
+        ++cell_start[point_cell[p]+1];
+    }
+    for(int c=0; c < gw*gh; ++c) cell_start[c+1] += cell_start[c];
+    ArenaVector<int> cell_points(num_pts, 0, alloc);
     {
-        ret[p1][p1] = Dist{ &pts[p1],0};
-        // Distance relation is symmetric
-        for(size_t p2=p1+1; p2 < pts.size(); ++p2 )
-        {
-            const double dist = Distance(pts[p1], pts[p2]);
-            ret[p1][p2] = Dist{ &pts[p2], dist};
-            ret[p2][p1] = Dist{ &pts[p1], dist};
+        ArenaVector<int> fill(cell_start.begin(), cell_start.end()-1, alloc);
+        for(size_t p=0; p < pts.size(); ++p) {
+            if(excluded[p]) continue;
+            cell_points[fill[point_cell[p]]++] = p;
         }
     }
 
-    // sort distances
-    for(size_t p1=0; p1 < pts.size(); ++p1) {
-        std::sort(ret[p1].begin(), ret[p1].end() );
+    // Search rings of cells around each point until the k closest are known:
+    // anything outside ring r is at least r cells away.
+    ArenaVector<Dist> found(alloc);
+    found.reserve(8*k);
+    for(size_t p1=0; p1 < pts.size(); ++p1)
+    {
+        if(excluded[p1]) continue;
+        const int cx = point_cell[p1] % gw;
+        const int cy = point_cell[p1] / gw;
+        found.clear();
+
+        for(int r=0; ; ++r) {
+            for(int y=cy-r; y <= cy+r; ++y) {
+                if(y < 0 || y >= gh) continue;
+                const bool edge_row = (y == cy-r || y == cy+r);
+                for(int x=cx-r; x <= cx+r; x += (edge_row || r == 0) ? 1 : 2*r) {
+                    if(x < 0 || x >= gw) continue;
+                    const int c = y*gw + x;
+                    for(int i=cell_start[c]; i < cell_start[c+1]; ++i) {
+                        const int p2 = cell_points[i];
+                        found.push_back(Dist{ &pts[p2], p2 == (int)p1 ? 0.0 : Distance(pts[p1], pts[p2]) });
+                    }
+                }
+            }
+
+            const bool covered = (cx-r <= 0 && cy-r <= 0 && cx+r >= gw-1 && cy+r >= gh-1);
+            if(found.size() >= k) {
+                std::partial_sort(found.begin(), found.begin()+k, found.end());
+                if(covered || found[k-1].dist <= r*cell) break;
+            }else if(covered) {
+                break;
+            }
+        }
+
+        ret[p1].assign(found.begin(), found.begin()+k);
     }
 
     return ret;
 }
 
-std::vector<Dist> MostCentral( std::vector<std::vector<Dist> >& distances )
+ArenaVector<Dist> MostCentral( std::vector<Vertex, Eigen::aligned_allocator<Vertex> >& pts,
+                               const std::vector<char>& excluded, Arena* arena )
 {
-    std::vector<Dist> sum_sq;
+    // The sum of squared distances from a point to all others is
+    // N |p - centroid|^2 plus a constant, so ordering by distance to the
+    // centroid gives the same order in linear time.
+    Eigen::Vector2d centroid = Eigen::Vector2d::Zero();
+    size_t num_pts = 0;
+    for(size_t i=0; i < pts.size(); ++i) {
+        if(excluded[i]) continue;
+        centroid += pts[i].pc;
+        ++num_pts;
+    }
+    if(num_pts) centroid /= num_pts;
 
-    for(size_t i=0; i < distances.size(); ++i) {
-        Vertex* v = distances[i][0].v;
-        Dist dist{v,0};
-        for(size_t j=0; j < distances[i].size(); ++j) {
-            dist.dist += distances[i][j].dist * distances[i][j].dist;
-        }
-        sum_sq.push_back( dist );
+    ArenaVector<Dist> sum_sq = ArenaVector<Dist>(ArenaAllocator<Dist>(arena));
+    sum_sq.reserve(num_pts);
+    for(size_t i=0; i < pts.size(); ++i) {
+        if(excluded[i]) continue;
+        sum_sq.push_back( Dist{ &pts[i], (pts[i].pc - centroid).squaredNorm() } );
     }
 
     std::sort(sum_sq.begin(), sum_sq.end());
     return sum_sq;
 }
 
-std::vector<Triple*> PrincipleDirections( Vertex& v)
+ArenaVector<Triple*> PrincipleDirections( Vertex& v, Arena* arena )
 {
     // Find principle directions by observing that neighbours from princple
     // directions are central within triple that is also formed from these
-    // neighbours.
-    std::set<Triple*> pd;
+    // neighbours. Triples are visited in storage order, so ret stays in
+    // address order.
+    ArenaVector<Triple*> ret = ArenaVector<Triple*>(ArenaAllocator<Triple*>(arena));
     for(size_t i=0; i<v.triples.size(); ++i) {
         Triple& t = v.triples[i];
         for(size_t j=0; j<2; ++j) {
@@ -153,16 +237,13 @@ std::vector<Triple*> PrincipleDirections( Vertex& v)
                 if(a.In(v.neighbours))  {
                     // a is parallel to principle direction
                     // t is a parallel direction.
-                    pd.insert(&t);
+                    if(ret.empty() || ret.back() != &t) ret.push_back(&t);
                     break;
                 }
             }
         }
     }
 
-    // convert to vector
-    std::vector<Triple*> ret;
-    ret.insert(ret.begin(), pd.begin(), pd.end());
 
     // find most x-ily and y-ily
     if(ret.size() == 2) {
@@ -213,28 +294,77 @@ double Area(const Conic& c)
     }
 }
 
-std::set<Vertex*> Neighbours(std::map<Eigen::Vector2i, Vertex*,
-                             std::less<Eigen::Vector2i>,
-                             Eigen::aligned_allocator<
-                             std::pair<Eigen::Vector2i, Vertex*> > >& map, const Vertex& v)
+// Assign to each grid point with a valid prediction the closest conic within
+// max_ratio of the local predicted grid spacing. Conics claimed by more than
+// one grid point are left unassigned. Returns the number of assignments.
+template<typename Points, typename Flags>
+int AssignPredicted(
+        const Eigen::Vector2i& grid_size,
+        const Points& predicted,
+        const Flags& valid,
+        const PointIndex& index, size_t num_conics, double max_ratio,
+        ArenaVector<int>& grid_conic
+        )
+{
+    const int neighbours[4][2] = { {-1,0}, {1,0}, {0,-1}, {0,1} };
+
+    grid_conic.assign(predicted.size(), -1);
+    ArenaVector<int> conic_grid(num_conics, -1, grid_conic.get_allocator());
+
+    for(int r=0; r < grid_size[1]; ++r) {
+        for(int c=0; c < grid_size[0]; ++c) {
+            const int g = r*grid_size[0] + c;
+            if(!valid[g]) continue;
+
+            // Local spacing from the closest predicted 4-neighbour
+            double spacing = std::numeric_limits<double>::max();
+            for(int n=0; n < 4; ++n) {
+                const int nc = c + neighbours[n][0];
+                const int nr = r + neighbours[n][1];
+                if(0 <= nc && nc < grid_size[0] && 0 <= nr && nr < grid_size[1]) {
+                    const int ng = nr*grid_size[0] + nc;
+                    if(valid[ng]) {
+                        spacing = std::min(spacing, (predicted[ng] - predicted[g]).norm());
+                    }
+                }
+            }
+            if(spacing == std::numeric_limits<double>::max()) continue;
+
+            const int ci = index.Nearest(predicted[g], max_ratio * spacing);
+            if(ci < 0) continue;
+
+            if(conic_grid[ci] == -1) {
+                conic_grid[ci] = g;
+                grid_conic[g] = ci;
+            }else{
+                // Ambiguous, drop both
+                if(conic_grid[ci] >= 0) grid_conic[conic_grid[ci]] = -1;
+                conic_grid[ci] = -2;
+            }
+        }
+    }
+
+    return std::count_if(grid_conic.begin(), grid_conic.end(), [](int i){ return i >= 0; });
+}
+
+void Neighbours(const VertexGrid& map, const Vertex& v, VertexSet& neighbours)
 {
-    std::set<Vertex*> neighbours;
+    neighbours.clear();
     for(int r=-1; r <=1; ++r) {
         for(int c=-1; c<=1; ++c) {
             Eigen::Vector2i pg(v.pg[0]+c, v.pg[1]+r);
-            auto i = map.find(pg);
-            if(i!= map.end()) {
-                neighbours.insert(i->second);
+            Vertex* n = map.Get(pg);
+            if(n) {
+                neighbours.insert(n);
             }
         }
     }
-    return neighbours;
 }
 
-void FindTriples( Vertex& v, std::vector<Dist>& closest, double thresh_dist, double thresh_area)
+void FindTriples( Vertex& v, ArenaVector<Dist>& closest, double thresh_dist, double thresh_area)
 {
     // Consider 9 closests points (including itself)
-    const size_t NEIGHBOURS = 9;
+    const size_t NEIGHBOURS = NUM_CLOSEST;
     const size_t max_neigh = std::min(closest.size(), NEIGHBOURS);
 
     // We need at least 3 points for a single collinear triple.
@@ -247,6 +377,9 @@ void FindTriples( Vertex& v, std::vector<Dist>& closest, double thresh_dist, dou
     std::array<bool,NEIGHBOURS> used;
     used.fill(false);
 
+    // At most one triple per pair of neighbours
+    v.triples.reserve(NEIGHBOURS / 2);
+
     // Filter possible pairs
     for(size_t n1 = 1; n1 < max_neigh; ++n1 ) {
         const double d1 = closest[n1].dist;
@@ -285,6 +418,66 @@ void FindTriples( Vertex& v, std::vector<Dist>& closest, double thresh_dist, dou
     }
 }
 
+namespace {
+
+// Project the target points in front of the camera, per camera model
+struct ProjectTargetPoints {
+    template<typename CameraView>
+    void operator()(const CameraView& cam) const
+    {
+        for(size_t i=0; i < tpts3d.size(); ++i) {
+            const Eigen::Vector3d P_c = T_cw * tpts3d[i];
+            if(P_c[2] > 0) {
+                projected[i] = cam.Project(P_c);
+                projected_valid[i] = is_finite(projected[i]);
+            }
+        }
+    }
+
+    const Sophus::SE3d& T_cw;
+    const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& tpts3d;
+    std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> >& projected;
+    std::vector<char>& projected_valid;
+};
+
+}
+
+void TargetGridDot::SampleCode(
+        const std::shared_ptr<CameraInterface<double>> cam,
+        const Sophus::SE3d& T_cw,
+        const ImageProcessing& images,
+        TargetCode& code,
+        int border
+        ) const
+{
+    const int n = codepts3d.size();
+    code.rays.resize(3, n);
+    code.pixels.resize(2, n);
+    const Eigen::Matrix3d R_cw = T_cw.rotationMatrix();
+    for(int c=0; c < n; ++c) {
+        code.rays.col(c) = R_cw * codepts3d[c] + T_cw.translation();
+    }
+    cam->Project(code.rays, code.pixels);
+
+    // Gather into bit masks, pixels relative to the processed region
+    const int w = images.Width();
+    const int h = images.Height();
+    const IRectangle& roi = images.Roi();
+    const unsigned char* thresh = images.ImgThresh();
+    code.bits = 0;
+    code.visible = 0;
+    for(int c=0; c < n; ++c) {
+        const int x = (int)std::floor(code.pixels(0,c) + 0.5) - roi.x1;
+        const int y = (int)std::floor(code.pixels(1,c) + 0.5) - roi.y1;
+        if(code.rays(2,c) <= 0 || x < border || x >= w - border ||
+           y < border || y >= h - border) {
+            continue;
+        }
+        code.visible |= 1u << c;
+        code.bits |= (uint32_t)(thresh[y*w + x] == 0) << c;
+    }
+}
+
 bool TargetGridDot::FindTarget(
         const Sophus::SE3d& T_cw,
         const std::shared_ptr<CameraInterface<double>> cam,
@@ -293,8 +486,29 @@ bool TargetGridDot::FindTarget(
         std::vector<int>& ellipse_target_map
         )
 {
-    // This target doesn't use position or camera information
-    return FindTarget(images,conics,ellipse_target_map);
+    CALIBU_TRACE("TargetGridDot::FindTarget");
+    CALIBU_STATS(stats_.Reset());
+    CALIBU_STATS_TIME(stats_.total);
+
+    if(params_.incremental && cam) {
+        // Predict grid points by projecting the target into the camera
+        projected_.resize(tpts3d.size());
+        projected_valid_.assign(tpts3d.size(), 0);
+        CameraHandle<double>(cam).Visit(
+                    ProjectTargetPoints{T_cw, tpts3d, projected_, projected_valid_});
+        excluded_.assign(conics.size(), 0);
+        if(MatchPredicted(projected_, projected_valid_, conics, excluded_, ellipse_target_map)) {
+            return true;
+        }
+    }
+
+    // Pose isn't stored as it may refer to a different image frame
+    claimed_.assign(conics.size(), 0);
+    if(SearchGrids(conics, claimed_, ellipse_target_map)) {
+        return true;
+    }
+    have_prev_ = false;
+    return false;
 }
 
 bool TargetGridDot::FindTarget(
@@ -310,31 +524,31 @@ bool TargetGridDot::FindTarget(
 
 void TargetGridDot::Clear()
 {
+    // Vertex and line group storage comes from the arena, so it can be
+    // recycled in one go once the containers referencing it are emptied.
     vs_.clear();
     line_groups_.clear();
-    map_grid_ellipse_.clear();
+    arena_.Reset();
+    // Seed vertex sits at (0,0) so positions span +/- the grid size
+    map_grid_ellipse_.Reset(Eigen::Vector2i::Constant(grid_size_.maxCoeff()));
 }
 
 void TargetGridDot::SetGrid(Vertex& v, const Eigen::Vector2i& g)
 {
     v.pg = g;
-    map_grid_ellipse_[g] = &v;
+    map_grid_ellipse_.Set(g, &v);
 }
 
-bool TargetGridDot::Match(std::map<Eigen::Vector2i, Vertex*,
-                          std::less<Eigen::Vector2i>,
-                          Eigen::aligned_allocator< std::pair<Eigen::Vector2i, Vertex*> > >& obs,
-                          const std::array<Eigen::MatrixXi,4>& PG)
+bool TargetGridDot::Match(VertexGrid& obs, const std::array<Eigen::MatrixXi,4>& PG)
 {
     Eigen::Vector2i omin(std::numeric_limits<int>::max(),std::numeric_limits<int>::max());
     Eigen::Vector2i omax(std::numeric_limits<int>::min(),std::numeric_limits<int>::min());
 
     // find max and min
-    for(auto i = obs.begin(); i != obs.end(); ++i) {
-        omin[0] = std::min(omin[0], i->first[0]);
-        omin[1] = std::min(omin[1], i->first[1]);
-        omax[0] = std::max(omax[0], i->first[0]);
-        omax[1] = std::max(omax[1], i->first[1]);
+    for(size_t i=0; i < obs.size(); ++i) {
+        const Eigen::Vector2i g = obs.Position(i);
+        omin = omin.cwiseMin(g);
+        omax = omax.cwiseMax(g);
     }
 
     // Create sample matrix
@@ -344,17 +558,18 @@ bool TargetGridDot::Match(std::map<Eigen::Vector2i, Vertex*,
         Eigen::MatrixXi m = Eigen::MatrixXi::Constant( osize(1), osize(0), -1);
         int num_valid = 0;
 
-        for(auto i = obs.begin(); i != obs.end(); ++i) {
-            const Eigen::Vector2i pg = i->first - omin;
-            i->second->pg = pg;
-            const int val = i->second->value;
+        for(size_t i=0; i < obs.size(); ++i) {
+            const Eigen::Vector2i pg = obs.Position(i) - omin;
+            obs.At(i)->pg = pg;
+            const int val = obs.At(i)->value;
             m(pg(1),pg(0)) = val;
             if(val >= 0) ++num_valid;
         }
 
         // TODO: Check best score is uniquely best.
         int bs,bg,br,bc;
-        const int num_matches = NumExactMatches(PG_,m,bs,bg,br,bc);
+        observed_bits_.Assign(m);
+        const int num_matches = NumExactMatches(PG_bits_,observed_bits_,bs,bg,br,bc);
         if( num_matches <= 1 && bs < num_valid / 8 )
 //        if( num_matches == 1 )
         {
@@ -370,8 +585,8 @@ bool TargetGridDot::Match(std::map<Eigen::Vector2i, Vertex*,
 
             Sophus::SE2Group<int> T_0m = T_0x[bg] * T_xm;
 
-            for(auto i = obs.begin(); i != obs.end(); ++i) {
-                i->second->pg = T_0m * i->second->pg;
+            for(size_t i=0; i < obs.size(); ++i) {
+                obs.At(i)->pg = T_0m * obs.At(i)->pg;
             }
             return true;
         }else{
@@ -384,41 +599,233 @@ bool TargetGridDot::Match(std::map<Eigen::Vector2i, Vertex*,
     return false;
 }
 
+bool TargetGridDot::MatchPredicted(
+        const std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> >& predicted,
+        const std::vector<char>& valid,
+        const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+        const std::vector<char>& excluded,
+        std::vector<int>& ellipse_target_map
+        )
+{
+    const int num_predicted = std::count(valid.begin(), valid.end(), 1);
+    if(num_predicted < 4) return false;
+
+    // Scratch below comes from the arena, so start the frame here
+    Clear();
+
+    PointIndex index(&arena_);
+    index.Build(conics.size(), [&conics](size_t i) { return conics[i].center; }, &excluded);
+
+    const ArenaAllocator<int> alloc(&arena_);
+    ArenaVector<int> grid_conic(alloc);
+    int num_matched = AssignPredicted(grid_size_, predicted, valid, index, conics.size(),
+                                      params_.max_prediction_ratio, grid_conic);
+    if(num_matched < 4) return false;
+
+    // Re-predict every grid point through a homography fitted to the matches.
+    // This corrects for motion and picks up points which came into view.
+    {
+        homography_src_.clear();
+        homography_dst_.clear();
+        for(size_t g=0; g < grid_conic.size(); ++g) {
+            if(grid_conic[g] >= 0) {
+                homography_src_.push_back(tpts2d[g] / grid_spacing_);
+                homography_dst_.push_back(conics[grid_conic[g]].center);
+            }
+        }
+        const Eigen::Matrix3d H_ig = EstimateH_ba(homography_src_, homography_dst_);
+
+        ArenaVector<Eigen::Vector2d> predicted_h(tpts2d.size(), Eigen::Vector2d::Zero(), alloc);
+        ArenaVector<char> valid_h(tpts2d.size(), 0, alloc);
+        for(size_t g=0; g < tpts2d.size(); ++g) {
+            const Eigen::Vector3d p = H_ig * (tpts2d[g] / grid_spacing_).homogeneous();
+            if(p[2] > 0) {
+                predicted_h[g] = p.head<2>() / p[2];
+                valid_h[g] = is_finite(predicted_h[g]);
+            }
+        }
+
+        ArenaVector<int> grid_conic_h(alloc);
+        const int num_matched_h = AssignPredicted(grid_size_, predicted_h, valid_h, index, conics.size(),
+                                                  params_.max_prediction_ratio, grid_conic_h);
+        if(num_matched_h >= num_matched) {
+            grid_conic.swap(grid_conic_h);
+            num_matched = num_matched_h;
+        }
+    }
+
+    if(num_matched < params_.min_tracked_ratio * num_predicted) return false;
+
+    // Guard against a consistent off-by-one assignment: adjacent big and
+    // small dots must be ordered by observed area as in the pattern.
+    int agree = 0, disagree = 0;
+    for(int r=0; r < grid_size_[1]; ++r) {
+        for(int c=0; c < grid_size_[0]; ++c) {
+            for(int d=0; d < 2; ++d) {
+                const int r2 = r + d;
+                const int c2 = c + 1 - d;
+                if(r2 >= grid_size_[1] || c2 >= grid_size_[0]) continue;
+                const int g1 = r*grid_size_[0] + c;
+                const int g2 = r2*grid_size_[0] + c2;
+                if(grid_conic[g1] < 0 || grid_conic[g2] < 0) continue;
+                const int v1 = PG_[0](r,c);
+                const int v2 = PG_[0](r2,c2);
+                if(v1 == v2) continue;
+                const double a1 = Area(conics[grid_conic[g1]]);
+                const double a2 = Area(conics[grid_conic[g2]]);
+                if( (a1 < a2) == (v1 < v2) ) ++agree; else ++disagree;
+            }
+        }
+    }
+    if(agree == 0 || disagree > 0.1 * (agree + disagree)) return false;
+
+    // Fill structures as a full search would
+    for( size_t i=0; i < conics.size(); ++i ) {
+        vs_.push_back(Vertex(i, conics[i], &arena_));
+    }
+    ellipse_target_map.assign(conics.size(), -1);
+    for(size_t g=0; g < grid_conic.size(); ++g) {
+        if(grid_conic[g] >= 0) {
+            Vertex& v = vs_[grid_conic[g]];
+            v.pg = Eigen::Vector2i(g % grid_size_[0], g / grid_size_[0]);
+            v.value = PG_[0](v.pg[1], v.pg[0]);
+            ellipse_target_map[grid_conic[g]] = g;
+        }
+    }
+    CALIBU_STATS(stats_.num_vertices = vs_.size());
+    CALIBU_STATS(stats_.num_predicted = num_matched);
+
+    return true;
+}
+
+void TargetGridDot::StorePrevious(
+        const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+        const std::vector<int>& ellipse_target_map
+        )
+{
+    std::fill(prev_valid_.begin(), prev_valid_.end(), 0);
+    for(size_t i=0; i < ellipse_target_map.size(); ++i) {
+        const int g = ellipse_target_map[i];
+        if(g >= 0) {
+            prev_centres_[g] = conics[i].center;
+            prev_valid_[g] = 1;
+        }
+    }
+    have_prev_ = true;
+}
+
+bool TargetGridDot::FindTarget(
+        const ImageProcessing& images,
+        const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+        std::vector<int>& ellipse_target_map
+        )
+{
+    claimed_.assign(conics.size(), 0);
+    return FindTarget(images, conics, claimed_, ellipse_target_map);
+}
+
 bool TargetGridDot::FindTarget(
         const ImageProcessing& images,
         const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+        std::vector<char>& claimed,
+        std::vector<int>& ellipse_target_map
+        )
+{
+    CALIBU_TRACE("TargetGridDot::FindTarget");
+    CALIBU_STATS(stats_.Reset());
+    CALIBU_STATS_TIME(stats_.total);
+
+    claimed.resize(conics.size(), 0);
+
+    // Try from where the grid was last seen before searching from scratch
+    bool found = params_.incremental && have_prev_ &&
+            MatchPredicted(prev_centres_, prev_valid_, conics, claimed, ellipse_target_map);
+
+    if(!found) {
+        found = SearchGrids(conics, claimed, ellipse_target_map);
+    }
+
+    if(found) {
+        StorePrevious(conics, ellipse_target_map);
+        for(size_t i=0; i < ellipse_target_map.size(); ++i) {
+            if(ellipse_target_map[i] >= 0) claimed[i] = 1;
+        }
+    }else{
+        have_prev_ = false;
+    }
+    return found;
+}
+
+bool TargetGridDot::SearchGrids(
+        const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+        const std::vector<char>& claimed,
         std::vector<int>& ellipse_target_map
         )
 {
+    // A grid which doesn't match may be part of another target, or
+    // clutter. Set it aside and grow another from what remains.
+    excluded_.assign(claimed.begin(), claimed.end());
+    for(int attempt=0; attempt < MAX_GRID_ATTEMPTS; ++attempt) {
+        if(FindTargetFull(conics, excluded_, ellipse_target_map)) {
+            return true;
+        }
+        if(map_grid_ellipse_.size() == 0) break;
+        for(size_t i=0; i < map_grid_ellipse_.size(); ++i) {
+            excluded_[map_grid_ellipse_.At(i)->id] = 1;
+        }
+    }
+    ellipse_target_map.clear();
+    return false;
+}
 
+bool TargetGridDot::FindTargetFull(
+        const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+        const std::vector<char>& excluded,
+        std::vector<int>& ellipse_target_map
+        )
+{
     // Clear cached data structures
     Clear();
     ellipse_target_map.clear();
 
     // Generate vertex and point structures
+    CALIBU_STATS(if( vs_.capacity() < conics.size() ) ++stats_.num_allocations);
     for( size_t i=0; i < conics.size(); ++i ) {
-      Vertex v(i, conics[i]);
+      Vertex v(i, conics[i], &arena_);
       vs_.push_back(v);
     }
+    CALIBU_STATS(stats_.num_vertices = vs_.size());
 
     // Compute closest points for each ellipse
-    std::vector<std::vector<Dist> > vs_distance = ClosestPoints(vs_);
-    std::vector<Dist> vs_central = MostCentral(vs_distance);
+    const ArenaAllocator<Dist> alloc(&arena_);
+    ArenaVector<ArenaVector<Dist> > vs_distance(alloc);
+    ArenaVector<Dist> vs_central(alloc);
+    {
+        CALIBU_STATS_TIME(stats_.closest_points);
+        vs_distance = ClosestPoints(vs_, NUM_CLOSEST, excluded, &arena_);
+        vs_central = MostCentral(vs_, excluded, &arena_);
+    }
 
     // Find colinear neighbours for each ellipse
-    for(size_t i=0; i < vs_.size(); ++i) {
-        FindTriples(vs_[i], vs_distance[i], params_.max_line_dist_ratio, params_.max_norm_triple_area );
-        for(Triple& t : vs_[i].triples) line_groups_.push_back( LineGroup(t)  );
+    {
+        CALIBU_STATS_TIME(stats_.triples);
+        for(size_t i=0; i < vs_.size(); ++i) {
+            if(excluded[i]) continue;
+            FindTriples(vs_[i], vs_distance[i], params_.max_line_dist_ratio, params_.max_norm_triple_area );
+            for(Triple& t : vs_[i].triples) line_groups_.push_back( LineGroup(t, &arena_) );
+        }
     }
+    CALIBU_STATS(stats_.num_line_groups = line_groups_.size());
+    CALIBU_STATS_TIME(stats_.grow);
 
     // Find central, well connected vertex
     Vertex* central = nullptr;
-    std::vector<Triple*> principle;
+    ArenaVector<Triple*> principle(alloc);
 
     for(size_t i=0; i < vs_central.size(); ++i) {
         Vertex* v = vs_central[i].v;
         if(v->triples.size() >= 2) {
-            principle = PrincipleDirections(*v);
+            principle = PrincipleDirections(*v, &arena_);
             if(principle.size() == 2) {
                 central = v;
                 break;
@@ -432,19 +839,19 @@ bool TargetGridDot::FindTarget(
     }
 
     for(auto* t: principle) {
-        line_groups_.push_back( LineGroup(*t) );
+        line_groups_.push_back( LineGroup(*t, &arena_) );
     }
 
-    // Search structures
-    std::deque<Vertex*> fringe;
-    std::deque<Vertex*> available;
-    for(size_t i=0; i< vs_.size(); ++i) {
-        available.push_back(&vs_[i]);
-    }
+    // Search structures. The fringe is a worklist walked by index; each
+    // vertex is pushed at most once, when it first gets a grid position.
+    // Vertices forming the basis are flagged so the fill-in pass skips them.
+    ArenaVector<Vertex*> fringe(alloc);
+    fringe.reserve(vs_.size());
+    ArenaVector<char> basis(vs_.size(), 0, alloc);
 
     // Setup central as center of grid
     SetGrid(*central, Eigen::Vector2i(0,0));
-    available.erase(std::find(available.begin(), available.end(), central));
+    basis[central->id] = 1;
 
     // add neighbours of central to form basis
     for(int i=0; i<2; ++i)
@@ -456,15 +863,15 @@ bool TargetGridDot::FindTarget(
             Vertex& n = t.Neighbour(j);
             g[i] = 2*j-1;
             SetGrid(n, g);
-            available.erase(std::find(available.begin(), available.end(), &n));
+            basis[n.id] = 1;
             fringe.push_back(&n);
         }
 //        line_groups.push_back( LineGroup(t) );
     }
 
     // depth first search extending 'fringe' set by adding colinear vertices
-    while(fringe.size() > 0) {
-        Vertex& f = *fringe.front();
+    for(size_t fi=0; fi < fringe.size(); ++fi) {
+        Vertex& f = *fringe[fi];
         for(size_t i=0; i<f.triples.size(); ++i) {
             Triple& t = f.triples[i];
             for(size_t j=0; j < 2; ++j) {
@@ -500,14 +907,12 @@ bool TargetGridDot::FindTarget(
                 }
             }
         }
-
-        // Remove from fringe
-        fringe.pop_front();
     }
 
     // Try to add any that we've missed by 'filling in'
-    while(available.size() > 0) {
-        Vertex& f = *available.front();
+    for(size_t vi=0; vi < vs_.size(); ++vi) {
+        if(basis[vi]) continue;
+        Vertex& f = vs_[vi];
         for(size_t i=0; i<f.triples.size(); ++i) {
             Triple& t = f.triples[i];
             Vertex& n = t.Neighbour(0);
@@ -531,32 +936,27 @@ bool TargetGridDot::FindTarget(
                 }
             }
         }
-        available.pop_front();
     }
 
     // Compute area and grid neighbours for all ellipses in grid
-    for(auto i = map_grid_ellipse_.begin(); i != map_grid_ellipse_.end(); ++i) {
-        Vertex& v = *i->second;
+    for(size_t i=0; i < map_grid_ellipse_.size(); ++i) {
+        Vertex& v = *map_grid_ellipse_.At(i);
         v.area = Area(v.conic);
-        v.neighbours = Neighbours(map_grid_ellipse_,v);
+        Neighbours(map_grid_ellipse_, v, v.neighbours);
     }
 
     // Determine binary value from neighbours area
-    for(auto i = map_grid_ellipse_.begin(); i != map_grid_ellipse_.end(); ++i) {
-        Vertex& v = *i->second;
+    for(size_t i=0; i < map_grid_ellipse_.size(); ++i) {
+        Vertex& v = *map_grid_ellipse_.At(i);
 
         if(v.neighbours.size() > 2) {
-            // TODO: just take min/max - no need to sort
-            // Sort neightbours by circle area
-            std::vector<Dist> vecrad;
-            vecrad.push_back( Dist{ &v, v.area });
+            // Smallest and largest circle area over neighbourhood
+            double _area0 = v.area;
+            double _area1 = v.area;
             for(Vertex* n : v.neighbours)  {
-                vecrad.push_back( Dist{n, n->area } );
+                _area0 = std::min(_area0, n->area);
+                _area1 = std::max(_area1, n->area);
             }
-            std::sort(vecrad.begin(), vecrad.end());
-
-            const double _area0 = vecrad.front().dist;
-            const double _area1 = vecrad.back().dist;
 
             // TODO: determine these values from pattern
             const double area0 = 2*2;
@@ -599,6 +999,25 @@ bool TargetGridDot::FindTarget(
     return true;
 }
 
+int FindTargets(
+        const std::vector<TargetGridDot*>& targets,
+        const ImageProcessing& images,
+        const std::vector<Conic, Eigen::aligned_allocator<Conic> >& conics,
+        std::vector<std::vector<int> >& ellipse_target_maps
+        )
+{
+    std::vector<char> claimed(conics.size(), 0);
+    ellipse_target_maps.resize(targets.size());
+
+    int num_found = 0;
+    for(size_t t=0; t < targets.size(); ++t) {
+        if(targets[t]->FindTarget(images, conics, claimed, ellipse_target_maps[t])) {
+            ++num_found;
+        }
+    }
+    return num_found;
+}
+
 void PlotCrossHair(
     double x, 
     double y, 
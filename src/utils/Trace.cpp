@@ -0,0 +1,233 @@
+/*
+   This file is part of the Calibu Project.
+   https://github.com/gwu-robotics/Calibu
+
+   Copyright (C) 2013 George Washington University,
+                      Steven Lovegrove
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <calibu/utils/Trace.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+namespace calibu {
+
+namespace {
+
+  // Spans of one thread. Only that thread appends, so its mutex is only
+  // contended while the trace is read.
+  struct ThreadTrace
+  {
+    uint32_t id;
+    std::string name;
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+  };
+
+  struct TraceRegistry
+  {
+    TraceRegistry() : next_id(0) {}
+
+    std::mutex mutex;
+    uint32_t next_id;
+    std::vector<std::shared_ptr<ThreadTrace> > threads;
+  };
+
+  // Leaked, so that threads outliving static destruction can still record
+  TraceRegistry& Registry()
+  {
+    static TraceRegistry* registry = new TraceRegistry;
+    return *registry;
+  }
+
+  std::atomic<bool> g_trace_enabled(false);
+
+  thread_local TraceContext t_context;
+  thread_local std::shared_ptr<ThreadTrace> t_trace;
+
+  ThreadTrace& CurrentThreadTrace()
+  {
+    if(!t_trace) {
+      TraceRegistry& registry = Registry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      t_trace = std::make_shared<ThreadTrace>();
+      t_trace->id = registry.next_id++;
+      registry.threads.push_back(t_trace);
+    }
+    return *t_trace;
+  }
+
+  void WriteJsonString(std::ostream& out, const std::string& s)
+  {
+    out << '"';
+    for(const char c : s) {
+      if(c == '"' || c == '\\') {
+        out << '\\' << c;
+      }else if((unsigned char)c < 0x20) {
+        out << ' ';
+      }else{
+        out << c;
+      }
+    }
+    out << '"';
+  }
+
+}
+
+void StartTrace()
+{
+  TraceRegistry& registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  // Forget threads which have exited, e.g. ParallelFor workers
+  registry.threads.erase(std::remove_if(
+      registry.threads.begin(), registry.threads.end(),
+      [](const std::shared_ptr<ThreadTrace>& thread) { return thread.use_count() == 1; }),
+      registry.threads.end());
+  for(const std::shared_ptr<ThreadTrace>& thread : registry.threads) {
+    std::lock_guard<std::mutex> thread_lock(thread->mutex);
+    thread->events.clear();
+  }
+  g_trace_enabled = true;
+}
+
+void StopTrace()
+{
+  g_trace_enabled = false;
+}
+
+bool TraceEnabled()
+{
+  return g_trace_enabled.load(std::memory_order_relaxed);
+}
+
+void SetTraceThreadName(const std::string& name)
+{
+  ThreadTrace& trace = CurrentThreadTrace();
+  std::lock_guard<std::mutex> lock(trace.mutex);
+  trace.name = name;
+}
+
+const TraceContext& CurrentTraceContext()
+{
+  return t_context;
+}
+
+int64_t TraceNowUs()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void RecordTrace(const char* name, int64_t begin_us, int64_t duration_us,
+                 const TraceContext& context)
+{
+  ThreadTrace& trace = CurrentThreadTrace();
+  TraceEvent event;
+  event.name = name;
+  event.begin_us = begin_us;
+  event.duration_us = duration_us;
+  event.thread = trace.id;
+  event.context = context;
+
+  std::lock_guard<std::mutex> lock(trace.mutex);
+  trace.events.push_back(event);
+}
+
+std::vector<TraceEvent> TraceEvents()
+{
+  std::vector<TraceEvent> events;
+  TraceRegistry& registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for(const std::shared_ptr<ThreadTrace>& thread : registry.threads) {
+    std::lock_guard<std::mutex> thread_lock(thread->mutex);
+    events.insert(events.end(), thread->events.begin(), thread->events.end());
+  }
+  std::stable_sort(events.begin(), events.end(),
+                   [](const TraceEvent& a, const TraceEvent& b) {
+    return a.begin_us < b.begin_us;
+  });
+  return events;
+}
+
+bool WriteChromeTrace(std::ostream& out)
+{
+  const std::vector<TraceEvent> events = TraceEvents();
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  {
+    // Thread names as metadata events
+    TraceRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for(const std::shared_ptr<ThreadTrace>& thread : registry.threads) {
+      std::lock_guard<std::mutex> thread_lock(thread->mutex);
+      if(thread->name.empty()) continue;
+      out << (first ? "\n" : ",\n")
+          << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->id
+          << ",\"args\":{\"name\":";
+      WriteJsonString(out, thread->name);
+      out << "}}";
+      first = false;
+    }
+  }
+
+  const int64_t t0 = events.empty() ? 0 : events.front().begin_us;
+  for(const TraceEvent& e : events) {
+    out << (first ? "\n" : ",\n") << "{\"name\":";
+    WriteJsonString(out, e.name);
+    out << ",\"cat\":\"calibu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+        << ",\"ts\":" << e.begin_us - t0 << ",\"dur\":" << e.duration_us
+        << ",\"args\":{\"frame\":" << e.context.frame
+        << ",\"camera\":" << e.context.camera << "}}";
+    first = false;
+  }
+  out << "\n]}\n";
+  return out.good();
+}
+
+bool WriteChromeTrace(const std::string& filename)
+{
+  std::ofstream out(filename.c_str());
+  if(!out.is_open() || !WriteChromeTrace(out)) {
+    std::cerr << "Unable to write trace to " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+ScopedTraceContext::ScopedTraceContext(const TraceContext& context)
+  : previous_(t_context)
+{
+  if(context.frame >= 0) t_context.frame = context.frame;
+  if(context.camera >= 0) t_context.camera = context.camera;
+}
+
+ScopedTraceContext::ScopedTraceContext(int frame, int camera)
+  : ScopedTraceContext(TraceContext(frame, camera))
+{
+}
+
+ScopedTraceContext::~ScopedTraceContext()
+{
+  t_context = previous_;
+}
+
+}